@@ -5,6 +5,8 @@
  *   2. Determination of individual E-value parameters
  *   3. Statistics and specific experiment drivers
  *   4. Benchmark driver
+ *   5. Unit tests
+ *   6. Test driver
  * 
  * SRE, Mon Aug  6 13:00:06 2007
  */
@@ -16,8 +18,14 @@
 #include "esl_randomseq.h"
 #include "esl_vectorops.h"
 
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
+
 #include "hmmer.h"
 
+static int simulate_scores(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int which, int ncpu, double *xv);
+
 /*****************************************************************
  * 1. p7_Calibrate():  model calibration wrapper 
  *****************************************************************/ 
@@ -47,6 +55,17 @@
  *                      pass <*byp_om == NULL> if <om> return desired;
  *                      pass <NULL> to use and discard internal default.          
  *
+ *            If <cfg_b->evtable> is non-<NULL>, and the table was
+ *            fit with the same simulation settings and covers this
+ *            model's length and mean match relative entropy, mu and
+ *            tau are predicted from the table and the simulations
+ *            are skipped (see <p7_evtable.c>).
+ *
+ *            If <cfg_b->ncpu> is >0, the simulations are scored by
+ *            that many worker threads. The random sequences are still
+ *            sampled in order from the one RNG, so the results are
+ *            identical to a serial calibration.
+ *
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEMEM> on allocation failure.
@@ -69,6 +88,7 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
   int             EfL    = ((cfg_b != NULL) ? cfg_b->EfL    : 100);
   int             EfN    = ((cfg_b != NULL) ? cfg_b->EfN    : 200);
   double          Eft    = ((cfg_b != NULL) ? cfg_b->Eft    : 0.04);
+  int             ncpu   = ((cfg_b != NULL) ? cfg_b->ncpu   : 0);
   double          lambda, mmu, vmu, tau;
   int             status;
   
@@ -100,11 +120,19 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
     if ((status = p7_oprofile_Convert(gm, om))         != eslOK) ESL_XFAIL(status,  errbuf, "failed to convert to optimized profile");
   }
 
-  /* The calibration steps themselves */
+  /* The calibration steps themselves. 
+   * Lambda is cheap. The mu's and tau come from the fast calibration table
+   * if we have one that covers this model, else from simulation.
+   */
   if ((status = p7_Lambda(hmm, bg, &lambda))                          != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine lambda");
-  if ((status = p7_MSVMu    (r, om, bg, EmL, EmN, lambda, &mmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
-  if ((status = p7_ViterbiMu(r, om, bg, EvL, EvN, lambda, &vmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
-  if ((status = p7_Tau      (r, om, bg, EfL, EfN, lambda, Eft, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
+  if (cfg_b == NULL || cfg_b->evtable == NULL ||
+      p7_evtable_Compatible(cfg_b->evtable, cfg_b, bg, NULL)                                              != eslOK ||
+      p7_evtable_Estimate(cfg_b->evtable, hmm->M, p7_MeanMatchRelativeEntropy(hmm, bg), &mmu, &vmu, &tau) != eslOK)
+    {
+      if ((status = p7_MSVMu    (r, om, bg, EmL, EmN, lambda,      ncpu, &mmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
+      if ((status = p7_ViterbiMu(r, om, bg, EvL, EvN, lambda,      ncpu, &vmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
+      if ((status = p7_Tau      (r, om, bg, EfL, EfN, lambda, Eft, ncpu, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
+    }
 
   /* Store results */
   hmm->evparam[p7_MLAMBDA] = om->evparam[p7_MLAMBDA] = lambda;
@@ -221,6 +249,7 @@ p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda)
  *            L       :  length of sequences to simulate
  *            N	      :  number of sequences to simulate		
  *            lambda  :  known Gumbel lambda parameter
+ *            ncpu    :  number of worker threads to score with; 0 = serial
  *            ret_mmu :  RETURN: ML estimate of location param mu
  *
  * Returns:   <eslOK> on success, and <ret_mu> contains the ML estimate
@@ -235,46 +264,24 @@ p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda)
  *            eventually - need to be sure that fix applies here too.
  */
 int
-p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_mmu)
+p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, int ncpu, double *ret_mmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
   double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-  float    maxsc   = (255 - om->base_b) / om->scale_b; /* if score overflows, use this */
   int      status;
 
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_MSVFilter(dsq, L, om, ox, &sc); 
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
+  if ((status = simulate_scores(r, om, bg, L, N, p7_MMU, ncpu, xv)) != eslOK) goto ERROR;
   if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_mmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
   free(xv);
-  free(dsq);
   return eslOK;
 
  ERROR:
   *ret_mmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
   return status;
 
 }
@@ -296,6 +303,7 @@ p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lam
  *            L       :  length of sequences to simulate
  *            N	      :  number of sequences to simulate		
  *            lambda  :  known Gumbel lambda parameter
+ *            ncpu    :  number of worker threads to score with; 0 = serial
  *            ret_vmu :  RETURN: ML estimate of location param mu
  *
  * Returns:   <eslOK> on success, and <ret_mu> contains the ML estimate
@@ -304,46 +312,24 @@ p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lam
  * Throws:    (no abnormal error conditions)
  */
 int
-p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_vmu)
+p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, int ncpu, double *ret_vmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
   double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-  float    maxsc   = (32767.0 - om->base_w) / om->scale_w; /* if score overflows, use this [J4/139] */
   int      status;
 
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_ViterbiFilter(dsq, L, om, ox, &sc); 
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
+  if ((status = simulate_scores(r, om, bg, L, N, p7_VMU, ncpu, xv)) != eslOK) goto ERROR;
   if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_vmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
   free(xv);
-  free(dsq);
   return eslOK;
 
  ERROR:
   *ret_vmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
   return status;
 
 }
@@ -401,6 +387,7 @@ p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double
  *            N      : number of sequences to generate
  *            lambda : expected slope of the exponential tail (from p7_Lambda())
  *            tailp  : tail mass from which we will extrapolate mu
+ *            ncpu   : number of worker threads to score with; 0 = serial
  *            ret_mu : RETURN: estimate for the Forward mu (base of exponential tail)
  *
  * Returns:   <eslOK> on success, and <*ret_fv> is the score difference
@@ -409,31 +396,19 @@ p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double
  * Throws:    <eslEMEM> on allocation error, and <*ret_fv> is 0.
  */
 int
-p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, double *ret_tau)
+p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, int ncpu, double *ret_tau)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, L);     /* DP matrix: for ForwardParser,  L rows */
-  ESL_DSQ *dsq     = NULL;
   double  *xv      = NULL;
-  float    fsc, nullsc;		                  
   double   gmu, glam;
   int      status;
-  int      i;
 
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_ForwardParser(dsq, L, om, ox, &fsc))      != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-      xv[i] = (fsc - nullsc) / eslCONST_LOG2;
-    }
-  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam)) != eslOK) goto ERROR;
+  if ((status = simulate_scores(r, om, bg, L, N, p7_FTAU, ncpu, xv)) != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam))           != eslOK) goto ERROR;
 
   /* Explanation of the eqn below: first find the x at which the Gumbel tail
    * mass is predicted to be equal to tailp. Then back up from that x
@@ -443,15 +418,188 @@ p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambd
   *ret_tau =  esl_gumbel_invcdf(1.0-tailp, gmu, glam) + (log(tailp) / lambda);
   
   free(xv);
-  free(dsq);
-  p7_omx_Destroy(ox);
   return eslOK;
 
  ERROR:
   *ret_tau = 0.;
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
-  if (ox  != NULL) p7_omx_Destroy(ox);
+  return status;
+}
+
+
+/* score_one()
+ * Score one simulated sequence <dsq> of length <L> with <om>, using
+ * the MSV filter, Viterbi filter, or Forward parser, for <which> =
+ * <p7_MMU>, <p7_VMU>, or <p7_FTAU> respectively. Overflowing filter
+ * scores are replaced by the highest representable score. <ox> must
+ * be big enough for the chosen algorithm (<L> rows for Forward).
+ */
+static int
+score_one(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, int which, float *ret_sc)
+{
+  int status;
+
+  switch (which) {
+  case p7_MMU:
+    status = p7_MSVFilter(dsq, L, om, ox, ret_sc);
+    if (status == eslERANGE) { *ret_sc = (255 - om->base_b) / om->scale_b;        status = eslOK; } /* if score overflows, use this */
+    break;
+  case p7_VMU:
+    status = p7_ViterbiFilter(dsq, L, om, ox, ret_sc);
+    if (status == eslERANGE) { *ret_sc = (32767.0 - om->base_w) / om->scale_w;    status = eslOK; } /* [J4/139] */
+    break;
+  case p7_FTAU:
+    status = p7_ForwardParser(dsq, L, om, ox, ret_sc);
+    break;
+  default:
+    ESL_EXCEPTION(eslEINVAL, "no such calibration score");
+  }
+  return status;
+}
+
+
+#ifdef HMMER_THREADS
+/* SIMULATION: shared by the worker threads of one threaded
+ * simulation. Worker <w> scores sequences w, w+nworkers, w+2*nworkers...
+ * and records any error in its own <wstatus[w]>; nothing is written
+ * by more than one thread.
+ */
+typedef struct {
+  const P7_OPROFILE *om;	/* profile, configured for length <L>; read-only   */
+  ESL_DSQ          **dsq;	/* [0..N-1] simulated sequences; read-only          */
+  int                L;		/* length of each sequence                          */
+  int                N;		/* number of sequences                              */
+  int                which;	/* p7_MMU | p7_VMU | p7_FTAU                       */
+  int                nworkers;	/* number of worker threads                         */
+  float             *sc;	/* RESULT: [0..N-1] raw scores, in nats             */
+  int               *wstatus;	/* RESULT: [0..nworkers-1] status of each worker    */
+} SIMULATION;
+
+static void
+simulate_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  SIMULATION  *sim;
+  P7_OMX      *ox  = NULL;
+  int          w, i;
+  int          status = eslOK;
+
+  impl_Init();			/* same FP modes as the master, so scores are identical */
+  esl_threads_Started(obj, &w);
+  sim = (SIMULATION *) esl_threads_GetData(obj, w);
+
+  if ((ox = p7_omx_Create(sim->om->M, 0, (sim->which == p7_FTAU ? sim->L : 0))) == NULL) status = eslEMEM;
+  for (i = w; status == eslOK && i < sim->N; i += sim->nworkers)
+    status = score_one(sim->dsq[i], sim->L, sim->om, ox, sim->which, &(sim->sc[i]));
+
+  sim->wstatus[w] = status;
+  p7_omx_Destroy(ox);
+  esl_threads_Finished(obj, w);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
+
+/* simulate_scores()
+ * The simulation shared by p7_MSVMu(), p7_ViterbiMu(), and p7_Tau():
+ * sample <N> iid sequences of length <L> from <bg>, score each with
+ * <om> (see score_one() for <which>), and return the null-corrected
+ * bit scores in <xv[0..N-1]>, which the caller allocates. <om> and
+ * <bg> must already be configured for length <L>.
+ *
+ * With <ncpu> > 0 (and threads compiled in), the scoring is done by
+ * <ncpu> worker threads. All the sequences are sampled first, in order
+ * from <r>, so the random number stream and the results are exactly
+ * the same as the serial version, for any number of threads. Sampling
+ * is cheap compared to scoring (about 12% of calibration time, mostly
+ * in the Forward simulation).
+ */
+static int
+simulate_scores(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int which, int ncpu, double *xv)
+{
+  P7_OMX      *ox     = NULL;
+  ESL_DSQ     *dsq    = NULL;
+  float        sc, nullsc;
+  int          i;
+  int          status;
+#ifdef HMMER_THREADS
+  ESL_THREADS *obj    = NULL;
+  ESL_DSQ    **dsqv   = NULL;
+  SIMULATION   sim;
+  int          w;
+
+  sim.sc      = NULL;
+  sim.wstatus = NULL;
+
+  if (ncpu > 0 && N > 1)
+    {
+      ncpu = ESL_MIN(ncpu, N);
+
+      ESL_ALLOC(dsq,         sizeof(ESL_DSQ)   * N * (L+2));
+      ESL_ALLOC(dsqv,        sizeof(ESL_DSQ *) * N);
+      ESL_ALLOC(sim.sc,      sizeof(float)     * N);
+      ESL_ALLOC(sim.wstatus, sizeof(int)       * ncpu);
+      for (i = 0; i < N; i++)
+	{
+	  dsqv[i] = dsq + i * (L+2);
+	  if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsqv[i])) != eslOK) goto ERROR;
+	}
+
+      sim.om       = om;
+      sim.dsq      = dsqv;
+      sim.L        = L;
+      sim.N        = N;
+      sim.which    = which;
+      sim.nworkers = ncpu;
+
+      if ((obj = esl_threads_Create(&simulate_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (w = 0; w < ncpu; w++) esl_threads_AddThread(obj, &sim);
+      esl_threads_WaitForStart(obj);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+      obj = NULL;
+
+      for (w = 0; w < ncpu; w++)
+	if ((status = sim.wstatus[w]) != eslOK) goto ERROR;
+
+      for (i = 0; i < N; i++)
+	{
+	  if ((status = p7_bg_NullOne(bg, dsqv[i], L, &nullsc)) != eslOK) goto ERROR;
+	  xv[i] = (sim.sc[i] - nullsc) / eslCONST_LOG2;
+	}
+
+      free(sim.wstatus);
+      free(sim.sc);
+      free(dsqv);
+      free(dsq);
+      return eslOK;
+    }
+#endif /*HMMER_THREADS*/
+
+  if ((ox = p7_omx_Create(om->M, 0, (which == p7_FTAU ? L : 0))) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
+
+  for (i = 0; i < N; i++)
+    {
+      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
+      if ((status = score_one(dsq, L, om, ox, which, &sc))       != eslOK) goto ERROR;
+      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;
+      xv[i] = (sc - nullsc) / eslCONST_LOG2;
+    }
+
+  p7_omx_Destroy(ox);
+  free(dsq);
+  return eslOK;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (obj)         esl_threads_Destroy(obj);
+  if (dsqv)        free(dsqv);
+  if (sim.sc)      free(sim.sc);
+  if (sim.wstatus) free(sim.wstatus);
+#endif
+  if (ox)  p7_omx_Destroy(ox);
+  if (dsq) free(dsq);
   return status;
 }
 /*-------------- end, determining individual parameters ---------*/
@@ -548,9 +696,9 @@ main(int argc, char **argv)
 
       for (iteration = 0; iteration < Z; iteration++)
 	{
-	  if (do_msv) p7_MSVMu     (r, om, bg, EmL, EmN, lambda,       &mmu);
-	  if (do_vit) p7_ViterbiMu (r, om, bg, EvL, EvN, lambda,       &vmu);
-	  if (do_fwd) p7_Tau       (r, om, bg, EfL, EfN, lambda, Eft,  &ftau);
+	  if (do_msv) p7_MSVMu     (r, om, bg, EmL, EmN, lambda,      0, &mmu);
+	  if (do_vit) p7_ViterbiMu (r, om, bg, EvL, EvN, lambda,      0, &vmu);
+	  if (do_fwd) p7_Tau       (r, om, bg, EfL, EfN, lambda, Eft, 0, &ftau);
       
 	  printf("%s %.4f %.4f %.4f %.4f\n", hmm->name, lambda, mmu, vmu, ftau);
 	}
@@ -639,3 +787,95 @@ main(int argc, char **argv)
 #endif /*p7EVALUES_BENCHMARK*/
 
 
+
+/*****************************************************************
+ * 5. Unit tests
+ *****************************************************************/
+#ifdef p7EVALUES_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_threaded()
+ * Calibrating with worker threads must give exactly the same
+ * E-value parameters as a serial calibration, because the samples
+ * are drawn in the same order from the same RNG.
+ */
+static void
+utest_threaded(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int M, int ncpu)
+{
+  char        msg[]  = "evalues threaded calibration unit test failed";
+  P7_HMM     *hmm    = NULL;
+  P7_BUILDER *bld    = NULL;
+  float       serial[p7_NEVPARAM];
+  int         z;
+
+  if (p7_hmm_Sample(rng, M, abc, &hmm)           != eslOK) esl_fatal(msg);
+  if ((bld = p7_builder_Create(NULL, abc))       == NULL)  esl_fatal(msg);
+  bld->EmN = bld->EvN = bld->EfN = 50;
+
+  bld->ncpu = 0;
+  if (p7_Calibrate(hmm, bld, &(bld->r), NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+  for (z = 0; z < p7_NEVPARAM; z++) serial[z] = hmm->evparam[z];
+
+  bld->ncpu = ncpu;
+  if (p7_Calibrate(hmm, bld, &(bld->r), NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+  for (z = 0; z < p7_NEVPARAM; z++)
+    if (hmm->evparam[z] != serial[z]) esl_fatal(msg);
+
+  p7_builder_Destroy(bld);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7EVALUES_TESTDRIVE*/
+
+
+/*****************************************************************
+ * 6. Test driver
+ *****************************************************************/
+#ifdef p7EVALUES_TESTDRIVE
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",  eslARG_INT,      "42", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
+  {"-v",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show verbose commentary/output",                 0},
+  {"-M",  eslARG_INT,      "50", NULL, NULL, NULL, NULL, NULL, "length of sampled test models",                  0},
+  {"--cpu", eslARG_INT,     "2", NULL,"n>0", NULL, NULL, NULL, "number of threads to compare against serial",    0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for evalues.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go         = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng        = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *aa         = esl_alphabet_Create(eslAMINO);
+  ESL_ALPHABET   *nt         = esl_alphabet_Create(eslDNA);
+  int             M          = esl_opt_GetInteger(go, "-M");
+  int             ncpu       = esl_opt_GetInteger(go, "--cpu");
+  int             be_verbose = esl_opt_GetBoolean(go, "-v");
+
+  if (be_verbose) printf("evalues unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  impl_Init();
+  utest_threaded(rng, aa, M, ncpu);
+  utest_threaded(rng, nt, M, ncpu);
+
+  esl_alphabet_Destroy(aa);
+  esl_alphabet_Destroy(nt);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7EVALUES_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
@@ -46,6 +46,7 @@ typedef struct {
   P7_HMM     *hmm;
   double      entropy;
   int         force_single; /* FALSE by default,  TRUE if esl_opt_IsUsed(go, "--singlemx") ;  only matters for single sequences */
+  int         ncpu;         /* threads the worker's builder may use for this alignment (see thread_loop()) */
 } WORK_ITEM;
 
 typedef struct _pending_s {
@@ -62,6 +63,7 @@ typedef struct _pending_s {
 #define CONOPTS "--fast,--hand"                                /* Exclusive options for model construction                    */
 #define EFFOPTS "--eent,--eentexp,--eclust,--eset,--enone"               /* Exclusive options for effective sequence number calculation */
 #define WGTOPTS "--wgsc,--wblosum,--wpb,--wnone,--wgiven"      /* Exclusive options for relative weighting                    */
+#define STREAMINCOMPAT "-O,--hand,--wgsc,--wblosum,--wgiven,--eclust,--singlemx" /* need the whole alignment in memory */
 
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
@@ -132,6 +134,7 @@ static ESL_OPTIONS options[] = {
   { "--w_beta",   eslARG_REAL,       NULL, NULL, NULL,    NULL,     NULL,    NULL, "tail mass at which window length is determined",        8 },
   { "--w_length", eslARG_INT,        NULL, NULL, NULL,    NULL,     NULL,    NULL, "window length ",                                        8 },
   { "--maxinsertlen",  eslARG_INT,   NULL, NULL, "n>=5",  NULL,     NULL,    NULL, "pretend all inserts are length <= <n>",   8 },
+  { "--stream",   eslARG_NONE,      FALSE, NULL, NULL,    NULL,     NULL, STREAMINCOMPAT, "read a huge aligned FASTA file a seq at a time, not into memory", 8 },
 
   /*Expert-only option, hidden from view. Likely to be removed in the future.
     This is an experimental alternative method for weighting sequence counts.
@@ -187,6 +190,7 @@ static char usage[]  = "[-options] <hmmfile_out> <msafile>";
 static char banner[] = "profile HMM construction from multiple sequence alignments";
 
 static int  usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg);
+static int  stream_master(const ESL_GETOPTS *go, struct cfg_s *cfg);
 static void serial_loop  (WORKER_INFO *info, struct cfg_s *cfg, const ESL_GETOPTS *go);
 #ifdef HMMER_THREADS
 static void thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg, const ESL_GETOPTS *go);
@@ -202,6 +206,7 @@ static void  mpi_init_other_failure(char *format, ...);
 
 static int output_header(const ESL_GETOPTS *go, const struct cfg_s *cfg);
 static int output_result(const struct cfg_s *cfg, char *errbuf, int msaidx, ESL_MSA *msa, P7_HMM *hmm, ESL_MSA *postmsa, double entropy);
+static int output_model (const struct cfg_s *cfg, char *errbuf, int msaidx, char *name, int nseq, int64_t alen, char *desc, P7_HMM *hmm, double entropy);
 static int set_msa_name (      struct cfg_s *cfg, char *errbuf, ESL_MSA *msa);
 
 
@@ -271,6 +276,8 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
 	goto FAILURE;
       }
     }
+  if (esl_opt_IsOn(go, "--mpi") && esl_opt_IsOn(go, "--stream")) 
+    { if (puts("Options --stream and --mpi are incompatible.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 #endif
 
   *ret_go = go;
@@ -337,6 +344,7 @@ output_header(const ESL_GETOPTS *go, const struct cfg_s *cfg)
   if (esl_opt_IsUsed(go, "--mx")         && fprintf(cfg->ofp, "# subst score matrix (built-in):    %s\n",         esl_opt_GetString (go, "--mx"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--mxfile")     && fprintf(cfg->ofp, "# subst score matrix (file):        %s\n",         esl_opt_GetString (go, "--mxfile"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--maxinsertlen")  && fprintf(cfg->ofp, "# max insert length:                %d\n",         esl_opt_GetInteger (go, "--maxinsertlen"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stream")     && fprintf(cfg->ofp, "# streaming build:                  on\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
 
 #ifdef HMMER_THREADS
@@ -460,7 +468,8 @@ main(int argc, char **argv)
   else
 #endif /*HMMER_MPI*/
     {
-      usual_master(go, &cfg);
+      if (esl_opt_GetBoolean(go, "--stream")) stream_master(go, &cfg);
+      else                                    usual_master(go, &cfg);
       esl_stopwatch_Stop(w);
     }
 
@@ -566,6 +575,7 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].bld = p7_builder_Create(go, cfg->abc);
 
       if (info[i].bld == NULL)  p7_Fail("p7_builder_Create failed");
+      info[i].bld->ncpu = 0;	/* threaded hmmbuild sets it per alignment; see thread_loop() */
 
       //do this here instead of in p7_builder_Create(), because it's an hmmbuild-specific option
 
@@ -622,6 +632,7 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
       item->msa       = NULL;
       item->hmm       = NULL;
       item->entropy   = 0.0;
+      item->ncpu      = 0;
 
       status = esl_workqueue_Init(queue, item);
       if (status != eslOK) esl_fatal("Failed to add block to work queue");
@@ -661,6 +672,86 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
   return eslFAIL;
 }
 
+/* stream_master()
+ * hmmbuild --stream: build one HMM from an aligned FASTA file that is
+ * read a sequence at a time by p7_StreamBuilder(), for alignments
+ * too large to read into memory. Calibration still uses the worker
+ * threads.
+ *
+ * Like the other masters, can only return if it's successful.
+ */
+static int
+stream_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
+{
+  P7_BUILDER *bld     = NULL;
+  P7_BG      *bg      = NULL;
+  P7_HMM     *hmm     = NULL;
+  char       *name    = NULL;
+  int64_t     alen    = 0;
+  int         ncpus   = 0;
+  double      popen;
+  double      pextend;
+  double      entropy;
+  char        errmsg[eslERRBUFSIZE];
+  int         status;
+
+  if (cfg->fmt != eslMSAFILE_UNKNOWN && cfg->fmt != eslMSAFILE_AFA) p7_Fail("--stream reads aligned FASTA only (--informat afa)\n");
+  if (strcmp(cfg->alifile, "-") == 0)                               p7_Fail("--stream reads <msafile> three times, so it can't be stdin\n");
+
+  if      (esl_opt_GetBoolean(go, "--amino"))   cfg->abc = esl_alphabet_Create(eslAMINO);
+  else if (esl_opt_GetBoolean(go, "--dna"))     cfg->abc = esl_alphabet_Create(eslDNA);
+  else if (esl_opt_GetBoolean(go, "--rna"))     cfg->abc = esl_alphabet_Create(eslRNA);
+  else                                          cfg->abc = NULL;
+
+  /* Opening as an MSA file gets us alphabet guessing; we only use its <bf>, never esl_msafile_Read(). */
+  status = esl_msafile_Open(&(cfg->abc), cfg->alifile, NULL, eslMSAFILE_AFA, NULL, &(cfg->afp));
+  if (status != eslOK) esl_msafile_OpenFailure(cfg->afp, status);
+
+  cfg->hmmfp = fopen(cfg->hmmfile, "w");
+  if (cfg->hmmfp == NULL) p7_Fail("Failed to open HMM file %s for writing", cfg->hmmfile);
+
+  if (esl_opt_IsUsed(go, "-o")) 
+    {
+      cfg->ofp = fopen(esl_opt_GetString(go, "-o"), "w");
+      if (cfg->ofp == NULL) p7_Fail("Failed to open -o output file %s\n", esl_opt_GetString(go, "-o"));
+    } 
+  else cfg->ofp = stdout;
+
+  output_header(go, cfg);
+  output_result(cfg, NULL, 0, NULL, NULL, NULL, 0.0);
+
+#ifdef HMMER_THREADS
+  ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
+
+  if ((bg  = p7_bg_Create(cfg->abc))           == NULL) p7_Fail("p7_bg_Create failed");
+  if ((bld = p7_builder_Create(go, cfg->abc))  == NULL) p7_Fail("p7_builder_Create failed");
+  bld->ncpu = ncpus;
+  if (esl_opt_IsOn(go, "--maxinsertlen")) bld->max_insert_len = esl_opt_GetInteger(go, "--maxinsertlen");
+  bld->w_len  = esl_opt_IsOn(go, "--w_length") ? esl_opt_GetInteger(go, "--w_length") : -1;
+  bld->w_beta = esl_opt_IsOn(go, "--w_beta")   ? esl_opt_GetReal   (go, "--w_beta")   : p7_DEFAULT_WINDOW_BETA;
+  if (bld->w_beta < 0 || bld->w_beta > 1) esl_fatal("Invalid window-length beta value\n");
+
+  popen   = esl_opt_IsUsed(go, "--popen")   ? esl_opt_GetReal(go, "--popen")   : -1;
+  pextend = esl_opt_IsUsed(go, "--pextend") ? esl_opt_GetReal(go, "--pextend") : -1;
+
+  if      (cfg->hmmName != NULL) { if (esl_strdup(cfg->hmmName, -1, &name) != eslOK) p7_Fail("allocation failed"); }
+  else if (esl_FileTail(cfg->alifile, TRUE, &name) != eslOK) p7_Fail("Failed to name the model from alignment file name %s", cfg->alifile);
+
+  cfg->nali = 1;
+  if ((status = p7_StreamBuilder(bld, cfg->afp->bf, name, bg, &hmm, &alen, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", bld->errbuf);
+  if (popen != -1 || pextend != -1) apply_fixed_gap_params(hmm, popen, pextend);
+
+  entropy = p7_MeanMatchRelativeEntropy(hmm, bg);
+  if ((status = output_model(cfg, errmsg, cfg->nali, name, hmm->nseq, alen, NULL, hmm, entropy)) != eslOK) p7_Fail(errmsg);
+
+  p7_hmm_Destroy(hmm);
+  p7_builder_Destroy(bld);
+  p7_bg_Destroy(bg);
+  free(name);
+  return eslOK;
+}
+
 #ifdef HMMER_MPI
 /* mpi_master()
  * The MPI version of hmmbuild.
@@ -1066,7 +1157,10 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg, const ES
 {
   int          status    = eslOK;
   int          sstatus   = eslOK;
+  int          rstatus;
   int          processed = 0;
+  int          ncpus     = esl_threads_GetWorkerCount(obj);
+  ESL_MSA     *nextmsa   = NULL;
   WORK_ITEM   *item;
   void        *newItem;
 
@@ -1082,18 +1176,31 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg, const ES
 
   status = esl_workqueue_ReaderUpdate(queue, NULL, &newItem);
   if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* Alignments are read one ahead, so we know when the one we hand
+   * out is the last. If no other alignment is still being built, its
+   * builder gets all <ncpus> threads for calibration and clustering
+   * (as when hmmbuild builds one big MSA); otherwise each worker builds
+   * serially, so about <ncpus> threads run at once.
+   */
+  rstatus = esl_msafile_Read(cfg->afp, &nextmsa);
+  if (rstatus != eslOK && rstatus != eslEOF) esl_msafile_ReadFailure(cfg->afp, rstatus);
       
   /* Main loop: */
   item = (WORK_ITEM *) newItem;
   while (sstatus == eslOK) {
-    sstatus = esl_msafile_Read(cfg->afp, &item->msa);
-    if (sstatus == eslOK) {
+    item->msa = nextmsa;
+    nextmsa   = NULL;
+    if (item->msa != NULL) {
       item->nali = ++cfg->nali;
       if (set_msa_name(cfg, errmsg, item->msa) != eslOK) p7_Fail("%s\n", errmsg);
+
+      rstatus = esl_msafile_Read(cfg->afp, &nextmsa);
+      if (rstatus != eslOK && rstatus != eslEOF) esl_msafile_ReadFailure(cfg->afp, rstatus);
+      item->ncpu = (rstatus == eslEOF && processed == cfg->nali-1) ? ncpus : 0;
     }
-    else if (sstatus == eslEOF && processed < cfg->nali) sstatus = eslOK;
-    else if (sstatus != eslEOF) 
-      esl_msafile_ReadFailure(cfg->afp, sstatus);
+    else if (processed < cfg->nali) sstatus = eslOK;
+    else                            sstatus = eslEOF;
 	  
     if (sstatus == eslOK) {
       item->force_single = esl_opt_IsUsed(go, "--singlemx");
@@ -1224,6 +1331,7 @@ pipeline_thread(void *arg)
   item = (WORK_ITEM *) newItem;
   while (item->msa != NULL)
     {
+      info->bld->ncpu = item->ncpu;
 
       if ( item->msa->nseq == 1 && item->force_single) {
         status = esl_sq_FetchFromMSA(item->msa, 0, &sq);
@@ -1285,6 +1393,26 @@ output_result(const struct cfg_s *cfg, char *errbuf, int msaidx, ESL_MSA *msa, P
     }
     return eslOK;
   }
+  if ((status = output_model(cfg, errbuf, msaidx, msa->name, msa->nseq, msa->alen, msa->desc, hmm, entropy)) != eslOK) return status;
+
+  if (cfg->postmsafp != NULL && postmsa != NULL) {
+    esl_msafile_Write(cfg->postmsafp, postmsa, eslMSAFILE_STOCKHOLM);
+  }
+
+  return eslOK;
+}
+
+
+/* output_model()
+ * Save <hmm> and print its line of the tabular results. Split out of
+ * output_result() so a streaming build, which has no <ESL_MSA>, can
+ * use it too.
+ */
+static int
+output_model(const struct cfg_s *cfg, char *errbuf, int msaidx, char *name, int nseq, int64_t alen, char *desc, P7_HMM *hmm, double entropy)
+{
+  int status;
+
 //  if ((status = p7_hmm_Validate(hmm, errbuf, 0.0001))       != eslOK) return status;
   if ((status = p7_hmmfile_WriteASCII(cfg->hmmfp, -1, hmm)) != eslOK) ESL_FAIL(status, errbuf, "HMM save failed");
 
@@ -1292,32 +1420,28 @@ output_result(const struct cfg_s *cfg, char *errbuf, int msaidx, ESL_MSA *msa, P
   if (cfg->abc->type == eslAMINO) {
     if (fprintf(cfg->ofp, "%-5d %-20s %5d %5" PRId64 " %5d %8.2f %6.3f %s\n",
           msaidx,
-          (msa->name != NULL) ? msa->name : "",
-          msa->nseq,
-          msa->alen,
+          (name != NULL) ? name : "",
+          nseq,
+          alen,
           hmm->M,
           hmm->eff_nseq,
           entropy,
-          (msa->desc != NULL) ? msa->desc : "") < 0)
+          (desc != NULL) ? desc : "") < 0)
       ESL_EXCEPTION_SYS(eslEWRITE, "output_result: write failed");
   } else {
     if (fprintf(cfg->ofp, "%-5d %-20s %5d %5" PRId64 " %5d %5d %8.2f %6.3f %s\n",
           msaidx,
-          (msa->name != NULL) ? msa->name : "",
-          msa->nseq,
-          msa->alen,
+          (name != NULL) ? name : "",
+          nseq,
+          alen,
           hmm->M,
           hmm->max_length,
           hmm->eff_nseq,
           entropy,
-          (msa->desc != NULL) ? msa->desc : "") < 0)
+          (desc != NULL) ? desc : "") < 0)
       ESL_EXCEPTION_SYS(eslEWRITE, "output_result: write failed");
   }
 
-  if (cfg->postmsafp != NULL && postmsa != NULL) {
-    esl_msafile_Write(cfg->postmsafp, postmsa, eslMSAFILE_STOCKHOLM);
-  }
-
   return eslOK;
 }
 
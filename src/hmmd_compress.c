@@ -0,0 +1,505 @@
+/* Optional compression of hmmpgmd result messages.
+ *
+ * Serialized hits are mostly alignment text (model, match, target,
+ * and posterior probability lines) with a lot of repetition, so even
+ * a fast byte-oriented LZ codec shrinks them substantially. Remote
+ * clients pulling large result sets are limited by bandwidth, not by
+ * the master's CPU, so trading a little CPU for bytes on the wire
+ * pays off.
+ *
+ * The codec here writes the LZ4 block format: a sequence of
+ * (token, literals, offset, match length) records, with matches
+ * limited to a 64KB window. It's a small greedy implementation,
+ * written here so that hmmpgmd has no new external dependency, and
+ * the decoder bounds-checks everything, since its input comes off
+ * the network.
+ *
+ * A packed message is:
+ *     uint8_t   method           HMMD_COMPRESS_NONE or HMMD_COMPRESS_LZ4
+ *     uint64_t  raw size         network byte order
+ *     ...       payload          raw bytes, or an LZ4 block
+ * Data that doesn't compress is sent with HMMD_COMPRESS_NONE, so a
+ * packed message is never more than 9 bytes bigger than the original.
+ *
+ * Compression is negotiated per connection: by a client with the
+ * "!compress" server command, and between master and worker by
+ * flags in the HMMD_CMD_INIT handshake. On a connection that has
+ * negotiated it, the payload after each successful
+ * HMMD_SEARCH_STATUS is a packed message, and the status's msg_size
+ * is the packed size. Error strings are never packed.
+ *
+ * Contents:
+ *   1. The LZ4 block codec.
+ *   2. Packing and unpacking messages.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include "p7_config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+
+
+/*****************************************************************
+ * 1. The LZ4 block codec.
+ *****************************************************************/
+
+#define LZ_MINMATCH      4	  /* shortest match encoded                          */
+#define LZ_LASTLITERALS  5	  /* the last 5 bytes are always literals            */
+#define LZ_MFLIMIT       12	  /* no match may start in the last 12 bytes         */
+#define LZ_MAXOFFSET     65535	  /* matches are within a 64KB window                */
+#define LZ_HASHLOG       16	  /* 64K-entry table of 4-byte prefixes              */
+
+/* worst-case compressed size for <n> bytes of input */
+#define LZ_BOUND(n)      ((n) + (n)/255 + 16)
+
+static uint32_t
+lz_read32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(uint32_t));
+  return v;
+}
+
+static uint32_t
+lz_hash(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - LZ_HASHLOG);
+}
+
+/* Write a length <n> that didn't fit in its 4-bit token field:
+ * 255's, then the remainder.
+ */
+static uint8_t *
+lz_putlen(uint8_t *op, uint64_t n)
+{
+  while (n >= 255) { *op++ = 255; n -= 255; }
+  *op++ = (uint8_t) n;
+  return op;
+}
+
+/* lz_compress()
+ * Compress <src[0..n-1]> into <dst>, which has room for at least
+ * LZ_BOUND(n) bytes; return the compressed size in <*ret_n>.
+ */
+static int
+lz_compress(const uint8_t *src, uint64_t n, uint8_t *dst, uint64_t *ret_n)
+{
+  int64_t  *table = NULL;	/* table[hash] = last position with that 4-byte prefix, or -1 */
+  uint8_t  *op    = dst;
+  uint8_t  *token;
+  uint64_t  anchor = 0;		/* start of pending literals */
+  uint64_t  ip     = 0;
+  uint64_t  ref, len, lit;
+  uint32_t  h;
+  int       status;
+
+  if (n > LZ_MFLIMIT)
+    {
+      uint64_t mflimit    = n - LZ_MFLIMIT;
+      uint64_t matchlimit = n - LZ_LASTLITERALS;
+
+      ESL_ALLOC(table, sizeof(int64_t) * (1 << LZ_HASHLOG));
+      memset(table, 0xff, sizeof(int64_t) * (1 << LZ_HASHLOG));
+
+      while (ip < mflimit)
+        {
+          h        = lz_hash(lz_read32(src + ip));
+          ref      = (uint64_t) table[h];
+          table[h] = ip;
+          if (ref == (uint64_t) -1 || ip - ref > LZ_MAXOFFSET || lz_read32(src + ref) != lz_read32(src + ip)) { ip++; continue; }
+
+          while (ip > anchor && ref > 0 && src[ip-1] == src[ref-1]) { ip--; ref--; }
+          for (len = LZ_MINMATCH; ip + len < matchlimit && src[ref+len] == src[ip+len]; len++) ;
+
+          lit   = ip - anchor;
+          token = op++;
+          if (lit >= 15) { *token = 15 << 4; op = lz_putlen(op, lit - 15); }
+          else             *token = (uint8_t) (lit << 4);
+          memcpy(op, src + anchor, lit);
+          op += lit;
+
+          *op++ = (uint8_t) ((ip - ref) & 0xff);
+          *op++ = (uint8_t) ((ip - ref) >> 8);
+
+          len -= LZ_MINMATCH;
+          if (len >= 15) { *token |= 15; op = lz_putlen(op, len - 15); }
+          else             *token |= (uint8_t) len;
+
+          ip    += len + LZ_MINMATCH;
+          anchor = ip;
+        }
+      free(table);
+    }
+
+  /* the last sequence is literals only */
+  lit   = n - anchor;
+  token = op++;
+  if (lit >= 15) { *token = 15 << 4; op = lz_putlen(op, lit - 15); }
+  else             *token = (uint8_t) (lit << 4);
+  memcpy(op, src + anchor, lit);
+  op += lit;
+
+  *ret_n = op - dst;
+  return eslOK;
+
+ ERROR:
+  *ret_n = 0;
+  return status;
+}
+
+/* lz_decompress()
+ * Decompress the <n> byte LZ4 block <src> into <dst>, which must
+ * decompress to exactly <rawn> bytes. Returns <eslECORRUPT> if it
+ * doesn't, or if any length or offset in <src> points outside its
+ * buffer.
+ */
+static int
+lz_decompress(const uint8_t *src, uint64_t n, uint8_t *dst, uint64_t rawn)
+{
+  uint64_t ip = 0;
+  uint64_t op = 0;
+  uint64_t lit, len, off;
+  uint8_t  token, b;
+
+  for (;;)
+    {
+      if (ip >= n) return eslECORRUPT;
+      token = src[ip++];
+
+      lit = token >> 4;
+      if (lit == 15) do {
+          if (ip >= n) return eslECORRUPT;
+          b = src[ip++];
+          lit += b;
+        } while (b == 255);
+      if (lit > n - ip || lit > rawn - op) return eslECORRUPT;
+      memcpy(dst + op, src + ip, lit);
+      ip += lit;
+      op += lit;
+
+      if (ip == n) break;	/* last sequence: literals only */
+
+      if (n - ip < 2) return eslECORRUPT;
+      off = (uint64_t) src[ip] | ((uint64_t) src[ip+1] << 8);
+      ip += 2;
+      if (off == 0 || off > op) return eslECORRUPT;
+
+      len = token & 15;
+      if (len == 15) do {
+          if (ip >= n) return eslECORRUPT;
+          b = src[ip++];
+          len += b;
+        } while (b == 255);
+      len += LZ_MINMATCH;
+      if (len > rawn - op) return eslECORRUPT;
+
+      for (; len > 0; len--, op++) dst[op] = dst[op-off]; /* byte at a time: a match may overlap its own output */
+    }
+
+  return (op == rawn) ? eslOK : eslECORRUPT;
+}
+
+
+/*****************************************************************
+ * 2. Packing and unpacking messages.
+ *****************************************************************/
+
+#define HMMD_COMPRESS_HDRSIZE (1 + sizeof(uint64_t))
+
+/* Function:  hmmd_compress_Pack()
+ * Synopsis:  Compress a message for sending.
+ *
+ * Purpose:   Compress the <rawn> bytes in <raw> into a new packed
+ *            message, returned in <*ret_msg>, of <*ret_n> bytes.
+ *            If LZ4 doesn't make the data smaller, it's stored as is.
+ *
+ *            If <opt_secs> is non-NULL, return the wall-clock time
+ *            spent compressing in <*opt_secs>, so callers can log the
+ *            CPU cost alongside the compression ratio.
+ *
+ * Returns:   <eslOK> on success; caller frees <*ret_msg>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <*ret_msg> is NULL and
+ *            <*ret_n> is 0.
+ */
+int
+hmmd_compress_Pack(const uint8_t *raw, uint64_t rawn, uint8_t **ret_msg, uint64_t *ret_n, double *opt_secs)
+{
+  ESL_STOPWATCH *w   = NULL;
+  uint8_t       *msg = NULL;
+  uint64_t       n;
+  uint64_t       network_64bit;
+  int            status;
+
+  if (opt_secs) { if ((w = esl_stopwatch_Create()) == NULL) { status = eslEMEM; goto ERROR; } esl_stopwatch_Start(w); }
+
+  ESL_ALLOC(msg, HMMD_COMPRESS_HDRSIZE + LZ_BOUND(rawn));
+  if ((status = lz_compress(raw, rawn, msg + HMMD_COMPRESS_HDRSIZE, &n)) != eslOK) goto ERROR;
+
+  if (n < rawn) msg[0] = HMMD_COMPRESS_LZ4;
+  else {
+    msg[0] = HMMD_COMPRESS_NONE;
+    memcpy(msg + HMMD_COMPRESS_HDRSIZE, raw, rawn);
+    n = rawn;
+  }
+  network_64bit = esl_hton64(rawn);
+  memcpy(msg + 1, &network_64bit, sizeof(uint64_t));
+
+  if (w) { esl_stopwatch_Stop(w); *opt_secs = w->elapsed; esl_stopwatch_Destroy(w); }
+  *ret_msg = msg;
+  *ret_n   = HMMD_COMPRESS_HDRSIZE + n;
+  return eslOK;
+
+ ERROR:
+  if (w)   esl_stopwatch_Destroy(w);
+  if (msg) free(msg);
+  if (opt_secs) *opt_secs = 0.;
+  *ret_msg = NULL;
+  *ret_n   = 0;
+  return status;
+}
+
+
+/* Function:  hmmd_compress_Unpack()
+ * Synopsis:  Decompress a received message.
+ *
+ * Purpose:   Decompress the <n> byte packed message <msg> into a new
+ *            buffer, returned in <*ret_raw>, of <*ret_rawn> bytes.
+ *
+ * Returns:   <eslOK> on success; caller frees <*ret_raw>.
+ *            <eslECORRUPT> if <msg> isn't a valid packed message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            On any error, <*ret_raw> is NULL and <*ret_rawn> is 0.
+ */
+int
+hmmd_compress_Unpack(const uint8_t *msg, uint64_t n, uint8_t **ret_raw, uint64_t *ret_rawn)
+{
+  uint8_t  *raw = NULL;
+  uint64_t  rawn;
+  uint64_t  network_64bit;
+  int       status;
+
+  if (n < HMMD_COMPRESS_HDRSIZE) { status = eslECORRUPT; goto ERROR; }
+  memcpy(&network_64bit, msg + 1, sizeof(uint64_t));
+  rawn = esl_ntoh64(network_64bit);
+
+  switch (msg[0]) {
+  case HMMD_COMPRESS_NONE:
+    if (rawn != n - HMMD_COMPRESS_HDRSIZE) { status = eslECORRUPT; goto ERROR; }
+    ESL_ALLOC(raw, ESL_MAX(rawn, 1));
+    memcpy(raw, msg + HMMD_COMPRESS_HDRSIZE, rawn);
+    break;
+  case HMMD_COMPRESS_LZ4:
+    /* an LZ4 block expands at most 255-fold, which bounds how much a corrupt size can make us allocate */
+    if (rawn / 255 > n) { status = eslECORRUPT; goto ERROR; }
+    ESL_ALLOC(raw, ESL_MAX(rawn, 1));
+    if ((status = lz_decompress(msg + HMMD_COMPRESS_HDRSIZE, n - HMMD_COMPRESS_HDRSIZE, raw, rawn)) != eslOK) goto ERROR;
+    break;
+  default:
+    status = eslECORRUPT;
+    goto ERROR;
+  }
+
+  *ret_raw  = raw;
+  *ret_rawn = rawn;
+  return eslOK;
+
+ ERROR:
+  if (raw) free(raw);
+  *ret_raw  = NULL;
+  *ret_rawn = 0;
+  return status;
+}
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7HMMD_COMPRESS_TESTDRIVE
+#include "esl_random.h"
+
+/* Pack and unpack <raw>, check that we get it back, and return the packed size. */
+static uint64_t
+roundtrip(const uint8_t *raw, uint64_t rawn, char *msg)
+{
+  uint8_t  *packed = NULL;
+  uint8_t  *back   = NULL;
+  uint64_t  n, backn;
+
+  if (hmmd_compress_Pack(raw, rawn, &packed, &n, NULL)     != eslOK) esl_fatal(msg);
+  if (n > rawn + HMMD_COMPRESS_HDRSIZE)                              esl_fatal(msg);
+  if (hmmd_compress_Unpack(packed, n, &back, &backn)       != eslOK) esl_fatal(msg);
+  if (backn != rawn || memcmp(raw, back, rawn) != 0)                 esl_fatal(msg);
+  free(packed);
+  free(back);
+  return n;
+}
+
+/* utest_Roundtrip()
+ * Edge-case sizes; incompressible random bytes; low-entropy data with
+ * long and overlapping matches; and alignment-like text, which should
+ * compress well.
+ */
+static void
+utest_Roundtrip(ESL_RANDOMNESS *rng)
+{
+  char      msg[]  = "hmmd_compress Roundtrip unit test failed";
+  uint64_t  maxn   = 300000;
+  uint8_t  *raw    = NULL;
+  char      cons[400];
+  uint64_t  rawn, i;
+  int       trial;
+  int       status;
+
+  ESL_ALLOC(raw, maxn);
+
+  /* every size around the codec's 12- and 5-byte edge limits */
+  for (rawn = 0; rawn < 40; rawn++)
+    {
+      for (i = 0; i < rawn; i++) raw[i] = 'A';
+      roundtrip(raw, rawn, msg);
+    }
+
+  /* random bytes are stored, not compressed */
+  for (i = 0; i < maxn; i++) raw[i] = (uint8_t) esl_rnd_Roll(rng, 256);
+  if (roundtrip(raw, maxn, msg) != maxn + HMMD_COMPRESS_HDRSIZE) esl_fatal(msg);
+
+  /* small alphabets, random lengths: lots of short, long, and overlapping matches */
+  for (trial = 0; trial < 50; trial++)
+    {
+      int K = 1 + esl_rnd_Roll(rng, 4);
+      rawn  = esl_rnd_Roll(rng, maxn);
+      for (i = 0; i < rawn; i++) raw[i] = 'a' + esl_rnd_Roll(rng, K);
+      roundtrip(raw, rawn, msg);
+    }
+
+  /* something like serialized alidisplays from one query: model lines
+   * are pieces of the same consensus, targets are mostly identical to
+   * it, and posterior probabilities are mostly '*'.
+   */
+  for (i = 0; i < 400; i++) cons[i] = "ACDEFGHIKLMNPQRSTVWY"[esl_rnd_Roll(rng, 20)];
+  rawn = 0;
+  while (rawn + 400 < maxn)
+    {
+      uint64_t off = esl_rnd_Roll(rng, 340);
+      for (i = 0; i < 60; i++) raw[rawn++] = cons[off+i];
+      raw[rawn++] = '\0';
+      for (i = 0; i < 60; i++) raw[rawn++] = esl_rnd_Roll(rng, 10) < 7 ? cons[off+i] : "ACDEFGHIKLMNPQRSTVWY"[esl_rnd_Roll(rng, 20)];
+      raw[rawn++] = '\0';
+      for (i = 0; i < 60; i++, rawn++) raw[rawn] = (raw[rawn-61] == raw[rawn-122]) ? raw[rawn-61] : (esl_rnd_Roll(rng, 2) ? '+' : ' '); /* vs. aseq, model */
+      raw[rawn++] = '\0';
+      for (i = 0; i < 60; i++) raw[rawn++] = esl_rnd_Roll(rng, 10) < 8 ? '*' : '0' + esl_rnd_Roll(rng, 10);
+      raw[rawn++] = '\0';
+      rawn += sprintf((char *) raw + rawn, "sp|Q%05d|GLOBIN_HUMAN", (int) esl_rnd_Roll(rng, 100000)) + 1;
+    }
+  if (roundtrip(raw, rawn, msg) * 4 > rawn * 3) esl_fatal(msg); /* at least 25% smaller */
+
+  free(raw);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_Corrupt()
+ * Unpack must reject truncated and malformed messages, and must never
+ * read or write out of bounds on garbage (run under valgrind to
+ * check the latter).
+ */
+static void
+utest_Corrupt(ESL_RANDOMNESS *rng)
+{
+  char      msg[]  = "hmmd_compress Corrupt unit test failed";
+  uint64_t  rawn   = 20000;
+  uint8_t  *raw    = NULL;
+  uint8_t  *packed = NULL;
+  uint8_t  *back   = NULL;
+  uint64_t  n, backn, i;
+  int       trial;
+  int       status;
+
+  ESL_ALLOC(raw, rawn);
+  for (i = 0; i < rawn; i++) raw[i] = 'a' + esl_rnd_Roll(rng, 3);
+  if (hmmd_compress_Pack(raw, rawn, &packed, &n, NULL) != eslOK) esl_fatal(msg);
+  if (packed[0] != HMMD_COMPRESS_LZ4)                             esl_fatal(msg);
+
+  /* every truncation is detected */
+  for (i = 0; i < n; i++)
+    {
+      if (hmmd_compress_Unpack(packed, i, &back, &backn) != eslECORRUPT) esl_fatal(msg);
+      if (back != NULL || backn != 0)                                    esl_fatal(msg);
+    }
+
+  /* unknown method */
+  packed[0] = 99;
+  if (hmmd_compress_Unpack(packed, n, &back, &backn) != eslECORRUPT) esl_fatal(msg);
+  packed[0] = HMMD_COMPRESS_LZ4;
+
+  /* random damage: may or may not be detected, but must be safe */
+  for (trial = 0; trial < 1000; trial++)
+    {
+      uint64_t pos = HMMD_COMPRESS_HDRSIZE + esl_rnd_Roll(rng, n - HMMD_COMPRESS_HDRSIZE);
+      uint8_t  old = packed[pos];
+      packed[pos]  = (uint8_t) esl_rnd_Roll(rng, 256);
+      if (hmmd_compress_Unpack(packed, n, &back, &backn) == eslOK) free(back);
+      packed[pos]  = old;
+    }
+
+  if (hmmd_compress_Unpack(packed, n, &back, &backn) != eslOK)  esl_fatal(msg);
+  if (backn != rawn || memcmp(raw, back, rawn) != 0)             esl_fatal(msg);
+
+  free(back);
+  free(packed);
+  free(raw);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7HMMD_COMPRESS_TESTDRIVE*/
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7HMMD_COMPRESS_TESTDRIVE
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",              0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for hmmpgmd message compression";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_Roundtrip(rng);
+  utest_Corrupt(rng);
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7HMMD_COMPRESS_TESTDRIVE*/
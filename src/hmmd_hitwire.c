@@ -0,0 +1,732 @@
+/* The v2 ("hitwire") format for returning hits from hmmpgmd to clients.
+ *
+ * The v1 format sends a serialized HMMD_SEARCH_STATS followed by
+ * each P7_HIT, P7_DOMAIN and P7_ALIDISPLAY converted field by field
+ * into network order, in a buffer that grows as it goes. For
+ * searches that return a million hits, that dominates the master's
+ * CPU time, and the client has to deserialize every hit back into
+ * allocated structures before it can look at any of them.
+ *
+ * A v2 block is written with one allocation, and a client can use it
+ * in place:
+ *
+ *    HMMD_HITWIRE_HEADER       search stats, counts, and offsets
+ *    HMMD_HITWIRE_HIT[nhits]   one fixed-size record per hit, sorted
+ *    HMMD_HITWIRE_DOM[ndom]    one fixed-size record per domain
+ *    char str[str_size]        string table: every name, accession,
+ *                              description, and alignment line,
+ *                              NUL-terminated; and scores_per_pos
+ *                              arrays, 4-byte aligned.
+ *
+ * Every field is little-endian, and every record is a multiple of 8
+ * bytes, so if the block is read into an 8-byte aligned buffer,
+ * records can be used directly as C structures. Strings are referred
+ * to by their offset in the string table; HMMD_HITWIRE_NOSTR means
+ * NULL.
+ *
+ * Version negotiation: a client asks for a v2 block with the search
+ * option "--wire 2". A server that doesn't know about v2 rejects the
+ * option with an error status, and the client can resend the query
+ * without it. A v2-capable server that isn't asked for v2 sends v1,
+ * so existing clients keep working. In both versions, the
+ * HMMD_SEARCH_STATUS is sent first in its v1 serialization, and its
+ * msg_size is the length of the v2 block.
+ *
+ * Contents:
+ *   1. Writing a v2 block.
+ *   2. Reading a v2 block in place.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include "p7_config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_ssi.h"		/* esl_byteswap() */
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+
+#ifdef WORDS_BIGENDIAN
+static void hitwire_swap_header(HMMD_HITWIRE_HEADER *hdr);
+static void hitwire_swap_hit   (HMMD_HITWIRE_HIT *hw);
+static void hitwire_swap_dom   (HMMD_HITWIRE_DOM *dw);
+#endif
+
+/*****************************************************************
+ * 1. Writing a v2 block.
+ *****************************************************************/
+
+/* how much string table space a string takes: 0 for NULL */
+#define HITWIRE_STRSIZE(s)  ((s) == NULL ? 0 : strlen(s) + 1)
+
+/* scores_per_pos arrays are aligned to 4 bytes within the string table */
+#define HITWIRE_ALIGN4(n)   (((n) + 3) & ~((uint64_t) 3))
+
+static uint64_t
+hitwire_domsize(const P7_DOMAIN *dom, uint64_t nstr)
+{
+  const P7_ALIDISPLAY *ad = dom->ad;
+
+  if (ad == NULL) return nstr;
+
+  if (ad->memsize) nstr += ad->memsize;
+  else {
+    nstr += HITWIRE_STRSIZE(ad->rfline) + HITWIRE_STRSIZE(ad->mmline) + HITWIRE_STRSIZE(ad->csline);
+    nstr += HITWIRE_STRSIZE(ad->model)  + HITWIRE_STRSIZE(ad->mline)  + HITWIRE_STRSIZE(ad->aseq);
+    nstr += HITWIRE_STRSIZE(ad->ntseq)  + HITWIRE_STRSIZE(ad->ppline);
+    nstr += HITWIRE_STRSIZE(ad->hmmname) + HITWIRE_STRSIZE(ad->hmmacc) + HITWIRE_STRSIZE(ad->hmmdesc);
+    nstr += HITWIRE_STRSIZE(ad->sqname)  + HITWIRE_STRSIZE(ad->sqacc)  + HITWIRE_STRSIZE(ad->sqdesc);
+  }
+  if (dom->scores_per_pos) nstr = HITWIRE_ALIGN4(nstr) + sizeof(float) * ad->N;
+  return nstr;
+}
+
+/* Copy string <s> to the string table at <*nstr>; return its offset. */
+static uint64_t
+hitwire_putstr(char *str, uint64_t *nstr, const char *s)
+{
+  uint64_t off = *nstr;
+  size_t   n;
+
+  if (s == NULL) return HMMD_HITWIRE_NOSTR;
+  n = strlen(s) + 1;
+  memcpy(str + off, s, n);
+  *nstr += n;
+  return off;
+}
+
+/* Alidisplay strings are either all in one <ad->mem> block, which
+ * we copy whole, or separately allocated.
+ */
+#define HITWIRE_ADSTR(field) (ad->memsize ? (ad->field ? base + (ad->field - ad->mem) : HMMD_HITWIRE_NOSTR) : hitwire_putstr(str, nstr, ad->field))
+
+static void
+hitwire_putdom(const P7_DOMAIN *dom, HMMD_HITWIRE_DOM *dw, char *str, uint64_t *nstr)
+{
+  const P7_ALIDISPLAY *ad   = dom->ad;
+  uint64_t             base = *nstr;
+
+  memset(dw, 0, sizeof(HMMD_HITWIRE_DOM)); /* no uninitialized padding goes out on the wire */
+  dw->ienv          = dom->ienv;
+  dw->jenv          = dom->jenv;
+  dw->iali          = dom->iali;
+  dw->jali          = dom->jali;
+  dw->iorf          = dom->iorf;
+  dw->jorf          = dom->jorf;
+  dw->lnP           = dom->lnP;
+  dw->envsc         = dom->envsc;
+  dw->domcorrection = dom->domcorrection;
+  dw->dombias       = dom->dombias;
+  dw->oasc          = dom->oasc;
+  dw->bitscore      = dom->bitscore;
+  dw->is_reported   = dom->is_reported;
+  dw->is_included   = dom->is_included;
+  dw->spp           = HMMD_HITWIRE_NOSTR;
+
+  if (ad == NULL) {
+    dw->rfline = dw->mmline  = dw->csline = dw->model  = dw->mline = dw->aseq  = dw->ntseq = dw->ppline = HMMD_HITWIRE_NOSTR;
+    dw->hmmname = dw->hmmacc = dw->hmmdesc = dw->sqname = dw->sqacc = dw->sqdesc = HMMD_HITWIRE_NOSTR;
+    return;
+  }
+
+  dw->flags   = HMMD_HITWIRE_HAS_AD;
+  dw->N       = ad->N;
+  dw->hmmfrom = ad->hmmfrom;
+  dw->hmmto   = ad->hmmto;
+  dw->M       = ad->M;
+  dw->sqfrom  = ad->sqfrom;
+  dw->sqto    = ad->sqto;
+  dw->L       = ad->L;
+
+  if (ad->memsize) {
+    memcpy(str + base, ad->mem, ad->memsize);
+    *nstr += ad->memsize;
+  }
+  dw->rfline  = HITWIRE_ADSTR(rfline);
+  dw->mmline  = HITWIRE_ADSTR(mmline);
+  dw->csline  = HITWIRE_ADSTR(csline);
+  dw->model   = HITWIRE_ADSTR(model);
+  dw->mline   = HITWIRE_ADSTR(mline);
+  dw->aseq    = HITWIRE_ADSTR(aseq);
+  dw->ntseq   = HITWIRE_ADSTR(ntseq);
+  dw->ppline  = HITWIRE_ADSTR(ppline);
+  dw->hmmname = HITWIRE_ADSTR(hmmname);
+  dw->hmmacc  = HITWIRE_ADSTR(hmmacc);
+  dw->hmmdesc = HITWIRE_ADSTR(hmmdesc);
+  dw->sqname  = HITWIRE_ADSTR(sqname);
+  dw->sqacc   = HITWIRE_ADSTR(sqacc);
+  dw->sqdesc  = HITWIRE_ADSTR(sqdesc);
+
+  if (dom->scores_per_pos) {
+    *nstr   = HITWIRE_ALIGN4(*nstr);
+    dw->spp = *nstr;
+    memcpy(str + *nstr, dom->scores_per_pos, sizeof(float) * ad->N);
+#ifdef WORDS_BIGENDIAN
+    { int i; for (i = 0; i < ad->N; i++) esl_byteswap(str + *nstr + sizeof(float) * i, sizeof(float)); }
+#endif
+    *nstr  += sizeof(float) * ad->N;
+  }
+}
+
+
+/* Function:  hmmd_hitwire_Write()
+ * Synopsis:  Write search stats and hits as one v2 block.
+ *
+ * Purpose:   Lay out the search statistics in <stats> and the
+ *            <stats->nhits> hits in <hit[]> (in the order they are
+ *            to be reported) as a v2 hit block. Sizes are computed in
+ *            a first pass, so the block is allocated exactly once;
+ *            the second pass fills it.
+ *
+ *            <stats->hit_offsets> isn't used; v2 records are fixed
+ *            size, so hit <i> is simply record <i>.
+ *
+ * Returns:   <eslOK> on success. <*ret_buf> is the newly allocated
+ *            block, which the caller frees, and <*ret_n> is its
+ *            length in bytes.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <eslFAIL> if the
+ *            two passes disagree about the block's size (a bug). In
+ *            either case <*ret_buf> is NULL and <*ret_n> is 0.
+ */
+int
+hmmd_hitwire_Write(const HMMD_SEARCH_STATS *stats, P7_HIT **hit, uint8_t **ret_buf, uint64_t *ret_n)
+{
+  HMMD_HITWIRE_HEADER *hdr;
+  HMMD_HITWIRE_HIT    *hw;
+  HMMD_HITWIRE_DOM    *dw;
+  uint8_t             *buf  = NULL;
+  char                *str;
+  uint64_t             ndom = 0;
+  uint64_t             nstr = 0;
+  uint64_t             size;
+  uint64_t             h;
+  int                  d;
+  int                  status;
+
+  /* Pass 1: count domains and size the string table */
+  for (h = 0; h < stats->nhits; h++)
+    {
+      ndom += hit[h]->ndom;
+      nstr += HITWIRE_STRSIZE(hit[h]->name) + HITWIRE_STRSIZE(hit[h]->acc) + HITWIRE_STRSIZE(hit[h]->desc);
+      for (d = 0; d < hit[h]->ndom; d++)
+        nstr = hitwire_domsize(&(hit[h]->dcl[d]), nstr);
+    }
+  nstr += 1;			/* a trailing NUL guarantees that any offset into the table hits a terminator */
+
+  size = sizeof(HMMD_HITWIRE_HEADER) + sizeof(HMMD_HITWIRE_HIT) * stats->nhits + sizeof(HMMD_HITWIRE_DOM) * ndom + nstr;
+  ESL_ALLOC(buf, size);
+
+  hdr = (HMMD_HITWIRE_HEADER *) buf;
+  hw  = (HMMD_HITWIRE_HIT *)    (buf + sizeof(HMMD_HITWIRE_HEADER));
+  dw  = (HMMD_HITWIRE_DOM *)    (buf + sizeof(HMMD_HITWIRE_HEADER) + sizeof(HMMD_HITWIRE_HIT) * stats->nhits);
+  str = (char *)                (buf + sizeof(HMMD_HITWIRE_HEADER) + sizeof(HMMD_HITWIRE_HIT) * stats->nhits + sizeof(HMMD_HITWIRE_DOM) * ndom);
+
+  memset(hdr, 0, sizeof(HMMD_HITWIRE_HEADER));
+  memcpy(hdr->magic, HMMD_HITWIRE_MAGIC, 4);
+  hdr->version     = HMMD_HITWIRE_VERSION;
+  hdr->hit_size    = sizeof(HMMD_HITWIRE_HIT);
+  hdr->dom_size    = sizeof(HMMD_HITWIRE_DOM);
+  hdr->elapsed     = stats->elapsed;
+  hdr->user        = stats->user;
+  hdr->sys         = stats->sys;
+  hdr->Z           = stats->Z;
+  hdr->domZ        = stats->domZ;
+  hdr->Z_setby     = stats->Z_setby;
+  hdr->domZ_setby  = stats->domZ_setby;
+  hdr->nmodels     = stats->nmodels;
+  hdr->nseqs       = stats->nseqs;
+  hdr->n_past_msv  = stats->n_past_msv;
+  hdr->n_past_bias = stats->n_past_bias;
+  hdr->n_past_vit  = stats->n_past_vit;
+  hdr->n_past_fwd  = stats->n_past_fwd;
+  hdr->nhits       = stats->nhits;
+  hdr->nreported   = stats->nreported;
+  hdr->nincluded   = stats->nincluded;
+  hdr->ndomains    = ndom;
+  hdr->dom_offset  = (uint8_t *) dw  - buf;
+  hdr->str_offset  = (uint8_t *) str - buf;
+  hdr->str_size    = nstr;
+
+  /* Pass 2: fill the records and the string table */
+  nstr = 0;
+  ndom = 0;
+  for (h = 0; h < stats->nhits; h++, hw++)
+    {
+      memset(hw, 0, sizeof(HMMD_HITWIRE_HIT));
+      hw->sortkey       = hit[h]->sortkey;
+      hw->lnP           = hit[h]->lnP;
+      hw->pre_lnP       = hit[h]->pre_lnP;
+      hw->sum_lnP       = hit[h]->sum_lnP;
+      hw->score         = hit[h]->score;
+      hw->pre_score     = hit[h]->pre_score;
+      hw->sum_score     = hit[h]->sum_score;
+      hw->nexpected     = hit[h]->nexpected;
+      hw->window_length = hit[h]->window_length;
+      hw->nregions      = hit[h]->nregions;
+      hw->nclustered    = hit[h]->nclustered;
+      hw->noverlaps     = hit[h]->noverlaps;
+      hw->nenvelopes    = hit[h]->nenvelopes;
+      hw->ndom          = hit[h]->ndom;
+      hw->nreported     = hit[h]->nreported;
+      hw->nincluded     = hit[h]->nincluded;
+      hw->best_domain   = hit[h]->best_domain;
+      hw->flags         = hit[h]->flags;
+      hw->seqidx        = hit[h]->seqidx;
+      hw->subseq_start  = hit[h]->subseq_start;
+      hw->name          = hitwire_putstr(str, &nstr, hit[h]->name);
+      hw->acc           = hitwire_putstr(str, &nstr, hit[h]->acc);
+      hw->desc          = hitwire_putstr(str, &nstr, hit[h]->desc);
+      hw->dom           = ndom;
+
+      for (d = 0; d < hit[h]->ndom; d++, ndom++)
+        {
+          hitwire_putdom(&(hit[h]->dcl[d]), &(dw[ndom]), str, &nstr);
+#ifdef WORDS_BIGENDIAN
+          hitwire_swap_dom(&(dw[ndom]));
+#endif
+        }
+#ifdef WORDS_BIGENDIAN
+      hitwire_swap_hit(hw);
+#endif
+    }
+  str[nstr++] = '\0';
+
+  if (nstr != hdr->str_size) ESL_XEXCEPTION(eslFAIL, "hmmd_hitwire_Write(): string table size mismatch");
+#ifdef WORDS_BIGENDIAN
+  hitwire_swap_header(hdr);
+#endif
+
+  *ret_buf = buf;
+  *ret_n   = size;
+  return eslOK;
+
+ ERROR:
+  if (buf) free(buf);
+  *ret_buf = NULL;
+  *ret_n   = 0;
+  return status;
+}
+
+
+/*****************************************************************
+ * 2. Reading a v2 block in place.
+ *****************************************************************/
+
+/* Function:  hmmd_hitwire_Open()
+ * Synopsis:  Validate a v2 block and set pointers into it.
+ *
+ * Purpose:   Check that the <n> bytes in <buf> are a well-formed v2
+ *            hit block, and set <hw->hdr>, <hw->hit>, <hw->dom>, and
+ *            <hw->str> to point to its header, hit records, domain
+ *            records, and string table. Nothing is copied: <buf>
+ *            must stay allocated while <hw> is in use, and the caller
+ *            still owns it. Use <hmmd_hitwire_Str()> to turn a
+ *            string offset into a <char *>.
+ *
+ *            Every string offset and domain index is checked against
+ *            the block's bounds, so a client can follow them without
+ *            further checking.
+ *
+ *            On big-endian hosts, the block is byte-swapped in place
+ *            to host order; so call <hmmd_hitwire_Open()> only once
+ *            on a given buffer.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <buf> isn't 8-byte aligned.
+ *            <eslEFORMAT> if <buf> isn't a v2 block or is corrupt;
+ *            <eslEINCOMPAT> if it's a different version of the
+ *            block. In all error cases, <hw>'s pointers are NULL.
+ */
+int
+hmmd_hitwire_Open(uint8_t *buf, uint64_t n, HMMD_HITWIRE *hw)
+{
+  HMMD_HITWIRE_HEADER  hdr;	/* host-order copy of the header, checked before <buf> is touched */
+  uint64_t             h;
+  uint64_t             d;
+  int                  status;
+
+  hw->hdr = NULL;
+  hw->hit = NULL;
+  hw->dom = NULL;
+  hw->str = NULL;
+
+  if (buf == NULL || ((uintptr_t) buf) % 8 != 0)       { status = eslEINVAL;  goto ERROR; }
+  if (n < sizeof(HMMD_HITWIRE_HEADER))                  { status = eslEFORMAT; goto ERROR; }
+  memcpy(&hdr, buf, sizeof(HMMD_HITWIRE_HEADER));
+  if (memcmp(hdr.magic, HMMD_HITWIRE_MAGIC, 4) != 0)    { status = eslEFORMAT; goto ERROR; }
+#ifdef WORDS_BIGENDIAN
+  hitwire_swap_header(&hdr);
+#endif
+  if (hdr.version  != HMMD_HITWIRE_VERSION)            { status = eslEINCOMPAT; goto ERROR; }
+  if (hdr.hit_size != sizeof(HMMD_HITWIRE_HIT) ||
+      hdr.dom_size != sizeof(HMMD_HITWIRE_DOM))        { status = eslEINCOMPAT; goto ERROR; }
+
+  /* section bounds. Dividing rather than multiplying keeps a corrupt count from overflowing. */
+  if (hdr.dom_offset < sizeof(HMMD_HITWIRE_HEADER)                                     ||
+      (hdr.dom_offset - sizeof(HMMD_HITWIRE_HEADER)) / sizeof(HMMD_HITWIRE_HIT) != hdr.nhits ||
+      (hdr.dom_offset - sizeof(HMMD_HITWIRE_HEADER)) % sizeof(HMMD_HITWIRE_HIT) != 0   ||
+      hdr.str_offset < hdr.dom_offset                                                 ||
+      (hdr.str_offset - hdr.dom_offset) / sizeof(HMMD_HITWIRE_DOM) != hdr.ndomains   ||
+      (hdr.str_offset - hdr.dom_offset) % sizeof(HMMD_HITWIRE_DOM) != 0               ||
+      hdr.str_offset > n || hdr.str_size != n - hdr.str_offset                        ||
+      hdr.str_size == 0  || buf[n-1] != '\0')
+    { status = eslEFORMAT; goto ERROR; }
+
+#ifdef WORDS_BIGENDIAN
+  memcpy(buf, &hdr, sizeof(HMMD_HITWIRE_HEADER));
+#endif
+  hw->hdr = (HMMD_HITWIRE_HEADER *) buf;
+  hw->hit = (HMMD_HITWIRE_HIT *) (buf + sizeof(HMMD_HITWIRE_HEADER));
+  hw->dom = (HMMD_HITWIRE_DOM *) (buf + hdr.dom_offset);
+  hw->str = (char *)             (buf + hdr.str_offset);
+
+#define HITWIRE_BADSTR(off) ((off) != HMMD_HITWIRE_NOSTR && (off) >= hdr.str_size)
+
+  for (h = 0; h < hdr.nhits; h++)
+    {
+#ifdef WORDS_BIGENDIAN
+      hitwire_swap_hit(&(hw->hit[h]));
+#endif
+      if (HITWIRE_BADSTR(hw->hit[h].name) || hw->hit[h].name == HMMD_HITWIRE_NOSTR ||
+          HITWIRE_BADSTR(hw->hit[h].acc)  || HITWIRE_BADSTR(hw->hit[h].desc))          { status = eslEFORMAT; goto ERROR; }
+      if (hw->hit[h].ndom < 0 || hw->hit[h].dom > hdr.ndomains ||
+          (uint64_t) hw->hit[h].ndom > hdr.ndomains - hw->hit[h].dom)                  { status = eslEFORMAT; goto ERROR; }
+    }
+
+  for (d = 0; d < hdr.ndomains; d++)
+    {
+      HMMD_HITWIRE_DOM *dw = &(hw->dom[d]);
+#ifdef WORDS_BIGENDIAN
+      hitwire_swap_dom(dw);
+#endif
+      if (HITWIRE_BADSTR(dw->rfline)  || HITWIRE_BADSTR(dw->mmline) || HITWIRE_BADSTR(dw->csline) ||
+          HITWIRE_BADSTR(dw->model)   || HITWIRE_BADSTR(dw->mline)  || HITWIRE_BADSTR(dw->aseq)   ||
+          HITWIRE_BADSTR(dw->ntseq)   || HITWIRE_BADSTR(dw->ppline) ||
+          HITWIRE_BADSTR(dw->hmmname) || HITWIRE_BADSTR(dw->hmmacc) || HITWIRE_BADSTR(dw->hmmdesc) ||
+          HITWIRE_BADSTR(dw->sqname)  || HITWIRE_BADSTR(dw->sqacc)  || HITWIRE_BADSTR(dw->sqdesc))  { status = eslEFORMAT; goto ERROR; }
+      if (dw->spp != HMMD_HITWIRE_NOSTR)
+        {
+          if (dw->N < 0 || dw->spp % 4 != 0 || dw->spp > hdr.str_size ||
+              (uint64_t) dw->N > (hdr.str_size - dw->spp) / sizeof(float))              { status = eslEFORMAT; goto ERROR; }
+#ifdef WORDS_BIGENDIAN
+          { int i; for (i = 0; i < dw->N; i++) esl_byteswap(hw->str + dw->spp + sizeof(float) * i, sizeof(float)); }
+#endif
+        }
+    }
+  return eslOK;
+
+ ERROR:
+  hw->hdr = NULL;
+  hw->hit = NULL;
+  hw->dom = NULL;
+  hw->str = NULL;
+  return status;
+}
+
+
+/* Function:  hmmd_hitwire_GetStats()
+ * Synopsis:  Copy search statistics out of an open v2 block.
+ *
+ * Purpose:   Fill in <stats> from the header of the open v2 block
+ *            <hw>, for clients that want a <HMMD_SEARCH_STATS> to
+ *            pass along to v1 code. <stats->hit_offsets> is set to
+ *            NULL.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+hmmd_hitwire_GetStats(const HMMD_HITWIRE *hw, HMMD_SEARCH_STATS *stats)
+{
+  stats->elapsed     = hw->hdr->elapsed;
+  stats->user        = hw->hdr->user;
+  stats->sys         = hw->hdr->sys;
+  stats->Z           = hw->hdr->Z;
+  stats->domZ        = hw->hdr->domZ;
+  stats->Z_setby     = (enum p7_zsetby_e) hw->hdr->Z_setby;
+  stats->domZ_setby  = (enum p7_zsetby_e) hw->hdr->domZ_setby;
+  stats->nmodels     = hw->hdr->nmodels;
+  stats->nseqs       = hw->hdr->nseqs;
+  stats->n_past_msv  = hw->hdr->n_past_msv;
+  stats->n_past_bias = hw->hdr->n_past_bias;
+  stats->n_past_vit  = hw->hdr->n_past_vit;
+  stats->n_past_fwd  = hw->hdr->n_past_fwd;
+  stats->nhits       = hw->hdr->nhits;
+  stats->nreported   = hw->hdr->nreported;
+  stats->nincluded   = hw->hdr->nincluded;
+  stats->hit_offsets = NULL;
+  return eslOK;
+}
+
+
+#ifdef WORDS_BIGENDIAN
+/* Byte-swapping between little-endian wire order and big-endian
+ * host order. Each is its own inverse.
+ */
+#define HITWIRE_SWAP(x) esl_byteswap((char *) &(x), sizeof(x))
+
+static void
+hitwire_swap_header(HMMD_HITWIRE_HEADER *hdr)
+{
+  HITWIRE_SWAP(hdr->version);     HITWIRE_SWAP(hdr->hit_size);    HITWIRE_SWAP(hdr->dom_size);
+  HITWIRE_SWAP(hdr->elapsed);     HITWIRE_SWAP(hdr->user);        HITWIRE_SWAP(hdr->sys);
+  HITWIRE_SWAP(hdr->Z);           HITWIRE_SWAP(hdr->domZ);
+  HITWIRE_SWAP(hdr->Z_setby);     HITWIRE_SWAP(hdr->domZ_setby);
+  HITWIRE_SWAP(hdr->nmodels);     HITWIRE_SWAP(hdr->nseqs);
+  HITWIRE_SWAP(hdr->n_past_msv);  HITWIRE_SWAP(hdr->n_past_bias); HITWIRE_SWAP(hdr->n_past_vit); HITWIRE_SWAP(hdr->n_past_fwd);
+  HITWIRE_SWAP(hdr->nhits);       HITWIRE_SWAP(hdr->nreported);   HITWIRE_SWAP(hdr->nincluded);
+  HITWIRE_SWAP(hdr->ndomains);    HITWIRE_SWAP(hdr->dom_offset);  HITWIRE_SWAP(hdr->str_offset); HITWIRE_SWAP(hdr->str_size);
+}
+
+static void
+hitwire_swap_hit(HMMD_HITWIRE_HIT *hw)
+{
+  HITWIRE_SWAP(hw->sortkey);       HITWIRE_SWAP(hw->lnP);         HITWIRE_SWAP(hw->pre_lnP);    HITWIRE_SWAP(hw->sum_lnP);
+  HITWIRE_SWAP(hw->score);         HITWIRE_SWAP(hw->pre_score);   HITWIRE_SWAP(hw->sum_score);  HITWIRE_SWAP(hw->nexpected);
+  HITWIRE_SWAP(hw->window_length); HITWIRE_SWAP(hw->nregions);    HITWIRE_SWAP(hw->nclustered); HITWIRE_SWAP(hw->noverlaps);
+  HITWIRE_SWAP(hw->nenvelopes);    HITWIRE_SWAP(hw->ndom);        HITWIRE_SWAP(hw->nreported);  HITWIRE_SWAP(hw->nincluded);
+  HITWIRE_SWAP(hw->best_domain);   HITWIRE_SWAP(hw->flags);
+  HITWIRE_SWAP(hw->seqidx);        HITWIRE_SWAP(hw->subseq_start);
+  HITWIRE_SWAP(hw->name);          HITWIRE_SWAP(hw->acc);         HITWIRE_SWAP(hw->desc);       HITWIRE_SWAP(hw->dom);
+}
+
+static void
+hitwire_swap_dom(HMMD_HITWIRE_DOM *dw)
+{
+  HITWIRE_SWAP(dw->ienv);    HITWIRE_SWAP(dw->jenv);    HITWIRE_SWAP(dw->iali);  HITWIRE_SWAP(dw->jali);
+  HITWIRE_SWAP(dw->iorf);    HITWIRE_SWAP(dw->jorf);    HITWIRE_SWAP(dw->lnP);
+  HITWIRE_SWAP(dw->envsc);   HITWIRE_SWAP(dw->domcorrection); HITWIRE_SWAP(dw->dombias);
+  HITWIRE_SWAP(dw->oasc);    HITWIRE_SWAP(dw->bitscore);
+  HITWIRE_SWAP(dw->is_reported); HITWIRE_SWAP(dw->is_included);
+  HITWIRE_SWAP(dw->N);       HITWIRE_SWAP(dw->hmmfrom); HITWIRE_SWAP(dw->hmmto); HITWIRE_SWAP(dw->M);   HITWIRE_SWAP(dw->flags);
+  HITWIRE_SWAP(dw->sqfrom);  HITWIRE_SWAP(dw->sqto);    HITWIRE_SWAP(dw->L);
+  HITWIRE_SWAP(dw->rfline);  HITWIRE_SWAP(dw->mmline);  HITWIRE_SWAP(dw->csline); HITWIRE_SWAP(dw->model);
+  HITWIRE_SWAP(dw->mline);   HITWIRE_SWAP(dw->aseq);    HITWIRE_SWAP(dw->ntseq);  HITWIRE_SWAP(dw->ppline);
+  HITWIRE_SWAP(dw->hmmname); HITWIRE_SWAP(dw->hmmacc);  HITWIRE_SWAP(dw->hmmdesc);
+  HITWIRE_SWAP(dw->sqname);  HITWIRE_SWAP(dw->sqacc);   HITWIRE_SWAP(dw->sqdesc);
+  HITWIRE_SWAP(dw->spp);
+}
+#endif /*WORDS_BIGENDIAN*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7HMMD_HITWIRE_TESTDRIVE
+
+static int
+hitwire_strsame(const HMMD_HITWIRE *hw, uint64_t off, const char *s)
+{
+  const char *w = hmmd_hitwire_Str(hw, off);
+
+  if (s == NULL || w == NULL) return (s == w) ? TRUE : FALSE;
+  return (strcmp(s, w) == 0) ? TRUE : FALSE;
+}
+
+/* Check that v2 record <hw->hit[h]> exactly reproduces <hit>. Values
+ * are copied, not converted, so equality is exact.
+ */
+static int
+hitwire_hit_Same(const HMMD_HITWIRE *hw, uint64_t h, const P7_HIT *hit)
+{
+  const HMMD_HITWIRE_HIT *w = &(hw->hit[h]);
+  int d, i;
+
+  if (w->sortkey   != hit->sortkey   || w->lnP       != hit->lnP       || w->pre_lnP != hit->pre_lnP || w->sum_lnP != hit->sum_lnP) return FALSE;
+  if (w->score     != hit->score     || w->pre_score != hit->pre_score || w->sum_score != hit->sum_score || w->nexpected != hit->nexpected) return FALSE;
+  if (w->window_length != hit->window_length || w->nregions  != hit->nregions  || w->nclustered != hit->nclustered ||
+      w->noverlaps     != hit->noverlaps     || w->nenvelopes != hit->nenvelopes || w->ndom      != hit->ndom     ||
+      w->nreported     != hit->nreported     || w->nincluded  != hit->nincluded  || w->best_domain != hit->best_domain ||
+      w->flags         != hit->flags         || w->seqidx     != hit->seqidx     || w->subseq_start != hit->subseq_start) return FALSE;
+  if (! hitwire_strsame(hw, w->name, hit->name) || ! hitwire_strsame(hw, w->acc, hit->acc) || ! hitwire_strsame(hw, w->desc, hit->desc)) return FALSE;
+
+  for (d = 0; d < hit->ndom; d++)
+    {
+      const HMMD_HITWIRE_DOM *dw  = &(hw->dom[w->dom + d]);
+      const P7_DOMAIN        *dom = &(hit->dcl[d]);
+      const P7_ALIDISPLAY    *ad  = dom->ad;
+
+      if (dw->ienv != dom->ienv || dw->jenv != dom->jenv || dw->iali != dom->iali || dw->jali != dom->jali ||
+          dw->iorf != dom->iorf || dw->jorf != dom->jorf || dw->lnP  != dom->lnP) return FALSE;
+      if (dw->envsc != dom->envsc || dw->domcorrection != dom->domcorrection || dw->dombias != dom->dombias ||
+          dw->oasc  != dom->oasc  || dw->bitscore      != dom->bitscore) return FALSE;
+      if (dw->is_reported != dom->is_reported || dw->is_included != dom->is_included) return FALSE;
+
+      if (ad == NULL) { if (dw->flags & HMMD_HITWIRE_HAS_AD) return FALSE; continue; }
+      if (! (dw->flags & HMMD_HITWIRE_HAS_AD)) return FALSE;
+      if (dw->N != ad->N || dw->hmmfrom != ad->hmmfrom || dw->hmmto != ad->hmmto || dw->M != ad->M ||
+          dw->sqfrom != ad->sqfrom || dw->sqto != ad->sqto || dw->L != ad->L) return FALSE;
+      if (! hitwire_strsame(hw, dw->rfline,  ad->rfline)  || ! hitwire_strsame(hw, dw->mmline, ad->mmline) ||
+          ! hitwire_strsame(hw, dw->csline,  ad->csline)  || ! hitwire_strsame(hw, dw->model,  ad->model)  ||
+          ! hitwire_strsame(hw, dw->mline,   ad->mline)   || ! hitwire_strsame(hw, dw->aseq,   ad->aseq)   ||
+          ! hitwire_strsame(hw, dw->ntseq,   ad->ntseq)   || ! hitwire_strsame(hw, dw->ppline, ad->ppline) ||
+          ! hitwire_strsame(hw, dw->hmmname, ad->hmmname) || ! hitwire_strsame(hw, dw->hmmacc, ad->hmmacc) ||
+          ! hitwire_strsame(hw, dw->hmmdesc, ad->hmmdesc) || ! hitwire_strsame(hw, dw->sqname, ad->sqname) ||
+          ! hitwire_strsame(hw, dw->sqacc,   ad->sqacc)   || ! hitwire_strsame(hw, dw->sqdesc, ad->sqdesc)) return FALSE;
+
+      if (dom->scores_per_pos == NULL) { if (dw->spp != HMMD_HITWIRE_NOSTR) return FALSE; continue; }
+      if (dw->spp == HMMD_HITWIRE_NOSTR) return FALSE;
+      for (i = 0; i < ad->N; i++)
+        if (((const float *) (hw->str + dw->spp))[i] != dom->scores_per_pos[i]) return FALSE;
+    }
+  return TRUE;
+}
+
+/* utest_WriteOpen()
+ * Sample hits, write them as a v2 block, open it, and check that
+ * every record and string reads back in place. Half of the sampled
+ * alidisplays are packed into one <ad->mem> block first, to exercise
+ * both of the ways hmmd_hitwire_Write() copies alignment strings.
+ */
+static void
+utest_WriteOpen(ESL_RAND64 *rng, int nhits)
+{
+  char               msg[] = "hmmd_hitwire WriteOpen unit test failed";
+  P7_HIT           **hit   = NULL;
+  HMMD_SEARCH_STATS  stats;
+  HMMD_SEARCH_STATS  stats2;
+  HMMD_HITWIRE       hw;
+  uint8_t           *buf   = NULL;
+  uint64_t           n;
+  int                h, d;
+  int                status;
+
+  ESL_ALLOC(hit, sizeof(P7_HIT *) * nhits);
+  for (h = 0; h < nhits; h++)
+    {
+      hit[h] = NULL;
+      if (p7_hit_TestSample(rng, &(hit[h])) != eslOK) esl_fatal(msg);
+      if (h % 2)
+        for (d = 0; d < hit[h]->ndom; d++)
+          if (hit[h]->dcl[d].ad && p7_alidisplay_Serialize_old(hit[h]->dcl[d].ad) != eslOK) esl_fatal(msg);
+    }
+
+  memset(&stats, 0, sizeof(HMMD_SEARCH_STATS));
+  stats.elapsed     = esl_rand64_double(rng);
+  stats.Z           = esl_rand64_double(rng);
+  stats.domZ        = esl_rand64_double(rng);
+  stats.Z_setby     = p7_ZSETBY_OPTION;
+  stats.domZ_setby  = p7_ZSETBY_NTARGETS;
+  stats.nseqs       = esl_rand64(rng);
+  stats.n_past_fwd  = esl_rand64(rng);
+  stats.nhits       = nhits;
+  stats.nreported   = nhits / 2;
+  stats.nincluded   = nhits / 3;
+  stats.hit_offsets = NULL;
+
+  if (hmmd_hitwire_Write(&stats, hit, &buf, &n)  != eslOK) esl_fatal(msg);
+  if (hmmd_hitwire_Open(buf, n, &hw)             != eslOK) esl_fatal(msg);
+  if (hw.hdr->nhits != nhits)                              esl_fatal(msg);
+
+  if (hmmd_hitwire_GetStats(&hw, &stats2) != eslOK)        esl_fatal(msg);
+  if (stats2.elapsed    != stats.elapsed    || stats2.Z          != stats.Z          || stats2.domZ      != stats.domZ      ||
+      stats2.Z_setby    != stats.Z_setby    || stats2.domZ_setby != stats.domZ_setby || stats2.nseqs     != stats.nseqs     ||
+      stats2.n_past_fwd != stats.n_past_fwd || stats2.nhits      != stats.nhits      || stats2.nreported != stats.nreported ||
+      stats2.nincluded  != stats.nincluded)                esl_fatal(msg);
+
+  for (h = 0; h < nhits; h++)
+    if (! hitwire_hit_Same(&hw, h, hit[h])) esl_fatal(msg);
+
+  free(buf);
+  for (h = 0; h < nhits; h++) p7_hit_Destroy(hit[h]);
+  free(hit);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_Corrupt()
+ * hmmd_hitwire_Open() rejects blocks that aren't v2, are truncated,
+ * or have an out-of-bounds string offset.
+ */
+static void
+utest_Corrupt(ESL_RAND64 *rng)
+{
+  char               msg[] = "hmmd_hitwire Corrupt unit test failed";
+  P7_HIT            *hit   = NULL;
+  HMMD_SEARCH_STATS  stats;
+  HMMD_HITWIRE       hw;
+  HMMD_HITWIRE_HIT  *w;
+  uint8_t           *buf   = NULL;
+  uint64_t           n;
+  uint64_t           name;
+  uint32_t           version;
+
+  if (p7_hit_TestSample(rng, &hit) != eslOK) esl_fatal(msg);
+  memset(&stats, 0, sizeof(HMMD_SEARCH_STATS));
+  stats.nhits = 1;
+
+  if (hmmd_hitwire_Write(&stats, &hit, &buf, &n)  != eslOK)        esl_fatal(msg);
+
+  /* a truncated block */
+  if (hmmd_hitwire_Open(buf, n-1, &hw)             != eslEFORMAT)   esl_fatal(msg);
+  if (hw.hdr != NULL)                                               esl_fatal(msg);
+
+  /* a v1 block, or anything else, has the wrong magic */
+  buf[0] = 'X';
+  if (hmmd_hitwire_Open(buf, n, &hw)               != eslEFORMAT)   esl_fatal(msg);
+  memcpy(buf, HMMD_HITWIRE_MAGIC, 4);
+
+  /* a different version. (Mutations here are chosen to be wrong in either byte order.) */
+  version = ((HMMD_HITWIRE_HEADER *) buf)->version;
+  ((HMMD_HITWIRE_HEADER *) buf)->version = ~version;
+  if (hmmd_hitwire_Open(buf, n, &hw)               != eslEINCOMPAT) esl_fatal(msg);
+  ((HMMD_HITWIRE_HEADER *) buf)->version = version;
+
+  /* a string offset past the end of the string table */
+  w    = (HMMD_HITWIRE_HIT *) (buf + sizeof(HMMD_HITWIRE_HEADER));
+  name = w->name;
+  w->name = HMMD_HITWIRE_NOSTR - 1;
+  if (hmmd_hitwire_Open(buf, n, &hw)               != eslEFORMAT)   esl_fatal(msg);
+  w->name = name;
+
+  if (hmmd_hitwire_Open(buf, n, &hw)               != eslOK)        esl_fatal(msg);
+
+  free(buf);
+  p7_hit_Destroy(hit);
+}
+#endif /*p7HMMD_HITWIRE_TESTDRIVE*/
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7HMMD_HITWIRE_TESTDRIVE
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",              0 },
+  { "-s",        eslARG_INT,      "0", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                     0 },
+  { "-N",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "number of hits to sample",                          0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for the v2 hmmpgmd hit format";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RAND64  *rng = esl_rand64_Create(esl_opt_GetInteger(go, "-s"));
+  int          N   = esl_opt_GetInteger(go, "-N");
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  utest_WriteOpen(rng, N);
+  utest_WriteOpen(rng, 0);
+  utest_Corrupt(rng);
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_rand64_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7HMMD_HITWIRE_TESTDRIVE*/
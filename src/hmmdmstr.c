@@ -58,6 +58,7 @@ typedef struct {
 typedef struct {
   int             sock_fd;
   char            ip_addr[64];
+  int             compress;     /* TRUE once the client has sent "!compress" */
 
   ESL_STACK      *cmdstack;	/* stack of commands that clients want done */
 } CLIENTSIDE_ARGS;
@@ -86,6 +87,7 @@ typedef struct {
 
   RANGE_LIST       *range_list;  /* (optional) list of ranges searched within the seqdb */
 
+  int              compress;     /* TRUE to offer compressed results to workers (--wcompress) */
   int              completed;
 } WORKERSIDE_ARGS;
 
@@ -96,6 +98,7 @@ typedef struct worker_s {
   int                   completed;
   int                   terminated;
   HMMD_COMMAND         *cmd;
+  int                   compress;    /* TRUE if this worker sends packed results */
 
   uint32_t              srch_inx;
   uint32_t              srch_cnt;
@@ -578,6 +581,7 @@ master_process(ESL_GETOPTS *go)
   worker_comm.seq_db     = seq_db;
   worker_comm.hmm_db     = hmm_db;
   worker_comm.db_version = 1;
+  worker_comm.compress   = esl_opt_GetBoolean(go, "--wcompress");
 
   worker_comm.ready      = 0;
   worker_comm.failed     = 0;
@@ -779,6 +783,12 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   int fd, n;
   uint8_t **buf, **buf2, **buf3, *buf_ptr, *buf2_ptr, *buf3_ptr;
   uint32_t nalloc, nalloc2, nalloc3, buf_offset, buf_offset2, buf_offset3;
+  uint8_t            *wire  = NULL;
+  uint64_t            nwire;
+  uint8_t            *packed = NULL;
+  uint64_t            npacked;
+  double              secs;
+  int                 wire_version = esl_opt_GetInteger(query->opts, "--wire");
   enum p7_pipemodes_e mode;
 
   // Initialize these pointers-to-pointers that we'll use for sending data
@@ -796,10 +806,11 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     
   /* sort the hits and apply score and E-value thresholds */
   if (results->nhits > 0) {
-    if(results->stats.hit_offsets != NULL){
+    // v2 records are fixed-size, so only v1 needs the hit_offsets array
+    if(wire_version != HMMD_HITWIRE_VERSION && results->stats.hit_offsets != NULL){
       if ((results->stats.hit_offsets = realloc(results->stats.hit_offsets, results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
-    else{
+    else if(wire_version != HMMD_HITWIRE_VERSION){
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
@@ -839,6 +850,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     results->stats.Z         = pli->Z;
   }
 
+  /* A client that asked for "--wire 2" gets the status, then one v2 hit block
+     that it can read in place (see hmmd_hitwire.c). */
+  if (wire_version == HMMD_HITWIRE_VERSION) {
+    if (hmmd_hitwire_Write(&(results->stats), results->hits, &wire, &nwire) != eslOK){
+      LOG_FATAL_MSG("Writing v2 hit block failed", errno);
+    }
+    goto SEND_WIRE;
+  }
+
   /* Build the buffers of serialized results we'll send back to the client.  
      Use three buffers, one for each object, because we need to build them in reverse order.
      We need to serialize the hits to build the hits_offset array in HMMD_SEARCH_STATS.
@@ -870,6 +890,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   }
 
   results->status.msg_size = buf_offset + buf_offset2; // set size of second message
+
+  // A client that sent "!compress" gets stats and hits as one packed block
+  if (query->compress) {
+    nwire = buf_offset2 + buf_offset;
+    if ((wire = malloc(nwire)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(wire,               buf2_ptr, buf_offset2);
+    memcpy(wire + buf_offset2, buf_ptr,  buf_offset);
+    goto SEND_WIRE;
+  }
   
   // Third, the buffer with the HMMD_SEARCH_STATUS object
   buf_offset3 = 0;
@@ -894,7 +923,6 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
     goto CLEAR;
   }
-  printf("%p\n", results->hits[1]);
   // and finally the hits 
   n=buf_offset;
 
@@ -902,6 +930,39 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
     goto CLEAR;
   }
+  goto SENT;
+
+  /* Single-block replies: the v2 hit block, or packed v1 stats and hits. */
+ SEND_WIRE:
+  if (query->compress) {
+    if (hmmd_compress_Pack(wire, nwire, &packed, &npacked, &secs) != eslOK){
+      LOG_FATAL_MSG("Packing results failed", errno);
+    }
+    printf("Packed %" PRIu64 " bytes to %" PRIu64 " (%.1f%%) in %.4f secs for %s (%d)\n",
+           nwire, npacked, (nwire ? 100.0 * npacked / nwire : 100.0), secs, query->ip_addr, fd);
+    free(wire);
+    wire  = packed;
+    nwire = npacked;
+  }
+  results->status.msg_size = nwire;
+
+  buf_offset3 = 0;
+  nalloc3 = 0;
+  if(hmmd_search_status_Serialize(&(results->status), buf3, &buf_offset3, &nalloc3) != eslOK){
+    LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+  }
+
+  n = buf_offset3;
+  if (writen(fd, buf3_ptr, n) != n) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+    goto CLEAR;
+  }
+  if (writen(fd, wire, nwire) != nwire) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+    goto CLEAR;
+  }
+
+ SENT:
   printf("Results for %s (%d) sent %" PRId64 " bytes\n", query->ip_addr, fd, results->status.msg_size);
   printf("Hits:%"PRId64 "  reported:%" PRId64 "  included:%"PRId64 "\n", results->stats.nhits, results->stats.nreported, results->stats.nincluded);
   fflush(stdout);
@@ -927,6 +988,7 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   if(buf3_ptr != NULL){
     free(buf3_ptr);
   }
+  if (wire) free(wire);
   if(results->stats.hit_offsets != NULL){
     free(results->stats.hit_offsets);
   }
@@ -1019,6 +1081,14 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
       cmd->hdr.length  = 0;
       cmd->hdr.command = HMMD_CMD_SHUTDOWN;
     } 
+  else if (strcmp(s, "compress") == 0)
+    {
+      /* results on this connection are packed (hmmd_compress.c) from now on;
+       * older servers answer "Unknown command", so clients can fall back */
+      data->compress = TRUE;
+      client_msg(fd, eslOK, "Compression on\n");
+      return;
+    }
   else 
     {
       client_msg(fd, eslEINVAL, "Unknown command %s\n", s);
@@ -1324,6 +1394,7 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   parms->sock       = data->sock_fd;
   parms->cmd_type   = cmd->hdr.command;
   parms->query_type = (seq != NULL) ? HMMD_SEQUENCE : HMMD_HMM;
+  parms->compress   = data->compress;
 
   date = time(NULL);
   ctime_r(&date, timestamp);
@@ -1413,6 +1484,7 @@ client_comm_thread(void *arg)
     if ((targs = malloc(sizeof(CLIENTSIDE_ARGS))) == NULL) LOG_FATAL_MSG("malloc", errno);
     targs->cmdstack   = data->cmdstack;
     targs->sock_fd    = fd;
+    targs->compress   = FALSE;
 
     addrlen = sizeof(targs->ip_addr);
     strncpy(targs->ip_addr, inet_ntoa(addr.sin_addr), addrlen);
@@ -1596,6 +1668,19 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
         break;
       }
 
+      // a worker that accepted compression sends a packed message
+      if (worker->compress) {
+        uint8_t  *raw;
+        uint64_t  rawn;
+        if (hmmd_compress_Unpack(buf, worker->status.msg_size, &raw, &rawn) != eslOK) {
+          p7_syslog(LOG_ERR,"[%s:%d] - corrupt packed results from %s\n", __FILE__, __LINE__, worker->ip_addr);
+          break;
+        }
+        free(buf);
+        buf = raw;
+        worker->status.msg_size = rawn;
+      }
+
       buf_position = 0; // start at beginning of new buffer of data
       // Now, serialize the data structures out of it
       if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
@@ -1693,6 +1778,7 @@ workerside_thread(void *arg)
 
     cmd->hdr.length  = n - sizeof(HMMD_HEADER);
     cmd->hdr.command = HMMD_CMD_INIT;
+    if (parent->compress) cmd->init.flags |= HMMD_INIT_COMPRESS_OFFER;
 
     p = cmd->init.data;
 
@@ -1756,6 +1842,7 @@ workerside_thread(void *arg)
       p7_syslog(LOG_ERR,"[%s:%d] - workers init status failed %d\n", __FILE__, __LINE__, cmd->hdr.status);
       status = eslFAIL;
     }
+    worker->compress = (cmd->init.flags & HMMD_INIT_COMPRESS_ACCEPT) ? TRUE : FALSE;
 
     worker->next = NULL;
     worker->prev = NULL;
@@ -818,6 +818,9 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
   int n;
   uint8_t **buf, **buf2, **buf3, *buf_ptr, *buf2_ptr, *buf3_ptr;
   uint32_t nalloc, nalloc2, nalloc3, buf_offset, buf_offset2, buf_offset3;
+  uint8_t            *wire  = NULL;
+  uint64_t            nwire;
+  int                 wire_version = esl_opt_GetInteger(query->opts, "--wire");
   enum p7_pipemodes_e mode;
 
   // Initialize these pointers-to-pointers that we'll use for sending data
@@ -835,10 +838,11 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     
   /* sort the hits and apply score and E-value thresholds */
   if (results->nhits > 0) {
-    if(results->stats.hit_offsets != NULL){
+    // v2 records are fixed-size, so only v1 needs the hit_offsets array
+    if(wire_version != HMMD_HITWIRE_VERSION && results->stats.hit_offsets != NULL){
       if ((results->stats.hit_offsets = realloc(results->stats.hit_offsets, results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
-    else{
+    else if(wire_version != HMMD_HITWIRE_VERSION){
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
@@ -878,6 +882,32 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     results->stats.Z         = pli->Z;
   }
 
+  /* A client that asked for "--wire 2" gets the status, then one v2 hit block
+     that it can read in place (see hmmd_hitwire.c). */
+  if (wire_version == HMMD_HITWIRE_VERSION) {
+    if (hmmd_hitwire_Write(&(results->stats), results->hits, &wire, &nwire) != eslOK){
+      LOG_FATAL_MSG("Writing v2 hit block failed", errno);
+    }
+    results->status.msg_size = nwire;
+
+    buf_offset3 = 0;
+    nalloc3 = 0;
+    if(hmmd_search_status_Serialize(&(results->status), buf3, &buf_offset3, &nalloc3) != eslOK){
+      LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+    }
+
+    n = buf_offset3;
+    if (writen(fd, buf3_ptr, n) != n) {
+      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+      goto CLEAR;
+    }
+    if (writen(fd, wire, nwire) != nwire) {
+      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+      goto CLEAR;
+    }
+    goto SENT;
+  }
+
   /* Build the buffers of serialized results we'll send back to the client.  
      Use three buffers, one for each object, because we need to build them in reverse order.
      We need to serialize the hits to build the hits_offset array in HMMD_SEARCH_STATS.
@@ -933,7 +963,6 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
     goto CLEAR;
   }
-  printf("%p\n", results->hits[1]);
   // and finally the hits 
   n=buf_offset;
 
@@ -941,6 +970,8 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
     p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
     goto CLEAR;
   }
+
+ SENT:
   printf("Results for %s (%d) sent %" PRId64 " bytes\n", query->ip_addr, fd, results->status.msg_size);
   printf("Hits:%"PRId64 "  reported:%" PRId64 "  included:%"PRId64 "\n", results->stats.nhits, results->stats.nreported, results->stats.nincluded);
   fflush(stdout);
@@ -966,6 +997,7 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
   if(buf3_ptr != NULL){
     free(buf3_ptr);
   }
+  if (wire) free(wire);
   if(results->stats.hit_offsets != NULL){
     free(results->stats.hit_offsets);
   }
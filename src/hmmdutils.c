@@ -88,11 +88,14 @@ static ESL_OPTIONS searchOpts[] = {
   /* Other options */
   { "--seed",       eslARG_INT,        "42", NULL, "n>=0",    NULL,  NULL, NULL,        "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--nonull2",    eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, NULL,        "turn off biased composition score corrections",               12 },
+  { "--adaptens",   eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, NULL,        "adaptively size stochastic trace ensembles",                  12 },
+  { "--domcpu",     eslARG_INT,        "0",  NULL, "n>=0",    NULL,  NULL, NULL,        "threads for domain definition of long targets",               12 },
   { "-Z",           eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of significant seqs, for domain E-value calculation",   12 },
   { "--hmmdb",      eslARG_INT,       NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--wire",       eslARG_INT,         "1",  NULL, "1<=n<=2", NULL,  NULL,  NULL,           "return hits in wire format <n>: 1 (serialized), 2 (hitwire block)", 12 },
   
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
@@ -59,6 +59,7 @@ typedef struct {
   ESL_SQ           *seq;         /* query sequence                   */
   ESL_ALPHABET     *abc;         /* digital alphabet                 */
   ESL_GETOPTS      *opts;        /* search specific options          */
+  const P7_EVTABLE *evtable;     /* COPY of fast calibration table, or NULL */
 
   RANGE_LIST       *range_list;  /* (optional) list of ranges searched within the seqdb */
 
@@ -77,6 +78,8 @@ typedef struct {
 
   P7_SEQCACHE *seq_db;           /* cached sequence database         */
   P7_HMMCACHE *hmm_db;           /* cached hmm database              */
+  P7_EVTABLE  *evtable;          /* fast calibration table for seq queries (--Etable), or NULL */
+  int          compress;         /* TRUE if the master accepts packed results */
 } WORKER_ENV;
 
 static void process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
@@ -87,7 +90,7 @@ static QUEUE_DATA *process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
 
 static int  setup_masterside_comm(ESL_GETOPTS *opts);
 
-static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
+static void send_results(int fd, int compress, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
 
 #define BLOCK_SIZE 1000
 static void search_thread(void *arg);
@@ -155,9 +158,15 @@ worker_process(ESL_GETOPTS *go)
 
   env.ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"),  esl_threads_GetCPUCount());
 
-  env.hmm_db = NULL;
-  env.seq_db = NULL;
-  env.fd     = setup_masterside_comm(go);
+  env.hmm_db  = NULL;
+  env.seq_db  = NULL;
+  env.evtable = NULL;
+  env.compress = FALSE;
+  if (esl_opt_IsOn(go, "--Etable")) {
+    char errbuf[eslERRBUFSIZE];
+    if (p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &env.evtable, errbuf) != eslOK) p7_Fail("Failed to read E-value calibration table:\n%s\n", errbuf);
+  }
+  env.fd      = setup_masterside_comm(go);
 
   while (!shutdown) 
     {
@@ -187,6 +196,7 @@ worker_process(ESL_GETOPTS *go)
 
   if (env.hmm_db) p7_hmmcache_Close(env.hmm_db);
   if (env.seq_db) p7_seqcache_Close(env.seq_db);
+  p7_evtable_Destroy(env.evtable);
   if (env.fd != -1) close(env.fd);
   return;
 }
@@ -253,6 +263,7 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
     info[i].hmm   = query->hmm;
     info[i].seq   = query->seq;
     info[i].opts  = query->opts;
+    info[i].evtable = env->evtable;
 
     info[i].range_list  = info[0].range_list;
 
@@ -319,7 +330,7 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   }
 
   print_timings(99, w->elapsed, info[0].pli);
-  send_results(env->fd, w, info[0].th, info[0].pli);
+  send_results(env->fd, env->compress, w, info[0].th, info[0].pli);
 
   /* free the last of the pipeline data */
   p7_pipeline_Destroy(info->pli);
@@ -530,6 +541,10 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
   setvbuf (stdout, NULL, _IOFBF, BUFSIZ);
 
 
+  /* accept compression if the master offered it */
+  env->compress = (cmd->init.flags & HMMD_INIT_COMPRESS_OFFER) ? TRUE : FALSE;
+  if (env->compress) cmd->init.flags |= HMMD_INIT_COMPRESS_ACCEPT;
+
   /* write back to the master that we are on line */
   n = MSG_SIZE(cmd);
   cmd->hdr.status = eslOK;
@@ -557,6 +572,7 @@ search_thread(void *arg)
   P7_TOPHITS       *th       = NULL;         /* top hit results                */
   P7_PROFILE       *gm       = NULL;         /* generic model                  */
   P7_OPROFILE      *om       = NULL;         /* optimized query profile        */
+  char              errbuf[eslERRBUFSIZE];
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
@@ -584,6 +600,7 @@ search_thread(void *arg)
     bld->EfL = esl_opt_GetInteger(info->opts, "--EfL");
     bld->EfN = esl_opt_GetInteger(info->opts, "--EfN");
     bld->Eft = esl_opt_GetReal   (info->opts, "--Eft");
+    bld->evtable = info->evtable;
 
     if (esl_opt_IsOn(info->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info->opts, "--mxfile"), NULL, esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg);
     else                                      status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info->opts, "--mx"),           esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg); 
@@ -593,6 +610,13 @@ search_thread(void *arg)
       pthread_exit(NULL);
       return;
     }
+    /* A query's own --mx, --popen, etc. can differ from what the table was fit for;
+     * then calibrate by simulation, as if there were no table.
+     */
+    if (bld->evtable && p7_evtable_Compatible(bld->evtable, bld, bg, errbuf) != eslOK) {
+      if (workeridx == 0) fprintf(stderr, "hmmpgmd: E-value calibration table not used for this query: %s\n", errbuf);
+      bld->evtable = NULL;
+    }
     p7_SingleBuilder(bld, info->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
     p7_builder_Destroy(bld);
   } else {
@@ -767,13 +791,17 @@ scan_thread(void *arg)
 
 
 static void
-send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
+send_results(int fd, int compress, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
   uint8_t **buf = NULL; // Buffer for the main results message
   uint8_t **buf2 = NULL; // Buffer for the initial HMMD_SEARCH_STATUS message
   uint8_t *buf_ptr = NULL; 
   uint8_t *buf2_ptr = NULL;
+  uint8_t *packed = NULL; // packed copy of the main message, if compressing
+  uint64_t npacked = 0;
+  uint64_t nraw;
+  double   secs;
   uint32_t n = 0; // index within buffer of serialized data
   uint32_t nalloc = 0; // Size of serialized buffer
 
@@ -820,6 +848,16 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   }
 
   status.msg_size = n; // n will have the number of bytes used to serialize the main data block
+  nraw = n;
+
+  // If the master accepted compression, send the packed message in its place
+  if (compress) {
+    if (hmmd_compress_Pack(buf_ptr, nraw, &packed, &npacked, &secs) != eslOK) LOG_FATAL_MSG("Packing results failed", errno);
+    free(buf_ptr);
+    buf_ptr         = packed;
+    status.msg_size = npacked;
+  }
+
   n = 0;
   nalloc = 0; // reset these to serialize status object
 
@@ -836,6 +874,9 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   free(buf_ptr);
   free(buf2_ptr);
   printf("Bytes: %" PRId64 "  hits: %" PRId64 "  sent on socket %d\n", status.msg_size, stats.nhits, fd);
+  if (compress)
+    printf("Packed %" PRIu64 " bytes to %" PRIu64 " (%.1f%%) in %.4f secs\n",
+           nraw, npacked, (nraw ? 100.0 * npacked / nraw : 100.0), secs);
   fflush(stdout);
 }
 
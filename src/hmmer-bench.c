@@ -0,0 +1,832 @@
+/* hmmer-bench: speed benchmarks for HMMER's DP kernels, with JSON output.
+ *
+ * Times each kernel (the SSE filters and parsers, decoding, null2,
+ * optimal accuracy, their generic equivalents, and optionally FM
+ * seeding) over a sweep of model lengths M and target lengths L, and
+ * reports speed in millions of DP cells per second, with a 95%
+ * confidence interval over replicate runs. Output is JSON, one result
+ * per line; a previous run's output can be given as a baseline, and
+ * any kernel that got significantly slower is flagged as a
+ * regression, and makes the exit status nonzero.
+ *
+ * This replaces scraping the text output of the individual
+ * *_benchmark drivers, which remain for studying one kernel at a time.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stats.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type          default  env  range toggles  reqs   incomp    help                                                  docgroup*/
+  { "-h",           eslARG_NONE,    FALSE, NULL, NULL,   NULL,  NULL,  NULL,    "show brief help on version and usage",                         1 },
+  { "-o",           eslARG_OUTFILE,  NULL, NULL, NULL,   NULL,  NULL,  NULL,    "direct JSON output to file <f>, not stdout",                   1 },
+  { "-s",           eslARG_INT,      "42", NULL, "n>=0", NULL,  NULL,  NULL,    "set random number seed to <n>",                                1 },
+  /* what to benchmark */
+  { "--kernels",    eslARG_STRING,  "all", NULL, NULL,   NULL,  NULL,  NULL,    "comma-separated list of kernels to time (or \"all\")",         2 },
+  { "--Mlist",      eslARG_STRING, "50,100,200,400,800", NULL, NULL, NULL, NULL, NULL, "model lengths of sampled models (no <hmmfile>)",      2 },
+  { "--Llist",      eslARG_STRING, "100,400,1000",       NULL, NULL, NULL, NULL, NULL, "target sequence lengths",                            2 },
+  { "--reps",       eslARG_INT,       "5", NULL, "n>=2", NULL,  NULL,  NULL,    "number of replicate timings of each kernel",                   2 },
+  { "--cells",      eslARG_REAL,    "1e8", NULL, "x>0",  NULL,  NULL,  NULL,    "time about <x> DP cells per replicate",                        2 },
+  { "--fmdb",       eslARG_INFILE,   NULL, NULL, NULL,   NULL,  NULL,  NULL,    "time FM seeding (fmseed) on makehmmerdb database <f>",         2 },
+  /* regression gate */
+  { "--baseline",   eslARG_INFILE,   NULL, NULL, NULL,   NULL,  NULL,  NULL,    "compare to previous hmmer-bench JSON output in <f>",           3 },
+  { "--tol",        eslARG_REAL,   "0.10", NULL, "0<=x<1",NULL, NULL,  NULL,    "flag slowdowns of more than fraction <x> as regressions",      3 },
+  /* FM seeding parameters, as in nhmmer */
+  { "--seed_max_depth",    eslARG_INT,          "15", NULL, NULL,    NULL,  NULL, NULL,          "seed length at which bit threshold must be met",             99 },
+  { "--seed_sc_thresh",    eslARG_REAL,         "15", NULL, NULL,    NULL,  NULL, NULL,          "Default req. score for FM seed (bits)",                      99 },
+  { "--seed_sc_density",   eslARG_REAL,        "0.8", NULL, NULL,    NULL,  NULL, NULL,          "seed must maintain this bit density from one of two ends",   99 },
+  { "--seed_drop_max_len", eslARG_INT,           "4", NULL, NULL,    NULL,  NULL, NULL,          "maximum run length with score under (max - [fm_drop_lim])",  99 },
+  { "--seed_drop_lim",     eslARG_REAL,        "0.3", NULL, NULL,    NULL,  NULL, NULL,          "in seed, max drop in a run of length [fm_drop_max_len]",     99 },
+  { "--seed_req_pos",      eslARG_INT,           "5", NULL, NULL,    NULL,  NULL, NULL,          "minimum number consecutive positive scores in seed" ,        99 },
+  { "--seed_consens_match", eslARG_INT,         "11", NULL, NULL,    NULL,  NULL, NULL,          "<n> consecutive matches to consensus will override score threshold" , 99 },
+  { "--seed_ssv_length",   eslARG_INT,          "70", NULL, NULL,    NULL,  NULL, NULL,          "length of window around FM seed to get full SSV diagonal",   99 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[-options] [<hmmfile>]";
+static char banner[] = "speed benchmarks for HMMER's DP kernels";
+
+
+/* The kernels. Those marked as dependent take the output of another
+ * kernel (a Forward matrix, or posterior probabilities) as input;
+ * it's computed once, untimed, and the kernel is timed on it
+ * repeatedly.
+ */
+enum bench_kernel_e {
+  bSSV, bMSV, bVITFILTER, bFWDPARSER, bBCKPARSER, bFORWARD, bBACKWARD, bDECODING, bNULL2, bOPTACC,
+  bGMSV, bGVITERBI, bGFORWARD, bGBACKWARD, bGDECODING, bGNULL2, bGOPTACC,
+  bFMSEED
+};
+#define bNKERNELS 18
+
+static const char *kernel_name[bNKERNELS] = {
+  "ssv", "msv", "vitfilter", "fwdparser", "bckparser", "forward", "backward", "decoding", "null2", "optacc",
+  "gmsv", "gviterbi", "gforward", "gbackward", "gdecoding", "gnull2", "goptacc",
+  "fmseed"
+};
+
+static const int kernel_is_dependent[bNKERNELS] = {
+  FALSE, FALSE, FALSE, FALSE, TRUE, FALSE, TRUE, TRUE, TRUE, TRUE,
+  FALSE, FALSE, FALSE, TRUE, TRUE, TRUE, TRUE,
+  FALSE
+};
+
+#define bNPOOL 1000   /* at most this many random target seqs are generated, and reused */
+
+/* BENCH: one model, configured for one target length <L>, and everything
+ * the kernels need to run on it.
+ */
+typedef struct {
+  P7_BG       *bg;
+  P7_PROFILE  *gm;
+  P7_OPROFILE *om;
+  int          M;
+  int          L;
+
+  P7_OMX      *ox;     /* one-row matrix for filters                       */
+  P7_OMX      *fwdp;   /* parsing Forward, Backward matrices               */
+  P7_OMX      *bckp;
+  P7_OMX      *fwd;    /* full Forward, Backward, posterior matrices       */
+  P7_OMX      *bck;
+  P7_OMX      *pp;
+  P7_GMX      *gx;     /* generic DP matrix, for Viterbi, MSV, optacc      */
+  P7_GMX      *gfwd;   /* generic Forward, Backward, posterior matrices    */
+  P7_GMX      *gbck;
+  P7_GMX      *gpp;
+  float       *null2;  /* null2 correction, [0..Kp-1]                      */
+
+  ESL_DSQ    **pool;   /* random target seqs, [0..npool-1][1..L]           */
+  int          npool;
+} BENCH;
+
+/* BASELINE: results of a previous run, to compare against. */
+typedef struct {
+  int     n;
+  char  **kernel;
+  int    *M;
+  int    *L;
+  double *mcells;
+} BASELINE;
+
+/* FMBENCH: an FM-index database, entirely in memory. */
+typedef struct {
+  FM_CFG      *cfg;
+  FILE        *fp;     /* open database file                               */
+  FM_DATA     *fmf;    /* forward and backward FM data, for each block [0..nblocks-1] */
+  FM_DATA     *fmb;
+  int          nblocks;
+  uint64_t     nres;   /* total residues in the database                   */
+} FMBENCH;
+
+
+static int  parse_intlist(const char *s, int **ret_v, int *ret_n);
+static int  parse_kernels(const char *s, int *do_kernel);
+
+static BENCH *bench_Create(ESL_RANDOMNESS *r, P7_HMM *hmm, int L, int npool);
+static void   bench_Destroy(BENCH *b);
+static int    bench_Prepare(BENCH *b, int k);
+static int    bench_Run(BENCH *b, int k, int N);
+
+static int    fmbench_Open(const char *fmfile, ESL_GETOPTS *go, FMBENCH **ret_fm);
+static void   fmbench_Close(FMBENCH *fm);
+static int    fmbench_Run(FMBENCH *fm, P7_OPROFILE *om, P7_BG *bg, P7_SCOREDATA *ssvdata, int npass);
+
+static int    baseline_Read(const char *file, BASELINE **ret_base, char *errbuf);
+static double baseline_Lookup(const BASELINE *base, const char *kernel, int M, int L);
+static void   baseline_Destroy(BASELINE *base);
+
+static int    time_kernel(ESL_STOPWATCH *w, BENCH *b, FMBENCH *fm, P7_OPROFILE *om, P7_BG *bg, P7_SCOREDATA *ssvdata,
+			  int k, int M, int L, int N, int nreps, double *mcells);
+static int    output_result(FILE *ofp, int *nresults, const char *kernel, int M, int L, int N, double *mcells, int nreps,
+			    const BASELINE *base, double tol, int *nregressions);
+static double t975(int df);
+
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go       = p7_CreateDefaultApp(options, -1, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r        = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_STOPWATCH  *w        = esl_stopwatch_Create();
+  FILE           *ofp      = stdout;
+  BASELINE       *base     = NULL;
+  FMBENCH        *fm       = NULL;
+  ESL_ALPHABET   *abc      = NULL;
+  P7_HMMFILE     *hfp      = NULL;
+  P7_HMM        **hmms     = NULL;
+  int             nhmms    = 0;
+  int            *Mlist    = NULL;
+  int             nM       = 0;
+  int            *Llist    = NULL;
+  int             nL       = 0;
+  int             do_kernel[bNKERNELS];
+  int             nreps    = esl_opt_GetInteger(go, "--reps");
+  double          cells    = esl_opt_GetReal(go, "--cells");
+  double          tol      = esl_opt_GetReal(go, "--tol");
+  double         *mcells   = NULL;
+  BENCH          *b        = NULL;
+  int             nresults = 0;
+  int             nregressions = 0;
+  time_t          date     = time(NULL);
+  char            timestamp[32];
+  char            errbuf[eslERRBUFSIZE];
+  int             h, i, k, N;
+  int             status;
+
+  if (esl_opt_ArgNumber(go) > 1) p7_Fail("Incorrect number of command line arguments.\n%s", usage);
+
+  p7_FLogsumInit();
+
+  if (parse_kernels(esl_opt_GetString(go, "--kernels"), do_kernel)  != eslOK) p7_Fail("Bad --kernels list: %s",   esl_opt_GetString(go, "--kernels"));
+  if (parse_intlist(esl_opt_GetString(go, "--Llist"), &Llist, &nL) != eslOK) p7_Fail("Bad --Llist: %s",          esl_opt_GetString(go, "--Llist"));
+#if ! defined (eslENABLE_SSE)
+  if (do_kernel[bSSV])		/* p7_SSVFilter() only exists in the SSE implementation */
+    {
+      if (strcmp(esl_opt_GetString(go, "--kernels"), "all") != 0) p7_Fail("ssv kernel is only available in SSE builds");
+      do_kernel[bSSV] = FALSE;
+    }
+#endif
+  if (do_kernel[bFMSEED] && ! esl_opt_IsOn(go, "--fmdb"))
+    {
+      if (esl_opt_IsUsed(go, "--kernels")) p7_Fail("fmseed kernel needs an FM-index database, with --fmdb");
+      do_kernel[bFMSEED] = FALSE;	/* "all" means all we can do */
+    }
+
+  /* The models: from <hmmfile>, or sampled at each length in --Mlist */
+  if (esl_opt_ArgNumber(go) == 1)
+    {
+      if (p7_hmmfile_OpenE(esl_opt_GetArg(go, 1), NULL, &hfp, errbuf) != eslOK) p7_Fail("Failed to open HMM file %s\n%s", esl_opt_GetArg(go, 1), errbuf);
+      while (1)
+	{
+	  ESL_REALLOC(hmms, sizeof(P7_HMM *) * (nhmms+1));
+	  status = p7_hmmfile_Read(hfp, &abc, &(hmms[nhmms]));
+	  if      (status == eslEOF) break;
+	  else if (status != eslOK)  p7_Fail("Failed to read HMM %d from %s", nhmms+1, esl_opt_GetArg(go, 1));
+	  nhmms++;
+	}
+      p7_hmmfile_Close(hfp);
+    }
+  else
+    {
+      if (parse_intlist(esl_opt_GetString(go, "--Mlist"), &Mlist, &nM) != eslOK) p7_Fail("Bad --Mlist: %s", esl_opt_GetString(go, "--Mlist"));
+      abc = esl_alphabet_Create(eslAMINO);
+      ESL_ALLOC(hmms, sizeof(P7_HMM *) * nM);
+      for (nhmms = 0; nhmms < nM; nhmms++)
+	if (p7_hmm_Sample(r, Mlist[nhmms], abc, &(hmms[nhmms])) != eslOK) p7_Fail("Failed to sample an HMM of length %d", Mlist[nhmms]);
+    }
+  if (nhmms == 0) p7_Fail("No models to benchmark");
+
+  if (esl_opt_IsOn(go, "--baseline") && baseline_Read(esl_opt_GetString(go, "--baseline"), &base, errbuf) != eslOK)
+    p7_Fail("Failed to read baseline %s:\n  %s", esl_opt_GetString(go, "--baseline"), errbuf);
+  if (do_kernel[bFMSEED] && fmbench_Open(esl_opt_GetString(go, "--fmdb"), go, &fm) != eslOK)
+    p7_Fail("Failed to read FM-index database %s", esl_opt_GetString(go, "--fmdb"));
+  if (esl_opt_IsOn(go, "-o") && (ofp = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL)
+    p7_Fail("Failed to open JSON output file %s for writing", esl_opt_GetString(go, "-o"));
+
+  ESL_ALLOC(mcells, sizeof(double) * nreps);
+
+  if (ctime_r(&date, timestamp) == NULL) strcpy(timestamp, "unknown\n");
+  timestamp[strlen(timestamp)-1] = '\0';
+  fprintf(ofp, "{\n");
+  fprintf(ofp, "  \"program\": \"hmmer-bench\",\n");
+  fprintf(ofp, "  \"version\": \"%s\",\n", HMMER_VERSION);
+  fprintf(ofp, "  \"date\": \"%s\",\n",    timestamp);
+  fprintf(ofp, "  \"seed\": %d,\n",        esl_opt_GetInteger(go, "-s"));
+  fprintf(ofp, "  \"reps\": %d,\n",        nreps);
+  fprintf(ofp, "  \"units\": \"Mcells/s\",\n");
+  fprintf(ofp, "  \"results\": [");
+
+  /* The DP kernels, for each model and target length */
+  for (h = 0; h < nhmms; h++)
+    for (i = 0; i < nL; i++)
+      {
+	b = bench_Create(r, hmms[h], Llist[i], ESL_MIN(bNPOOL, (int) (cells / ((double) hmms[h]->M * (double) Llist[i])) + 1));
+	for (k = 0; k < bNKERNELS; k++)
+	  {
+	    if (! do_kernel[k] || k == bFMSEED) continue;
+	    N = ESL_MAX(1, (int) (cells / ((double) b->M * (double) b->L)));
+
+	    if ((status = bench_Prepare(b, k)) != eslOK) p7_Fail("Failed to prepare input of %s kernel, M=%d L=%d", kernel_name[k], b->M, b->L);
+	    time_kernel(w, b, NULL, NULL, NULL, NULL, k, b->M, b->L, N, nreps, mcells);
+	    output_result(ofp, &nresults, kernel_name[k], b->M, b->L, N, mcells, nreps, base, tol, &nregressions);
+	  }
+	bench_Destroy(b);
+	b = NULL;
+      }
+
+  /* FM seeding, for each model, over the whole database; nucleotide models only */
+  if (fm)
+    {
+      ESL_ALPHABET *dna = esl_alphabet_Create(eslDNA);
+      P7_HMM       *hmm = NULL;
+      P7_BG        *bg  = p7_bg_Create(dna);
+      P7_PROFILE   *gm  = NULL;
+      P7_OPROFILE  *om  = NULL;
+      P7_SCOREDATA *ssvdata = NULL;
+
+      for (h = 0; h < nhmms; h++)
+	{
+	  if (hmms[h]->abc->type == eslDNA || hmms[h]->abc->type == eslRNA) hmm = p7_hmm_Clone(hmms[h]);
+	  else if (p7_hmm_Sample(r, hmms[h]->M, dna, &hmm) != eslOK)          p7_Fail("Failed to sample a DNA HMM of length %d", hmms[h]->M);
+	  if (hmm->max_length == -1) p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA);
+
+	  gm = p7_profile_Create(hmm->M, dna);
+	  om = p7_oprofile_Create(hmm->M, dna);
+	  p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+	  p7_oprofile_Convert(gm, om);
+	  ssvdata = p7_hmm_ScoreDataCreate(om, NULL);
+
+	  N = ESL_MAX(1, (int) (cells / ((double) om->M * (double) fm->nres)));
+	  time_kernel(w, NULL, fm, om, bg, ssvdata, bFMSEED, om->M, (int) ESL_MIN(fm->nres, INT_MAX), N, nreps, mcells);
+	  output_result(ofp, &nresults, kernel_name[bFMSEED], om->M, (int) ESL_MIN(fm->nres, INT_MAX), N, mcells, nreps, base, tol, &nregressions);
+
+	  p7_hmm_ScoreDataDestroy(ssvdata);
+	  p7_oprofile_Destroy(om);
+	  p7_profile_Destroy(gm);
+	  p7_hmm_Destroy(hmm);
+	}
+      p7_bg_Destroy(bg);
+      esl_alphabet_Destroy(dna);
+    }
+
+  fprintf(ofp, "\n  ]");
+  if (base) fprintf(ofp, ",\n  \"baseline\": \"%s\",\n  \"tolerance\": %g,\n  \"nregressions\": %d", esl_opt_GetString(go, "--baseline"), tol, nregressions);
+  fprintf(ofp, "\n}\n");
+
+  if (ofp != stdout) fclose(ofp);
+  for (h = 0; h < nhmms; h++) p7_hmm_Destroy(hmms[h]);
+  free(hmms);
+  free(Mlist);
+  free(Llist);
+  free(mcells);
+  if (fm)   fmbench_Close(fm);
+  if (base) baseline_Destroy(base);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return (nregressions > 0 ? 1 : 0);
+
+ ERROR:
+  p7_Fail("allocation failed");
+  return status;
+}
+
+
+/* parse_intlist()
+ * Parse a comma-separated list of positive integers, like "50,100,200".
+ */
+static int
+parse_intlist(const char *s, int **ret_v, int *ret_n)
+{
+  int  *v = NULL;
+  int   n = 0;
+  char *end;
+  long  x;
+  int   status;
+
+  while (*s != '\0')
+    {
+      x = strtol(s, &end, 10);
+      if (end == s || x <= 0 || x > INT_MAX) { status = eslESYNTAX; goto ERROR; }
+      ESL_REALLOC(v, sizeof(int) * (n+1));
+      v[n++] = (int) x;
+      s = end;
+      if      (*s == ',')  s++;
+      else if (*s != '\0') { status = eslESYNTAX; goto ERROR; }
+    }
+  if (n == 0) { status = eslESYNTAX; goto ERROR; }
+
+  *ret_v = v;
+  *ret_n = n;
+  return eslOK;
+
+ ERROR:
+  if (v) free(v);
+  *ret_v = NULL;
+  *ret_n = 0;
+  return status;
+}
+
+/* parse_kernels()
+ * Parse a comma-separated list of kernel names, or "all", setting
+ * <do_kernel[0..bNKERNELS-1]> TRUE for each one named.
+ */
+static int
+parse_kernels(const char *s, int *do_kernel)
+{
+  int    k;
+  size_t n;
+
+  for (k = 0; k < bNKERNELS; k++) do_kernel[k] = (strcmp(s, "all") == 0 ? TRUE : FALSE);
+  if (strcmp(s, "all") == 0) return eslOK;
+
+  while (*s != '\0')
+    {
+      n = strcspn(s, ",");
+      for (k = 0; k < bNKERNELS; k++)
+	if (strlen(kernel_name[k]) == n && strncmp(s, kernel_name[k], n) == 0) break;
+      if (k == bNKERNELS) return eslESYNTAX;
+      do_kernel[k] = TRUE;
+      s += n;
+      if (*s == ',') s++;
+    }
+  return eslOK;
+}
+
+
+/*****************************************************************
+ * The DP kernels
+ *****************************************************************/
+
+/* bench_Create()
+ * Configure <hmm> for target length <L>, allocate everything the
+ * kernels need, and generate <npool> random iid target seqs.
+ */
+static BENCH *
+bench_Create(ESL_RANDOMNESS *r, P7_HMM *hmm, int L, int npool)
+{
+  BENCH *b = NULL;
+  int    i;
+  int    status;
+
+  ESL_ALLOC(b, sizeof(BENCH));
+  b->M     = hmm->M;
+  b->L     = L;
+  b->pool  = NULL;
+  b->npool = 0;
+
+  b->bg = p7_bg_Create(hmm->abc);
+  p7_bg_SetLength(b->bg, L);
+  b->gm = p7_profile_Create(hmm->M, hmm->abc);
+  p7_ProfileConfig(hmm, b->bg, b->gm, L, p7_LOCAL);
+  b->om = p7_oprofile_Create(hmm->M, hmm->abc);
+  p7_oprofile_Convert(b->gm, b->om);
+  p7_oprofile_ReconfigLength(b->om, L);
+
+  b->ox   = p7_omx_Create(hmm->M, 0, 0);
+  b->fwdp = p7_omx_Create(hmm->M, 0, L);
+  b->bckp = p7_omx_Create(hmm->M, 0, L);
+  b->fwd  = p7_omx_Create(hmm->M, L, L);
+  b->bck  = p7_omx_Create(hmm->M, L, L);
+  b->pp   = p7_omx_Create(hmm->M, L, L);
+  b->gx   = p7_gmx_Create(hmm->M, L);
+  b->gfwd = p7_gmx_Create(hmm->M, L);
+  b->gbck = p7_gmx_Create(hmm->M, L);
+  b->gpp  = p7_gmx_Create(hmm->M, L);
+  ESL_ALLOC(b->null2, sizeof(float) * hmm->abc->Kp);
+
+  ESL_ALLOC(b->pool, sizeof(ESL_DSQ *) * npool);
+  for (i = 0; i < npool; i++) b->pool[i] = NULL;
+  for (b->npool = 0; b->npool < npool; b->npool++)
+    {
+      ESL_ALLOC(b->pool[b->npool], sizeof(ESL_DSQ) * (L+2));
+      esl_rsq_xfIID(r, b->bg->f, hmm->abc->K, L, b->pool[b->npool]);
+    }
+  return b;
+
+ ERROR:
+  bench_Destroy(b);
+  p7_Fail("allocation failed");
+  return NULL;
+}
+
+static void
+bench_Destroy(BENCH *b)
+{
+  int i;
+
+  if (b)
+    {
+      if (b->pool) { for (i = 0; i < b->npool; i++) free(b->pool[i]); free(b->pool); }
+      free(b->null2);
+      p7_gmx_Destroy(b->gpp);
+      p7_gmx_Destroy(b->gbck);
+      p7_gmx_Destroy(b->gfwd);
+      p7_gmx_Destroy(b->gx);
+      p7_omx_Destroy(b->pp);
+      p7_omx_Destroy(b->bck);
+      p7_omx_Destroy(b->fwd);
+      p7_omx_Destroy(b->bckp);
+      p7_omx_Destroy(b->fwdp);
+      p7_omx_Destroy(b->ox);
+      p7_oprofile_Destroy(b->om);
+      p7_profile_Destroy(b->gm);
+      p7_bg_Destroy(b->bg);
+      free(b);
+    }
+}
+
+/* bench_Prepare()
+ * For a dependent kernel <k>, compute its input on the first target
+ * seq: the Forward matrix for a Backward, or posterior probabilities
+ * for the rest.
+ */
+static int
+bench_Prepare(BENCH *b, int k)
+{
+  ESL_DSQ *dsq = b->pool[0];
+  int      L   = b->L;
+  float    sc;
+  int      status = eslOK;
+
+  if (! kernel_is_dependent[k]) return eslOK;
+
+  switch (k) {
+  case bBCKPARSER: status = p7_ForwardParser(dsq, L, b->om, b->fwdp, &sc); break;
+  case bBACKWARD:  status = p7_Forward      (dsq, L, b->om, b->fwd,  &sc); break;
+  case bDECODING:
+  case bNULL2:
+  case bOPTACC:
+    if ((status = p7_Forward (dsq, L, b->om, b->fwd,         &sc)) != eslOK) return status;
+    if ((status = p7_Backward(dsq, L, b->om, b->fwd, b->bck, &sc)) != eslOK) return status;
+    status = p7_Decoding(b->om, b->fwd, b->bck, b->pp);
+    break;
+  case bGBACKWARD: status = p7_GForward(dsq, L, b->gm, b->gfwd, &sc); break;
+  case bGDECODING:
+  case bGNULL2:
+  case bGOPTACC:
+    if ((status = p7_GForward (dsq, L, b->gm, b->gfwd, &sc)) != eslOK) return status;
+    if ((status = p7_GBackward(dsq, L, b->gm, b->gbck, &sc)) != eslOK) return status;
+    status = p7_GDecoding(b->gm, b->gfwd, b->gbck, b->gpp);
+    break;
+  }
+  return status;
+}
+
+/* bench_Run()
+ * Run kernel <k> <N> times: on successive seqs of the random pool,
+ * or for a dependent kernel, on its prepared input.
+ */
+static int
+bench_Run(BENCH *b, int k, int N)
+{
+  ESL_DSQ *dsq;
+  int      L = b->L;
+  float    sc;
+  int      i;
+
+  for (i = 0; i < N; i++)
+    {
+      dsq = b->pool[i % b->npool];
+      switch (k) {
+#if defined (eslENABLE_SSE)
+      case bSSV:       p7_SSVFilter      (dsq, L, b->om,          &sc);          break;
+#endif
+      case bMSV:       p7_MSVFilter      (dsq, L, b->om, b->ox,   &sc);          break;
+      case bVITFILTER: p7_ViterbiFilter  (dsq, L, b->om, b->ox,   &sc);          break;
+      case bFWDPARSER: p7_ForwardParser  (dsq, L, b->om, b->fwdp, &sc);          break;
+      case bBCKPARSER: p7_BackwardParser (b->pool[0], L, b->om, b->fwdp, b->bckp, &sc); break;
+      case bFORWARD:   p7_Forward        (dsq, L, b->om, b->fwd,  &sc);          break;
+      case bBACKWARD:  p7_Backward       (b->pool[0], L, b->om, b->fwd, b->bck, &sc);   break;
+      case bDECODING:  p7_Decoding       (b->om, b->fwd, b->bck, b->pp);         break;
+      case bNULL2:     p7_Null2_ByExpectation(b->om, b->pp, b->null2);           break;
+      case bOPTACC:    p7_OptimalAccuracy(b->om, b->pp, b->bck, &sc);          break;
+      case bGMSV:      p7_GMSV           (dsq, L, b->gm, b->gx, 2.0, &sc);       break;
+      case bGVITERBI:  p7_GViterbi       (dsq, L, b->gm, b->gx,   &sc);          break;
+      case bGFORWARD:  p7_GForward       (dsq, L, b->gm, b->gfwd, &sc);          break;
+      case bGBACKWARD: p7_GBackward      (b->pool[0], L, b->gm, b->gbck, &sc);   break;
+      case bGDECODING: p7_GDecoding      (b->gm, b->gfwd, b->gbck, b->gpp);      break;
+      case bGNULL2:    p7_GNull2_ByExpectation(b->gm, b->gpp, b->null2);         break;
+      case bGOPTACC:   p7_GOptimalAccuracy(b->gm, b->gpp, b->gx,  &sc);          break;
+      default:         ESL_EXCEPTION(eslEINVAL, "no such kernel");
+      }
+    }
+  return eslOK;
+}
+
+
+/*****************************************************************
+ * FM seeding
+ *****************************************************************/
+
+/* fmbench_Open()
+ * Read all the blocks of FM-index database <fmfile> into memory, so
+ * timing doesn't include reading it. FM configuration comes from
+ * the --seed_* options in <go>.
+ */
+static int
+fmbench_Open(const char *fmfile, ESL_GETOPTS *go, FMBENCH **ret_fm)
+{
+  FMBENCH     *fm   = NULL;
+  FM_METADATA *meta = NULL;
+  int          i;
+  int          status;
+
+  ESL_ALLOC(fm, sizeof(FMBENCH));
+  fm->cfg     = NULL;
+  fm->fp      = NULL;
+  fm->fmf     = NULL;
+  fm->fmb     = NULL;
+  fm->nblocks = 0;
+  fm->nres    = 0;
+
+  if ((status = fm_configAlloc(&(fm->cfg))) != eslOK) goto ERROR;
+  meta = fm->cfg->meta;
+  if ((fm->fp = fopen(fmfile, "rb")) == NULL)                 { status = eslENOTFOUND; goto ERROR; }
+  meta->fp = fm->fp;
+  if ((status = fm_readFMmeta(meta))                != eslOK) goto ERROR;
+  if (meta->alph_type != fm_DNA)                              { status = eslEFORMAT;   goto ERROR; }
+  if ((status = fm_configInit(fm->cfg, go))         != eslOK) goto ERROR;
+  if ((status = fm_alphabetCreate(meta, NULL))      != eslOK) goto ERROR;
+
+  ESL_ALLOC(fm->fmf, sizeof(FM_DATA) * meta->block_count);
+  ESL_ALLOC(fm->fmb, sizeof(FM_DATA) * meta->block_count);
+  for (i = 0; i < meta->block_count; i++)
+    {
+      if ((status = fm_FM_read(&(fm->fmf[i]), meta, TRUE))  != eslOK) goto ERROR;
+      if ((status = fm_FM_read(&(fm->fmb[i]), meta, FALSE)) != eslOK) { fm_FM_destroy(&(fm->fmf[i]), 1); goto ERROR; }
+      fm->fmb[i].SA = fm->fmf[i].SA;
+      fm->fmb[i].T  = fm->fmf[i].T;
+      fm->nres     += fm->fmf[i].N;
+      fm->nblocks++;
+    }
+
+  *ret_fm = fm;
+  return eslOK;
+
+ ERROR:
+  fmbench_Close(fm);
+  *ret_fm = NULL;
+  return status;
+}
+
+static void
+fmbench_Close(FMBENCH *fm)
+{
+  int i;
+
+  if (fm)
+    {
+      for (i = 0; i < fm->nblocks; i++)
+	{
+	  fm_FM_destroy(&(fm->fmf[i]), 1);
+	  fm_FM_destroy(&(fm->fmb[i]), 0);
+	}
+      free(fm->fmf);
+      free(fm->fmb);
+      if (fm->cfg) fm_configDestroy(fm->cfg); /* frees meta and its alphabet too */
+      if (fm->fp)  fclose(fm->fp);
+      free(fm);
+    }
+}
+
+/* fmbench_Run()
+ * Seed <om> against every block of the database, both strands, <npass> times.
+ */
+static int
+fmbench_Run(FMBENCH *fm, P7_OPROFILE *om, P7_BG *bg, P7_SCOREDATA *ssvdata, int npass)
+{
+  P7_HMM_WINDOWLIST windowlist;
+  int               pass, i;
+
+  windowlist.windows = NULL;
+  p7_hmmwindow_init(&windowlist);
+  for (pass = 0; pass < npass; pass++)
+    for (i = 0; i < fm->nblocks; i++)
+      {
+	windowlist.count = 0;
+	p7_SSVFM_longlarget(om, 2.0, bg, 0.02, &(fm->fmf[i]), &(fm->fmb[i]), fm->cfg, ssvdata, p7_STRAND_BOTH, &windowlist);
+      }
+  if (windowlist.windows) free(windowlist.windows);
+  return eslOK;
+}
+
+
+/*****************************************************************
+ * Timing and output
+ *****************************************************************/
+
+/* time_kernel()
+ * Time <nreps> replicates of <N> runs of kernel <k>, on <M> x <L>
+ * cells each; return the speed of each in <mcells[0..nreps-1]>,
+ * in Mcells/s of CPU time.
+ */
+static int
+time_kernel(ESL_STOPWATCH *w, BENCH *b, FMBENCH *fm, P7_OPROFILE *om, P7_BG *bg, P7_SCOREDATA *ssvdata,
+	    int k, int M, int L, int N, int nreps, double *mcells)
+{
+  double t;
+  int    rep;
+
+  for (rep = 0; rep < nreps; rep++)
+    {
+      esl_stopwatch_Start(w);
+      if (k == bFMSEED) fmbench_Run(fm, om, bg, ssvdata, N);
+      else              bench_Run(b, k, N);
+      esl_stopwatch_Stop(w);
+
+      t = ESL_MAX(w->user, 1e-6); /* don't divide by 0 if --cells is way too small */
+      mcells[rep] = (double) N * (double) M * (double) L * 1e-6 / t;
+    }
+  return eslOK;
+}
+
+/* output_result()
+ * Write one result line of the JSON "results" array: mean speed and
+ * 95% confidence interval half-width. If there's a <base>line result
+ * for the same kernel, M and L, compare to it: a slowdown of more than
+ * fraction <tol>, beyond the confidence interval, is a regression.
+ */
+static int
+output_result(FILE *ofp, int *nresults, const char *kernel, int M, int L, int N, double *mcells, int nreps,
+	      const BASELINE *base, double tol, int *nregressions)
+{
+  double mean, var, ci;
+  double old;
+  int    is_regression;
+
+  esl_stats_DMean(mcells, nreps, &mean, &var);
+  ci = t975(nreps-1) * sqrt(var / (double) nreps);
+
+  fprintf(ofp, "%s\n    { \"kernel\": \"%s\", \"M\": %d, \"L\": %d, \"n\": %d, \"mcells\": %.2f, \"ci95\": %.2f",
+	  (*nresults > 0 ? "," : ""), kernel, M, L, N, mean, ci);
+
+  if (base && (old = baseline_Lookup(base, kernel, M, L)) > 0.)
+    {
+      is_regression = ( (mean - old) / old < -tol && mean + ci < old ) ? TRUE : FALSE;
+      fprintf(ofp, ", \"baseline\": %.2f, \"change\": %.4f, \"regression\": %s", old, (mean - old) / old, is_regression ? "true" : "false");
+      if (is_regression) (*nregressions)++;
+    }
+  fprintf(ofp, " }");
+  (*nresults)++;
+  return eslOK;
+}
+
+/* t975()
+ * Two-sided 95% critical value of Student's t with <df> degrees of freedom.
+ */
+static double
+t975(int df)
+{
+  static const double t[31] = { 0.0,
+				12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+				 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+				 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+  if (df < 1)  return 0.0;
+  if (df > 30) return 1.960;
+  return t[df];
+}
+
+
+/*****************************************************************
+ * Baselines
+ *****************************************************************/
+
+/* json_field()
+ * In one result line of our own JSON output, find field <key> and
+ * return a pointer to its value, or NULL if it isn't there.
+ */
+static const char *
+json_field(const char *line, const char *key)
+{
+  char        pattern[64];
+  const char *s;
+
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  if ((s = strstr(line, pattern)) == NULL) return NULL;
+  s += strlen(pattern);
+  while (*s == ' ') s++;
+  return s;
+}
+
+/* baseline_Read()
+ * Read the results of a previous hmmer-bench run from <file>. We only
+ * need to read our own output, which has one result per line.
+ */
+static int
+baseline_Read(const char *file, BASELINE **ret_base, char *errbuf)
+{
+  BASELINE   *base = NULL;
+  FILE       *fp   = NULL;
+  char        line[1024];
+  const char *s;
+  size_t      n;
+  int         status;
+
+  ESL_ALLOC(base, sizeof(BASELINE));
+  base->n      = 0;
+  base->kernel = NULL;
+  base->M      = NULL;
+  base->L      = NULL;
+  base->mcells = NULL;
+
+  if ((fp = fopen(file, "r")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "couldn't open file");
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      if ((s = json_field(line, "kernel")) == NULL) continue;
+      if (*s != '"' || (n = strcspn(s+1, "\"")) == 0) ESL_XFAIL(eslEFORMAT, errbuf, "bad kernel name in: %s", line);
+
+      ESL_REALLOC(base->kernel, sizeof(char *) * (base->n+1));
+      ESL_REALLOC(base->M,      sizeof(int)    * (base->n+1));
+      ESL_REALLOC(base->L,      sizeof(int)    * (base->n+1));
+      ESL_REALLOC(base->mcells, sizeof(double) * (base->n+1));
+      ESL_ALLOC(base->kernel[base->n], sizeof(char) * (n+1));
+      strncpy(base->kernel[base->n], s+1, n);
+      base->kernel[base->n][n] = '\0';
+      base->n++;
+
+      if ((s = json_field(line, "M"))      == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "no M in: %s",      line);
+      base->M[base->n-1] = atoi(s);
+      if ((s = json_field(line, "L"))      == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "no L in: %s",      line);
+      base->L[base->n-1] = atoi(s);
+      if ((s = json_field(line, "mcells")) == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "no mcells in: %s", line);
+      base->mcells[base->n-1] = atof(s);
+    }
+  if (base->n == 0) ESL_XFAIL(eslEFORMAT, errbuf, "no results found");
+
+  fclose(fp);
+  *ret_base = base;
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  baseline_Destroy(base);
+  *ret_base = NULL;
+  return status;
+}
+
+/* baseline_Lookup()
+ * Return the baseline speed of <kernel> at <M>,<L>; or -1 if we don't have one.
+ */
+static double
+baseline_Lookup(const BASELINE *base, const char *kernel, int M, int L)
+{
+  int i;
+
+  for (i = 0; i < base->n; i++)
+    if (base->M[i] == M && base->L[i] == L && strcmp(base->kernel[i], kernel) == 0)
+      return base->mcells[i];
+  return -1.;
+}
+
+static void
+baseline_Destroy(BASELINE *base)
+{
+  int i;
+
+  if (base)
+    {
+      for (i = 0; i < base->n; i++) free(base->kernel[i]);
+      free(base->kernel);
+      free(base->M);
+      free(base->L);
+      free(base->mcells);
+      free(base);
+    }
+}
@@ -41,6 +41,7 @@
 
 #include "easel.h"
 #include "esl_alphabet.h"	/* ESL_DSQ, ESL_ALPHABET */
+#include "esl_buffer.h"		/* ESL_BUFFER            */
 #include "esl_dmatrix.h"	/* ESL_DMATRIX           */
 #include "esl_getopts.h"	/* ESL_GETOPTS           */
 #include "esl_histogram.h"      /* ESL_HISTOGRAM         */
@@ -626,6 +627,12 @@ typedef struct p7_dom_s {
   P7_ALIDISPLAY *ad; 
 } P7_DOMAIN;
 
+struct p7_dregion_s {		/* a region of a long target, for parallel domain definition */
+  int i, j;			/* region coords on the target, 1..L                          */
+  int is_multi;			/* TRUE if region needs stochastic trace clustering           */
+  int d0, nd;			/* its domains are <dcl[d0..d0+nd-1]> of the thread's ddef   */
+};
+
 /* Structure: P7_DOMAINDEF
  * 
  * This is a container for all the necessary information for domain
@@ -654,8 +661,24 @@ typedef struct p7_domaindef_s {
   ESL_RANDOMNESS *r;		/* random number generator                                 */
   int             do_reseeding;	/* TRUE to reset the RNG, make results reproducible        */
   P7_SPENSEMBLE  *sp;		/* an ensemble of sampled segment pairs (domain endpoints) */
+  struct p7_spcoord_s *prvc;	/* adaptive sampling: clusters defined by the previous round */
+  int             nprvc;	/* number of clusters in <prvc>; -1 if no round yet done     */
+  int             prvc_alloc;	/* current allocation size of <prvc>                         */
   P7_TRACE       *tr;		/* reusable space for a trace of a domain                  */
   P7_TRACE       *gtr;		/* reusable space for a traceback of the entire target seq */
+  P7_TRACE      **trb;		/* reusable space for a batch of sampled traces, [0..ntrb-1] */
+  int             ntrb;		/* number of traces allocated in <trb>                       */
+
+  /* parallel definition of the regions of a long target (HMMER_THREADS only) */
+  int                     ncpu;	  /* if >0, use this many threads for targets of length >= <par_minL> */
+  int                     par_minL;	  /* minimum target length for parallel domain definition          */
+  struct p7_dregion_s    *reg;	  /* regions found by the posterior scan, [0..nreg-1]              */
+  int                     nreg;	  /* number of regions in <reg>                                    */
+  int                     reg_alloc;	  /* current allocation size of <reg>                              */
+  struct p7_domaindef_s **sub;	  /* per-thread domain definition workspace, [0..nsub-1]           */
+  struct p7_omx_s       **subfwd;	  /* per-thread DP matrices, [0..nsub-1]                           */
+  struct p7_omx_s       **subbck;
+  int                     nsub;	  /* number of threads' workspaces allocated                       */
 
   /* Heuristic thresholds that control the region definition process */
   /* "rt" = "region threshold", for lack of better term  */
@@ -664,7 +687,9 @@ typedef struct p7_domaindef_s {
   float  rt3;		/* controls when regions are flagged for split: if expected # of E preceding B is >= dt3   */
   
   /* Heuristic thresholds that control the stochastic traceback/clustering process */
-  int    nsamples;	/* collect ensemble of this many stochastic traces */
+  int    nsamples;	/* collect ensemble of (at most) this many stochastic traces */
+  int    nround;	/* if >0, sample in rounds of this many traces; stop when clusters converge */
+  int    nbatch;	/* sample traces in batches of up to this many, from one Forward matrix     */
   float  min_overlap;	/* 0.8 means >= 80% overlap of (smaller/larger) segment to link, both in seq and hmm            */
   int    of_smaller;	/* see above; TRUE means overlap denom is calc'ed wrt smaller segment; FALSE means larger       */
   int    max_diagdiff;	/* 4 means either start or endpoints of two segments must be within <=4 diagonals of each other */
@@ -675,6 +700,8 @@ typedef struct p7_domaindef_s {
   P7_DOMAIN *dcl;
   int        ndom;	 /* number of domains defined, in the end.         */
   int        nalloc;     /* number of domain structures allocated in <dcl> */
+  struct p7_hitarena_s *arena; /* if non-NULL, build <dcl>'s alidisplays in this (caller's hit list's) arena */
+  int        ad_in_arena; /* TRUE if <dcl>'s alidisplays are in <arena>, and aren't ours to free */
 
   /* Additional results storage */
   float  nexpected;     /* posterior expected number of domains in the sequence (from posterior arrays) */
@@ -682,6 +709,7 @@ typedef struct p7_domaindef_s {
   int    nclustered;	/* number of regions evaluated by clustering ensemble of tracebacks */
   int    noverlaps;	/* number of envelopes defined in ensemble clustering that overlap w/ prev envelope */
   int    nenvelopes;	/* number of envelopes handed over for domain definition, null2, alignment, and scoring. */
+  int    nsampled;	/* number of stochastic traces sampled, over all clustered regions */
 
 } P7_DOMAINDEF;
 
@@ -739,9 +767,30 @@ typedef struct p7_hit_s {
 
   P7_DOMAIN *dcl;	/* domain coordinate list and alignment display */
   esl_pos_t  offset;	/* used in socket communications, in serialized communication: offset of P7_DOMAIN msg for this P7_HIT */
+  int        in_arena;  /* TRUE if name, acc, desc, dcl (and its ads) live in the owning P7_TOPHITS's arena, not malloc() */
 } P7_HIT;
 
 
+/* Structure: P7_HITARENA
+ * 
+ * Bump allocator owned by a P7_TOPHITS, holding the variable-size
+ * memory of its hits (names, domain lists, alignment displays). 
+ * Allocations are carved from the last chunk; when it fills, a new
+ * chunk of twice the size is added. Nothing is freed individually.
+ */
+typedef struct p7_hitarena_s {
+  char   **chunk;       /* chunk[0..nchunk-1]: memory blocks; allocation is from chunk[nchunk-1] */
+  size_t  *chunksize;   /* allocated size of each chunk, in bytes                                */
+  int      nchunk;      /* number of chunks in use                                               */
+  int      nalloc;      /* allocated size of chunk[], chunksize[]                                */
+  size_t   used;        /* bytes used in chunk[nchunk-1]                                         */
+  int      mark_nchunk; /* <nchunk> saved by p7_hitarena_Mark()                                  */
+  size_t   mark_used;   /* <used> saved by p7_hitarena_Mark()                                    */
+} P7_HITARENA;
+
+#define p7_HITARENA_CHUNKSIZE 65536  /* size of an arena's first chunk, in bytes */
+
+
 /* Structure: P7_TOPHITS
  * merging when we prepare to output results. "hit" list is NULL and
  * unavailable until after we do a sort.  
@@ -755,8 +804,14 @@ typedef struct p7_tophits_s {
   uint64_t nincluded;	/* number of hits that are includable       */
   int      is_sorted_by_sortkey; /* TRUE when hits sorted by sortkey and th->hit valid for all N hits */
   int      is_sorted_by_seqidx; /* TRUE when hits sorted by seq_idx, position, and th->hit valid for all N hits */
+  P7_HITARENA *arena;   /* memory for hits' names, domains, alidisplays (see p7_tophits_CopyHitNames()) */
 } P7_TOPHITS;
 
+#define p7_TOPHITS_RADIXSORT 1024  /* p7_tophits_SortBySortkey() radix sorts lists of >= this many hits; smaller ones, qsort() */
+#define p7_TOPHITS_MPICHUNK  (1<<20) /* p7_tophits_MPISend() streams lists bigger than this many bytes as several messages */
+#define p7_HITSOUT_MAGIC     "P7HB"  /* starts each record of a --hitsout binary hit file (p7_tophits_WriteBinary()) */
+#define p7_HITSOUT_VERSION   1
+
 
 
 
@@ -1220,6 +1275,7 @@ typedef struct p7_pipeline_s {
   int     B3;               /* window length for biased-composition modifier - Forward*/
   int     do_biasfilter;	/* TRUE to use biased comp HMM filter       */
   int     do_null2;		/* TRUE to use null2 score corrections      */
+  float   msvsc;		/* MSV score of last target (nats), or +inf */
 
   /* Accounting. (reduceable in threaded/MPI parallel version)              */
   uint64_t      nmodels;        /* # of HMMs searched                       */
@@ -1231,6 +1287,8 @@ typedef struct p7_pipeline_s {
   uint64_t      n_past_vit;	/* # comparisons that pass ViterbiFilter()  */
   uint64_t      n_past_fwd;	/* # comparisons that pass ForwardFilter()  */
   uint64_t      n_output;	    /* # alignments that make it to the final output (used for nhmmer) */
+  uint64_t      n_clustered;	/* # regions resolved by stochastic trace clustering */
+  uint64_t      n_sampled;	/* # stochastic traces sampled for those regions     */
   uint64_t      pos_past_msv;	/* # positions that pass MSVFilter()  (used for nhmmer) */
   uint64_t      pos_past_bias;	/* # positions that pass bias filter  (used for nhmmer) */
   uint64_t      pos_past_vit;	/* # positions that pass ViterbiFilter()  (used for nhmmer) */
@@ -1262,6 +1320,31 @@ enum p7_archchoice_e { p7_ARCH_FAST = 0, p7_ARCH_HAND = 1 };
 enum p7_wgtchoice_e  { p7_WGT_NONE  = 0, p7_WGT_GIVEN = 1, p7_WGT_GSC    = 2, p7_WGT_PB       = 3, p7_WGT_BLOSUM = 4 };
 enum p7_effnchoice_e { p7_EFFN_NONE = 0, p7_EFFN_SET  = 1, p7_EFFN_CLUST = 2, p7_EFFN_ENTROPY = 3, p7_EFFN_ENTROPY_EXP = 4 };
 
+/* Regression table for fast E-value calibration of query models (p7_evtable.c):
+ * mu, tau predicted as c0 + c1 log(M) + c2 H, fit in bins of model length M.
+ */
+#define p7_EVTABLE_NCOEF 4	/* per parameter: intercept, log(M) slope, H slope, rms residual */
+
+typedef struct p7_evbin_s {
+  int     Mmin, Mmax;		        /* model lengths covered by this bin, inclusive           */
+  double  Hmin, Hmax;		        /* range of mean match rel entropy (bits) seen in the fit */
+  int     n;			        /* number of calibrated models the fit was made from      */
+  double  c[3][p7_EVTABLE_NCOEF];       /* coefs for [0] MSV mu, [1] Viterbi mu, [2] Fwd tau      */
+} P7_EVBIN;
+
+typedef struct p7_evtable_s {
+  int       abctype;		        /* alphabet type the table was fit for                    */
+  int       EmL, EvL, EfL;	        /* simulation lengths the fit was made with               */
+  double    Eft;		        /* Forward tail mass the fit was made with                */
+  uint32_t  mxsum;		        /* checksum of the single-seq substitution score matrix   */
+  double    popen, pextend;	        /* single-seq gap open, extend probabilities              */
+  float    *f;		        /* background residue frequencies [0..K-1]; NULL if unset */
+  int       K;			        /* size of <f>                                            */
+  P7_EVBIN *bin;		        /* model length bins, in increasing M order               */
+  int       nbins;
+  int       nalloc;
+} P7_EVTABLE;
+
 typedef struct p7_builder_s {
   /* Model architecture                                                                            */
   enum p7_archchoice_e arch_strategy;    /* choice of model architecture determination algorithm   */
@@ -1291,6 +1374,8 @@ typedef struct p7_builder_s {
   int                  EfL;	         /* length of sequences generated for Forward fitting      */
   int                  EfN;	         /* # of sequences generated for Forward fitting           */
   double               Eft;	         /* tail mass used for Forward fitting                     */
+  int                  ncpu;	         /* # of threads for calibration and big-MSA clustering; 0 = serial */
+  const P7_EVTABLE    *evtable;	 /* OPTIONAL: COPY of table for fast calibration, or NULL  */
 
   /* Choice of prior                                                                               */
   P7_PRIOR            *prior;	         /* choice of prior when parameterizing from counts        */
@@ -1332,9 +1417,9 @@ extern void p7_Fail(char *format, ...);
 /* evalues.c */
 extern int p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **byp_bg, P7_PROFILE **byp_gm, P7_OPROFILE **byp_om);
 extern int p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda);
-extern int p7_MSVMu     (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               double *ret_mmu);
-extern int p7_ViterbiMu (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               double *ret_vmu);
-extern int p7_Tau       (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, double *ret_tau);
+extern int p7_MSVMu     (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               int ncpu, double *ret_mmu);
+extern int p7_ViterbiMu (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               int ncpu, double *ret_vmu);
+extern int p7_Tau       (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, int ncpu, double *ret_tau);
 
 /* eweight.c */
 extern int p7_EntropyWeight(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, double infotarget, double *ret_Neff);
@@ -1417,6 +1502,10 @@ extern float p7_FLogsumError(float a, float b);
 extern int   p7_ILogsumInit(void);
 extern int   p7_ILogsum(int s1, int s2);
 
+/* linkage.c */
+extern int p7_SingleLinkage(const ESL_MSA *msa, double maxid, int ncpu, int **opt_c, int *ret_nc);
+extern int p7_BLOSUMWeights(ESL_MSA *msa, double maxid, int ncpu);
+
 
 /* modelconfig.c */
 extern int p7_ProfileConfig(const P7_HMM *hmm, const P7_BG *bg, P7_PROFILE *gm, int L, int mode);
@@ -1466,6 +1555,7 @@ extern int p7_tracealign_getMSAandStats(P7_HMM *hmm, ESL_SQ  **sq, int N, ESL_MS
 
 /* p7_alidisplay.c */
 extern P7_ALIDISPLAY *p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
+extern P7_ALIDISPLAY *p7_alidisplay_CreateInArena(P7_HITARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
 extern P7_ALIDISPLAY *p7_alidisplay_Create_empty();
 extern P7_ALIDISPLAY *p7_alidisplay_Clone(const P7_ALIDISPLAY *ad);
 extern size_t         p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad);
@@ -1510,6 +1600,7 @@ extern void        p7_builder_Destroy(P7_BUILDER *bld);
 
 extern int p7_Builder      (P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE ***opt_trarr, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om, ESL_MSA **opt_postmsa);
 extern int p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq,   P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE  **opt_tr,    P7_PROFILE **opt_gm, P7_OPROFILE **opt_om); 
+extern int p7_StreamBuilder(P7_BUILDER *bld, ESL_BUFFER *bf, char *name, P7_BG *bg, P7_HMM **opt_hmm, int64_t *opt_alen, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om);
 extern int p7_Builder_MaxLength      (P7_HMM *hmm, double emit_thresh);
 
 /* p7_domain.c */
@@ -1534,6 +1625,16 @@ extern int p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *nt
 				                                  P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
 
 
+/* p7_evtable.c */
+extern P7_EVTABLE *p7_evtable_Create(int abctype, int EmL, int EvL, int EfL, double Eft);
+extern void        p7_evtable_Destroy(P7_EVTABLE *tbl);
+extern int         p7_evtable_Fit(P7_EVTABLE *tbl, int n, const int *M, const double *H, const double *mmu, const double *vmu, const double *tau);
+extern int         p7_evtable_SetScoreSystem(P7_EVTABLE *tbl, const P7_BUILDER *bld, const P7_BG *bg);
+extern int         p7_evtable_Compatible(const P7_EVTABLE *tbl, const P7_BUILDER *bld, const P7_BG *bg, char *errbuf);
+extern int         p7_evtable_Estimate(const P7_EVTABLE *tbl, int M, double H, double *ret_mmu, double *ret_vmu, double *ret_tau);
+extern int         p7_evtable_Read(const char *tblfile, P7_EVTABLE **ret_tbl, char *errbuf);
+extern int         p7_evtable_Write(FILE *fp, const P7_EVTABLE *tbl);
+
 /* p7_gmx.c */
 extern P7_GMX *p7_gmx_Create (int allocM, int allocL);
 extern int     p7_gmx_GrowTo (P7_GMX *gx, int allocM, int allocL);
@@ -1693,6 +1794,11 @@ extern void    p7_spensemble_Destroy(P7_SPENSEMBLE *sp);
 extern P7_TOPHITS *p7_tophits_Create(void);
 extern int         p7_tophits_Grow(P7_TOPHITS *h);
 extern int         p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit);
+extern int         p7_tophits_CopyHitNames(P7_TOPHITS *h, P7_HIT *hit, const char *name, const char *acc, const char *desc);
+extern int         p7_tophits_CopyHitDomains(P7_TOPHITS *h, P7_HIT *hit, const P7_DOMAIN *dcl, int ndom);
+extern void       *p7_hitarena_Alloc(P7_HITARENA *a, size_t n);
+extern void        p7_hitarena_Mark(P7_HITARENA *a);
+extern void        p7_hitarena_Rewind(P7_HITARENA *a);
 extern int         p7_tophits_Add(P7_TOPHITS *h,
 				  char *name, char *acc, char *desc, 
 				  double sortkey, 
@@ -1707,6 +1813,7 @@ extern int         p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *h);
 extern int         p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h);
 
 extern int         p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2);
+extern int         p7_tophits_MergeList(P7_TOPHITS *h, P7_TOPHITS **hl, int nlist);
 extern int         p7_tophits_GetMaxPositionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxNameLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxAccessionLength(P7_TOPHITS *h);
@@ -1730,6 +1837,10 @@ extern int p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS
 extern int p7_tophits_TabularTail(FILE *ofp, const char *progname, enum p7_pipemodes_e pipemode, 
 				  const char *qfile, const char *tfile, const ESL_GETOPTS *go);
 extern int p7_tophits_AliScores(FILE *ofp, char *qname, P7_TOPHITS *th );
+extern int p7_tophits_WriteBinary(FILE *ofp, const char *qname, const char *qacc, const char *qdesc, int64_t qlen,
+				  const P7_TOPHITS *th, const P7_PIPELINE *pli);
+extern int p7_tophits_ReadBinary(FILE *ifp, P7_TOPHITS *th, P7_PIPELINE *pli,
+				 char **ret_qname, char **ret_qacc, char **ret_qdesc, int64_t *ret_qlen, char *errbuf);
 
 /* p7_trace.c */
 extern P7_TRACE *p7_trace_Create(void);
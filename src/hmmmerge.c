@@ -0,0 +1,335 @@
+/* hmmmerge: merge binary hit lists from a search split by target database.
+ *
+ * A large hmmsearch or hmmscan can be split across machines by
+ * splitting the target database, each piece run with --hitsout.
+ * hmmmerge reads those binary files, merges each query's hit lists,
+ * recalculates Z and domZ from the summed target counts, rethresholds,
+ * and writes the same output the unsplit search would have.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+#define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
+#define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
+#define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
+#define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
+#define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range     toggles   reqs   incomp              help                                                      docgroup*/
+  { "-h",           eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                         1 },
+  /* Control of output */
+  { "-o",           eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "direct output to file <f>, not stdout",                        2 },
+  { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-target hits to file <f>",          2 },
+  { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
+  { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",   2 },
+  { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
+  { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
+  { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                         2 },
+  { "--textw",      eslARG_INT,    "120", NULL, "n>=120",NULL,  NULL, "--notextw",      "set max width of ASCII text output lines",                     2 },
+  /* Control of reporting thresholds */
+  { "-E",           eslARG_REAL,  "10.0", NULL, "x>0",   NULL,  NULL,  REPOPTS,         "report targets <= this E-value threshold in output",           4 },
+  { "-T",           eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  REPOPTS,         "report targets >= this score threshold in output",             4 },
+  { "--domE",       eslARG_REAL,  "10.0", NULL, "x>0",   NULL,  NULL,  DOMREPOPTS,      "report domains <= this E-value threshold in output",           4 },
+  { "--domT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  DOMREPOPTS,      "report domains >= this score cutoff in output",                4 },
+  /* Control of inclusion (significance) thresholds */
+  { "--incE",       eslARG_REAL,  "0.01", NULL, "x>0",   NULL,  NULL,  INCOPTS,         "consider targets <= this E-value threshold as significant",    5 },
+  { "--incT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  INCOPTS,         "consider targets >= this score threshold as significant",      5 },
+  { "--incdomE",    eslARG_REAL,  "0.01", NULL, "x>0",   NULL,  NULL,  INCDOMOPTS,      "consider domains <= this E-value threshold as significant",    5 },
+  { "--incdomT",    eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  INCDOMOPTS,      "consider domains >= this score threshold as significant",      5 },
+  /* Model-specific thresholding for both reporting and inclusion */
+  { "--cut_ga",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  THRESHOPTS,      "keep the searches' GA cutoff thresholding",                    6 },
+  { "--cut_nc",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  THRESHOPTS,      "keep the searches' NC cutoff thresholding",                    6 },
+  { "--cut_tc",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  THRESHOPTS,      "keep the searches' TC cutoff thresholding",                    6 },
+  /* Other options */
+  { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
+  { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant targets, for domain E-value calculation",12 },
+
+  /* Accepted and ignored, so a search's command line options can be
+   * reused as is; the pipeline configuration reads them, too.
+   */
+  { "--max",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--F1,--F2,--F3", "(ignored) search's --max",                                    99 },
+  { "--F1",         eslARG_REAL,  "0.02", NULL, NULL,    NULL,  NULL, "--max",          "(ignored) search's --F1",                                     99 },
+  { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "(ignored) search's --F2",                                     99 },
+  { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "(ignored) search's --F3",                                     99 },
+  { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL, "--max",          "(ignored) search's --nobias",                                 99 },
+  { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "(ignored) search's --nonull2",                                99 },
+  { "--adaptens",   eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "(ignored) search's --adaptens",                               99 },
+  { "--domcpu",     eslARG_INT,    "0",   NULL, "n>=0",  NULL,  NULL,  NULL,            "(ignored) search's --domcpu",                                 99 },
+  { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "(ignored) search's --seed",                                   99 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[options] <hitsfile> <hitsfile>...";
+static char banner[] = "merge binary hit lists from searches split by target database";
+
+
+static int
+process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go)
+{
+  ESL_GETOPTS *go = esl_getopts_Create(options);
+  int          status;
+
+  if (esl_opt_ProcessEnvironment(go)         != eslOK)  { if (printf("Failed to process environment: %s\n", go->errbuf) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK)  { if (printf("Failed to parse command line: %s\n",  go->errbuf) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+  if (esl_opt_VerifyConfig(go)               != eslOK)  { if (printf("Failed to parse command line: %s\n",  go->errbuf) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
+  /* help format: */
+  if (esl_opt_GetBoolean(go, "-h") == TRUE)
+    {
+      p7_banner(stdout, argv[0], banner);
+      esl_usage(stdout, argv[0], usage);
+      if (puts("\nBasic options:")                                           < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 1, 2, 80); /* 1= group; 2 = indentation; 80=textwidth*/
+
+      if (puts("\nOptions directing output:")                                < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 2, 2, 80);
+
+      if (puts("\nOptions controlling reporting thresholds:")                < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 4, 2, 80);
+
+      if (puts("\nOptions controlling inclusion (significance) thresholds:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 5, 2, 80);
+
+      if (puts("\nOptions controlling model-specific thresholding:")         < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 6, 2, 80);
+
+      if (puts("\nOther expert options:")                                    < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 12, 2, 80);
+      exit(0);
+    }
+
+  if (esl_opt_ArgNumber(go) < 1) { if (puts("Incorrect number of command line arguments.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
+  *ret_go = go;
+  return eslOK;
+
+ FAILURE:  /* all errors handled here are user errors, so be polite.  */
+  esl_usage(stdout, argv[0], usage);
+  if (puts("\nwhere most common options are:")                                 < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+  esl_opt_DisplayHelp(stdout, go, 1, 2, 80); /* 1= group; 2 = indentation; 80=textwidth*/
+  if (printf("\nTo see more help on available options, do %s -h\n\n", argv[0]) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+  esl_getopts_Destroy(go);
+  exit(1);
+
+ ERROR:
+  if (go) esl_getopts_Destroy(go);
+  exit(status);
+}
+
+static int
+output_header(FILE *ofp, const ESL_GETOPTS *go)
+{
+  int i;
+
+  p7_banner(ofp, go->argv[0], banner);
+
+  for (i = 1; i <= esl_opt_ArgNumber(go); i++)
+    if (fprintf(ofp, "# binary hit list file:            %s\n", esl_opt_GetArg(go, i))                                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "-o")           && fprintf(ofp, "# output directed to file:         %s\n",             esl_opt_GetString(go, "-o"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-target hits tabular output:  %s\n",             esl_opt_GetString(go, "--tblout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--pfamtblout") && fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--noali")      && fprintf(ofp, "# show alignments in output:       no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--notextw")    && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--textw")      && fprintf(ofp, "# max ASCII text line length:      %d\n",             esl_opt_GetInteger(go, "--textw"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "-E")           && fprintf(ofp, "# target reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "-E"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "-T")           && fprintf(ofp, "# target reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "-T"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domE")       && fprintf(ofp, "# domain reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--domE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domT")       && fprintf(ofp, "# domain reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "--domT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--incE")       && fprintf(ofp, "# target inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--incT")       && fprintf(ofp, "# target inclusion threshold:      score >= %g\n",    esl_opt_GetReal(go, "--incT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--incdomE")    && fprintf(ofp, "# domain inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incdomE"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--incdomT")    && fprintf(ofp, "# domain inclusion threshold:      score >= %g\n",    esl_opt_GetReal(go, "--incdomT"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cut_ga")     && fprintf(ofp, "# model-specific thresholding:     GA cutoffs\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cut_nc")     && fprintf(ofp, "# model-specific thresholding:     NC cutoffs\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cut_tc")     && fprintf(ofp, "# model-specific thresholding:     TC cutoffs\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# search space set to:             %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  return eslOK;
+}
+
+
+/* unthreshold()
+ * The hits come to us flagged by each piece's own thresholding, with
+ * its own Z. Clear that, so p7_tophits_Threshold() starts over with
+ * the merged Z. Model-specific cutoffs don't depend on Z, so with
+ * --cut_* the searches' flags stand and only the counts are redone.
+ */
+static void
+unthreshold(P7_TOPHITS *th, const P7_PIPELINE *pli)
+{
+  uint64_t h;
+  int      d;
+
+  for (h = 0; h < th->N; h++)
+    {
+      th->hit[h]->nreported = 0;
+      th->hit[h]->nincluded = 0;
+      if (pli->use_bit_cutoffs) continue;
+
+      th->hit[h]->flags &= ~(p7_IS_REPORTED | p7_IS_INCLUDED);
+      for (d = 0; d < th->hit[h]->ndom; d++)
+	{
+	  th->hit[h]->dcl[d].is_reported = FALSE;
+	  th->hit[h]->dcl[d].is_included = FALSE;
+	}
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS     *go        = NULL;
+  FILE            *ofp       = stdout;
+  FILE            *tblfp     = NULL;
+  FILE            *domtblfp  = NULL;
+  FILE            *pfamtblfp = NULL;
+  FILE           **fp        = NULL;   /* open hit list files, [0..nfiles-1]     */
+  P7_TOPHITS     **th        = NULL;   /* one query's hit lists, [0..nfiles-1]   */
+  P7_PIPELINE     *pli       = NULL;   /* merged accounting and thresholds       */
+  P7_PIPELINE      rec;                /* accounting read from one file's record */
+  P7_PIPELINE      rec0;               /* ... and from the first file's          */
+  char            *qname     = NULL;
+  char            *qacc      = NULL;
+  char            *qdesc     = NULL;
+  char            *name      = NULL;
+  int64_t          qlen      = 0;
+  int              nfiles;
+  int              nquery    = 0;
+  int              textw;
+  int              i;
+  int              status;
+  char             errbuf[eslERRBUFSIZE];
+
+  process_commandline(argc, argv, &go);
+  memset(&rec0, 0, sizeof(P7_PIPELINE));
+  rec0.mode = p7_SEARCH_SEQS;	/* in case there are no queries at all */
+  nfiles = esl_opt_ArgNumber(go);
+  textw  = (esl_opt_GetBoolean(go, "--notextw") ? 0 : esl_opt_GetInteger(go, "--textw"));
+
+  ESL_ALLOC(fp, sizeof(FILE *)       * nfiles);
+  ESL_ALLOC(th, sizeof(P7_TOPHITS *) * nfiles);
+  for (i = 0; i < nfiles; i++) { fp[i] = NULL; th[i] = NULL; }
+  for (i = 0; i < nfiles; i++)
+    if ((fp[i] = fopen(esl_opt_GetArg(go, i+1), "rb")) == NULL) p7_Fail("Failed to open hit list file %s for reading\n", esl_opt_GetArg(go, i+1));
+
+  if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL) p7_Fail("Failed to open output file %s for writing\n",    esl_opt_GetString(go, "-o")); }
+  if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-target output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
+  if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+
+  output_header(ofp, go);
+
+  /* One query at a time: the nth record of each file is the nth
+   * query's results against that file's piece of the targets.
+   */
+  while (1)
+    {
+      for (i = 0; i < nfiles; i++)
+	{
+	  if ((th[i] = p7_tophits_Create()) == NULL) p7_Fail("allocation failed");
+	  memset(&rec, 0, sizeof(P7_PIPELINE));
+
+	  status = p7_tophits_ReadBinary(fp[i], th[i], &rec, (i == 0 ? &qname : &name), (i == 0 ? &qacc : NULL), (i == 0 ? &qdesc : NULL), (i == 0 ? &qlen : NULL), errbuf);
+	  if      (status == eslEOF && i > 0) p7_Fail("Hit list file %s has fewer queries than %s", esl_opt_GetArg(go, i+1), esl_opt_GetArg(go, 1));
+	  else if (status == eslEOF)          break;
+	  else if (status == eslEFORMAT)      p7_Fail("Bad hit list file %s:\n   %s", esl_opt_GetArg(go, i+1), errbuf);
+	  else if (status != eslOK)           p7_Fail("Unexpected error reading hit list file %s", esl_opt_GetArg(go, i+1));
+
+	  if (rec.long_targets) p7_Fail("Hit list file %s is from nhmmer; hmmmerge can't merge those", esl_opt_GetArg(go, i+1));
+
+	  if (i == 0)
+	    {
+	      rec0 = rec;
+	      if ((pli = p7_pipeline_Create(go, 100, 100, FALSE, rec.mode)) == NULL) p7_Fail("allocation failed");
+	      /* p7_pipeline_Merge() only sums the counts that vary across the pieces */
+	      if (rec.mode == p7_SEARCH_SEQS) { pli->nmodels = rec.nmodels; pli->nnodes = rec.nnodes; }
+	      else                            { pli->nseqs   = rec.nseqs;   pli->nres   = rec.nres;   }
+	    }
+	  else
+	    {
+	      if (strcmp(name, qname) != 0) p7_Fail("Query %d is %s in %s but %s in %s", nquery+1, qname, esl_opt_GetArg(go, 1), name, esl_opt_GetArg(go, i+1));
+	      if (rec.mode != rec0.mode)    p7_Fail("%s and %s are from different programs (hmmsearch, hmmscan)", esl_opt_GetArg(go, 1), esl_opt_GetArg(go, i+1));
+	      if (rec.Z_setby != rec0.Z_setby || (rec.Z_setby == p7_ZSETBY_OPTION && rec.Z != rec0.Z))
+		p7_Fail("%s and %s were searched with different -Z settings", esl_opt_GetArg(go, 1), esl_opt_GetArg(go, i+1));
+	      free(name); name = NULL;
+	    }
+	  p7_pipeline_Merge(pli, &rec);
+	}
+      if (i == 0) break;	/* normal EOF: no more queries */
+      nquery++;
+
+      /* Z: set here with -Z; or as the searches set it with -Z;
+       * or else the total number of targets, now that we've seen them all.
+       */
+      if      (esl_opt_IsOn(go, "-Z"))            { pli->Z = esl_opt_GetReal(go, "-Z"); pli->Z_setby = p7_ZSETBY_OPTION;   }
+      else if (rec0.Z_setby == p7_ZSETBY_OPTION)  { pli->Z = rec0.Z;                    pli->Z_setby = p7_ZSETBY_OPTION;   }
+      else                                        { pli->Z = (pli->mode == p7_SCAN_MODELS) ? pli->nmodels : pli->nseqs; pli->Z_setby = p7_ZSETBY_NTARGETS; }
+
+      if (! esl_opt_IsOn(go, "--domZ") && rec0.domZ_setby == p7_ZSETBY_OPTION) { pli->domZ = rec0.domZ; pli->domZ_setby = p7_ZSETBY_OPTION; }
+
+      if (fprintf(ofp, "Query:       %s  [%c=%ld]\n", qname, (pli->mode == p7_SCAN_MODELS ? 'L' : 'M'), (long) qlen) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      if (qacc)  { if (fprintf(ofp, "Accession:   %s\n", qacc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+      if (qdesc) { if (fprintf(ofp, "Description: %s\n", qdesc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+
+      if ((status = p7_tophits_MergeList(th[0], th+1, nfiles-1)) != eslOK) goto ERROR;
+      if ((status = p7_tophits_SortBySortkey(th[0]))             != eslOK) goto ERROR; /* MergeList() doesn't bother, if there's nothing to merge */
+      unthreshold(th[0], pli);
+
+      p7_tophits_Threshold(th[0], pli);
+      p7_tophits_Targets(ofp, th[0], pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      p7_tophits_Domains(ofp, th[0], pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+      if (tblfp)     p7_tophits_TabularTargets(tblfp,    qname, qacc, th[0], pli, (nquery == 1));
+      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qname, qacc, th[0], pli, (nquery == 1));
+      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp,   qname, qacc, th[0], pli);
+
+      p7_pli_Statistics(ofp, pli, NULL);
+      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      fflush(ofp);
+
+      for (i = 0; i < nfiles; i++) { p7_tophits_Destroy(th[i]); th[i] = NULL; }
+      p7_pipeline_Destroy(pli); pli = NULL;
+      free(qname);             qname = NULL;
+      if (qacc)  { free(qacc);  qacc  = NULL; }
+      if (qdesc) { free(qdesc); qdesc = NULL; }
+    }
+  /* The first file ran out; so must all the others. */
+  for (i = 1; i < nfiles; i++)
+    {
+      if ((th[i] = p7_tophits_Create()) == NULL) p7_Fail("allocation failed");
+      if (p7_tophits_ReadBinary(fp[i], th[i], &rec, NULL, NULL, NULL, NULL, errbuf) != eslEOF)
+	p7_Fail("Hit list file %s has more queries than %s", esl_opt_GetArg(go, i+1), esl_opt_GetArg(go, 1));
+    }
+
+  if (tblfp)     p7_tophits_TabularTail(tblfp,     "hmmmerge", rec0.mode, esl_opt_GetArg(go, 1), NULL, go);
+  if (domtblfp)  p7_tophits_TabularTail(domtblfp,  "hmmmerge", rec0.mode, esl_opt_GetArg(go, 1), NULL, go);
+  if (pfamtblfp) p7_tophits_TabularTail(pfamtblfp, "hmmmerge", rec0.mode, esl_opt_GetArg(go, 1), NULL, go);
+  if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  for (i = 0; i < nfiles; i++) { fclose(fp[i]); if (th[i]) p7_tophits_Destroy(th[i]); }
+  free(fp);
+  free(th);
+  if (ofp != stdout) fclose(ofp);
+  if (tblfp)         fclose(tblfp);
+  if (domtblfp)      fclose(domtblfp);
+  if (pfamtblfp)     fclose(pfamtblfp);
+  esl_getopts_Destroy(go);
+  return eslOK;
+
+ ERROR:
+  p7_Fail("hmmmerge failed with status code %d", status);
+  return status;
+}
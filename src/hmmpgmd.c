@@ -30,10 +30,12 @@ static ESL_OPTIONS cmdlineOpts[] = {
   { "--wport",      eslARG_INT,     "51372",  NULL, "49151<n<65536",NULL,  NULL,  NULL,            "port to use for server/worker communication",                 12 },
   { "--ccncts",     eslARG_INT,     "16",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of client side connections to accept",         12 },
   { "--wcncts",     eslARG_INT,     "32",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of worker side connections to accept",         12 },
+  { "--wcompress",  eslARG_NONE,    FALSE,    NULL, NULL,           NULL,  NULL,  "--worker",      "offer workers compression of the results they send",          12 },
   { "--pid",        eslARG_OUTFILE, NULL,     NULL, NULL,           NULL,  NULL,  NULL,            "file to write process id to",                                 12 },
   { "--seqdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "protein database to cache for searches",                      12 },
   { "--hmmdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "hmm database to cache for searches",                          12 },
   { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>0",        NULL,  NULL,  "--master",      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--Etable",     eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--master",      "fast calibration of seq queries from regression table <f>",   12 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 
   };
@@ -36,6 +36,66 @@ typedef struct {
                                    array of serialized hits to the start of the second hit, and so on */
 } HMMD_SEARCH_STATS;
 
+/* The v2 hit block (hmmd_hitwire.c), sent to clients that ask for it
+ * with "--wire 2". All fields are little-endian; all records are
+ * multiples of 8 bytes, with no implicit padding, so they can be
+ * used in place. String fields are offsets into the string table.
+ */
+#define HMMD_HITWIRE_MAGIC    "P7HW"
+#define HMMD_HITWIRE_VERSION  2
+#define HMMD_HITWIRE_NOSTR    UINT64_MAX   /* string offset meaning NULL          */
+#define HMMD_HITWIRE_HAS_AD   (1<<0)       /* HMMD_HITWIRE_DOM flag: has an alignment */
+
+typedef struct {
+  char       magic[4];          /* HMMD_HITWIRE_MAGIC, not NUL-terminated   */
+  uint32_t   version;           /* HMMD_HITWIRE_VERSION                     */
+  uint32_t   hit_size;          /* sizeof(HMMD_HITWIRE_HIT)                 */
+  uint32_t   dom_size;          /* sizeof(HMMD_HITWIRE_DOM)                 */
+  double     elapsed, user, sys;
+  double     Z, domZ;
+  uint32_t   Z_setby, domZ_setby;
+  uint64_t   nmodels, nseqs;
+  uint64_t   n_past_msv, n_past_bias, n_past_vit, n_past_fwd;
+  uint64_t   nhits, nreported, nincluded;
+  uint64_t   ndomains;          /* total # of domain records                */
+  uint64_t   dom_offset;        /* offset of domain records from block start */
+  uint64_t   str_offset;        /* offset of string table from block start   */
+  uint64_t   str_size;          /* size of string table, to end of block     */
+} HMMD_HITWIRE_HEADER;          /* hit records follow immediately            */
+
+typedef struct {
+  double     sortkey, lnP, pre_lnP, sum_lnP;
+  float      score, pre_score, sum_score, nexpected;
+  int32_t    window_length, nregions, nclustered, noverlaps, nenvelopes;
+  int32_t    ndom, nreported, nincluded, best_domain;
+  uint32_t   flags;
+  int64_t    seqidx, subseq_start;
+  uint64_t   name, acc, desc;   /* string offsets                           */
+  uint64_t   dom;               /* this hit's domains are dom..dom+ndom-1    */
+} HMMD_HITWIRE_HIT;
+
+typedef struct {
+  int64_t    ienv, jenv, iali, jali, iorf, jorf;
+  double     lnP;
+  float      envsc, domcorrection, dombias, oasc, bitscore;
+  int32_t    is_reported, is_included;
+  int32_t    N, hmmfrom, hmmto, M;  /* alidisplay fields, if HMMD_HITWIRE_HAS_AD */
+  uint32_t   flags;
+  int64_t    sqfrom, sqto, L;
+  uint64_t   rfline, mmline, csline, model, mline, aseq, ntseq, ppline;
+  uint64_t   hmmname, hmmacc, hmmdesc, sqname, sqacc, sqdesc;
+  uint64_t   spp;               /* offset of float scores_per_pos[0..N-1]   */
+} HMMD_HITWIRE_DOM;
+
+typedef struct {
+  HMMD_HITWIRE_HEADER *hdr;
+  HMMD_HITWIRE_HIT    *hit;     /* hit[0..hdr->nhits-1]                     */
+  HMMD_HITWIRE_DOM    *dom;     /* dom[0..hdr->ndomains-1]                  */
+  char                *str;     /* string table                             */
+} HMMD_HITWIRE;
+
+#define hmmd_hitwire_Str(hw, off)  ((off) == HMMD_HITWIRE_NOSTR ? NULL : (hw)->str + (off))
+
 #define HMMD_SEQUENCE   101
 #define HMMD_HMM        102
 
@@ -69,9 +129,14 @@ typedef struct {
   uint32_t    seq_cnt;              /* sequences in database                    */
   uint32_t    hmm_cnt;              /* total number hmm databases               */
   uint32_t    model_cnt;            /* models in hmm database                   */
+  uint32_t    flags;                /* HMMD_INIT_* negotiation flags            */
   char        data[1];              /* string data                              */
 } HMMD_INIT_CMD;
 
+/* HMMD_INIT_CMD flags: the master offers, the worker echoes back what it accepts */
+#define HMMD_INIT_COMPRESS_OFFER   (1<<0)  /* master can unpack compressed results   */
+#define HMMD_INIT_COMPRESS_ACCEPT  (1<<1)  /* worker will send compressed results    */
+
 /* HMMD_CMD_RESET */
 typedef struct {
   char        ip_addr[1];           /* ip address                               */
@@ -116,6 +181,7 @@ typedef struct queue_data_s {
   int            dbx;         /* database index to search       */
   int            inx;         /* sequence index to start search */
   int            cnt;         /* number of sequences to search  */
+  int            compress;    /* TRUE to pack results to client */
 
 } QUEUE_DATA;
 
@@ -148,4 +214,15 @@ extern int hmmd_search_status_Serialize(const HMMD_SEARCH_STATUS *obj, uint8_t *
 extern int hmmd_search_status_Deserialize(const uint8_t *buf, uint32_t *n, HMMD_SEARCH_STATUS *ret_obj);
 extern int hmmd_search_status_TestSample(ESL_RAND64 *rng, HMMD_SEARCH_STATUS **ret_obj);
 extern int hmmd_search_status_Compare(HMMD_SEARCH_STATUS *first, HMMD_SEARCH_STATUS *second);
+
+/* hmmd_hitwire.c */
+extern int hmmd_hitwire_Write(const HMMD_SEARCH_STATS *stats, P7_HIT **hit, uint8_t **ret_buf, uint64_t *ret_n);
+extern int hmmd_hitwire_Open(uint8_t *buf, uint64_t n, HMMD_HITWIRE *hw);
+extern int hmmd_hitwire_GetStats(const HMMD_HITWIRE *hw, HMMD_SEARCH_STATS *stats);
+
+/* hmmd_compress.c */
+#define HMMD_COMPRESS_NONE  0      /* packed message method: stored as is   */
+#define HMMD_COMPRESS_LZ4   1      /*                        LZ4 block      */
+extern int hmmd_compress_Pack  (const uint8_t *raw, uint64_t rawn, uint8_t **ret_msg, uint64_t *ret_n, double *opt_secs);
+extern int hmmd_compress_Unpack(const uint8_t *msg, uint64_t n,    uint8_t **ret_raw, uint64_t *ret_rawn);
 #endif /*P7_HMMPGMD_INCLUDED*/
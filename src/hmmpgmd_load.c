@@ -0,0 +1,658 @@
+/* hmmpgmd_load: load generator and latency benchmark for hmmpgmd.
+ *
+ * Sends queries to an hmmpgmd master, at a target rate or with a fixed
+ * number of concurrent client connections, and reports latency
+ * percentiles, throughput, result bytes and errors. Queries are either
+ * replayed from a query log, in the same format that hmmc2 reads, or
+ * are a synthetic mix of phmmer, hmmsearch and hmmscan queries of
+ * configurable sizes.
+ *
+ * With --qps, the load is open-loop: query <i> is due at time i/qps
+ * after the start, and its latency is measured from when it was due,
+ * not from when a connection got around to sending it. Otherwise
+ * the load is closed-loop: each of the --conc connections sends its
+ * next query as soon as it has the last one's results.
+ *
+ * Contents:
+ *   1. Queries: replayed from a log, or synthetic.
+ *   2. Client threads.
+ *   3. Report.
+ *   4. main().
+ */
+#include "p7_config.h"
+
+#ifdef HMMER_THREADS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <sys/socket.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>     /* On FreeBSD, you need netinet/in.h for struct sockaddr_in            */
+#endif                      /* On OpenBSD, netinet/in.h is required for (must precede) arpa/inet.h */
+#include <arpa/inet.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_vectorops.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+
+#define SYNOPTS "--phmmer,--hmmsearch,--hmmscan,-L,-M,--npool,--seqdb,--hmmdb,--opts"
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default      env  range toggles reqs incomp     help                                                   docgroup*/
+  { "-h",           eslARG_NONE,       FALSE, NULL, NULL,  NULL,  NULL,  NULL,    "show brief help on version and usage",                          1 },
+  { "-i",           eslARG_STRING,"127.0.0.1",NULL, NULL,  NULL,  NULL,  NULL,    "IP address of the hmmpgmd master",                              1 },
+  { "-p",           eslARG_INT,      "51371", NULL, "49151<n<65536",NULL,NULL,NULL,"client port of the hmmpgmd master",                            1 },
+  { "-o",           eslARG_OUTFILE,     NULL, NULL, NULL,  NULL,  NULL,  NULL,    "save latency, bytes, status of each query in table <f>",        1 },
+  { "-s",           eslARG_INT,         "42", NULL, "n>=0",NULL,  NULL,  NULL,    "set random number seed to <n>",                                 1 },
+  /* load */
+  { "-N",           eslARG_INT,         NULL, NULL, "n>0", NULL,  NULL,  NULL,    "send <n> queries [default: each logged query once, or 100]",    2 },
+  { "--conc",       eslARG_INT,          "1", NULL, "n>0", NULL,  NULL,  NULL,    "use <n> concurrent client connections",                         2 },
+  { "--qps",        eslARG_REAL,        NULL, NULL, "x>0", NULL,  NULL,  NULL,    "send queries at <x> per second, open-loop",                     2 },
+  /* synthetic queries */
+  { "--phmmer",     eslARG_REAL,         "1", NULL, "x>=0",NULL,  NULL,  NULL,    "relative weight of phmmer queries (seq vs. --seqdb)",           3 },
+  { "--hmmsearch",  eslARG_REAL,         "0", NULL, "x>=0",NULL,  NULL,  NULL,    "relative weight of hmmsearch queries (HMM vs. --seqdb)",        3 },
+  { "--hmmscan",    eslARG_REAL,         "0", NULL, "x>=0",NULL,  NULL,  NULL,    "relative weight of hmmscan queries (seq vs. --hmmdb)",          3 },
+  { "-L",           eslARG_INT,        "300", NULL, "n>0", NULL,  NULL,  NULL,    "length of synthetic query sequences",                           3 },
+  { "-M",           eslARG_INT,        "200", NULL, "n>0", NULL,  NULL,  NULL,    "length of synthetic query models",                              3 },
+  { "--npool",      eslARG_INT,         "10", NULL, "n>0", NULL,  NULL,  NULL,    "number of different synthetic queries to cycle through",        3 },
+  { "--seqdb",      eslARG_INT,          "1", NULL, "n>0", NULL,  NULL,  NULL,    "sequence database number for phmmer, hmmsearch queries",        3 },
+  { "--hmmdb",      eslARG_INT,          "1", NULL, "n>0", NULL,  NULL,  NULL,    "HMM database number for hmmscan queries",                       3 },
+  { "--opts",       eslARG_STRING,      NULL, NULL, NULL,  NULL,  NULL,  NULL,    "add search options <s> to each synthetic query",                3 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[-options] [<query log>]";
+static char banner[] = "load generator and latency benchmark for hmmpgmd";
+
+
+/*****************************************************************
+ * 1. Queries: replayed from a log, or synthetic.
+ *****************************************************************/
+
+enum query_type_e { qPHMMER = 0, qHMMSEARCH = 1, qHMMSCAN = 2, qOTHER = 3 };
+#define qNTYPES 4
+static const char *query_type_name[qNTYPES] = { "phmmer", "hmmsearch", "hmmscan", "other" };
+
+/* QUERY: the complete text of one query to send to the master, as
+ * hmmc2 would: an optional "@" options line, a sequence or HMM, and
+ * the terminating "//" line.
+ */
+typedef struct {
+  char *text;
+  int   n;
+  int   type;
+} QUERY;
+
+/* classify_query()
+ * Guess what kind of search a query is: hmmscan if it names an
+ * --hmmdb, otherwise hmmsearch for an HMM or phmmer for a sequence.
+ */
+static int
+classify_query(const char *text)
+{
+  const char *s      = text;
+  int         is_scan = FALSE;
+
+  while (*s && isspace(*s)) s++;
+  if (*s == '@')
+    {
+      const char *eol = strchr(s, '\n');
+      const char *db  = strstr(s, "--hmmdb");
+      if (db && (eol == NULL || db < eol)) is_scan = TRUE;
+      s = (eol ? eol+1 : s + strlen(s));
+      while (*s && isspace(*s)) s++;
+    }
+  if (*s == '>')                   return (is_scan ? qHMMSCAN : qPHMMER);
+  if (strncmp(s, "HMMER", 5) == 0) return (is_scan ? qOTHER   : qHMMSEARCH);
+  return qOTHER;
+}
+
+/* read_query_log()
+ * Read all the queries in the log <logfile>, each ending with a "//"
+ * line. Server commands (starting with '!') are skipped; a load test
+ * shouldn't shut the server down.
+ */
+static int
+read_query_log(const char *logfile, QUERY **ret_q, int *ret_nq, char *errbuf)
+{
+  FILE  *fp     = NULL;
+  QUERY *q      = NULL;
+  int    nq     = 0;
+  char  *text   = NULL;
+  int    n      = 0;
+  int    nalloc = 0;
+  char   line[4096];
+  int    len;
+  char  *s;
+  int    status;
+
+  if ((fp = fopen(logfile, "r")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "failed to open query log %s", logfile);
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      len = strlen(line);
+      if (n + len + 1 > nalloc) {
+	nalloc = ESL_MAX(2 * nalloc, n + len + 1);
+	ESL_REALLOC(text, sizeof(char) * nalloc);
+      }
+      strcpy(text + n, line);
+      n += len;
+      if (strncmp(line, "//", 2) != 0) continue;
+
+      /* one complete query */
+      for (s = text; *s && isspace(*s); s++) ;
+      if (*s != '!' && strncmp(s, "//", 2) != 0)
+	{
+	  ESL_REALLOC(q, sizeof(QUERY) * (nq+1));
+	  q[nq].text = text;
+	  q[nq].n    = n;
+	  q[nq].type = classify_query(text);
+	  nq++;
+	  text   = NULL;
+	  nalloc = 0;
+	}
+      n = 0;
+    }
+  if (nq == 0) ESL_XFAIL(eslEFORMAT, errbuf, "no queries in %s; each must end with a // line", logfile);
+
+  free(text);
+  fclose(fp);
+  *ret_q  = q;
+  *ret_nq = nq;
+  return eslOK;
+
+ ERROR:
+  if (fp)   fclose(fp);
+  if (text) free(text);
+  while (nq--) free(q[nq].text);
+  if (q)    free(q);
+  *ret_q  = NULL;
+  *ret_nq = 0;
+  return status;
+}
+
+/* append_text()
+ * Append string <s> to the query text being built in <q>,
+ * reallocating as needed.
+ */
+static int
+append_text(QUERY *q, int *nalloc, const char *s)
+{
+  int len = strlen(s);
+  int status;
+
+  if (q->n + len + 1 > *nalloc) {
+    *nalloc = ESL_MAX(2 * (*nalloc), q->n + len + 1);
+    ESL_REALLOC(q->text, sizeof(char) * (*nalloc));
+  }
+  strcpy(q->text + q->n, s);
+  q->n += len;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* make_synthetic()
+ * Make a pool of <npool> synthetic queries, in the proportions of
+ * types given by --phmmer, --hmmsearch, --hmmscan. Query sequences are
+ * iid with background frequencies; query models are sampled and
+ * calibrated, so the master gets E-value parameters.
+ */
+static int
+make_synthetic(ESL_GETOPTS *go, ESL_RANDOMNESS *r, QUERY **ret_q, int *ret_nq)
+{
+  ESL_ALPHABET *abc    = esl_alphabet_Create(eslAMINO);
+  P7_BG        *bg     = p7_bg_Create(abc);
+  P7_HMM       *hmm    = NULL;
+  FILE         *tmpfp  = NULL;
+  ESL_DSQ      *dsq    = NULL;
+  QUERY        *q      = NULL;
+  int           npool  = esl_opt_GetInteger(go, "--npool");
+  int           L      = esl_opt_GetInteger(go, "-L");
+  int           M      = esl_opt_GetInteger(go, "-M");
+  double        w[3];
+  char          line[4096];
+  int           nalloc;
+  int           i, pos;
+  int           status;
+
+  w[qPHMMER]    = esl_opt_GetReal(go, "--phmmer");
+  w[qHMMSEARCH] = esl_opt_GetReal(go, "--hmmsearch");
+  w[qHMMSCAN]   = esl_opt_GetReal(go, "--hmmscan");
+  if (esl_vec_DSum(w, 3) == 0.) p7_Fail("The --phmmer, --hmmsearch, --hmmscan weights can't all be zero");
+  esl_vec_DNorm(w, 3);
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
+  ESL_ALLOC(q,   sizeof(QUERY)   * npool);
+  for (i = 0; i < npool; i++) q[i].text = NULL;
+
+  for (i = 0; i < npool; i++)
+    {
+      q[i].type = esl_rnd_DChoose(r, w, 3);
+      q[i].n    = 0;
+      nalloc    = 0;
+
+      snprintf(line, sizeof(line), "@%s %d%s%s\n",
+	       (q[i].type == qHMMSCAN ? "--hmmdb" : "--seqdb"),
+	       (q[i].type == qHMMSCAN ? esl_opt_GetInteger(go, "--hmmdb") : esl_opt_GetInteger(go, "--seqdb")),
+	       (esl_opt_IsOn(go, "--opts") ? " " : ""),
+	       (esl_opt_IsOn(go, "--opts") ? esl_opt_GetString(go, "--opts") : ""));
+      if ((status = append_text(&(q[i]), &nalloc, line)) != eslOK) goto ERROR;
+
+      if (q[i].type == qHMMSEARCH)
+	{
+	  if (p7_hmm_Sample(r, M, abc, &hmm) != eslOK) p7_Fail("failed to sample an HMM");
+	  snprintf(line, sizeof(line), "synthetic%d", i);
+	  p7_hmm_SetName(hmm, line);
+	  if (p7_Calibrate(hmm, NULL, &r, &bg, NULL, NULL) != eslOK) p7_Fail("failed to calibrate an HMM");
+
+	  if ((tmpfp = tmpfile()) == NULL) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to open a tmpfile");
+	  if (p7_hmmfile_WriteASCII(tmpfp, -1, hmm) != eslOK) ESL_XEXCEPTION_SYS(eslEWRITE, "HMM write failed");
+	  rewind(tmpfp);
+	  while (fgets(line, sizeof(line), tmpfp) != NULL)
+	    if (strncmp(line, "//", 2) != 0 && (status = append_text(&(q[i]), &nalloc, line)) != eslOK) goto ERROR;
+	  fclose(tmpfp);  tmpfp = NULL;
+	  p7_hmm_Destroy(hmm); hmm = NULL;
+	}
+      else
+	{
+	  esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+	  snprintf(line, sizeof(line), ">synthetic%d\n", i);
+	  if ((status = append_text(&(q[i]), &nalloc, line)) != eslOK) goto ERROR;
+	  for (pos = 1; pos <= L; pos++)
+	    {
+	      line[0] = abc->sym[dsq[pos]];
+	      line[1] = (pos % 60 == 0 || pos == L) ? '\n' : '\0';
+	      line[2] = '\0';
+	      if ((status = append_text(&(q[i]), &nalloc, line)) != eslOK) goto ERROR;
+	    }
+	}
+      if ((status = append_text(&(q[i]), &nalloc, "//\n")) != eslOK) goto ERROR;
+    }
+
+  free(dsq);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  *ret_q  = q;
+  *ret_nq = npool;
+  return eslOK;
+
+ ERROR:
+  if (tmpfp) fclose(tmpfp);
+  if (hmm)   p7_hmm_Destroy(hmm);
+  if (q)     { for (i = 0; i < npool; i++) free(q[i].text); free(q); }
+  free(dsq);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  *ret_q  = NULL;
+  *ret_nq = 0;
+  return status;
+}
+
+
+/*****************************************************************
+ * 2. Client threads.
+ *****************************************************************/
+
+/* Status of each query, as recorded in the results. */
+#define qrNOTSENT   0     /* never sent: its connection was lost      */
+#define qrOK        1
+#define qrFAILED    2     /* the master returned an error             */
+#define qrCONNERR   3     /* connection failed while it was in flight */
+
+/* LOAD: shared by all the client threads. */
+typedef struct {
+  struct sockaddr_in  serv_addr;
+  QUERY              *q;
+  int                 nq;
+  int                 N;          /* total number of queries to send          */
+  double              qps;        /* target rate, or 0 for closed-loop        */
+  double              t0;         /* start time, seconds                      */
+
+  pthread_mutex_t     mutex;      /* protects <next>                          */
+  int                 next;       /* index of next query to send              */
+
+  double             *latency;    /* results of each query [0..N-1]: seconds  */
+  uint64_t           *bytes;      /*   result bytes received                  */
+  int                *status;     /*   qrOK, etc.                             */
+} LOAD;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec + (double) tv.tv_usec * 1e-6;
+}
+
+static void
+sleep_until(double t)
+{
+  struct timespec ts;
+  double          dt;
+
+  while ((dt = t - now()) > 0.)
+    {
+      ts.tv_sec  = (time_t) dt;
+      ts.tv_nsec = (long) ((dt - (double) ts.tv_sec) * 1e9);
+      nanosleep(&ts, NULL);
+    }
+}
+
+static int
+open_connection(const struct sockaddr_in *serv_addr)
+{
+  int sock;
+
+  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+  if (connect(sock, (const struct sockaddr *) serv_addr, sizeof(struct sockaddr_in)) < 0) { close(sock); return -1; }
+  return sock;
+}
+
+/* send_query()
+ * Send one query on <sock> and read its complete reply, into <*buf>
+ * (reallocated as needed). Return qrOK, qrFAILED or qrCONNERR, and the
+ * number of bytes received in <*ret_bytes>.
+ */
+static int
+send_query(int sock, const QUERY *q, uint8_t **buf, uint64_t *nalloc, uint64_t *ret_bytes)
+{
+  uint8_t             sbuf[HMMD_SEARCH_STATUS_SERIAL_SIZE];
+  uint32_t            pos = 0;
+  HMMD_SEARCH_STATUS  sstatus;
+  void               *p;
+
+  *ret_bytes = 0;
+  if (writen(sock, q->text, q->n) != (size_t) q->n)                                                          return qrCONNERR;
+  if (readn(sock, sbuf, HMMD_SEARCH_STATUS_SERIAL_SIZE) != HMMD_SEARCH_STATUS_SERIAL_SIZE)             return qrCONNERR;
+  if (hmmd_search_status_Deserialize(sbuf, &pos, &sstatus) != eslOK)                                   return qrCONNERR;
+
+  if (sstatus.msg_size > *nalloc) {
+    if ((p = realloc(*buf, sstatus.msg_size)) == NULL) return qrCONNERR;
+    *buf    = p;
+    *nalloc = sstatus.msg_size;
+  }
+  if (sstatus.msg_size > 0 && readn(sock, *buf, sstatus.msg_size) != sstatus.msg_size) return qrCONNERR;
+
+  *ret_bytes = HMMD_SEARCH_STATUS_SERIAL_SIZE + sstatus.msg_size;
+  return (sstatus.status == eslOK ? qrOK : qrFAILED);
+}
+
+/* client_thread()
+ * One client connection: take the next query, send it when it's due,
+ * record its latency, until all have been sent. If the connection is
+ * lost, try once to reconnect, then give up; queries this thread
+ * doesn't get to are taken by the others.
+ */
+static void *
+client_thread(void *arg)
+{
+  LOAD     *load   = (LOAD *) arg;
+  uint8_t  *buf    = NULL;
+  uint64_t  nalloc = 0;
+  int       sock;
+  double    start;
+  int       i;
+
+  if ((sock = open_connection(&(load->serv_addr))) < 0) return NULL;
+
+  while (1)
+    {
+      pthread_mutex_lock(&(load->mutex));
+      i = load->next++;
+      pthread_mutex_unlock(&(load->mutex));
+      if (i >= load->N) break;
+
+      if (load->qps > 0.) {
+	start = load->t0 + (double) i / load->qps;
+	sleep_until(start);
+      } else start = now();
+
+      load->status[i]  = send_query(sock, &(load->q[i % load->nq]), &buf, &nalloc, &(load->bytes[i]));
+      load->latency[i] = now() - start;
+
+      if (load->status[i] == qrCONNERR)
+	{
+	  close(sock);
+	  if ((sock = open_connection(&(load->serv_addr))) < 0) break;
+	}
+    }
+
+  if (sock >= 0) close(sock);
+  free(buf);
+  return NULL;
+}
+
+
+/*****************************************************************
+ * 3. Report.
+ *****************************************************************/
+
+static int
+cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/* percentile()
+ * <p>'th percentile of sorted values <x[0..n-1]>, nearest rank.
+ */
+static double
+percentile(const double *x, int n, double p)
+{
+  int i = (int) ceil(p / 100. * (double) n) - 1;
+  return x[ESL_MAX(0, ESL_MIN(i, n-1))];
+}
+
+/* output_latencies()
+ * One summary line: how many queries of a kind (<type>, or all
+ * of them if it's -1) completed, and their latency percentiles in ms.
+ */
+static int
+output_latencies(FILE *ofp, const LOAD *load, int type, const char *label)
+{
+  double  *x = NULL;
+  double   sum = 0.;
+  int      n   = 0;
+  int      nerr = 0;
+  int      i;
+  int      status;
+
+  ESL_ALLOC(x, sizeof(double) * load->N);
+  for (i = 0; i < load->N; i++)
+    {
+      if (type != -1 && load->q[i % load->nq].type != type) continue;
+      if (load->status[i] == qrOK) { x[n++] = load->latency[i] * 1000.; sum += load->latency[i] * 1000.; }
+      else nerr++;
+    }
+  if (n + nerr > 0)
+    {
+      qsort(x, n, sizeof(double), cmp_double);
+      if (n > 0) fprintf(ofp, "%-10s %8d %8d %10.1f %10.1f %10.1f %10.1f %10.1f\n", label, n, nerr,
+			 sum / (double) n, percentile(x, n, 50.), percentile(x, n, 95.), percentile(x, n, 99.), x[n-1]);
+      else       fprintf(ofp, "%-10s %8d %8d %10s %10s %10s %10s %10s\n", label, n, nerr, "-", "-", "-", "-", "-");
+    }
+  free(x);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* output_report()
+ * Summarize the run on <ofp>; return the number of failed queries in <*ret_nerr>.
+ */
+static int
+output_report(FILE *ofp, const LOAD *load, double elapsed, int *ret_nerr)
+{
+  uint64_t totbytes = 0;
+  int      nok      = 0;
+  int      nfailed  = 0;
+  int      nconn    = 0;
+  int      nnotsent = 0;
+  int      i, t;
+
+  for (i = 0; i < load->N; i++)
+    switch (load->status[i]) {
+    case qrOK:      nok++;   totbytes += load->bytes[i]; break;
+    case qrFAILED:  nfailed++;                           break;
+    case qrCONNERR: nconn++;                             break;
+    default:        nnotsent++;                          break;
+    }
+
+  fprintf(ofp, "# queries completed:     %d of %d\n", nok, load->N);
+  fprintf(ofp, "# errors from master:    %d\n", nfailed);
+  fprintf(ofp, "# connection errors:     %d\n", nconn);
+  fprintf(ofp, "# queries not sent:      %d\n", nnotsent);
+  fprintf(ofp, "# elapsed time:          %.3f s\n", elapsed);
+  fprintf(ofp, "# throughput:            %.2f queries/s\n", (double) nok / elapsed);
+  fprintf(ofp, "# result bytes:          %" PRIu64 " total, %.0f per query\n", totbytes, nok > 0 ? (double) totbytes / (double) nok : 0.);
+  fprintf(ofp, "# result bandwidth:      %.3f MB/s\n", (double) totbytes / elapsed / 1e6);
+  fprintf(ofp, "#\n");
+  fprintf(ofp, "# %-8s %8s %8s %10s %10s %10s %10s %10s\n", "type",     "ok",       "errors",   "mean ms",    "p50 ms",     "p95 ms",     "p99 ms",     "max ms");
+  fprintf(ofp, "# %-8s %8s %8s %10s %10s %10s %10s %10s\n", "--------", "--------", "--------", "----------", "----------", "----------", "----------", "----------");
+  for (t = 0; t < qNTYPES; t++)
+    output_latencies(ofp, load, t, query_type_name[t]);
+  output_latencies(ofp, load, -1, "all");
+
+  *ret_nerr = nfailed + nconn + nnotsent;
+  return eslOK;
+}
+
+/* output_table()
+ * For -o: one line per query.
+ */
+static int
+output_table(FILE *ofp, const LOAD *load)
+{
+  static const char *statusname[4] = { "notsent", "ok", "failed", "connerr" };
+  int i;
+
+  fprintf(ofp, "# %6s %-9s %10s %12s %s\n", "query", "type",      "latency_ms", "bytes",        "status");
+  fprintf(ofp, "# %6s %-9s %10s %12s %s\n", "------", "---------", "----------", "------------", "-------");
+  for (i = 0; i < load->N; i++)
+    fprintf(ofp, "%8d %-9s %10.2f %12" PRIu64 " %s\n", i, query_type_name[load->q[i % load->nq].type],
+	    load->latency[i] * 1000., load->bytes[i], statusname[load->status[i]]);
+  return eslOK;
+}
+
+
+/*****************************************************************
+ * 4. main().
+ *****************************************************************/
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, -1, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r       = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  FILE           *tblfp   = NULL;
+  pthread_t      *tid     = NULL;
+  LOAD            load;
+  int             nconc   = esl_opt_GetInteger(go, "--conc");
+  int             nerr    = 0;
+  double          elapsed;
+  char            errbuf[eslERRBUFSIZE];
+  int             i;
+  int             status;
+
+  if (esl_opt_ArgNumber(go) > 1) p7_Fail("Incorrect number of command line arguments.\n%s", usage);
+  if (esl_opt_ArgNumber(go) == 1 && (esl_opt_IsUsed(go, "--phmmer") || esl_opt_IsUsed(go, "--hmmsearch") || esl_opt_IsUsed(go, "--hmmscan") ||
+				     esl_opt_IsUsed(go, "-L") || esl_opt_IsUsed(go, "-M") || esl_opt_IsUsed(go, "--npool") ||
+				     esl_opt_IsUsed(go, "--seqdb") || esl_opt_IsUsed(go, "--hmmdb") || esl_opt_IsUsed(go, "--opts")))
+    p7_Fail("Options %s only apply to synthetic queries, not to a query log", SYNOPTS);
+
+  /* a lost connection shouldn't kill us; it's an error to count */
+  signal(SIGPIPE, SIG_IGN);
+
+  load.q       = NULL;
+  load.latency = NULL;
+  load.bytes   = NULL;
+  load.status  = NULL;
+  load.next    = 0;
+  load.qps     = esl_opt_IsOn(go, "--qps") ? esl_opt_GetReal(go, "--qps") : 0.;
+
+  if (esl_opt_ArgNumber(go) == 1) {
+    if (read_query_log(esl_opt_GetArg(go, 1), &load.q, &load.nq, errbuf) != eslOK) p7_Fail("%s", errbuf);
+  } else {
+    if (make_synthetic(go, r, &load.q, &load.nq) != eslOK) p7_Fail("Failed to make synthetic queries");
+  }
+  load.N = (esl_opt_IsOn(go, "-N") ? esl_opt_GetInteger(go, "-N") : (esl_opt_ArgNumber(go) == 1 ? load.nq : 100));
+
+  memset(&(load.serv_addr), 0, sizeof(load.serv_addr));
+  load.serv_addr.sin_family = AF_INET;
+  load.serv_addr.sin_port   = htons(esl_opt_GetInteger(go, "-p"));
+  if (inet_pton(AF_INET, esl_opt_GetString(go, "-i"), &(load.serv_addr.sin_addr)) != 1) p7_Fail("Bad IP address %s", esl_opt_GetString(go, "-i"));
+
+  ESL_ALLOC(load.latency, sizeof(double)   * load.N);
+  ESL_ALLOC(load.bytes,   sizeof(uint64_t) * load.N);
+  ESL_ALLOC(load.status,  sizeof(int)      * load.N);
+  ESL_ALLOC(tid,          sizeof(pthread_t) * nconc);
+  for (i = 0; i < load.N; i++) { load.latency[i] = 0.; load.bytes[i] = 0; load.status[i] = qrNOTSENT; }
+  if (pthread_mutex_init(&(load.mutex), NULL) != 0) p7_Fail("mutex init failed");
+
+  p7_banner(stdout, argv[0], banner);
+  fprintf(stdout, "# hmmpgmd master:          %s:%d\n", esl_opt_GetString(go, "-i"), esl_opt_GetInteger(go, "-p"));
+  if (esl_opt_ArgNumber(go) == 1)
+    fprintf(stdout, "# query log:               %s (%d queries)\n", esl_opt_GetArg(go, 1), load.nq);
+  else
+    fprintf(stdout, "# synthetic queries:       %d (phmmer L=%d, hmmsearch M=%d, hmmscan L=%d)\n", load.nq,
+	    esl_opt_GetInteger(go, "-L"), esl_opt_GetInteger(go, "-M"), esl_opt_GetInteger(go, "-L"));
+  fprintf(stdout, "# queries to send:         %d\n", load.N);
+  fprintf(stdout, "# concurrent connections:  %d\n", nconc);
+  if (load.qps > 0.) fprintf(stdout, "# target rate:             %.2f queries/s (open loop)\n", load.qps);
+  else               fprintf(stdout, "# target rate:             as fast as possible (closed loop)\n");
+  fprintf(stdout, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n");
+
+  load.t0 = now();
+  for (i = 0; i < nconc; i++)
+    if (pthread_create(&(tid[i]), NULL, client_thread, &load) != 0) p7_Fail("thread create failed");
+  for (i = 0; i < nconc; i++)
+    pthread_join(tid[i], NULL);
+  elapsed = now() - load.t0;
+
+  output_report(stdout, &load, elapsed, &nerr);
+
+  if (esl_opt_IsOn(go, "-o"))
+    {
+      if ((tblfp = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL) p7_Fail("Failed to open table %s for writing", esl_opt_GetString(go, "-o"));
+      output_table(tblfp, &load);
+      fclose(tblfp);
+    }
+
+  pthread_mutex_destroy(&(load.mutex));
+  for (i = 0; i < load.nq; i++) free(load.q[i].text);
+  free(load.q);
+  free(load.latency);
+  free(load.bytes);
+  free(load.status);
+  free(tid);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return (nerr > 0 ? 1 : 0);
+
+ ERROR:
+  p7_Fail("allocation failed");
+  return status;
+}
+
+#endif /*HMMER_THREADS*/
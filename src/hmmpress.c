@@ -10,12 +10,45 @@
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
 
+#ifdef HMMER_THREADS
+#include <unistd.h>
+#include "esl_threads.h"
+#include "esl_workqueue.h"
+#endif /*HMMER_THREADS*/
+
 #include "hmmer.h"
 
+typedef struct {
+#ifdef HMMER_THREADS
+  ESL_WORK_QUEUE   *queue;
+#endif /*HMMER_THREADS*/
+  P7_BG            *bg;
+} WORKER_INFO;
+
+#ifdef HMMER_THREADS
+typedef struct {
+  int          nmodel;		/* which # model this is in the file, 1.. */
+  int          processed;
+  int          status;		/* status of conversion                   */
+  P7_HMM      *hmm;
+  P7_OPROFILE *om;
+} WORK_ITEM;
+
+typedef struct _pending_s {
+  int          nmodel;
+  P7_HMM      *hmm;
+  P7_OPROFILE *om;
+  struct _pending_s *next;
+} PENDING_ITEM;
+#endif /*HMMER_THREADS*/
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",          0 },
   { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "force: overwrite any previous pressed files",   0 },
+#ifdef HMMER_THREADS 
+  { "--cpu",     eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>=0",  NULL,      NULL,    NULL, "number of parallel CPU workers for multithreads", 0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
@@ -39,6 +72,15 @@ struct dbfiles {
 static struct dbfiles *open_dbfiles (ESL_GETOPTS *go, char *basename);
 static void            close_dbfiles(struct dbfiles *dbf, int status);
 
+static int  convert_model(P7_HMM *hmm, P7_BG *bg, P7_OPROFILE **ret_om);
+static int  press_model  (struct dbfiles *dbf, uint16_t fh, P7_HMM *hmm, P7_OPROFILE *om, char *errbuf);
+static int  read_failure (int status, char *hmmfile, char *errbuf);
+static int  serial_loop  (P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM *hmm, P7_BG *bg, struct dbfiles *dbf, uint16_t fh, int *ret_nmodel, char *errbuf);
+#ifdef HMMER_THREADS
+static int  thread_loop  (ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM *hmm, struct dbfiles *dbf, uint16_t fh, int *ret_nmodel, char *errbuf);
+static void pipeline_thread(void *arg);
+#endif /*HMMER_THREADS*/
+
 int
 main(int argc, char **argv)
 {
@@ -48,12 +90,17 @@ main(int argc, char **argv)
   P7_HMMFILE     *hfp     = NULL;
   P7_HMM         *hmm     = NULL;
   P7_BG          *bg      = NULL;
-  P7_PROFILE     *gm      = NULL;
-  P7_OPROFILE    *om      = NULL;
   struct dbfiles *dbf     = NULL;
   uint16_t        fh      = 0;
   int             nmodel  = 0;
-  uint64_t        totM    = 0;
+  int             ncpus   = 0;
+  WORKER_INFO    *info    = NULL;
+#ifdef HMMER_THREADS
+  ESL_THREADS    *threadObj = NULL;
+  ESL_WORK_QUEUE *queue     = NULL;
+  WORK_ITEM      *item      = NULL;
+#endif
+  int             i;
   int             status;
   char            errbuf[eslERRBUFSIZE];
 
@@ -74,42 +121,48 @@ main(int argc, char **argv)
   printf("Working...    "); 
   fflush(stdout);
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+  /* The first model tells us the alphabet, which we need before we can set up workers. */
+  status = p7_hmmfile_Read(hfp, &abc, &hmm);
+  if (status == eslOK)
     {
-      if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
-
-      if (nmodel == 0) { 	/* first time initialization, now that alphabet known */
-	bg = p7_bg_Create(abc);
-	p7_bg_SetLength(bg, 400);
-      }
-
-      nmodel++;
-      totM += hmm->M;
-
-      gm = p7_profile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
-      om = p7_oprofile_Create(gm->M, abc);
-      p7_oprofile_Convert(gm, om);
-      
-      if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
-      if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
-      if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
-
-      if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
-      if (hmm->acc) {
-	if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
-      }
-
-      p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
-      p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
-
-      p7_profile_Destroy(gm);
-      p7_oprofile_Destroy(om);
-      p7_hmm_Destroy(hmm);
+      bg = p7_bg_Create(abc);
+      p7_bg_SetLength(bg, 400);
+
+#ifdef HMMER_THREADS
+      ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+      if (ncpus > 0)
+	{
+	  threadObj = esl_threads_Create(&pipeline_thread);
+	  queue     = esl_workqueue_Create(ncpus * 2);
+
+	  ESL_ALLOC(info, sizeof(*info) * ncpus);
+	  for (i = 0; i < ncpus; i++)
+	    {
+	      info[i].bg    = p7_bg_Create(abc);
+	      p7_bg_SetLength(info[i].bg, 400);
+	      info[i].queue = queue;
+	      esl_threads_AddThread(threadObj, &info[i]);
+	    }
+
+	  for (i = 0; i < ncpus * 2; i++)
+	    {
+	      ESL_ALLOC(item, sizeof(*item));
+	      item->nmodel    = 0;
+	      item->processed = FALSE;
+	      item->status    = eslOK;
+	      item->hmm       = NULL;
+	      item->om        = NULL;
+	      if (esl_workqueue_Init(queue, item) != eslOK) ESL_XFAIL(eslEMEM, errbuf, "Failed to add block to work queue");
+	    }
+	  status = thread_loop(threadObj, queue, hfp, &abc, hmm, dbf, fh, &nmodel, errbuf);
+	}
+      else
+#endif /*HMMER_THREADS*/
+	status = serial_loop(hfp, &abc, hmm, bg, dbf, fh, &nmodel, errbuf);
+      hmm = NULL;		/* the loops took care of it */
+      if (status != eslOK) goto ERROR;
     }
-  if      (status == eslEFORMAT)   ESL_XFAIL(status, errbuf, "bad file format in HMM file %s",             hmmfile); 
-  else if (status == eslEINCOMPAT) ESL_XFAIL(status, errbuf, "HMM file %s contains different alphabets",   hmmfile); 
-  else if (status != eslEOF)       ESL_XFAIL(status, errbuf, "Unexpected error in reading HMMs from %s",   hmmfile); 
+  else if (status != eslEOF) { read_failure(status, hmmfile, errbuf); goto ERROR; }
 
   status = esl_newssi_Write(dbf->nssi);
   if      (status == eslEDUP)     ESL_XFAIL(status, errbuf, "SSI index construction failed:\n  %s", dbf->nssi->errbuf);        
@@ -127,6 +180,18 @@ main(int argc, char **argv)
   printf("Profiles (MSV part) pressed into:  %s\n", dbf->ffile);
   printf("Profiles (remainder) pressed into: %s\n", dbf->pfile);
 
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &item) == eslOK) free(item);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+      for (i = 0; i < ncpus; i++) p7_bg_Destroy(info[i].bg);
+      free(info);
+    }
+#endif
+
   close_dbfiles(dbf, eslOK);
   p7_bg_Destroy(bg);
   p7_hmmfile_Close(hfp);
@@ -137,6 +202,7 @@ main(int argc, char **argv)
  ERROR:
   fprintf(stderr, "%s\n", errbuf);
   close_dbfiles(dbf, status);
+  p7_hmm_Destroy(hmm);
   p7_bg_Destroy(bg);
   p7_hmmfile_Close(hfp);
   esl_alphabet_Destroy(abc);
@@ -222,3 +288,266 @@ close_dbfiles(struct dbfiles *dbf, int status)
 
 }
 
+
+
+/* convert_model()
+ * Configure <hmm> as a local profile for a length 400 target, and
+ * convert it to the optimized profile <*ret_om> that gets written to
+ * the .h3f/.h3p files. This is the expensive part of pressing, the
+ * part that the worker threads do.
+ */
+static int
+convert_model(P7_HMM *hmm, P7_BG *bg, P7_OPROFILE **ret_om)
+{
+  P7_PROFILE  *gm = NULL;
+  P7_OPROFILE *om = NULL;
+  int          status;
+
+  if ((gm = p7_profile_Create(hmm->M, hmm->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((om = p7_oprofile_Create(hmm->M, hmm->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL)) != eslOK) goto ERROR;
+  if ((status = p7_oprofile_Convert(gm, om))                  != eslOK) goto ERROR;
+
+  p7_profile_Destroy(gm);
+  *ret_om = om;
+  return eslOK;
+
+ ERROR:
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  *ret_om = NULL;
+  return status;
+}
+
+
+/* press_model()
+ * Write <hmm> and its optimized profile <om> to the pressed files,
+ * and index it. Must be called in the order the models are in the
+ * input file.
+ */
+static int
+press_model(struct dbfiles *dbf, uint16_t fh, P7_HMM *hmm, P7_OPROFILE *om, char *errbuf)
+{
+  int status;
+
+  if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_FAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
+  if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_FAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
+  if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_FAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
+
+  if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_FAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
+  if (hmm->acc) {
+    if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_FAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
+  }
+
+  p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
+  p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
+  return eslOK;
+}
+
+
+/* read_failure()
+ * Set <errbuf> for a non-OK, non-EOF <status> from p7_hmmfile_Read().
+ */
+static int
+read_failure(int status, char *hmmfile, char *errbuf)
+{
+  if      (status == eslEFORMAT)   ESL_FAIL(status, errbuf, "bad file format in HMM file %s",             hmmfile); 
+  else if (status == eslEINCOMPAT) ESL_FAIL(status, errbuf, "HMM file %s contains different alphabets",   hmmfile); 
+  else                             ESL_FAIL(status, errbuf, "Unexpected error in reading HMMs from %s",   hmmfile); 
+}
+
+
+/* serial_loop()
+ * Press <hmm>, the first model in <hfp>, and all the rest.
+ * Takes ownership of <hmm>.
+ */
+static int
+serial_loop(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM *hmm, P7_BG *bg, struct dbfiles *dbf, uint16_t fh, int *ret_nmodel, char *errbuf)
+{
+  P7_OPROFILE *om     = NULL;
+  int          nmodel = 0;
+  int          status = eslOK;
+
+  do {
+    if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
+    nmodel++;
+
+    if ((status = convert_model(hmm, bg, &om))            != eslOK) ESL_XFAIL(status, errbuf, "Failed to convert HMM %s to an optimized profile", hmm->name);
+    if ((status = press_model(dbf, fh, hmm, om, errbuf))  != eslOK) goto ERROR;
+
+    p7_oprofile_Destroy(om);  om  = NULL;
+    p7_hmm_Destroy(hmm);      hmm = NULL;
+  } while ((status = p7_hmmfile_Read(hfp, byp_abc, &hmm)) == eslOK);
+  if (status != eslEOF) { read_failure(status, hfp->fname, errbuf); goto ERROR; }
+
+  *ret_nmodel = nmodel;
+  return eslOK;
+
+ ERROR:
+  p7_oprofile_Destroy(om);
+  p7_hmm_Destroy(hmm);
+  *ret_nmodel = nmodel;
+  return status;
+}
+
+
+#ifdef HMMER_THREADS
+/* thread_loop()
+ * Threaded version of serial_loop(). The master reads models and
+ * hands them to the workers to convert; converted models come back
+ * in any order, and are held in a pending list so they're written
+ * and indexed in input file order. The pressed files are identical
+ * to serial_loop()'s.
+ */
+static int
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM *hmm, struct dbfiles *dbf, uint16_t fh, int *ret_nmodel, char *errbuf)
+{
+  int           rstatus   = eslOK;	/* status of reading models                  */
+  int           status    = eslOK;
+  int           nmodel    = 0;		/* number of models read                     */
+  int           processed = 0;		/* number of models back from the workers    */
+  int           next      = 1;		/* number of the next model to write         */
+  WORK_ITEM    *item;
+  void         *newItem;
+  PENDING_ITEM *top       = NULL;
+  PENDING_ITEM *empty     = NULL;
+  PENDING_ITEM *tmp       = NULL;
+  PENDING_ITEM *ptr;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* Main loop: */
+  item = (WORK_ITEM *) newItem;
+  while (rstatus == eslOK) {
+    if (hmm == NULL) rstatus = p7_hmmfile_Read(hfp, byp_abc, &hmm);   /* the first model was read by our caller */
+    if (rstatus == eslOK) {
+      if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
+      item->nmodel = ++nmodel;
+      item->hmm    = hmm;
+      hmm          = NULL;
+    }
+    else if (rstatus == eslEOF && processed < nmodel) rstatus = eslOK;
+    else if (rstatus != eslEOF) { read_failure(rstatus, hfp->fname, errbuf); status = rstatus; goto ERROR; }
+
+    if (rstatus == eslOK) {
+      status = esl_workqueue_ReaderUpdate(queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue reader failed");
+
+      /* process any results */
+      item = (WORK_ITEM *) newItem;
+      if (item->processed == TRUE) {
+	++processed;
+	if (item->status != eslOK) ESL_XFAIL(item->status, errbuf, "Failed to convert HMM %s to an optimized profile", item->hmm->name);
+
+	/* add it to the pending list, in file order... */
+	if (empty != NULL) { tmp = empty; empty = tmp->next; }
+	else               ESL_ALLOC(tmp, sizeof(PENDING_ITEM));
+	tmp->nmodel = item->nmodel;
+	tmp->hmm    = item->hmm;
+	tmp->om     = item->om;
+
+	if (top == NULL || tmp->nmodel < top->nmodel) {
+	  tmp->next = top;
+	  top       = tmp;
+	} else {
+	  ptr = top;
+	  while (ptr->next != NULL && tmp->nmodel > ptr->next->nmodel) ptr = ptr->next;
+	  tmp->next = ptr->next;
+	  ptr->next = tmp;
+	}
+
+	/* ...and write as many as we can while keeping that order */
+	while (top != NULL && top->nmodel == next) {
+	  if ((status = press_model(dbf, fh, top->hmm, top->om, errbuf)) != eslOK) goto ERROR;
+	  p7_oprofile_Destroy(top->om);
+	  p7_hmm_Destroy(top->hmm);
+
+	  tmp       = top;
+	  top       = tmp->next;
+	  tmp->next = empty;
+	  empty     = tmp;
+	  ++next;
+	}
+
+	item->nmodel    = 0;
+	item->processed = FALSE;
+	item->status    = eslOK;
+	item->hmm       = NULL;
+	item->om        = NULL;
+      }
+    }
+  }
+
+  if (top != NULL) esl_fatal("Top is not empty\n");
+
+  while (empty != NULL) {
+    tmp   = empty;
+    empty = tmp->next;
+    free(tmp);
+  }
+
+  status = esl_workqueue_ReaderUpdate(queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+
+  *ret_nmodel = nmodel;
+  return eslOK;
+
+  /* Errors are fatal to the caller, which removes the partial pressed files and exits; 
+   * we don't try to shut the workers down cleanly.
+   */
+ ERROR:
+  p7_hmm_Destroy(hmm);
+  *ret_nmodel = nmodel;
+  return status;
+}
+
+static void 
+pipeline_thread(void *arg)
+{
+  int           workeridx;
+  int           status;
+
+  WORK_ITEM    *item;
+  void         *newItem;
+
+  WORKER_INFO  *info;
+  ESL_THREADS  *obj;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  /* loop until all models have been converted */
+  item = (WORK_ITEM *) newItem;
+  while (item->hmm != NULL)
+    {
+      item->status    = convert_model(item->hmm, info->bg, &item->om);
+      item->processed = TRUE;
+
+      status = esl_workqueue_WorkerUpdate(info->queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue worker failed");
+
+      item = (WORK_ITEM *) newItem;
+    }
+
+  status = esl_workqueue_WorkerUpdate(info->queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif   /* HMMER_THREADS */
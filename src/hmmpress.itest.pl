@@ -51,6 +51,26 @@ if ($? != 0)                                     { die "hmmpress -f failed to pr
 if ($output !~ /Pressed and indexed (\d+) HMMs/) { die "unexpected hmmpress -f output"; }
 if ($1 != $nmodels)                              { die "unexpected number of models after hmmpress -f"; }
 
+# With worker threads, a press of the same file has to give the same
+# four files as a serial (--cpu 0) press, byte for byte: models are written
+# in input order no matter which worker converts them.
+$output = `$hmmpress -h 2>&1`;
+if ($output =~ /--cpu/)
+{
+    $output = `$hmmpress -f --cpu 0 $tmppfx.hmm 2>&1`;
+    if ($? != 0)                                     { die "hmmpress --cpu 0 failed to press $minifam"; }
+
+    foreach $sfx ("h3m", "h3i", "h3f", "h3p") { system("cp $tmppfx.hmm.$sfx $tmppfx.serial.$sfx 2>&1"); if ($? != 0) { die "failed to copy $tmppfx.hmm.$sfx"; } }
+
+    $output = `$hmmpress -f --cpu 4 $tmppfx.hmm 2>&1`;
+    if ($? != 0)                                     { die "hmmpress --cpu 4 failed to press $minifam"; }
+    if ($output !~ /Pressed and indexed (\d+) HMMs/) { die "unexpected hmmpress --cpu 4 output"; }
+    if ($1 != $nmodels)                              { die "unexpected number of models after hmmpress --cpu 4"; }
+
+    foreach $sfx ("h3m", "h3i", "h3f", "h3p") { system("cmp -s $tmppfx.hmm.$sfx $tmppfx.serial.$sfx"); if ($? != 0) { die "hmmpress --cpu 4 .$sfx file differs from serial press"; } }
+    unlink <$tmppfx.serial.*>;
+}
+
 print "ok\n";
 unlink <$tmppfx.hmm*>;
 exit 0;
@@ -41,20 +41,37 @@ typedef struct {
   P7_TOPHITS       *th;          /* top hit results                         */
 } WORKER_INFO;
 
+/* One query's finished results, waiting for their reports to be
+ * written. With threads, a writer thread formats and writes them, in
+ * query order, while the master goes on with the next query.
+ */
+typedef struct {
+  ESL_SQ           *qsq;         /* query sequence                          */
+  P7_PIPELINE      *pli;         /* merged pipeline; NULL means no more queries */
+  P7_TOPHITS       *th;          /* merged, sorted top hits                 */
+  ESL_STOPWATCH    *w;           /* timing of the query's search            */
+  int               nquery;      /* query number, 1..                       */
+} REPORT_JOB;
+
+typedef struct {
+#ifdef HMMER_THREADS
+  ESL_WORK_QUEUE   *queue;       /* REPORT_JOBs from master to writer       */
+#endif
+  FILE             *ofp;         /* main output                             */
+  FILE             *tblfp;       /* --tblout, or NULL                       */
+  FILE             *domtblfp;    /* --domtblout, or NULL                    */
+  FILE             *pfamtblfp;   /* --pfamtblout, or NULL                   */
+  FILE             *hitsfp;      /* --hitsout, or NULL                      */
+  char             *hitsfile;    /* name of --hitsout file, for errors      */
+  int               textw;
+} REPORT_INFO;
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
-#else
-#define CPUOPTS     NULL
-#define MPIOPTS     NULL
-#endif
-
 static ESL_OPTIONS options[] = {
   /* name           type          default  env  range toggles  reqs   incomp                         help                                           docgroup*/
   { "-h",           eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                          1 },
@@ -63,6 +80,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",         2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",           2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",    2 },
+  { "--hitsout",    eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save binary hit lists to file <f>, for merging with hmmmerge",  2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                        2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                 2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                          2 },
@@ -89,16 +107,18 @@ static ESL_OPTIONS options[] = {
   { "--nobias",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                              7 },
   /* Other options */
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",                12 },
+  { "--adaptens",   eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "adaptively size stochastic trace ensembles",                   12 },
+  { "--domcpu",     eslARG_INT,     "0",  NULL, "n>=0",  NULL,  NULL,  NULL,            "threads for domain definition of long targets",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",           12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert input <seqfile> is in format <s>: no autodetection",    12 },
 #ifdef HMMER_THREADS
-  { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,      "number of parallel CPU workers to use for multithreads",       12 },
+  { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  NULL,         "number of parallel CPU workers to use for multithreads",       12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",              12 },  
-  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  MPIOPTS,         "run as an MPI parallel program",                               12 },
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "run as an MPI parallel program",                               12 },
 #endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -124,16 +144,28 @@ static char banner[] = "search sequence(s) against a profile database";
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
 
+static REPORT_JOB *report_job_Create(ESL_ALPHABET *abc);
+static void        report_job_Destroy(REPORT_JOB *job);
+static int         output_report(REPORT_INFO *rpt, REPORT_JOB *job);
+
+#define REPORT_BUFSIZE (1 << 18) /* stdio buffer for each output stream: few, large writes */
+
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
+#define REPORT_NJOBS 4           /* how many queries' results can wait for the writer */
 
 static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
 static void pipeline_thread(void *arg);
+static void report_thread(void *arg);
 #endif
 
 #ifdef HMMER_MPI
 static int  mpi_master   (ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  mpi_worker   (ESL_GETOPTS *go, struct cfg_s *cfg);
+static void mpi_serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp);
+#ifdef HMMER_THREADS
+static void mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
+#endif
 #endif
 
 /* process_commandline()
@@ -216,6 +248,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")    && fprintf(ofp, "# per-seq hits tabular output:     %s\n",            esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout") && fprintf(ofp, "# per-dom hits tabular output:     %s\n",            esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout")&& fprintf(ofp, "# pfam-style tabular hit output:   %s\n",            esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hitsout")   && fprintf(ofp, "# binary hit lists output:         %s\n",            esl_opt_GetString(go, "--hitsout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")       && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")     && fprintf(ofp, "# show alignments in output:       no\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")   && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -237,6 +270,8 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adaptens")  && fprintf(ofp, "# adaptive trace ensembles:        on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domcpu")    && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--domcpu"))              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",          esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -261,6 +296,9 @@ main(int argc, char **argv)
   ESL_GETOPTS     *go  = NULL;	
   struct cfg_s     cfg;         
   int              status   = eslOK;
+#ifdef HMMER_MPI
+  int              provided;
+#endif
 
   impl_Init();			/* processor-specific initialization */
   p7_FLogsumInit();		/* we're going to use table-driven Logsum() approximations at times */
@@ -287,7 +325,7 @@ main(int argc, char **argv)
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
       cfg.do_mpi     = TRUE;
-      MPI_Init(&argc, &argv);
+      MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* only a rank's main thread talks MPI */
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
       MPI_Comm_size(MPI_COMM_WORLD, &(cfg.nproc));
 
@@ -321,15 +359,15 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *hitsfp   = NULL;              /* output stream for binary hit lists (--hitsout)  */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
   P7_OPROFILE     *om       = NULL;		 /* target profile                                  */
-  ESL_STOPWATCH   *w        = NULL;              /* timing                                          */
-  ESL_SQ          *qsq      = NULL;		 /* query sequence                                  */
+  REPORT_INFO      rpt;                          /* where and how to write each query's reports     */
+  REPORT_JOB      *job      = NULL;              /* query being searched, and its results           */
   int              nquery   = 0;
-  int              textw;
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
@@ -339,17 +377,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;   /* worker hit lists to merge into info[0].th */
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  ESL_THREADS     *rptObj   = NULL;   /* the report writer thread                  */
+  void            *newJob   = NULL;
 #endif
   char             errbuf[eslERRBUFSIZE];
 
-  w = esl_stopwatch_Create();
-
-  if (esl_opt_GetBoolean(go, "--notextw")) textw = 0;
-  else                                     textw = esl_opt_GetInteger(go, "--textw");
+  if (esl_opt_GetBoolean(go, "--notextw")) rpt.textw = 0;
+  else                                     rpt.textw = esl_opt_GetInteger(go, "--textw");
 
   /* If caller declared an input format, decode it */
   if (esl_opt_IsOn(go, "--qformat")) {
@@ -378,13 +417,27 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",        cfg->seqfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
-  qsq = esl_sq_CreateDigital(abc);
 
   /* Open the results output files */
   if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  esl_fatal("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); }
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--hitsout"))   { if ((hitsfp    = fopen(esl_opt_GetString(go, "--hitsout"),    "wb")) == NULL) esl_fatal("Failed to open binary hits output file %s for writing\n", esl_opt_GetString(go, "--hitsout")); }
+
+  /* Reports are made of many small writes; buffer them, and write once per query, when we fflush(). */
+  setvbuf(ofp, NULL, _IOFBF, REPORT_BUFSIZE);
+  if (tblfp)     setvbuf(tblfp,     NULL, _IOFBF, REPORT_BUFSIZE);
+  if (domtblfp)  setvbuf(domtblfp,  NULL, _IOFBF, REPORT_BUFSIZE);
+  if (pfamtblfp) setvbuf(pfamtblfp, NULL, _IOFBF, REPORT_BUFSIZE);
+  if (hitsfp)    setvbuf(hitsfp,    NULL, _IOFBF, REPORT_BUFSIZE);
+
+  rpt.ofp       = ofp;
+  rpt.tblfp     = tblfp;
+  rpt.domtblfp  = domtblfp;
+  rpt.pfamtblfp = pfamtblfp;
+  rpt.hitsfp    = hitsfp;
+  rpt.hitsfile  = (hitsfp ? esl_opt_GetString(go, "--hitsout") : NULL);
 
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
 
@@ -395,11 +448,26 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
+
+      /* The report writer runs alongside, for the whole run. The
+       * REPORT_NJOBS jobs in its queue bound how far the search can
+       * get ahead of it.
+       */
+      rptObj    = esl_threads_Create(&report_thread);
+      rpt.queue = esl_workqueue_Create(REPORT_NJOBS);
+      for (i = 0; i < REPORT_NJOBS; i++)
+	if (esl_workqueue_Init(rpt.queue, report_job_Create(abc)) != eslOK) esl_fatal("Failed to add job to report queue");
+      esl_threads_AddThread(rptObj, &rpt);
+      esl_threads_WaitForStart(rptObj);
+      if (esl_workqueue_ReaderUpdate(rpt.queue, NULL, &newJob) != eslOK) esl_fatal("Report queue reader failed");
+      job = (REPORT_JOB *) newJob;
     }
 #endif
+  if (job == NULL) job = report_job_Create(abc);
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
   for (i = 0; i < infocnt; ++i)
     {
@@ -421,10 +489,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   /* Outside loop: over each query sequence in <seqfile>. */
-  while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
+  while ((sstatus = esl_sqio_Read(sqfp, job->qsq)) == eslOK)
     {
       nquery++;
-      esl_stopwatch_Start(w);	                          
+      esl_stopwatch_Start(job->w);
 
       /* Open the target profile database */
       status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
@@ -439,10 +507,6 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	}
 #endif
 
-      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
       for (i = 0; i < infocnt; ++i)
 	{
 	  /* Create processing pipeline and hit list */
@@ -450,8 +514,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
 	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
-	  p7_pli_NewSeq(info[i].pli, qsq);
-	  info[i].qsq = qsq;
+	  p7_pli_NewSeq(info[i].pli, job->qsq);
+	  info[i].qsq = job->qsq;
 
 #ifdef HMMER_THREADS
 	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
@@ -472,42 +536,53 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile); 
 	}
 
-      /* merge the results of the search results */
+      /* merge the results of the search results: each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeList(info[0].th, thl, infocnt-1);
       for (i = 1; i < infocnt; ++i)
 	{
-	  p7_tophits_Merge(info[0].th, info[i].th);
 	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
 	  p7_pipeline_Destroy(info[i].pli);
 	  p7_tophits_Destroy(info[i].th);
 	}
 
-      /* Print results */
       p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
-
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
-
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      fflush(ofp);
-
       p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
-      esl_sq_Reuse(qsq);
+      info->pli->hfp = NULL;
+      esl_stopwatch_Stop(job->w);
+
+      /* Hand the results over to be reported; the job takes over the pipeline and hit list. */
+      job->pli    = info->pli;
+      job->th     = info->th;
+      job->nquery = nquery;
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{
+	  if (esl_workqueue_ReaderUpdate(rpt.queue, job, &newJob) != eslOK) esl_fatal("Report queue reader failed");
+	  job = (REPORT_JOB *) newJob;
+	  continue;
+	}
+#endif
+      if ((status = output_report(&rpt, job)) != eslOK) goto ERROR;
     }
   if      (sstatus == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n",
 					    sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
   else if (sstatus != eslEOF)     esl_fatal("Unexpected error %d reading sequence file %s",
 					    sstatus, sqfp->filename);
 
+#ifdef HMMER_THREADS
+  /* Send the writer an empty job, meaning no more queries, and wait for it to finish */
+  if (ncpus > 0)
+    {
+      job->pli = NULL;
+      if (esl_workqueue_ReaderUpdate(rpt.queue, job, NULL) != eslOK) esl_fatal("Report queue reader failed");
+      esl_threads_WaitForFinish(rptObj);
+      esl_workqueue_Complete(rpt.queue);
+      job = NULL;
+    }
+#endif
+
   /* Terminate outputs - any last words?
    */
   if (tblfp)    p7_tophits_TabularTail(tblfp,    "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
@@ -528,13 +603,19 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	p7_oprofile_DestroyBlock(block);
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
+
+      esl_workqueue_Reset(rpt.queue);
+      while (esl_workqueue_Remove(rpt.queue, &newJob) == eslOK)
+	report_job_Destroy((REPORT_JOB *) newJob);
+      esl_workqueue_Destroy(rpt.queue);
+      esl_threads_Destroy(rptObj);
     }
 #endif
 
   free(info);
+  free(thl);
 
-  esl_sq_Destroy(qsq);
-  esl_stopwatch_Destroy(w);
+  if (job) report_job_Destroy(job);
   esl_alphabet_Destroy(abc);
   esl_sqfile_Close(sqfp);
 
@@ -542,6 +623,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (hitsfp)        fclose(hitsfp);
   return eslOK;
 
  ERROR:
@@ -720,6 +802,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *hitsfp   = NULL;              /* output stream for binary hit lists (--hitsout)  */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
@@ -737,6 +820,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures */
   int              mpi_size = 0;                 /* size of the allocated buffer */
+  P7_TOPHITS     **mpi_thl  = NULL;              /* each worker's hit list for the current query */
   BLOCK_LIST      *list     = NULL;
   MSV_BLOCK        block;
 
@@ -787,7 +871,10 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
+  if (esl_opt_IsOn(go, "--hitsout")   && (hitsfp   = fopen(esl_opt_GetString(go, "--hitsout"),   "wb")) == NULL)
+    mpi_failure("Failed to open binary hits output file %s for writing\n", esl_opt_GetString(go, "--hitsout"));
  
+  ESL_ALLOC(mpi_thl, sizeof(P7_TOPHITS *) * cfg->nproc);
   ESL_ALLOC(list, sizeof(MSV_BLOCK));
   list->complete = 0;
   list->size     = 0;
@@ -891,29 +978,35 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
 	}
 
-      /* merge the results of the search results */
+      /* send an empty block to every worker to signal they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* collect the results in whatever order the workers finish */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
+	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
 	  if ((status = p7_pipeline_MPIRecv(dest, HMMER_PIPELINE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, go, &mpi_pli)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving pipeline from %d", status, dest);
 
-	  p7_tophits_Merge(th, mpi_th);
 	  p7_pipeline_Merge(pli, mpi_pli);
-
 	  p7_pipeline_Destroy(mpi_pli);
-	  p7_tophits_Destroy(mpi_th);
+	  mpi_thl[dest-1] = mpi_th;
 	}
 
+      /* merge the search results in rank order, so output doesn't depend on who finished first */
+      p7_tophits_MergeList(th, mpi_thl, cfg->nproc-1);
+      for (dest = 1; dest < cfg->nproc; ++dest) p7_tophits_Destroy(mpi_thl[dest-1]);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(th);
       p7_tophits_Threshold(th, pli);
@@ -923,6 +1016,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp,   qsq->name, qsq->acc, th, pli);
+      if (hitsfp && p7_tophits_WriteBinary(hitsfp, qsq->name, qsq->acc, qsq->desc, qsq->n, th, pli) != eslOK)
+        mpi_failure("Failed to write binary hits to %s\n", esl_opt_GetString(go, "--hitsout"));
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
@@ -970,6 +1065,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Cleanup - prepare for successful exit
    */
   free(list);
+  free(mpi_thl);
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_bg_Destroy(bg);
@@ -982,6 +1078,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (hitsfp)        fclose(hitsfp);
 
   return eslOK;
 
@@ -990,11 +1087,18 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 }
 
 
+/* mpi_worker()
+ * An MPI worker scans its query against the blocks of the profile
+ * database that the master hands it. If --cpu was given, a worker is
+ * itself threaded: its main thread reads the models and talks to the
+ * master, and <ncpus> pipeline threads search them, so one rank can
+ * cover a whole node. Without --cpu, each rank is a single-threaded
+ * worker.
+ */
 static int
 mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 {
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
@@ -1004,11 +1108,23 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
+  int              i;
+
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;              /* pipeline threads' hit lists to merge into info[0].th */
+#ifdef HMMER_THREADS
+  P7_OM_BLOCK     *block    = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+  int              provided;
+#endif
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures */
   int              mpi_size = 0;                 /* size of the allocated buffer */
 
-  MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
@@ -1036,16 +1152,47 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
 
   qsq = esl_sq_CreateDigital(abc);
-  bg = p7_bg_Create(abc);
 
-  /* Outside loop: over each query sequence in <seqfile>. */
-  while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
+#ifdef HMMER_THREADS
+  /* Only thread the worker if --cpu was set, and MPI lets a threaded
+   * process make MPI calls from its main thread.
+   */
+  MPI_Query_thread(&provided);
+  if (esl_opt_IsUsed(go, "--cpu") && provided >= MPI_THREAD_FUNNELED)
+    ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
     {
-      P7_PIPELINE     *pli     = NULL;		/* processing pipeline                      */
-      P7_TOPHITS      *th      = NULL;        	/* top-scoring sequence hits                */
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
 
-      MSV_BLOCK        block;
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg    = p7_bg_Create(abc);
+#ifdef HMMER_THREADS
+      info[i].queue = queue;
+#endif
+    }
+
+#ifdef HMMER_THREADS
+  for (i = 0; i < ncpus * 2; ++i)
+    {
+      block = p7_oprofile_CreateBlock(BLOCK_SIZE);
+      if (block == NULL)    mpi_failure("Failed to allocate sequence block");
+
+      status = esl_workqueue_Init(queue, block);
+      if (status != eslOK)  mpi_failure("Failed to add block to work queue");
+    }
+#endif
+
+  /* Outside loop: over each query sequence in <seqfile>. */
+  while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
+    {
       esl_stopwatch_Start(w);
 
       status = 0;
@@ -1054,81 +1201,58 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Open the target profile database */
       status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK) mpi_failure("Unexpected error %d in opening hmm file %s.\n", status, cfg->hmmfile);  
-  
-      /* Create processing pipeline and hit list */
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-      pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
-
-      p7_pli_NewSeq(pli, qsq);
 
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+#ifdef HMMER_THREADS
+      /* if we are threaded, create a lock to prevent multiple readers */
+      if (ncpus > 0)
 	{
-	  uint64_t length = 0;
-	  uint64_t count  = block.count;
-
-	  hstatus = p7_oprofile_Position(hfp, block.offset);
-	  if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block.offset);
-
-	  while (count > 0 && (hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
-	    {
-	      length = om->eoff - block.offset + 1;
-
-	      p7_pli_NewModel(pli, om, bg);
-	      p7_bg_SetLength(bg, qsq->n);
-	      p7_oprofile_ReconfigLength(om, qsq->n);
-	      
-	      p7_Pipeline(pli, om, bg, qsq, NULL, th);
-	      
-	      p7_oprofile_Destroy(om);
-	      p7_pipeline_Reuse(pli);
+	  status = p7_hmmfile_CreateLock(hfp);
+	  if (status != eslOK) mpi_failure("Unexpected error %d creating lock\n", status);
+	}
+#endif
+  
+      for (i = 0; i < infocnt; ++i)
+	{
+	  /* Create processing pipeline and hit list */
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
-	      --count;
-	    }
+	  p7_pli_NewSeq(info[i].pli, qsq);
+	  info[i].qsq = qsq;
 
-	  /* check the status of reading the hmm */
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
 
-	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	  if (count > 0)              
-	    {
-	      switch(hstatus)
-		{
-		case eslEFORMAT:
-		  mpi_failure("bad file format in HMM file %s",              cfg->hmmfile);
-		  break;
-		case eslEINCOMPAT:
-		  mpi_failure("HMM file %s contains different alphabets",    cfg->hmmfile);
-		  break;
-		case eslOK:
-		case eslEOF:
-		  mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n", block.count, block.count-count, block.offset);
-		  break;
-		default:
-		  mpi_failure("Unexpected error %d in reading HMMs from %s", hstatus, cfg->hmmfile); 
-		}
-	    }
-	  if (block.length != length) 
-	    mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length, block.offset);
+#ifdef HMMER_THREADS
+      if (ncpus > 0)  mpi_thread_loop(threadObj, queue, hfp);
+      else            mpi_serial_loop(info, hfp);
+#else
+      mpi_serial_loop(info, hfp);
+#endif
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* merge the pipeline threads' results: each thread has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeList(info[0].th, thl, infocnt-1);
+      for (i = 1; i < infocnt; ++i)
+	{
+	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
 	}
 
       esl_stopwatch_Stop(w);
 
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info->th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info->pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
       p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      p7_pipeline_Destroy(info->pli);
+      p7_tophits_Destroy(info->th);
       esl_sq_Reuse(qsq);
     } /* end outer loop over query HMMs */
   if (sstatus == eslEFORMAT) 
@@ -1141,7 +1265,22 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (mpi_buf != NULL) free(mpi_buf);
 
-  p7_bg_Destroy(bg);
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+	p7_oprofile_DestroyBlock(block);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  free(info);
+  free(thl);
 
   esl_sq_Destroy(qsq);
   esl_stopwatch_Destroy(w);
@@ -1149,9 +1288,254 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sqfile_Close(sqfp);
 
   return eslOK;
+
+ ERROR:
+  mpi_failure("Memory allocation failure in MPI worker");
+  return eslEMEM;
+}
+
+/* mpi_serial_loop()
+ * Search each block of the profile database that the master sends,
+ * until it sends an empty one. The request for the next block goes
+ * out as soon as this one arrives, so the master's answer is in
+ * flight while we work.
+ */
+static void
+mpi_serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
+{
+  P7_OPROFILE     *om       = NULL;
+  ESL_ALPHABET    *abc      = NULL;
+  MSV_BLOCK        block;
+  MPI_Status       mpistatus;
+  uint64_t         length;
+  uint64_t         count;
+  int              status;
+  int              hstatus  = eslOK;
+
+  /* receive a sequence block from the master */
+  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+  while (block.count > 0)
+    {
+      /* ask for the next block of models now */
+      status = 0;
+      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+
+      length = 0;
+      count  = block.count;
+
+      hstatus = p7_oprofile_Position(hfp, block.offset);
+      if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block.offset);
+
+      while (count > 0 && (hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
+	{
+	  length = om->eoff - block.offset + 1;
+
+	  p7_pli_NewModel(info->pli, om, info->bg);
+	  p7_bg_SetLength(info->bg, info->qsq->n);
+	  p7_oprofile_ReconfigLength(om, info->qsq->n);
+	      
+	  p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
+	      
+	  p7_oprofile_Destroy(om);
+	  p7_pipeline_Reuse(info->pli);
+
+	  --count;
+	}
+
+      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
+      if (count > 0)              
+	{
+	  switch(hstatus)
+	    {
+	    case eslEFORMAT:   mpi_failure("bad file format in HMM file %s",              hfp->fname);  break;
+	    case eslEINCOMPAT: mpi_failure("HMM file %s contains different alphabets",    hfp->fname);  break;
+	    case eslOK:
+	    case eslEOF:       mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n", block.count, block.count-count, block.offset); break;
+	    default:           mpi_failure("Unexpected error %d in reading HMMs from %s", hstatus, hfp->fname); 
+	    }
+	}
+      if (block.length != length) 
+	mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length, block.offset);
+
+      /* wait for the next block of models */
+      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+    }
+
+  esl_alphabet_Destroy(abc);
+}
+
+#ifdef HMMER_THREADS
+/* mpi_thread_loop()
+ * The reader for a threaded MPI worker: like thread_loop(), but what
+ * it reads are the blocks the master hands out. Each one is read into
+ * work queue blocks for the pipeline threads. As in mpi_serial_loop(),
+ * the next block is requested before this one is read, so the node
+ * always has one block on order.
+ */
+static void
+mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
+{
+  P7_OM_BLOCK     *block;
+  ESL_ALPHABET    *abc      = NULL;
+  void            *newBlock;
+  MSV_BLOCK        range;
+  MPI_Status       mpistatus;
+  uint64_t         length;
+  uint64_t         count;
+  int              status;
+  int              hstatus  = eslOK;
+  int              eofCount;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  MPI_Recv(&range, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+  while (range.count > 0)
+    {
+      status = 0;
+      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+
+      length = 0;
+      count  = range.count;
+
+      hstatus = p7_oprofile_Position(hfp, range.offset);
+      if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", range.offset);
+
+      /* like p7_oprofile_ReadBlockMSV(), but stopping at the end of the range */
+      while (count > 0)
+	{
+	  block = (P7_OM_BLOCK *) newBlock;
+	  for (block->count = 0; block->count < block->listSize && count > 0; block->count++, count--)
+	    {
+	      hstatus = p7_oprofile_ReadMSV(hfp, &abc, &(block->list[block->count]));
+	      if (hstatus != eslOK) break;
+	      length = block->list[block->count]->eoff - range.offset + 1;
+	    }
+	  if (block->count == 0) break;
+
+	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+	  if (status != eslOK) mpi_failure("Work queue reader failed");
+	  if (hstatus != eslOK) break;
+	}
+
+      if (count > 0)
+	{
+	  switch(hstatus)
+	    {
+	    case eslEFORMAT:   mpi_failure("bad file format in HMM file %s",              hfp->fname);  break;
+	    case eslEINCOMPAT: mpi_failure("HMM file %s contains different alphabets",    hfp->fname);  break;
+	    case eslOK:
+	    case eslEOF:       mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n", range.count, range.count-count, range.offset); break;
+	    default:           mpi_failure("Unexpected error %d in reading HMMs from %s", hstatus, hfp->fname); 
+	    }
+	}
+      if (range.length != length) 
+	mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", range.length, length, range.offset);
+
+      MPI_Recv(&range, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+    }
+
+  /* an empty block tells a pipeline thread it's done */
+  block = (P7_OM_BLOCK *) newBlock;
+  block->count = 0;
+  for (eofCount = 0; eofCount < esl_threads_GetWorkerCount(obj); eofCount++)
+    {
+      status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+      if (status != eslOK) mpi_failure("Work queue reader failed");
+      block = (P7_OM_BLOCK *) newBlock;
+      block->count = 0;
+    }
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+
+  esl_alphabet_Destroy(abc);
 }
+#endif /*HMMER_THREADS*/
 #endif /*HMMER_MPI*/
 
+/* report_job_Create(), report_job_Destroy()
+ * A REPORT_JOB owns its query sequence and stopwatch; the pipeline and
+ * hit list it's handed are freed by output_report().
+ */
+static REPORT_JOB *
+report_job_Create(ESL_ALPHABET *abc)
+{
+  REPORT_JOB *job = NULL;
+  int         status;
+
+  ESL_ALLOC(job, sizeof(REPORT_JOB));
+  job->qsq    = esl_sq_CreateDigital(abc);
+  job->w      = esl_stopwatch_Create();
+  job->pli    = NULL;
+  job->th     = NULL;
+  job->nquery = 0;
+  if (job->qsq == NULL || job->w == NULL) { status = eslEMEM; goto ERROR; }
+  return job;
+
+ ERROR:
+  report_job_Destroy(job);
+  esl_fatal("Failed to allocate report job");
+  return NULL;
+}
+
+static void
+report_job_Destroy(REPORT_JOB *job)
+{
+  if (job)
+    {
+      if (job->qsq) esl_sq_Destroy(job->qsq);
+      if (job->w)   esl_stopwatch_Destroy(job->w);
+      if (job->pli) p7_pipeline_Destroy(job->pli);
+      if (job->th)  p7_tophits_Destroy(job->th);
+      free(job);
+    }
+}
+
+/* output_report()
+ * Threshold one query's merged results and write all its reports.
+ * Then free its pipeline and hit list, and clear its query, so the
+ * job can be reused for another query.
+ */
+static int
+output_report(REPORT_INFO *rpt, REPORT_JOB *job)
+{
+  ESL_SQ      *qsq = job->qsq;
+  P7_PIPELINE *pli = job->pli;
+  P7_TOPHITS  *th  = job->th;
+  FILE        *ofp = rpt->ofp;
+
+  if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  p7_tophits_Threshold(th, pli);
+
+  p7_tophits_Targets(ofp, th, pli, rpt->textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  p7_tophits_Domains(ofp, th, pli, rpt->textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (rpt->tblfp)     p7_tophits_TabularTargets(rpt->tblfp,    qsq->name, qsq->acc, th, pli, (job->nquery == 1));
+  if (rpt->domtblfp)  p7_tophits_TabularDomains(rpt->domtblfp, qsq->name, qsq->acc, th, pli, (job->nquery == 1));
+  if (rpt->pfamtblfp) p7_tophits_TabularXfam(rpt->pfamtblfp,   qsq->name, qsq->acc, th, pli);
+  if (rpt->hitsfp && p7_tophits_WriteBinary(rpt->hitsfp, qsq->name, qsq->acc, qsq->desc, qsq->n, th, pli) != eslOK)
+    esl_fatal("Failed to write binary hits to %s\n", rpt->hitsfile);
+
+  p7_pli_Statistics(ofp, pli, job->w);
+  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  fflush(ofp);
+
+  p7_pipeline_Destroy(pli); job->pli = NULL;
+  p7_tophits_Destroy(th);   job->th  = NULL;
+  esl_sq_Reuse(qsq);
+  return eslOK;
+}
+
 static int
 serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 {
@@ -1279,6 +1663,43 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th); /* so the master only has to merge */
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+
+/* report_thread()
+ * The report writer: take finished queries from the report queue, in
+ * the order the master sent them, and write their reports, until
+ * the master sends a job with no results.
+ */
+static void
+report_thread(void *arg)
+{
+  int            workeridx;
+  ESL_THREADS   *obj;
+  REPORT_INFO   *rpt;
+  REPORT_JOB    *job;
+  void          *newJob;
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  rpt = (REPORT_INFO *) esl_threads_GetData(obj, workeridx);
+
+  if (esl_workqueue_WorkerUpdate(rpt->queue, NULL, &newJob) != eslOK) esl_fatal("Report queue worker failed");
+
+  job = (REPORT_JOB *) newJob;
+  while (job->pli != NULL)
+    {
+      if (output_report(rpt, job) != eslOK) p7_Fail("Failed to write results of query %d", job->nquery);
+
+      if (esl_workqueue_WorkerUpdate(rpt->queue, job, &newJob) != eslOK) esl_fatal("Report queue worker failed");
+      job = (REPORT_JOB *) newJob;
+    }
+
+  if (esl_workqueue_WorkerUpdate(rpt->queue, job, NULL) != eslOK) esl_fatal("Report queue worker failed");
+
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -21,6 +21,7 @@
 #include "esl_stopwatch.h"
 
 #ifdef HMMER_MPI
+#include <sys/stat.h>
 #include "mpi.h"
 #include "esl_mpi.h"
 #endif 
@@ -49,14 +50,6 @@ typedef struct {
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
-#else
-#define CPUOPTS     NULL
-#define MPIOPTS     NULL
-#endif
-
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles   reqs   incomp              help                                                      docgroup*/
   { "-h",           eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "show brief help on version and usage",                         1 },
@@ -66,6 +59,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",   2 },
+  { "--hitsout",    eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save binary hit lists to file <f>, for merging with hmmmerge", 2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                         2 },
@@ -93,17 +87,19 @@ static ESL_OPTIONS options[] = {
 
 /* Other options */
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
+  { "--adaptens",   eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "adaptively size stochastic trace ensembles",                  12 },
+  { "--domcpu",     eslARG_INT,    "0",   NULL, "n>=0",  NULL,  NULL,  NULL,            "threads for domain definition of long targets",               12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--tformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert target <seqfile> is in format <s>: no autodetection",  12 },
 
 #ifdef HMMER_THREADS 
-  { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  NULL,         "number of parallel CPU workers to use for multithreads",      12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",             12 },  
-  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  MPIOPTS,         "run as an MPI parallel program",                              12 },
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "run as an MPI parallel program",                              12 },
 #endif
 
   /* Restrict search to subset of database - hidden because these flags are
@@ -151,6 +147,10 @@ static void pipeline_thread(void *arg);
 #ifdef HMMER_MPI
 static int  mpi_master   (ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  mpi_worker   (ESL_GETOPTS *go, struct cfg_s *cfg);
+static void mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
+#ifdef HMMER_THREADS
+static void mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+#endif
 #endif 
 
 
@@ -228,6 +228,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout") && fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hitsout")    && fprintf(ofp, "# binary hit lists output:         %s\n",             esl_opt_GetString(go, "--hitsout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")      && fprintf(ofp, "# show alignments in output:       no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")    && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -253,6 +254,8 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adaptens")   && fprintf(ofp, "# adaptive trace ensembles:        on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domcpu")     && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--domcpu"))                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -276,6 +279,9 @@ main(int argc, char **argv)
   ESL_GETOPTS     *go       = NULL;	
   struct cfg_s     cfg;        
   int              status   = eslOK;
+#ifdef HMMER_MPI
+  int              provided;
+#endif
 
   impl_Init();                  /* processor specific initialization */
   p7_FLogsumInit();		/* we're going to use table-driven Logsum() approximations at times */
@@ -316,7 +322,7 @@ main(int argc, char **argv)
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
       cfg.do_mpi     = TRUE;
-      MPI_Init(&argc, &argv);
+      MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* only a rank's main thread talks MPI */
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
       MPI_Comm_size(MPI_COMM_WORLD, &(cfg.nproc));
 
@@ -354,6 +360,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *hitsfp   = NULL;              /* output stream for binary hit lists (--hitsout)  */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
@@ -371,6 +378,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;   /* worker hit lists to merge into info[0].th */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -417,6 +425,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--hitsout"))   { if ((hitsfp    = fopen(esl_opt_GetString(go, "--hitsout"),    "wb")) == NULL) esl_fatal("Failed to open binary hits output file %s for writing\n", esl_opt_GetString(go, "--hitsout")); }
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
@@ -430,6 +439,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
@@ -527,10 +537,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
       }
 
-      /* merge the results of the search results */
+      /* merge the results of the search results: each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeList(info[0].th, thl, infocnt-1);
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
@@ -547,6 +558,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
       if (domtblfp)  p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, info->th, info->pli);
+      if (hitsfp && p7_tophits_WriteBinary(hitsfp, hmm->name, hmm->acc, hmm->desc, hmm->M, info->th, info->pli) != eslOK)
+        esl_fatal("Failed to write binary hits to %s\n", esl_opt_GetString(go, "--hitsout"));
   
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, info->pli, w);
@@ -616,6 +629,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thl);
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
   esl_alphabet_Destroy(abc);
@@ -626,6 +640,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (hitsfp)        fclose(hitsfp);
 
   return eslOK;
 
@@ -688,7 +703,20 @@ mpi_failure(char *format, ...)
     }
 }
 
-#define MAX_BLOCK_SIZE (512*1024)
+/* The master indexes the database in chunks of about MIN_BLOCK_SIZE
+ * bytes, and hands out blocks made of whole chunks. A worker's block
+ * is sized to take it about BLOCK_SECONDS to search, at the rate it
+ * reported for its last block (INIT_BLOCK_SIZE until it has reported
+ * one), but near the end of the database blocks shrink so the workers
+ * finish together. Each worker keeps HMMER_PREFETCH requests for work
+ * outstanding, so its next block is already there when it finishes
+ * one.
+ */
+#define MIN_BLOCK_SIZE  (64*1024)
+#define INIT_BLOCK_SIZE (512*1024)
+#define MAX_BLOCK_SIZE  (16*1024*1024)
+#define BLOCK_SECONDS   2.0
+#define HMMER_PREFETCH  2
 
 typedef struct {
   uint64_t  offset;
@@ -704,13 +732,13 @@ typedef struct {
   SEQ_BLOCK *blocks;
 } BLOCK_LIST;
 
-/* this routine parses the database keeping track of the blocks
+/* this routine parses the database keeping track of the chunks'
  * offset within the file, number of sequences and the length
- * of the block.  These blocks are passed as work units to the
- * MPI workers.  If multiple hmm's are in the query file, the
- * blocks are reused without parsing the database a second time.
+ * of the chunk.  If multiple hmm's are in the query file, the
+ * chunks are reused without parsing the database a second time.
  */
-int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block, int n_targetseqs)
+static int
+next_chunk(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block, int n_targetseqs)
 {
   int      status   = eslOK;
 
@@ -745,7 +773,7 @@ int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block,
 
   esl_sq_Reuse(sq);
   if (n_targetseqs == 0) status = eslEOF; //this is to handle the end-case of a restrictdb scenario, where no more targets are required, and we want to mark the list as complete
-  while (block->length < MAX_BLOCK_SIZE && (n_targetseqs <0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+  while (block->length < MIN_BLOCK_SIZE && (n_targetseqs <0 || block->count < n_targetseqs) && (status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
     {
       if (block->count == 0) block->offset = sq->roff;
       block->length = sq->eoff - block->offset + 1;
@@ -782,6 +810,103 @@ int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block,
   return eslEMEM;
 }
 
+/* next_block()
+ * Fill <block> with the next run of whole chunks of the database,
+ * stopping once it's at least <target> bytes long. The block is a work
+ * unit for one MPI worker.
+ */
+static int
+next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block, int n_targetseqs, uint64_t target)
+{
+  SEQ_BLOCK chunk;
+  int       status;
+
+  block->offset = 0;
+  block->length = 0;
+  block->count  = 0;
+
+  do {
+    status = next_chunk(sqfp, sq, list, &chunk, (n_targetseqs < 0) ? -1 : n_targetseqs - block->count);
+    if (status != eslOK) break;
+
+    if (block->count == 0) block->offset = chunk.offset;
+    block->length = chunk.offset + chunk.length - block->offset;
+    block->count += chunk.count;
+  } while (block->length < target && (n_targetseqs < 0 || block->count < n_targetseqs));
+
+  if (status == eslEOF && block->count > 0) status = eslOK;
+  return status;
+}
+
+/* block_target()
+ * How many bytes of the database to give a worker that reported
+ * searching <rate> bytes/sec (0 if it hasn't reported yet), when
+ * <remaining> bytes are left to hand out (-1 if unknown) among
+ * <nworkers> workers. Guided self-scheduling: no block is more than a
+ * 1/(2*nworkers) share of what's left.
+ */
+static uint64_t
+block_target(double rate, int64_t remaining, int nworkers)
+{
+  double target = (rate > 0.) ? rate * BLOCK_SECONDS : (double) INIT_BLOCK_SIZE;
+
+  if (remaining >= 0) target = ESL_MIN(target, (double) remaining / (double) (2 * nworkers));
+  target = ESL_MAX(target, (double) MIN_BLOCK_SIZE);
+  target = ESL_MIN(target, (double) MAX_BLOCK_SIZE);
+  return (uint64_t) target;
+}
+
+/* recv_ready()
+ * Wait for a request for work from any worker. Return the worker's
+ * rank in <*ret_dest>, and the search rate (bytes/sec) it measured on
+ * its last block in <*ret_rate> (0 if it has none).
+ */
+static void
+recv_ready(char **buf, int *nalloc, int *ret_dest, double *ret_rate)
+{
+  MPI_Status mpistatus;
+  int        size;
+  int        pos  = 0;
+  int        dest;
+  int        status;
+
+  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0)
+    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
+
+  MPI_Get_count(&mpistatus, MPI_PACKED, &size);
+  if (*buf == NULL || size > *nalloc) {
+    void *tmp;
+    ESL_RALLOC(*buf, tmp, sizeof(char) * size);
+    *nalloc = size;
+  }
+
+  dest = mpistatus.MPI_SOURCE;
+  MPI_Recv(*buf, size, MPI_PACKED, dest, mpistatus.MPI_TAG, MPI_COMM_WORLD, &mpistatus);
+
+  if (mpistatus.MPI_TAG == HMMER_ERROR_TAG)
+    mpi_failure("MPI client %d raised error:\n%s\n", dest, *buf);
+  if (mpistatus.MPI_TAG != HMMER_READY_TAG)
+    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
+
+  if (MPI_Unpack(*buf, size, &pos, ret_rate, 1, MPI_DOUBLE, MPI_COMM_WORLD) != 0)
+    mpi_failure("Bad work request from %d\n", dest);
+  *ret_dest = dest;
+  return;
+
+ ERROR:
+  mpi_failure("Memory allocation failure in MPI master");
+}
+
+/* send_ready()
+ * Ask the master for another block, telling it how fast we searched
+ * the last one.
+ */
+static void
+send_ready(double rate)
+{
+  MPI_Send(&rate, 1, MPI_DOUBLE, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+}
+
 /* mpi_master()
  * The MPI version of hmmbuild.
  * Follows standard pattern for a master/worker load-balanced MPI program (J1/78-79).
@@ -808,6 +933,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *hitsfp   = NULL;              /* output stream for binary hit lists (--hitsout)  */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
@@ -825,12 +951,17 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures */
   int              mpi_size = 0;                 /* size of the allocated buffer */
+  P7_TOPHITS     **mpi_thl  = NULL;              /* each worker's hit list for the current query */
+  double          *mpi_rate = NULL;              /* each worker's last reported search rate, bytes/sec */
   BLOCK_LIST      *list     = NULL;
   SEQ_BLOCK        block;
+  int64_t          dbsize   = -1;                /* size of the database in bytes, if known */
+  int64_t          dbend;                        /* end of the database handed out so far */
+  double           rate;
 
   int              i;
-  int              size;
   MPI_Status       mpistatus;
+  struct stat      fileinfo;
   char             errbuf[eslERRBUFSIZE];
 
   int              n_targets;
@@ -882,6 +1013,14 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
 
+  if (esl_opt_IsOn(go, "--hitsout") && (hitsfp = fopen(esl_opt_GetString(go, "--hitsout"), "wb")) == NULL)
+    mpi_failure("Failed to open binary hits output file %s for writing\n", esl_opt_GetString(go, "--hitsout"));
+
+  if (stat(cfg->dbfile, &fileinfo) == 0) dbsize = fileinfo.st_size;
+
+  ESL_ALLOC(mpi_thl,  sizeof(P7_TOPHITS *) * cfg->nproc);
+  ESL_ALLOC(mpi_rate, sizeof(double)       * cfg->nproc);
+  for (i = 0; i < cfg->nproc; i++) mpi_rate[i] = 0.;
   ESL_ALLOC(list, sizeof(BLOCK_LIST));
   list->complete = 0;
   list->size     = 0;
@@ -937,31 +1076,24 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       pli = p7_pipeline_Create(go, hmm->M, 100, FALSE, p7_SEARCH_SEQS);
       p7_pli_NewModel(pli, om, bg);
 
-      /* Main loop: */
-      while ((n_targets==-1 || seq_cnt<=n_targets) && (sstatus = next_block(dbfp, dbsq, list, &block, n_targets-seq_cnt)) == eslOK )
+      /* Main loop: each request for work gets the next block, sized for the worker that asked */
+      dbend   = 0;
+      sstatus = eslOK;
+      while (sstatus == eslOK)
       {
-        seq_cnt += block.count;
-
-        if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0)
-          mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
-
-        MPI_Get_count(&mpistatus, MPI_PACKED, &size);
-        if (mpi_buf == NULL || size > mpi_size) {
-          void *tmp;
-          ESL_RALLOC(mpi_buf, tmp, sizeof(char) * size);
-          mpi_size = size;
-        }
-
-        dest = mpistatus.MPI_SOURCE;
-        MPI_Recv(mpi_buf, size, MPI_PACKED, dest, mpistatus.MPI_TAG, MPI_COMM_WORLD, &mpistatus);
+        recv_ready(&mpi_buf, &mpi_size, &dest, &rate);
+        if (rate > 0.) mpi_rate[dest] = rate;
 
-        if (mpistatus.MPI_TAG == HMMER_ERROR_TAG)
-          mpi_failure("MPI client %d raised error:\n%s\n", dest, mpi_buf);
-        if (mpistatus.MPI_TAG != HMMER_READY_TAG)
-          mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
+        sstatus = next_block(dbfp, dbsq, list, &block, (n_targets == -1) ? -1 : n_targets-seq_cnt,
+                             block_target(mpi_rate[dest], (dbsize >= 0) ? ESL_MAX(0, dbsize - dbend) : -1, cfg->nproc-1));
+        if (sstatus != eslOK) break; /* this worker's request gets its answer with everyone else's, below */
 
+        seq_cnt += block.count;
+        dbend    = block.offset + block.length;
         MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
       }
+      if (list->complete && list->last > 0) /* now we know exactly where the database ends */
+        dbsize = list->blocks[list->last-1].offset + list->blocks[list->last-1].length;
 
       if (n_targets!=-1 && seq_cnt==n_targets)
         sstatus = eslEOF;
@@ -981,51 +1113,40 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
-      for (i = 1; i < cfg->nproc; ++i)
-	{
-	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
-	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
+      /* collect the rest of the workers' outstanding requests (we already have one) */
+      for (i = 1; i < (cfg->nproc-1) * HMMER_PREFETCH; ++i)
+	recv_ready(&mpi_buf, &mpi_size, &dest, &rate);
 
-	  MPI_Get_count(&mpistatus, MPI_PACKED, &size);
-	  if (mpi_buf == NULL || size > mpi_size) {
-	    void *tmp;
-	    ESL_RALLOC(mpi_buf, tmp, sizeof(char) * size);
-	    mpi_size = size; 
-	  }
-
-	  dest = mpistatus.MPI_SOURCE;
-	  MPI_Recv(mpi_buf, size, MPI_PACKED, dest, mpistatus.MPI_TAG, MPI_COMM_WORLD, &mpistatus);
-
-	  if (mpistatus.MPI_TAG == HMMER_ERROR_TAG)
-	    mpi_failure("MPI client %d raised error:\n%s\n", dest, mpi_buf);
-	  if (mpistatus.MPI_TAG != HMMER_READY_TAG)
-	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
-	}
-
-      /* merge the results of the search results */
+      /* answer each with an empty block to signal they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	for (i = 0; i < HMMER_PREFETCH; ++i)
+	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* collect the results in whatever order the workers finish */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
+	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
 	  if ((status = p7_pipeline_MPIRecv(dest, HMMER_PIPELINE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, go, &mpi_pli)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving pipeline from %d", status, dest);
 
-	  p7_tophits_Merge(th, mpi_th);
 	  p7_pipeline_Merge(pli, mpi_pli);
-
 	  p7_pipeline_Destroy(mpi_pli);
-	  p7_tophits_Destroy(mpi_th);
+	  mpi_thl[dest-1] = mpi_th;
 	}
 
+      /* merge the search results in rank order, so output doesn't depend on who finished first */
+      p7_tophits_MergeList(th, mpi_thl, cfg->nproc-1);
+      for (dest = 1; dest < cfg->nproc; ++dest) p7_tophits_Destroy(mpi_thl[dest-1]);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(th);
       p7_tophits_Threshold(th, pli);
@@ -1035,6 +1156,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (tblfp)    p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, th, pli, (nquery == 1));
       if (domtblfp) p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, th, pli, (nquery == 1));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, th, pli);
+      if (hitsfp && p7_tophits_WriteBinary(hitsfp, hmm->name, hmm->acc, hmm->desc, hmm->M, th, pli) != eslOK)
+        mpi_failure("Failed to write binary hits to %s\n", esl_opt_GetString(go, "--hitsout"));
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
@@ -1079,6 +1202,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* monitor all the workers to make sure they have ended */
   for (i = 1; i < cfg->nproc; ++i)
     {
+      int size;
+
       if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
 	mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
 
@@ -1108,6 +1233,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Cleanup - prepare for exit
    */
   free(list);
+  free(mpi_thl);
+  free(mpi_rate);
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_hmmfile_Close(hfp);
@@ -1122,6 +1249,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (hitsfp)        fclose(hitsfp);
 
   return eslOK;
 
@@ -1130,25 +1258,41 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 }
 
 
+/* mpi_worker()
+ * An MPI worker searches the blocks of the target database that the
+ * master hands it. If --cpu was given, a worker is itself threaded:
+ * its main thread reads the blocks and talks to the master, and <ncpus>
+ * pipeline threads search them, so one rank can cover a whole node.
+ * Without --cpu, each rank is a single-threaded worker.
+ */
 static int
 mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 {
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
-  ESL_SQ          *dbsq     = NULL;              /* one target sequence (digital)                   */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
   ESL_STOPWATCH   *w;
   int              status   = eslOK;
   int              hstatus  = eslOK;
-  int              sstatus  = eslOK;
+  int              i;
+
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;              /* pipeline threads' hit lists to merge into info[0].th */
+#ifdef HMMER_THREADS
+  ESL_SQ_BLOCK    *block    = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+  int              provided;
+#endif
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures           */
   int              mpi_size = 0;                 /* size of the allocated buffer                    */
 
-  MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
@@ -1166,14 +1310,49 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   mpi_failure("File format problem in trying to open HMM file %s.\n%s\n",                cfg->hmmfile, errbuf);
   else if (status != eslOK)        mpi_failure("Unexpected error %d in opening HMM file %s.\n%s\n",               status, cfg->hmmfile, errbuf);  
 
+#ifdef HMMER_THREADS
+  /* Only thread the worker if --cpu was set, and MPI lets a threaded
+   * process make MPI calls from its main thread.
+   */
+  MPI_Query_thread(&provided);
+  if (esl_opt_IsUsed(go, "--cpu") && provided >= MPI_THREAD_FUNNELED)
+    ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
-      dbsq = esl_sq_CreateDigital(abc);
-      bg = p7_bg_Create(abc);
       esl_sqfile_SetDigital(dbfp, abc);
+
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].bg    = p7_bg_Create(abc);
+#ifdef HMMER_THREADS
+	  info[i].queue = queue;
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      for (i = 0; i < ncpus * 2; ++i)
+	{
+	  block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+	  if (block == NULL) 	      mpi_failure("Failed to allocate sequence block");
+
+ 	  status = esl_workqueue_Init(queue, block);
+	  if (status != eslOK)	      mpi_failure("Failed to add block to work queue");
+	}
+#endif
     }
   
   /* Outer loop: over each query HMM in <hmmfile>. */
@@ -1181,72 +1360,59 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       P7_PROFILE      *gm      = NULL;
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
-      P7_PIPELINE     *pli     = NULL;
-      P7_TOPHITS      *th      = NULL;
-
-      SEQ_BLOCK        block;
 
       esl_stopwatch_Start(w);
 
-      status = 0;
-      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* get our first blocks on order while we set up */
+      for (i = 0; i < HMMER_PREFETCH; ++i) send_ready(0.);
 
       /* Convert to an optimized model */
       gm = p7_profile_Create (hmm->M, abc);
       om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL);
       p7_oprofile_Convert(gm, om);
 
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-      p7_pli_NewModel(pli, om, bg);
-
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+      for (i = 0; i < infocnt; ++i)
 	{
-	  uint64_t length = 0;
-	  uint64_t count  = block.count;
-
-	  status = esl_sqfile_Position(dbfp, block.offset);
-	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
-
-	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
-	    {
-	      length = dbsq->eoff - block.offset + 1;
-
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
-      
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
-
-	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
+	  /* Create processing pipeline and hit list */
+	  info[i].th  = p7_tophits_Create();
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
-	      --count;
-	    }
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
 
-	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	  if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
-	  if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
+#ifdef HMMER_THREADS
+      if (ncpus > 0)  mpi_thread_loop(threadObj, queue, dbfp);
+      else            mpi_serial_loop(info, dbfp);
+#else
+      mpi_serial_loop(info, dbfp);
+#endif
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      /* merge the pipeline threads' results: each thread has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeList(info[0].th, thl, infocnt-1);
+      for (i = 1; i < infocnt; ++i)
+	{
+	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_oprofile_Destroy(info[i].om);
 	}
 
       esl_stopwatch_Stop(w);
 
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info->th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info->pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      p7_pipeline_Destroy(info->pli);
+      p7_tophits_Destroy(info->th);
+      p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
       p7_profile_Destroy(gm);
       p7_hmm_Destroy(hmm);
@@ -1274,15 +1440,201 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (mpi_buf != NULL) free(mpi_buf);
 
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+	esl_sq_DestroyBlock(block);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  free(info);
+  free(thl);
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
-
-  p7_bg_Destroy(bg);
-  esl_sq_Destroy(dbsq);
+  esl_alphabet_Destroy(abc);
   esl_stopwatch_Destroy(w);
 
   return eslOK;
+
+ ERROR:
+  mpi_failure("Memory allocation failure in MPI worker");
+  return eslEMEM;
+}
+
+/* mpi_serial_loop()
+ * Search each block of the database that the master sends, until it
+ * sends an empty one. We keep HMMER_PREFETCH requests for work
+ * outstanding: a new one goes out as soon as a block arrives, so the
+ * next block is already here when we finish this one. Each request
+ * reports how fast we searched the last block, which the master uses
+ * to size our next one.
+ */
+static void
+mpi_serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
+{
+  ESL_SQ          *dbsq     = esl_sq_CreateDigital(info->om->abc);
+  ESL_STOPWATCH   *w        = esl_stopwatch_Create();
+  SEQ_BLOCK        block;
+  MPI_Status       mpistatus;
+  uint64_t         length;
+  uint64_t         count;
+  double           rate     = 0.;
+  int              status;
+  int              sstatus  = eslOK;
+  int              i;
+
+  /* receive a sequence block from the master */
+  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+  while (block.count > 0)
+    {
+      /* ask for another block of sequences now */
+      send_ready(rate);
+
+      esl_stopwatch_Start(w);
+      length = 0;
+      count  = block.count;
+
+      status = esl_sqfile_Position(dbfp, block.offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
+
+      while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+	{
+	  length = dbsq->eoff - block.offset + 1;
+
+	  p7_pli_NewSeq(info->pli, dbsq);
+	  p7_bg_SetLength(info->bg, dbsq->n);
+	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      
+	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+
+	  esl_sq_Reuse(dbsq);
+	  p7_pipeline_Reuse(info->pli);
+
+	  --count;
+	}
+
+      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
+      if (sstatus == eslEFORMAT)  mpi_failure("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+      if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
+      if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
+
+      esl_stopwatch_Stop(w);
+      rate = (w->elapsed > 0.) ? (double) block.length / w->elapsed : 0.;
+
+      /* wait for the next block of sequences */
+      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+    }
+
+  /* the master answers our other outstanding requests with empty blocks too */
+  for (i = 1; i < HMMER_PREFETCH; i++)
+    {
+      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+      if (block.count > 0) mpi_failure("Unexpected block at offset %ld after the end of the database\n", block.offset);
+    }
+
+  esl_stopwatch_Destroy(w);
+  esl_sq_Destroy(dbsq);
+}
+
+#ifdef HMMER_THREADS
+/* mpi_thread_loop()
+ * The reader for a threaded MPI worker: like thread_loop(), but what
+ * it reads are the blocks the master hands out. Each one is read into
+ * work queue blocks for the pipeline threads. Requests for work go out
+ * as in mpi_serial_loop(); the rate we report is how fast the pipeline
+ * threads drain the work queue, since the reader can only get a few
+ * work queue blocks ahead of them.
+ */
+static void
+mpi_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
+{
+  ESL_SQ_BLOCK    *block;
+  void            *newBlock;
+  ESL_STOPWATCH   *w        = esl_stopwatch_Create();
+  SEQ_BLOCK        range;
+  MPI_Status       mpistatus;
+  uint64_t         length;
+  uint64_t         count;
+  double           rate     = 0.;
+  int              status;
+  int              sstatus  = eslOK;
+  int              eofCount;
+  int              i;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  MPI_Recv(&range, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+  while (range.count > 0)
+    {
+      send_ready(rate);
+
+      esl_stopwatch_Start(w);
+      length = 0;
+      count  = range.count;
+
+      status = esl_sqfile_Position(dbfp, range.offset);
+      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", range.offset);
+
+      while (count > 0)
+	{
+	  block   = (ESL_SQ_BLOCK *) newBlock;
+	  sstatus = esl_sqio_ReadBlock(dbfp, block, -1, count, /*max_init_window=*/FALSE, FALSE);
+	  if (sstatus != eslOK) break;
+
+	  count -= block->count;
+	  length = block->list[block->count-1].eoff - range.offset + 1;
+
+	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+	  if (status != eslOK) mpi_failure("Work queue reader failed");
+	}
+
+      if (sstatus == eslEFORMAT)  mpi_failure("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+      if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  range.count,  range.count - count, range.offset);
+      if (range.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", range.length, length,              range.offset);
+
+      esl_stopwatch_Stop(w);
+      rate = (w->elapsed > 0.) ? (double) range.length / w->elapsed : 0.;
+
+      MPI_Recv(&range, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+    }
+
+  for (i = 1; i < HMMER_PREFETCH; i++)
+    {
+      MPI_Recv(&range, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+      if (range.count > 0) mpi_failure("Unexpected block at offset %ld after the end of the database\n", range.offset);
+    }
+
+  /* an empty block tells a pipeline thread it's done */
+  block = (ESL_SQ_BLOCK *) newBlock;
+  block->count = 0;
+  for (eofCount = 0; eofCount < esl_threads_GetWorkerCount(obj); eofCount++)
+    {
+      status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+      if (status != eslOK) mpi_failure("Work queue reader failed");
+      block = (ESL_SQ_BLOCK *) newBlock;
+      block->count = 0;
+    }
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) mpi_failure("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+
+  esl_stopwatch_Destroy(w);
 }
+#endif /*HMMER_THREADS*/
 #endif /*HMMER_MPI*/
 
 static int
@@ -1422,6 +1774,7 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th); /* so the master only has to merge */
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -14,6 +14,12 @@
 #include "mpi.h"
 #endif 
 
+#ifdef HMMER_THREADS
+#include <unistd.h>
+#include "esl_threads.h"
+#include "esl_workqueue.h"
+#endif /*HMMER_THREADS*/
+
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_stats.h"
@@ -34,6 +40,13 @@
 #define ALGORITHMS "--fwd,--vit,--hyb,--msv"           /* Exclusive choice for scoring algorithms */
 #define STYLES     "--fs,--sw,--ls,--s"	               /* Exclusive choice for alignment mode     */
 
+/* Random seqs are sampled in blocks of SIMBLOCK, each from its own
+ * RNG stream, seeded from the master RNG. Blocks are the unit of
+ * work for threads; since the blocking doesn't depend on the number
+ * of threads, neither do the scores.
+ */
+#define SIMBLOCK   100
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles   reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "show brief help on version and usage",              1 },
@@ -41,6 +54,9 @@ static ESL_OPTIONS options[] = {
   { "-v",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "verbose: print scores",                             1 },
   { "-L",        eslARG_INT,    "100", NULL, "n>0",     NULL,  NULL, NULL, "length of random target seqs",                      1 },
   { "-N",        eslARG_INT,   "1000", NULL, "n>0",     NULL,  NULL, NULL, "number of random target seqs",                      1 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL, NULL, "number of parallel CPU workers to use for multithreads", 1 },
+#endif
 #ifdef HMMER_MPI
   { "--mpi",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "run as an MPI parallel program",                    1 },
 #endif
@@ -119,16 +135,71 @@ struct cfg_s {
   FILE           *alfp;		/* optional output for alignment lengths */
 };
 
+/* SIM_UNIT: one model, configured and ready to score, and its results.
+ * Once created, it's only read by the scoring routines, except for
+ * its own stretch of <xv>, <av>; so any number of threads can score 
+ * blocks of it at once.
+ */
+typedef struct sim_unit_s {
+  int          idx;		/* which # model this is in the file, 1..           */
+  P7_HMM      *hmm;
+  P7_BG       *bg;		/* copy of cfg->bg, customized for this model        */
+  P7_PROFILE  *gm;
+  P7_OPROFILE *om;
+  double       mu;		/* E-value parameters determined for this model     */
+  double       lambda;
+  uint32_t    *seed;		/* seed of the RNG stream for each block, 0..nblocks-1 */
+  int          nblocks;		/* N / SIMBLOCK, rounded up                          */
+  int          nleft;		/* number of blocks not scored yet (threaded master) */
+  double      *xv;		/* results: array of N scores                        */
+  int         *av;		/* optional results: array of N alignment lengths    */
+  struct sim_unit_s *next;
+} SIM_UNIT;
+
+/* SIM_SCRATCH: what one scoring thread needs for itself. */
+typedef struct {
+  ESL_RANDOMNESS *r;
+  P7_GMX         *gx;
+  P7_OMX         *ox;
+  P7_TRACE       *tr;
+  ESL_DSQ        *dsq;
+} SIM_SCRATCH;
+
+#ifdef HMMER_THREADS
+typedef struct {
+  ESL_GETOPTS    *go;
+  struct cfg_s   *cfg;
+  SIM_SCRATCH    *w;
+  ESL_WORK_QUEUE *queue;
+} WORKER_INFO;
+
+typedef struct {
+  SIM_UNIT  *sim;		/* model to score a block of; NULL = worker shutdown */
+  int        b;			/* which block, 0..sim->nblocks-1                    */
+  int        processed;
+  int        status;
+} WORK_ITEM;
+#endif /*HMMER_THREADS*/
+
 
 static int  init_master_cfg(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf);
 
 static void serial_master  (ESL_GETOPTS *go, struct cfg_s *cfg);
+#ifdef HMMER_THREADS
+static void thread_master  (ESL_GETOPTS *go, struct cfg_s *cfg, int ncpus);
+static void pipeline_thread(void *arg);
+#endif 
 #ifdef HMMER_MPI
 static void mpi_master     (ESL_GETOPTS *go, struct cfg_s *cfg);
 static void mpi_worker     (ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  minimum_mpi_working_buffer(ESL_GETOPTS *go, int N, int *ret_wn);
 #endif 
 static int process_workunit   (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double *ret_mu, double *ret_lambda);
+static int create_simunit     (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, SIM_UNIT **ret_sim);
+static void destroy_simunit   (SIM_UNIT *sim);
+static SIM_SCRATCH *create_scratch(struct cfg_s *cfg);
+static void destroy_scratch   (SIM_SCRATCH *w);
+static int score_block        (ESL_GETOPTS *go, struct cfg_s *cfg, SIM_UNIT *sim, int b, SIM_SCRATCH *w);
 static int output_result      (ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double mu, double lambda);
 static int output_filter_power(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, double mu, double lambda);
 
@@ -244,7 +315,12 @@ main(int argc, char **argv)
   else
 #endif /*HMMER_MPI*/
     {		
-      /* No MPI? Then we're just the serial master. */
+#ifdef HMMER_THREADS
+      int ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+      if (ncpus > 0) thread_master(go, &cfg, ncpus);
+      else
+#endif
+      /* No MPI, no threads? Then we're just the serial master. */
       serial_master(go, &cfg);
       esl_stopwatch_Stop(w);
     }      
@@ -390,6 +466,194 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 }
 
 
+#ifdef HMMER_THREADS
+/* thread_master()
+ * The threaded version of hmmsim.
+ *
+ * The master reads models and configures them, including the
+ * E-value calibration, then hands out their blocks of random
+ * sequences to the workers to score. Blocks from the next model are
+ * handed out while the workers are still finishing the last one, so
+ * a file of many small models keeps the workers busy too. Results
+ * are output in the order of the HMM file as each model's blocks
+ * all come back.
+ */
+static void
+thread_master(ESL_GETOPTS *go, struct cfg_s *cfg, int ncpus)
+{
+  ESL_THREADS    *obj     = NULL;
+  ESL_WORK_QUEUE *queue   = NULL;
+  WORKER_INFO    *info    = NULL;
+  WORK_ITEM      *item    = NULL;
+  void           *newItem;
+  P7_HMM         *hmm     = NULL;
+  SIM_UNIT       *sim     = NULL;
+  SIM_UNIT       *top     = NULL;  /* models in progress, in file order: the next one to output...  */
+  SIM_UNIT       *bottom  = NULL;  /* ... and the last one read                                     */
+  SIM_UNIT       *done;
+  double         *xv      = NULL;
+  int            *av      = NULL;
+  int             nmodel  = 0;
+  int             nissued = 0;     /* number of blocks handed to the workers                        */
+  int             ndone   = 0;     /* number of blocks they've handed back                          */
+  int             have_work = TRUE;
+  int             nb;
+  int             b, i;
+  char            errbuf[eslERRBUFSIZE];
+  int             status;
+
+  if ((status = init_master_cfg(go, cfg, errbuf)) != eslOK) p7_Fail(errbuf);
+
+  obj   = esl_threads_Create(&pipeline_thread);
+  queue = esl_workqueue_Create(ncpus * 2);
+  ESL_ALLOC(info, sizeof(WORKER_INFO) * ncpus);
+  for (i = 0; i < ncpus; i++)
+    {
+      info[i].go    = go;
+      info[i].cfg   = cfg;
+      info[i].queue = queue;
+      if ((info[i].w = create_scratch(cfg)) == NULL) p7_Fail("allocation failed");
+      esl_threads_AddThread(obj, &info[i]);
+    }
+  for (i = 0; i < ncpus * 2; i++)
+    {
+      ESL_ALLOC(item, sizeof(WORK_ITEM));
+      item->sim       = NULL;
+      item->b         = 0;
+      item->processed = FALSE;
+      item->status    = eslOK;
+      if (esl_workqueue_Init(queue, item) != eslOK) p7_Fail("Failed to add block to work queue");
+    }
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  if (esl_workqueue_ReaderUpdate(queue, NULL, &newItem) != eslOK) esl_fatal("Work queue reader failed");
+  item = (WORK_ITEM *) newItem;
+
+  while (have_work || ndone < nissued)
+    {
+      /* Get the next model, if we're still reading, and hand out its blocks.
+       * Once we're out of models, hand out empty items (which shut down the workers)
+       * until all the blocks are back.
+       */
+      sim = NULL;
+      nb  = 1;
+      if (have_work)
+	{
+	  status = p7_hmmfile_Read(cfg->hfp, &(cfg->abc), &hmm);
+	  if      (status == eslEOD)       p7_Fail("read failed, HMM file %s may be truncated?", cfg->hmmfile);
+	  else if (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);
+	  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   cfg->hmmfile);
+	  else if (status == eslEOF)       have_work = FALSE;
+	  else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile);
+	}
+
+      if (have_work)
+	{
+	  if (cfg->bg == NULL) {
+	    if (esl_opt_GetBoolean(go, "--bgflat")) cfg->bg = p7_bg_CreateUniform(cfg->abc);
+	    else                                    cfg->bg = p7_bg_Create(cfg->abc);
+	    p7_bg_SetLength(cfg->bg, esl_opt_GetInteger(go, "-L"));
+	  }
+
+	  ESL_ALLOC(xv, sizeof(double) * cfg->N);
+	  if (esl_opt_GetBoolean(go, "-a")) ESL_ALLOC(av, sizeof(int) * cfg->N);
+	  if (create_simunit(go, cfg, errbuf, hmm, xv, av, &sim) != eslOK) p7_Fail(errbuf);
+	  sim->idx = ++nmodel;
+	  nb       = sim->nblocks;  /* <sim> may be output and freed before we're out of the loop below */
+	  hmm = NULL; xv = NULL; av = NULL; 
+
+	  if (bottom == NULL) top = bottom = sim;
+	  else                { bottom->next = sim; bottom = sim; }
+	}
+
+      for (b = 0; b < nb; b++)
+	{
+	  item->sim = sim;
+	  item->b   = b;
+	  if (sim != NULL) nissued++;
+
+	  if (esl_workqueue_ReaderUpdate(queue, item, &newItem) != eslOK) esl_fatal("Work queue reader failed");
+	  item = (WORK_ITEM *) newItem;
+
+	  if (item->processed == TRUE)
+	    {
+	      if (item->status != eslOK) p7_Fail("allocation failure");
+	      item->sim->nleft--;
+	      ndone++;
+
+	      /* output finished models, keeping the order of the HMM file */
+	      while (top != NULL && top->nleft == 0)
+		{
+		  if (output_result(go, cfg, errbuf, top->hmm, top->xv, top->av, top->mu, top->lambda) != eslOK) p7_Fail(errbuf);
+		  done = top;
+		  top  = top->next;
+		  if (top == NULL) bottom = NULL;
+		  free(done->xv);
+		  free(done->av);
+		  p7_hmm_Destroy(done->hmm);
+		  destroy_simunit(done);
+		}
+
+	      item->sim       = NULL;
+	      item->processed = FALSE;
+	      item->status    = eslOK;
+	    }
+	}
+    }
+
+  if (esl_workqueue_ReaderUpdate(queue, item, NULL) != eslOK) esl_fatal("Work queue reader failed");
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);
+
+  esl_workqueue_Reset(queue);
+  while (esl_workqueue_Remove(queue, (void **) &item) == eslOK) free(item);
+  esl_workqueue_Destroy(queue);
+  esl_threads_Destroy(obj);
+  for (i = 0; i < ncpus; i++) destroy_scratch(info[i].w);
+  free(info);
+  return;
+
+ ERROR:
+  p7_Fail("allocation failed");
+}
+
+static void 
+pipeline_thread(void *arg)
+{
+  int          workeridx;
+  WORKER_INFO *info;
+  ESL_THREADS *obj;
+  WORK_ITEM   *item;
+  void        *newItem;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  if (esl_workqueue_WorkerUpdate(info->queue, NULL, &newItem) != eslOK) esl_fatal("Work queue worker failed");
+
+  /* loop until an empty item tells us we're done */
+  item = (WORK_ITEM *) newItem;
+  while (item->sim != NULL)
+    {
+      item->status    = score_block(info->go, info->cfg, item->sim, item->b, info->w);
+      item->processed = TRUE;
+
+      if (esl_workqueue_WorkerUpdate(info->queue, item, &newItem) != eslOK) esl_fatal("Work queue worker failed");
+      item = (WORK_ITEM *) newItem;
+    }
+
+  if (esl_workqueue_WorkerUpdate(info->queue, item, NULL) != eslOK) esl_fatal("Work queue worker failed");
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
+
 #ifdef HMMER_MPI
 /* mpi_master()
  * The MPI version of hmmsim.
@@ -608,28 +872,73 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 static int
 process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double *ret_mu, double *ret_lambda)
 {
-  int             L   = esl_opt_GetInteger(go, "-L");
-  P7_PROFILE     *gm  = NULL;
-  P7_OPROFILE    *om  = NULL;
-  P7_GMX         *gx  = NULL;
-  P7_OMX         *ox  = NULL;
-  P7_TRACE       *tr  = NULL;
-  ESL_DSQ        *dsq = NULL;
-  int             i;
-  int             status;
-  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
-  float  sc;
-  float  nullsc;
-  double mu, lambda;
-  int    EmL          = esl_opt_GetInteger(go, "--EmL");
-  int    EmN          = esl_opt_GetInteger(go, "--EmN");
-  int    EvL          = esl_opt_GetInteger(go, "--EvL");
-  int    EvN          = esl_opt_GetInteger(go, "--EvN");
-  int    EfL          = esl_opt_GetInteger(go, "--EfL");
-  int    EfN          = esl_opt_GetInteger(go, "--EfN");
-  double Eft          = esl_opt_GetReal   (go, "--Eft");
-  float  nu           = esl_opt_GetReal   (go, "--nu");
+  SIM_UNIT    *sim = NULL;
+  SIM_SCRATCH *w   = NULL;
+  int          b;
+  int          status;
+
+  if ((status = create_simunit(go, cfg, errbuf, hmm, scores, alilens, &sim)) != eslOK) goto ERROR;
+  if ((w = create_scratch(cfg)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  for (b = 0; b < sim->nblocks; b++)
+    if ((status = score_block(go, cfg, sim, b, w)) != eslOK) goto ERROR;
+
+  *ret_mu     = sim->mu;
+  *ret_lambda = sim->lambda;
+  status      = eslOK;
 
+ ERROR:
+  destroy_scratch(w);
+  destroy_simunit(sim);
+  if (status == eslEMEM) sprintf(errbuf, "allocation failure");
+  return status;
+}
+
+
+/* create_simunit()
+ *
+ * Configure <hmm> for scoring, determine its E-value parameters, and
+ * seed the RNG streams for its blocks of random sequences. Results
+ * will go to <scores> and (optionally) <alilens>, which the caller
+ * provides and remains responsible for, as for <hmm>.
+ *
+ * The seeds are drawn from <cfg->r>, reseeded for each model, so a
+ * model's scores depend only on --seed, not on what order its blocks
+ * are scored in.
+ *
+ * The mu/tau fits run serially, even in a threaded hmmsim: the master
+ * calls this while the workers are still scoring the previous model's
+ * blocks, so its own threads would only compete with them.
+ */
+static int
+create_simunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, SIM_UNIT **ret_sim)
+{
+  SIM_UNIT *sim   = NULL;
+  int       L     = esl_opt_GetInteger(go, "-L");
+  int    EmL      = esl_opt_GetInteger(go, "--EmL");
+  int    EmN      = esl_opt_GetInteger(go, "--EmN");
+  int    EvL      = esl_opt_GetInteger(go, "--EvL");
+  int    EvN      = esl_opt_GetInteger(go, "--EvN");
+  int    EfL      = esl_opt_GetInteger(go, "--EfL");
+  int    EfN      = esl_opt_GetInteger(go, "--EfN");
+  double Eft      = esl_opt_GetReal   (go, "--Eft");
+  int    b;
+  int    status;
+
+  ESL_ALLOC(sim, sizeof(SIM_UNIT));
+  sim->idx     = 0;
+  sim->hmm     = hmm;
+  sim->bg      = NULL;
+  sim->gm      = NULL;
+  sim->om      = NULL;
+  sim->seed    = NULL;
+  sim->nblocks = (cfg->N + SIMBLOCK - 1) / SIMBLOCK;
+  sim->nleft   = sim->nblocks;
+  sim->xv      = scores;
+  sim->av      = alilens;
+  sim->next    = NULL;
+
+  if ((sim->bg = p7_bg_Clone(cfg->bg)) == NULL) { status = eslEMEM; goto ERROR; }
 
   // reseed the RNG to its initial value, to allow reproduction of results
   esl_randomness_Init(cfg->r, esl_opt_GetInteger(go, "--seed"));
@@ -641,93 +950,172 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
       float *p = NULL;
       float  KL;
 
-      p7_hmm_CompositionKLD(hmm, cfg->bg, &KL, &p);
-      esl_vec_FCopy(p, cfg->abc->K, cfg->bg->f);
+      p7_hmm_CompositionKLD(hmm, sim->bg, &KL, &p);
+      esl_vec_FCopy(p, cfg->abc->K, sim->bg->f);
+      free(p);
     }
 
   /* First pass: configure gm, om for local until after we've determined mu, lambda, tau params */
-  gm = p7_profile_Create(hmm->M, cfg->abc);
-  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_LOCAL);
-  om = p7_oprofile_Create(gm->M, cfg->abc);
-  p7_oprofile_Convert(gm, om);
+  if ((sim->gm = p7_profile_Create(hmm->M, cfg->abc))  == NULL) { status = eslEMEM; goto ERROR; }
+  p7_ProfileConfig(hmm, sim->bg, sim->gm, L, p7_LOCAL);
+  if ((sim->om = p7_oprofile_Create(hmm->M, cfg->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  p7_oprofile_Convert(sim->gm, sim->om);
 
   /* Determine E-value parameters (in addition to any that are already in the HMM structure)  */
-  p7_Lambda(hmm, cfg->bg, &lambda);
-  if      (esl_opt_GetBoolean(go, "--vit"))  p7_ViterbiMu(cfg->r, om, cfg->bg, EvL, EvN, lambda,      &mu);
-  else if (esl_opt_GetBoolean(go, "--msv"))  p7_MSVMu    (cfg->r, om, cfg->bg, EmL, EmN, lambda,      &mu);
-  else if (esl_opt_GetBoolean(go, "--fwd"))  p7_Tau      (cfg->r, om, cfg->bg, EfL, EfN, lambda, Eft, &mu);
-  else    mu = 0.0;		/* undetermined, for Hybrid, at least for now. */
+  p7_Lambda(hmm, sim->bg, &(sim->lambda));
+  if      (esl_opt_GetBoolean(go, "--vit"))  p7_ViterbiMu(cfg->r, sim->om, sim->bg, EvL, EvN, sim->lambda,      0, &(sim->mu));
+  else if (esl_opt_GetBoolean(go, "--msv"))  p7_MSVMu    (cfg->r, sim->om, sim->bg, EmL, EmN, sim->lambda,      0, &(sim->mu));
+  else if (esl_opt_GetBoolean(go, "--fwd"))  p7_Tau      (cfg->r, sim->om, sim->bg, EfL, EfN, sim->lambda, Eft, 0, &(sim->mu));
+  else    sim->mu = 0.0;		/* undetermined, for Hybrid, at least for now. */
 
   /* Now reconfig the models however we were asked to */
-  if      (esl_opt_GetBoolean(go, "--fs"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_LOCAL);
-  else if (esl_opt_GetBoolean(go, "--sw"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_UNILOCAL);
-  else if (esl_opt_GetBoolean(go, "--ls"))  p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_GLOCAL);
-  else if (esl_opt_GetBoolean(go, "--s"))   p7_ProfileConfig(hmm, cfg->bg, gm, L, p7_UNIGLOCAL);
+  if      (esl_opt_GetBoolean(go, "--fs"))  p7_ProfileConfig(hmm, sim->bg, sim->gm, L, p7_LOCAL);
+  else if (esl_opt_GetBoolean(go, "--sw"))  p7_ProfileConfig(hmm, sim->bg, sim->gm, L, p7_UNILOCAL);
+  else if (esl_opt_GetBoolean(go, "--ls"))  p7_ProfileConfig(hmm, sim->bg, sim->gm, L, p7_GLOCAL);
+  else if (esl_opt_GetBoolean(go, "--s"))   p7_ProfileConfig(hmm, sim->bg, sim->gm, L, p7_UNIGLOCAL);
 
-  if (esl_opt_GetBoolean(go, "--x-no-lengthmodel")) elide_length_model(gm, cfg->bg);
+  if (esl_opt_GetBoolean(go, "--x-no-lengthmodel")) elide_length_model(sim->gm, sim->bg);
 
-  p7_oprofile_Convert(gm, om);
-  p7_bg_SetLength    (cfg->bg, L);
+  p7_oprofile_Convert(sim->gm, sim->om);
+  p7_bg_SetLength    (sim->bg, L);
 
-  /* Remaining allocations */
-  gx = p7_gmx_Create(gm->M, L);
-  ox = p7_omx_Create(gm->M, 0, L);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-  tr = p7_trace_Create();
+  /* One RNG stream per block. Seed 0 would mean "pick one arbitrarily" to esl_randomness_Init(), so avoid it. */
+  ESL_ALLOC(sim->seed, sizeof(uint32_t) * sim->nblocks);
+  for (b = 0; b < sim->nblocks; b++)
+    do { sim->seed[b] = esl_random_uint32(cfg->r); } while (sim->seed[b] == 0);
 
-  /* Collect scores from N random sequences of length L  */
-  for (i = 0; i < cfg->N; i++)
+  *ret_sim = sim;
+  return eslOK;
+
+ ERROR:
+  destroy_simunit(sim);
+  if (status == eslEMEM) sprintf(errbuf, "allocation failure");
+  *ret_sim = NULL;
+  return status;
+}
+
+/* destroy_simunit()
+ * Free a SIM_UNIT; but not its <hmm>, <xv>, <av>, which belong to the caller.
+ */
+static void
+destroy_simunit(SIM_UNIT *sim)
+{
+  if (sim)
+    {
+      p7_bg_Destroy(sim->bg);
+      p7_profile_Destroy(sim->gm);
+      p7_oprofile_Destroy(sim->om);
+      if (sim->seed) free(sim->seed);
+      free(sim);
+    }
+}
+
+
+static SIM_SCRATCH *
+create_scratch(struct cfg_s *cfg)
+{
+  SIM_SCRATCH *w = NULL;
+  int          status;
+
+  ESL_ALLOC(w, sizeof(SIM_SCRATCH));
+  w->r   = NULL;
+  w->gx  = NULL;
+  w->ox  = NULL;
+  w->tr  = NULL;
+  w->dsq = NULL;
+
+  if ((w->r  = esl_randomness_Create(42))     == NULL) goto ERROR; /* each block reseeds it */
+  if ((w->gx = p7_gmx_Create(100, cfg->L))    == NULL) goto ERROR; /* each block grows these to fit its model */
+  if ((w->ox = p7_omx_Create(100, 0, cfg->L)) == NULL) goto ERROR;
+  if ((w->tr = p7_trace_Create())             == NULL) goto ERROR;
+  ESL_ALLOC(w->dsq, sizeof(ESL_DSQ) * (cfg->L+2));
+  return w;
+
+ ERROR:
+  destroy_scratch(w);
+  return NULL;
+}
+
+static void
+destroy_scratch(SIM_SCRATCH *w)
+{
+  if (w)
+    {
+      esl_randomness_Destroy(w->r);
+      p7_gmx_Destroy(w->gx);
+      p7_omx_Destroy(w->ox);
+      p7_trace_Destroy(w->tr);
+      if (w->dsq) free(w->dsq);
+      free(w);
+    }
+}
+
+
+/* score_block()
+ *
+ * Score block <b> of <sim>'s random sequences, sampled from their own
+ * RNG stream, storing results in <sim->xv> (and <sim->av>) from
+ * <b*SIMBLOCK>. Uses the thread's own workspace <w>; <sim> is
+ * otherwise read-only, so blocks of the same model can be scored
+ * concurrently.
+ */
+static int
+score_block(ESL_GETOPTS *go, struct cfg_s *cfg, SIM_UNIT *sim, int b, SIM_SCRATCH *w)
+{
+  int    L     = cfg->L;
+  int    start = b * SIMBLOCK;
+  int    end   = ESL_MIN(start + SIMBLOCK, cfg->N);
+  float  nu    = esl_opt_GetReal(go, "--nu");
+  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
+  float  sc;
+  float  nullsc;
+  int    i;
+  int    status;
+
+  if ((status = p7_gmx_GrowTo(w->gx, sim->gm->M, L))    != eslOK) return status;
+  if ((status = p7_omx_GrowTo(w->ox, sim->om->M, 0, L)) != eslOK) return status;
+  esl_randomness_Init(w->r, sim->seed[b]);
+
+  /* Collect scores from this block's random sequences of length L  */
+  for (i = start; i < end; i++)
     {
-      esl_rsq_xfIID(cfg->r, cfg->bg->f, cfg->abc->K, L, dsq);
+      esl_rsq_xfIID(w->r, sim->bg->f, cfg->abc->K, L, w->dsq);
 
       if (esl_opt_GetBoolean(go, "--fast")) 
 	{
-	  if      (esl_opt_GetBoolean(go, "--vit")) p7_ViterbiFilter(dsq, L, om, ox, &sc);
-	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_ForwardParser(dsq, L, om, ox, &sc);
-	  else if (esl_opt_GetBoolean(go, "--msv")) p7_MSVFilter    (dsq, L, om, ox, &sc);
+	  if      (esl_opt_GetBoolean(go, "--vit")) p7_ViterbiFilter(w->dsq, L, sim->om, w->ox, &sc);
+	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_ForwardParser(w->dsq, L, sim->om, w->ox, &sc);
+	  else if (esl_opt_GetBoolean(go, "--msv")) p7_MSVFilter    (w->dsq, L, sim->om, w->ox, &sc);
 	} 
 
       if (! esl_opt_GetBoolean(go, "--fast") || sc == eslINFINITY) /* note, if a filter overflows, failover to slow versions */
 	{
-	  if      (esl_opt_GetBoolean(go, "--vit")) p7_GViterbi(dsq, L, gm, gx,       &sc);
-	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_GForward(dsq, L, gm, gx,       &sc);
-	  else if (esl_opt_GetBoolean(go, "--hyb")) p7_GHybrid (dsq, L, gm, gx, NULL, &sc);
-	  else if (esl_opt_GetBoolean(go, "--msv")) p7_GMSV    (dsq, L, gm, gx, nu,   &sc);
+	  if      (esl_opt_GetBoolean(go, "--vit")) p7_GViterbi(w->dsq, L, sim->gm, w->gx,       &sc);
+	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_GForward(w->dsq, L, sim->gm, w->gx,       &sc);
+	  else if (esl_opt_GetBoolean(go, "--hyb")) p7_GHybrid (w->dsq, L, sim->gm, w->gx, NULL, &sc);
+	  else if (esl_opt_GetBoolean(go, "--msv")) p7_GMSV    (w->dsq, L, sim->gm, w->gx, nu,   &sc);
 	}
 
       /* Optional: get Viterbi alignment length too. */
       if (esl_opt_GetBoolean(go, "-a"))  /* -a only works with Viterbi; getopts has checked this already */
 	{
-	  p7_GTrace(dsq, L, gm, gx, tr);
-	  p7_trace_GetStateUseCounts(tr, scounts);
+	  p7_GTrace(w->dsq, L, sim->gm, w->gx, w->tr);
+	  p7_trace_GetStateUseCounts(w->tr, scounts);
 
 	  /* there's various ways we could counts "alignment length". 
 	   * Here we'll use the total length of model used, in nodes: M+D states.
            * score vs al would gives us relative entropy / model position.
 	   */
 	  /* alilens[i] = scounts[p7T_D] + scounts[p7T_I]; SRE: temporarily testing this instead */
-	  alilens[i] = scounts[p7T_M] + scounts[p7T_D] + scounts[p7T_I];
+	  sim->av[i] = scounts[p7T_M] + scounts[p7T_D] + scounts[p7T_I];
 
-	  p7_trace_Reuse(tr);
+	  p7_trace_Reuse(w->tr);
 	}
 
-      p7_bg_NullOne(cfg->bg, dsq, L, &nullsc);
-      scores[i] = (sc - nullsc) / eslCONST_LOG2;
+      p7_bg_NullOne(sim->bg, w->dsq, L, &nullsc);
+      sim->xv[i] = (sc - nullsc) / eslCONST_LOG2;
     }
-
-  *ret_mu     = mu;
-  *ret_lambda = lambda;
-  status      = eslOK;
-
- ERROR:
-  if (dsq != NULL) free(dsq);
-  p7_omx_Destroy(ox);
-  p7_oprofile_Destroy(om);
-  p7_profile_Destroy(gm);
-  p7_gmx_Destroy(gx);
-  p7_trace_Destroy(tr);
-  if (status == eslEMEM) sprintf(errbuf, "allocation failure");
-  return status;
+  return eslOK;
 }
 
 
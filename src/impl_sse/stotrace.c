@@ -34,8 +34,12 @@ static inline int select_n(int i);
 static inline int select_c(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
 static inline int select_j(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
 static inline int select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k);
+static inline int select_e_roll(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k);
+static inline int select_e_cached(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, const double *ecdf, int i, int *ret_k);
 static inline int select_b(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i);
 
+static int stochastic_trace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, double **ecdf, P7_TRACE *tr);
+static int ecdf_row(const P7_OMX *ox, int i, double **ret_cdf);
 
 /*****************************************************************
  * 1. Stochastic trace implementation.
@@ -70,6 +74,85 @@ static inline int select_b(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_
 int
 p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
 		   P7_TRACE *tr)
+{
+  return stochastic_trace(rng, dsq, L, om, ox, NULL, tr);
+}
+
+
+/* Function:  p7_StochasticTraceBatch()
+ * Synopsis:  Sample a batch of tracebacks from one Forward matrix.
+ *
+ * Purpose:   Sample <ntr> tracebacks from Forward matrix <ox>, using
+ *            random number generator <rng>, and return them in
+ *            <tr[0..ntr-1]>. The result is the same as <ntr>
+ *            successive calls to <p7_StochasticTrace()>: the traces
+ *            are drawn one after another from the one RNG stream,
+ *            so a batch doesn't change anything that depends on
+ *            the seed. 
+ *            
+ *            What a batch saves is work that depends only on the
+ *            matrix, not on the trace. Choosing which M or D state
+ *            an E(i) state came from is an O(M) scan over row <i>
+ *            in <p7_StochasticTrace()>. Here, the cumulative
+ *            distribution over row <i> is computed the first time
+ *            any trace in the batch needs it, and each choice is a
+ *            binary search of it. Traces sampled from the same
+ *            matrix tend to end their domains on the same few rows,
+ *            so this replaces most of the scans.
+ *            
+ *            Each trace in <tr> must be empty (new, or Reuse()'d);
+ *            their allocations will be grown as needed here.
+ *
+ * Args:      rng - source of random numbers
+ *            dsq - digital sequence being aligned, 1..L
+ *            L   - length of dsq
+ *            om  - profile
+ *            ox  - Forward matrix to trace, LxM
+ *            tr  - storage for the sampled tracebacks, [0..ntr-1]
+ *            ntr - number of tracebacks to sample
+ *
+ * Returns:   <eslOK> on success
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> on the same problems as <p7_StochasticTrace()>.
+ */
+int
+p7_StochasticTraceBatch(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+			P7_TRACE **tr, int ntr)
+{
+  double **ecdf = NULL;		/* ecdf[i]: cumulative distribution of E(i)'s predecessors; NULL until needed */
+  int      i, t;
+  int      status;
+
+  ESL_ALLOC(ecdf, sizeof(double *) * (L+1));
+  for (i = 0; i <= L; i++) ecdf[i] = NULL;
+
+  for (t = 0; t < ntr; t++)
+    if ((status = stochastic_trace(rng, dsq, L, om, ox, ecdf, tr[t])) != eslOK) goto ERROR;
+
+  for (i = 0; i <= L; i++) if (ecdf[i]) free(ecdf[i]);
+  free(ecdf);
+  return eslOK;
+
+ ERROR:
+  if (ecdf) {
+    for (i = 0; i <= L; i++) if (ecdf[i]) free(ecdf[i]);
+    free(ecdf);
+  }
+  return status;
+}
+
+
+/* stochastic_trace()
+ * 
+ * The stochastic traceback itself, for both the single and the
+ * batch API. If <ecdf> is non-NULL, it's the batch's cache of E
+ * row distributions, <ecdf[0..L]>, with NULL for rows not computed
+ * yet.
+ */
+static int
+stochastic_trace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox,
+		 double **ecdf, P7_TRACE *tr)
 {
   int   i;			/* position in sequence 1..L */
   int   k;			/* position in model 1..M */
@@ -92,7 +175,11 @@ p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPRO
       case p7T_N: s1 = select_n(i);                            break;
       case p7T_C: s1 = select_c(rng, om, ox, i);               break;
       case p7T_J: s1 = select_j(rng, om, ox, i);               break;
-      case p7T_E: s1 = select_e(rng, om, ox, i, &k);           break;
+      case p7T_E: 
+	if (ecdf == NULL) { s1 = select_e(rng, om, ox, i, &k); break; }
+	if (ecdf[i] == NULL && (status = ecdf_row(ox, i, &(ecdf[i]))) != eslOK) return status;
+	s1 = select_e_cached(rng, om, ox, ecdf[i], i, &k);
+	break;
       case p7T_B: s1 = select_b(rng, om, ox, i);               break;
       default: ESL_EXCEPTION(eslEINVAL, "bogus state in traceback");
       }
@@ -248,10 +335,15 @@ select_j(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i)
  */
 static inline int
 select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k)
+{
+  return select_e_roll(esl_random(rng), om, ox, i, ret_k);
+}
+
+static inline int
+select_e_roll(double roll, const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k)
 {
   int    Q     = p7O_NQF(ox->M);
   double sum   = 0.0;
-  double roll  = esl_random(rng);
   double norm  = 1.0 / ox->xmx[i*p7X_NXCELLS+p7X_E];
   __m128 xEv   = _mm_set1_ps(norm); /* all M, D already scaled exactly the same */
   union { __m128 v; float p[4]; } u;
@@ -278,6 +370,67 @@ select_e(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i, in
   ESL_EXCEPTION(-1, "unreached code was reached. universe collapses.");
 } 
 
+/* The same choice, by binary search of the cumulative distribution
+ * <ecdf> over row i that ecdf_row() precomputed, in the same order
+ * and with the same arithmetic as the scan above. The scan wraps
+ * around if roundoff leaves the total a hair short of 1 and the roll
+ * lands above it; that rare case goes to the scan itself, so the
+ * choice is always the same one select_e() makes.
+ */
+static inline int
+select_e_cached(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, const double *ecdf, int i, int *ret_k)
+{
+  int    Q    = p7O_NQF(ox->M);
+  double roll = esl_random(rng);
+  int    lo   = 0;
+  int    hi   = 8*Q-1;
+  int    mid;
+
+  if (roll >= ecdf[hi]) return select_e_roll(roll, om, ox, i, ret_k);
+
+  while (lo < hi) {		/* find the first cell <lo> with roll < ecdf[lo] */
+    mid = (lo + hi) / 2;
+    if (roll < ecdf[mid]) hi = mid;
+    else                  lo = mid+1;
+  }
+  *ret_k = (lo%4)*Q + lo/8 + 1;
+  return ((lo%8) < 4 ? p7T_M : p7T_D);
+}
+
+/* ecdf_row()
+ * Allocate and compute the cumulative distribution of the states
+ * that E(i) is reached from, in the order select_e() scans them:
+ * for each q, the four M cells, then the four D cells.
+ */
+static int
+ecdf_row(const P7_OMX *ox, int i, double **ret_cdf)
+{
+  int     Q    = p7O_NQF(ox->M);
+  double *cdf  = NULL;
+  double  sum  = 0.0;
+  double  norm = 1.0 / ox->xmx[i*p7X_NXCELLS+p7X_E];
+  __m128  xEv  = _mm_set1_ps(norm);
+  union { __m128 v; float p[4]; } u;
+  int     q,r;
+  int     status;
+
+  ESL_ALLOC(cdf, sizeof(double) * 8 * Q);
+  for (q = 0; q < Q; q++)
+    {
+      u.v = _mm_mul_ps(ox->dpf[i][q*3 + p7X_M], xEv);
+      for (r = 0; r < 4; r++) { sum += u.p[r]; cdf[8*q+r]   = sum; }
+
+      u.v = _mm_mul_ps(ox->dpf[i][q*3 + p7X_D], xEv);
+      for (r = 0; r < 4; r++) { sum += u.p[r]; cdf[8*q+4+r] = sum; }
+    }
+  *ret_cdf = cdf;
+  return eslOK;
+
+ ERROR:
+  *ret_cdf = NULL;
+  return status;
+}
+
 /* B(i) is reached from N(i) or J(i). */
 static inline int
 select_b(ESL_RANDOMNESS *rng, const P7_OPROFILE *om, const P7_OMX *ox, int i)
@@ -318,6 +471,7 @@ static ESL_OPTIONS options[] = {
   { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
   { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seq" ,                   0 },
   { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of sampled tracebacks",                   0 },
+  { "-B",        eslARG_INT,       "0", NULL, "n>=0",NULL,  NULL, NULL, "sample in batches of <n> traces (0=one at a time)", 0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
@@ -339,10 +493,12 @@ main(int argc, char **argv)
   P7_GMX         *gx      = NULL;
   P7_OMX         *fwd     = NULL;
   P7_TRACE       *tr      = NULL;
+  P7_TRACE      **trb     = NULL;
   int             L       = esl_opt_GetInteger(go, "-L");
   int             N       = esl_opt_GetInteger(go, "-N");
+  int             B       = esl_opt_GetInteger(go, "-B");
   ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
-  int             i;
+  int             i, b, nb;
   float           sc, fsc, vsc;
   float           bestsc  = -eslINFINITY;
   
@@ -361,13 +517,35 @@ main(int argc, char **argv)
   p7_GViterbi(dsq, L, gm, gx,  &vsc);
   p7_Forward (dsq, L, om, fwd, &fsc);
 
+  if (B > 0) {
+    trb = malloc(sizeof(P7_TRACE *) * B);
+    for (b = 0; b < B; b++) trb[b] = p7_trace_Create();
+  }
+
   esl_stopwatch_Start(w);
-  for (i = 0; i < N; i++)
+  if (B == 0) 
     {
-      p7_StochasticTrace(r, dsq, L, om, fwd, tr);
-      p7_trace_Score(tr, dsq, gm, &sc);
-      bestsc = ESL_MAX(bestsc, sc);
-      p7_trace_Reuse(tr);
+      for (i = 0; i < N; i++)
+	{
+	  p7_StochasticTrace(r, dsq, L, om, fwd, tr);
+	  p7_trace_Score(tr, dsq, gm, &sc);
+	  bestsc = ESL_MAX(bestsc, sc);
+	  p7_trace_Reuse(tr);
+	}
+    }
+  else
+    {
+      for (i = 0; i < N; i += nb)
+	{
+	  nb = ESL_MIN(B, N-i);
+	  p7_StochasticTraceBatch(r, dsq, L, om, fwd, trb, nb);
+	  for (b = 0; b < nb; b++) 
+	    {
+	      p7_trace_Score(trb[b], dsq, gm, &sc);
+	      bestsc = ESL_MAX(bestsc, sc);
+	      p7_trace_Reuse(trb[b]);
+	    }
+	}
     }
   esl_stopwatch_Stop(w);
   esl_stopwatch_Display(stdout, w, "# CPU time: ");
@@ -376,6 +554,10 @@ main(int argc, char **argv)
   printf("viterbi sc   = %.4f nats\n", vsc);
   printf("max trace sc = %.4f nats\n", bestsc);
 
+  if (trb) {
+    for (b = 0; b < B; b++) p7_trace_Destroy(trb[b]);
+    free(trb);
+  }
   free(dsq);
   p7_trace_Destroy(tr);
   p7_gmx_Destroy(gx);
@@ -450,6 +632,51 @@ utest_stotrace(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_PROFI
   p7_omx_Destroy(ox);
   p7_gmx_Destroy(gx);
 }
+
+/* utest_batch():
+ * a batch of traces from p7_StochasticTraceBatch() must be identical
+ * to the same number of traces from p7_StochasticTrace(), given two
+ * RNGs with the same seed.
+ */
+static void
+utest_batch(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_PROFILE *gm, P7_OPROFILE *om, ESL_DSQ *dsq, int L, int ntrace)
+{
+  ESL_RANDOMNESS *r1   = NULL;
+  ESL_RANDOMNESS *r2   = NULL;
+  P7_OMX         *ox   = NULL;
+  P7_TRACE       *tr   = NULL;
+  P7_TRACE      **trb  = NULL;
+  char            errbuf[eslERRBUFSIZE];
+  uint32_t        seed;
+  int             idx;
+
+  do { seed = esl_random_uint32(rng); } while (seed == 0); /* seed 0 would mean an arbitrary seed, different for r1, r2 */
+  if ((r1  = esl_randomness_CreateFast(seed))      == NULL)  esl_fatal("RNG creation failed");
+  if ((r2  = esl_randomness_CreateFast(seed))      == NULL)  esl_fatal("RNG creation failed");
+  if ((ox  = p7_omx_Create(gm->M, L, L))           == NULL)  esl_fatal("optimized DP matrix create failed");
+  if ((tr  = p7_trace_Create())                    == NULL)  esl_fatal("trace creation failed");
+  if ((trb = malloc(sizeof(P7_TRACE *) * ntrace))  == NULL)  esl_fatal("malloc failed");
+  for (idx = 0; idx < ntrace; idx++)
+    if ((trb[idx] = p7_trace_Create())             == NULL)  esl_fatal("trace creation failed");
+
+  if (p7_Forward(dsq, L, om, ox, NULL)                        != eslOK) esl_fatal("forward failed");
+  if (p7_StochasticTraceBatch(r2, dsq, L, om, ox, trb, ntrace) != eslOK) esl_fatal("batch stochastic trace failed");
+
+  for (idx = 0; idx < ntrace; idx++)
+    {
+      if (p7_StochasticTrace(r1, dsq, L, om, ox, tr)      != eslOK) esl_fatal("stochastic trace failed");
+      if (p7_trace_Validate(trb[idx], abc, dsq, errbuf)   != eslOK) esl_fatal("batch trace invalid:\n%s", errbuf);
+      if (p7_trace_Compare(tr, trb[idx], 0.0)             != eslOK) esl_fatal("batch trace %d differs from single trace", idx);
+      p7_trace_Reuse(tr);
+    }
+
+  for (idx = 0; idx < ntrace; idx++) p7_trace_Destroy(trb[idx]);
+  free(trb);
+  p7_trace_Destroy(tr);
+  p7_omx_Destroy(ox);
+  esl_randomness_Destroy(r1);
+  esl_randomness_Destroy(r2);
+}
 #endif /*p7STOTRACE_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
@@ -507,11 +734,13 @@ main(int argc, char **argv)
   if ((dsq = malloc(sizeof(ESL_DSQ) *(L+2)))  == NULL)  esl_fatal("malloc failed");
   if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq) != eslOK) esl_fatal("seq generation failed");
   utest_stotrace(go, r, abc, gm, om, dsq, L, ntrace);
+  utest_batch   (go, r, abc, gm, om, dsq, L, ntrace);
 
   /* Test with seq sampled from profile */
   if ((sq = esl_sq_CreateDigital(abc))             == NULL) esl_fatal("sequence allocation failed");
   if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)    != eslOK) esl_fatal("profile emission failed");
   utest_stotrace(go, r, abc, gm, om, sq->dsq, sq->n, ntrace);
+  utest_batch   (go, r, abc, gm, om, sq->dsq, sq->n, ntrace);
    
   esl_sq_Destroy(sq);
   free(dsq);
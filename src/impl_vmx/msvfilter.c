@@ -18,6 +18,7 @@
 #include "p7_config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #ifndef __APPLE_ALTIVEC__
@@ -428,6 +429,112 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
 /*------------------ end, p7_SSVFilter_longtarget() ------------------------*/
 
 
+
+/* Function:  p7_MSVFilterDelta()
+ * Synopsis:  Per-residue bound on how much MSV scores can change between two profiles.
+ *
+ * Purpose:   Given two optimized profiles <om1> and <om2> of the same
+ *            length (typically consecutive rounds of an iterative
+ *            search), calculate for each residue code <x> a bound
+ *            <delta[x]>, in the MSV filter's internal byte units, on
+ *            how much one row of the MSV filter's DP can change when
+ *            <om1> is replaced by <om2>. Caller provides <delta>,
+ *            allocated for at least <abc->Kp> ints.
+ *
+ *            Every step of the MSV recursion (max, saturated add of
+ *            the bias, saturated subtraction of a match cost) changes
+ *            its result by no more than it changes its arguments, so
+ *            for any target <dsq>, the final MSV score changes by at
+ *            most $\sum_i$ <delta[dsq[i]]>, as long as the constant
+ *            transition costs are the same in both profiles. Pass
+ *            that sum to <p7_MSVFilterBound()> to turn it into an
+ *            upper bound on the new score.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINCOMPAT> if the two profiles differ in length,
+ *            alphabet, or the MSV filter's constant costs, so no
+ *            bound is possible; <delta> is undefined.
+ */
+int
+p7_MSVFilterDelta(const P7_OPROFILE *om1, const P7_OPROFILE *om2, int *delta)
+{
+  int Q = p7O_NQB(om1->M);
+  int q, r, x;
+  int d;
+  union { vector unsigned char v; uint8_t c[16]; } a, b;
+
+  if (om1->M          != om2->M          ||
+      om1->abc->type  != om2->abc->type  ||
+      om1->tbm_b      != om2->tbm_b      ||
+      om1->tec_b      != om2->tec_b      ||
+      om1->base_b     != om2->base_b     ||
+      om1->scale_b    != om2->scale_b) return eslEINCOMPAT;
+
+  for (x = 0; x < om1->abc->Kp; x++)
+    {
+      delta[x] = 0;
+      for (q = 0; q < Q; q++)
+	{
+	  a.v = om1->rbv[x][q]; b.v = om2->rbv[x][q];
+	  for (r = 0; r < 16; r++)
+	    {
+	      d = abs((int) a.c[r] - (int) b.c[r]);
+	      if (d > delta[x]) delta[x] = d;
+	    }
+	}
+      delta[x] += abs((int) om1->bias_b - (int) om2->bias_b);
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_MSVFilterBound()
+ * Synopsis:  Upper bound on an MSV score, from an old score and a change bound.
+ *
+ * Purpose:   A target had MSV score <oldsc> (nats, as returned by
+ *            <p7_MSVFilter()>) with some earlier profile. Since then
+ *            the profile has changed by a total of <slack> byte units
+ *            for this target, as summed from <p7_MSVFilterDelta()>.
+ *            Calculate an upper bound <*ret_maxsc> on the target's
+ *            MSV score with the current profile <om>, which must
+ *            already be configured for the target's length.
+ *
+ *            The bound is computed in the same limited precision as
+ *            <p7_MSVFilter()> itself, so a target whose <*ret_maxsc>
+ *            fails a P-value threshold is guaranteed to fail it when
+ *            rescored.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if <oldsc> is infinite, or if the new score
+ *            might overflow the filter's range (in which case
+ *            <p7_MSVFilter()> would report a high-scoring hit);
+ *            <*ret_maxsc> is set to <eslINFINITY>.
+ */
+int
+p7_MSVFilterBound(const P7_OPROFILE *om, float oldsc, int slack, float *ret_maxsc)
+{
+  int xJ;
+
+  if (oldsc == eslINFINITY) { *ret_maxsc = eslINFINITY; return eslERANGE; }
+
+  /* invert the final score calculation of p7_MSVFilter() */
+  xJ  = (int) roundf((oldsc + 3.0) * om->scale_b) + om->tjb_b + om->base_b;
+  xJ += slack;
+
+  /* The old DP had Mk->E <= xJ + tec at every row, so the new one
+   * has Mk->E <= xJ + slack + tec; it can only overflow if that
+   * reaches the filter's ceiling.
+   */
+  if (xJ + om->tec_b + om->bias_b >= 255) { *ret_maxsc = eslINFINITY; return eslERANGE; }
+
+  *ret_maxsc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_maxsc /= om->scale_b;
+  *ret_maxsc -= 3.0;
+  return eslOK;
+}
+/*------------ end, p7_MSVFilterDelta(), p7_MSVFilterBound() -----------------*/
+
+
 /*****************************************************************
  * 2. Benchmark driver.
  *****************************************************************/
@@ -10,6 +10,7 @@
 #include "esl_alphabet.h"
 #include "esl_dmatrix.h"
 #include "esl_getopts.h"
+#include "esl_gumbel.h"
 #include "esl_keyhash.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
@@ -31,10 +32,39 @@
 
 #include "hmmer.h"
 
+/* TARGET_CACHE: with --dbcache, the target database is read and
+ * digitized once, into blocks of sequences held in memory, and every
+ * round of every query is searched from the cache instead of
+ * re-parsing the file. The <next> cursor hands out blocks to worker
+ * threads, under <mutex>.
+ *
+ * With --fcache, the cache also remembers each target's MSV score
+ * from the last round it was scored in, and a bound on how much the
+ * model has changed since, for that target. A target whose bounded
+ * score still fails the MSV filter is skipped without rescoring; the
+ * bound is strict, so the results are the same as without the cache.
+ */
+typedef struct {
+  ESL_SQ_BLOCK   **blocks;	/* digital target sequences, in db order: [0..nblocks-1] */
+  int              nblocks;	/* number of blocks in use                               */
+  int              nalloc;	/* allocated size of <blocks>                            */
+  int              next;	/* index of next block to hand to a worker               */
+
+  float          **msvsc;	/* [b][i] MSV score when last scored, or +inf; NULL if no --fcache */
+  int            **slack;	/* [b][i] bound on MSV score change since then, filter units    */
+  int             *delta;	/* [0..Kp-1] per-residue bound for this round's model change  */
+  P7_OPROFILE     *om;		/* previous round's model, to compute <delta> from           */
+#ifdef HMMER_THREADS
+  pthread_mutex_t  mutex;	/* serializes access to <next>                           */
+#endif
+} TARGET_CACHE;
+
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
 #endif
+  TARGET_CACHE     *tcache;     /* target seqs cached in memory (--dbcache), or NULL */
+  uint64_t          nskipped;   /* # of targets skipped by the --fcache score cache  */
   P7_BG            *bg;
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
@@ -58,6 +88,12 @@ typedef struct {
 #define MPIOPTS     NULL
 #endif
 
+#ifdef HMMER_MPI
+#define DBCACHEOPTS "--mpi"                                                 // the MPI master hands out workers' blocks by disk offset
+#else
+#define DBCACHEOPTS NULL
+#endif
+
 static ESL_OPTIONS options[] = {
   /* name           type              default   env  range   toggles     reqs   incomp                             help                                                  docgroup*/
   { "-h",           eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "show brief help on version and usage",                         1 },
@@ -130,13 +166,18 @@ static ESL_OPTIONS options[] = {
   { "--EfL",         eslARG_INT,        "100", NULL,"n>0",      NULL,    NULL,  NULL,            "length of sequences for Forward exp tail tau fit",            11 },   
   { "--EfN",         eslARG_INT,        "200", NULL,"n>0",      NULL,    NULL,  NULL,            "number of sequences for Forward exp tail tau fit",            11 },   
   { "--Eft",         eslARG_REAL,      "0.04", NULL,"0<x<1",    NULL,    NULL,  NULL,            "tail mass for Forward exponential tail tau fit",              11 },   
+  { "--Etable",      eslARG_INFILE,      NULL, NULL, NULL,       NULL,    NULL,  NULL,            "fast calibration: estimate round 1 mu, tau from table <f>",   11 },
 /* Other options */
   { "--nonull2",    eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL,  NULL,            "turn off biased composition score corrections",               12 },
+  { "--adaptens",   eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL,  NULL,            "adaptively size stochastic trace ensembles",                  12 },
+  { "--domcpu",     eslARG_INT,          "0",  NULL, "n>=0",    NULL,    NULL,  NULL,            "threads for domain definition of long targets",               12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",    NULL,    NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--qformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--dbcache",    eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  DBCACHEOPTS,     "cache <seqdb> in memory, instead of rereading each round",   12 },
+  { "--fcache",     eslARG_NONE,        FALSE, NULL, NULL,      NULL,"--dbcache",NULL,           "skip targets that provably fail MSV again, from last round",   12 },
 
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,      p7_NCPU,"HMMER_NCPU","n>=0", NULL,    NULL,  CPUOPTS,       "number of parallel CPU workers to use for multithreads",      12 },
@@ -167,15 +208,23 @@ struct cfg_s {
 
 
 
+#define BLOCK_SIZE 1000
+
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
+static int  cache_serial_loop(WORKER_INFO *info, TARGET_CACHE *tcache);
 #ifdef HMMER_THREADS
-#define BLOCK_SIZE 1000
-
 static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+static int  cache_thread_loop(ESL_THREADS *obj);
 static void pipeline_thread(void *arg);
 #endif 
 
+static int           tcache_Load(ESL_SQFILE *dbfp, const ESL_ALPHABET *abc, int do_fcache, TARGET_CACHE **ret_tcache);
+static int           tcache_NewModel(TARGET_CACHE *tcache, const P7_OPROFILE *om, int is_first_round);
+static ESL_SQ_BLOCK *tcache_Next(TARGET_CACHE *tcache, int *ret_b);
+static void          tcache_Search(WORKER_INFO *info, TARGET_CACHE *tcache, int b, int i);
+static void          tcache_Destroy(TARGET_CACHE *tcache);
+
 #ifdef HMMER_MPI
 static int  mpi_master   (ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  mpi_worker   (ESL_GETOPTS *go, struct cfg_s *cfg);
@@ -343,7 +392,10 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--EfL")        && fprintf(ofp, "# seq length, Fwd exp tau fit:     %d\n",             esl_opt_GetInteger(go, "--EfL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EfN")        && fprintf(ofp, "# seq number, Fwd exp tau fit:     %d\n",             esl_opt_GetInteger(go, "--EfN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--Eft")        && fprintf(ofp, "# tail mass for Fwd exp tau fit:   %f\n",             esl_opt_GetReal   (go, "--Eft"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--Etable")     && fprintf(ofp, "# fast calibration table:          %s\n",             esl_opt_GetString (go, "--Etable"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adaptens")   && fprintf(ofp, "# adaptive trace ensembles:        on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domcpu")     && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--domcpu"))               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))
@@ -353,6 +405,8 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
     }
   if (esl_opt_IsUsed(go, "--qformat")    && fprintf(ofp, "# query <seqfile> format asserted: %s\n",             esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dbcache")    && fprintf(ofp, "# target <seqdb> cached in memory: on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--fcache")     && fprintf(ofp, "# MSV filter score cache:          on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
@@ -435,9 +489,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                     */
+  TARGET_CACHE    *tcache   = NULL;               /* dbfile cached in memory, if --dbcache           */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                               */
   P7_BG           *bg       = NULL;		  /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
+  P7_EVTABLE      *evtable  = NULL;               /* fast E-value calibration table (--Etable)       */
+  char             errbuf[eslERRBUFSIZE];
   ESL_SQ          *qsq      = NULL;               /* query sequence                                  */
   ESL_KEYHASH     *kh       = NULL;		  /* hash of previous top hits' ranks                */
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                      */
@@ -456,6 +513,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;   /* worker hit lists to merge into info[0].th */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -494,6 +552,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (esl_opt_IsOn(go, "--Etable") && p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &evtable, errbuf) != eslOK)
+    p7_Fail("Failed to read E-value calibration table:\n%s\n", errbuf);
+  if (evtable && p7_evtable_Compatible(evtable, bld, bg, errbuf) != eslOK)
+    p7_Fail("E-value calibration table %s doesn't apply to this search:\n%s\n", esl_opt_GetString(go, "--Etable"), errbuf);
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o")          && (ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  
@@ -512,8 +574,17 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
   
-  if (! esl_sqfile_IsRewindable(dbfp)) 
-    p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
+  /* With --dbcache, read and digitize the whole target database once, now;
+   * then the file needn't be rewindable, and can even be a stdin pipe.
+   */
+  if (esl_opt_GetBoolean(go, "--dbcache"))
+    {
+      status = tcache_Load(dbfp, abc, esl_opt_GetBoolean(go, "--fcache"), &tcache);
+      if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+      else if (status != eslOK)      p7_Fail("Unexpected error %d caching sequence file %s", status, dbfp->filename);
+    }
+  else if (! esl_sqfile_IsRewindable(dbfp)) 
+    p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is (or use --dbcache)", cfg->dbfile);
 
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
@@ -531,10 +602,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
     }
+  bld->ncpu = ncpus;		/* workers are idle while the master builds each round's model */
 #endif
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* Ready to begin */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -545,6 +618,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].th    = NULL;
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
+      info[i].tcache = tcache;
+      info[i].nskipped = 0;
 #ifdef HMMER_THREADS
       info[i].queue = queue;
 #endif
@@ -598,7 +673,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
  	  /* Create the search model: from query alone (round 1) or from MSA (round 2+) */
 	  if (msa == NULL)	/* round 1 */
 	    {
+	      bld->evtable = evtable;	/* the table is fit to single-sequence models; not used in later rounds */
 	      p7_SingleBuilder(bld, qsq, info[0].bg, ret_hmm, &qtr, NULL, &om); /* bypass HMM - only need model */
+	      bld->evtable = NULL;
 	      prv_msa_nseq = 1;
 	    }
 	  else
@@ -627,6 +704,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    hmm = NULL;
 	  }
 
+	  /* Rewind the target cache before any worker thread starts pulling from it:
+	   * workers are released as soon as they're added, below.
+	   */
+	  if (tcache) tcache->next = 0;
+	  if (tcache && tcache_NewModel(tcache, om, (iteration == 1)) != eslOK) p7_Fail("Failed to update target cache for new model");
+
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  for (i = 0; i < infocnt; ++i)
 	    {
@@ -634,6 +717,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	      info[i].om  = p7_oprofile_Clone(om);
 	      info[i].pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
 	      p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+	      info[i].nskipped = 0;
 
 #ifdef HMMER_THREADS
 	      if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
@@ -641,10 +725,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp);
-	  else           sstatus = serial_loop(info, dbfp);
+	  if      (tcache && ncpus > 0) sstatus = cache_thread_loop(threadObj);
+	  else if (tcache)              sstatus = cache_serial_loop(info, tcache);
+	  else if (ncpus > 0)           sstatus = thread_loop(threadObj, queue, dbfp);
+	  else                          sstatus = serial_loop(info, dbfp);
 #else
-	  sstatus = serial_loop(info, dbfp);
+	  if (tcache) sstatus = cache_serial_loop(info, tcache);
+	  else        sstatus = serial_loop(info, dbfp);
 #endif
 	  switch(sstatus)
 	    {
@@ -660,11 +747,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 			sstatus, dbfp->filename);
 	    }
 
-	  /* merge the results of the search results */
+	  /* merge the results of the search results: each worker has sorted its own hits */
+	  for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+	  p7_tophits_MergeList(info[0].th, thl, infocnt-1);
 	  for (i = 1; i < infocnt; ++i)
 	    {
-	      p7_tophits_Merge(info[0].th, info[i].th);
 	      p7_pipeline_Merge(info[0].pli, info[i].pli);
+	      info[0].nskipped += info[i].nskipped;
 
 	      p7_pipeline_Destroy(info[i].pli);
 	      p7_tophits_Destroy(info[i].th);
@@ -692,6 +781,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 	  esl_stopwatch_Stop(w);
 	  p7_pli_Statistics(ofp, info->pli, w);
+	  if (tcache && tcache->msvsc &&
+	      fprintf(ofp, "# MSV score cache: %" PRIu64 " of %" PRIu64 " targets skipped (%.4g)\n",
+		      info->nskipped, info->pli->nseqs, (info->pli->nseqs ? (double) info->nskipped / (double) info->pli->nseqs : 0.0)) < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
 
 	  /* Convergence test */
@@ -709,7 +802,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  else if (iteration < maxiterations)
 	    { if (fprintf(ofp, "@@ Continuing to next round.\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
-	  esl_sqfile_Position(dbfp, 0);
+	  if (! tcache) esl_sqfile_Position(dbfp, 0);
 	} /* end iteration loop */
 
       /* Because we destroy/create the hitlist, om, pipeline, and msa above, rather than create/destroy,
@@ -740,7 +833,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_trace_Destroy(qtr);
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
+      if (! tcache) esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -770,13 +863,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thl);
 
   esl_keyhash_Destroy(kh);
   esl_sqfile_Close(qfp);
   esl_sqfile_Close(dbfp);
+  tcache_Destroy(tcache);
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
+  p7_evtable_Destroy(evtable);
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
 
@@ -992,6 +1088,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                               */
   P7_BG           *bg       = NULL;               /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
+  P7_EVTABLE      *evtable  = NULL;               /* fast E-value calibration table (--Etable)       */
+  char             errbuf[eslERRBUFSIZE];
   ESL_SQ          *qsq      = NULL;               /* query sequence                                  */
   ESL_SQ          *dbsq     = NULL;               /* target sequence                                 */
   ESL_KEYHASH     *kh       = NULL;		  /* hash of previous top hits' ranks                */
@@ -1045,6 +1143,10 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (esl_opt_IsOn(go, "--Etable") && p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &evtable, errbuf) != eslOK)
+    mpi_failure("Failed to read E-value calibration table:\n%s\n", errbuf);
+  if (evtable && p7_evtable_Compatible(evtable, bld, bg, errbuf) != eslOK)
+    mpi_failure("E-value calibration table %s doesn't apply to this search:\n%s\n", esl_opt_GetString(go, "--Etable"), errbuf);
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o")          && (ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  
@@ -1119,7 +1221,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
  	  /* Create the search model: from query alone (round 1) or from MSA (round 2+) */
 	  if (msa == NULL)	/* round 1 */
 	    {
+	      bld->evtable = evtable;	/* the table is fit to single-sequence models; not used in later rounds */
 	      p7_SingleBuilder(bld, qsq, bg, ret_hmm, &qtr, NULL, &om); /* bypass HMM - only need model */
+	      bld->evtable = NULL;
 
 	      prv_msa_nseq = 1;
 	    }
@@ -1350,6 +1454,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
+  p7_evtable_Destroy(evtable);
   esl_alphabet_Destroy(abc);
 
   if (ofp      != stdout) fclose(ofp);
@@ -1623,6 +1728,23 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
   return sstatus;
 }
 
+/* cache_serial_loop()
+ * Same as serial_loop(), but the target sequences come from the
+ * in-memory cache. They're read-only: we must not Reuse() them,
+ * because the next round searches them again. Returns eslEOF
+ * on success, like serial_loop() does at the end of the file.
+ */
+static int
+cache_serial_loop(WORKER_INFO *info, TARGET_CACHE *tcache)
+{
+  int b, i;
+
+  for (b = 0; b < tcache->nblocks; b++)
+    for (i = 0; i < tcache->blocks[b]->count; i++)
+      tcache_Search(info, tcache, b, i);
+  return eslEOF;
+}
+
 #ifdef HMMER_THREADS
 static int
 thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
@@ -1670,10 +1792,26 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
   return sstatus;
 }
 
+/* cache_thread_loop()
+ * Threaded search of the in-memory target cache. No reader is
+ * needed; the workers pull blocks straight from the cache (see
+ * pipeline_thread()), so all the master does is start them and
+ * wait. The caller must already have rewound the cache's cursor,
+ * before adding the threads. Returns eslEOF on success, like
+ * thread_loop().
+ */
+static int
+cache_thread_loop(ESL_THREADS *obj)
+{
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+  return eslEOF;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
-  int i;
+  int i, b;
   int status;
   int workeridx;
   WORKER_INFO   *info;
@@ -1690,6 +1828,19 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
+  /* --dbcache: take blocks from the shared cache until it's exhausted.
+   * Cached seqs are searched again next round; don't Reuse() them.
+   */
+  if (info->tcache != NULL)
+    {
+      while ((block = tcache_Next(info->tcache, &b)) != NULL)
+	for (i = 0; i < block->count; ++i)
+	  tcache_Search(info, info->tcache, b, i);
+      p7_tophits_SortBySortkey(info->th); /* so the master only has to merge */
+      esl_threads_Finished(obj, workeridx);
+      return;
+    }
+
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
@@ -1721,9 +1872,207 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th); /* so the master only has to merge */
   esl_threads_Finished(obj, workeridx);
   return;
 }
 #endif   /* HMMER_THREADS */
 
 
+/*****************************************************************
+ * TARGET_CACHE: target database digitized once, held in memory
+ *****************************************************************/
+
+/* tcache_Load()
+ * Read the rest of the open target database <dbfp> into a new
+ * in-memory cache, in blocks of up to BLOCK_SIZE digital
+ * sequences. If <do_fcache> is TRUE, also allocate the per-target
+ * MSV score cache. Return eslOK and the new cache in <*ret_tcache>
+ * on success; eslEFORMAT on a parse error (and the message is in
+ * <dbfp>'s error buffer); eslEMEM on allocation failure.
+ */
+static int
+tcache_Load(ESL_SQFILE *dbfp, const ESL_ALPHABET *abc, int do_fcache, TARGET_CACHE **ret_tcache)
+{
+  TARGET_CACHE *tcache = NULL;
+  ESL_SQ_BLOCK *block  = NULL;
+  int           b;
+  int           status;
+
+  ESL_ALLOC(tcache, sizeof(TARGET_CACHE));
+  tcache->blocks  = NULL;
+  tcache->nblocks = 0;
+  tcache->nalloc  = 0;
+  tcache->next    = 0;
+  tcache->msvsc   = NULL;
+  tcache->slack   = NULL;
+  tcache->delta   = NULL;
+  tcache->om      = NULL;
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&tcache->mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+#endif
+
+  while (1)
+    {
+      if ((block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc)) == NULL) { status = eslEMEM; goto ERROR; }
+
+      status = esl_sqio_ReadBlock(dbfp, block, -1, -1, /*max_init_window=*/FALSE, FALSE);
+      if (status == eslEOF) break;
+      if (status != eslOK)  goto ERROR;
+
+      if (tcache->nblocks == tcache->nalloc)
+	{
+	  tcache->nalloc = (tcache->nalloc == 0 ? 16 : tcache->nalloc * 2);
+	  ESL_REALLOC(tcache->blocks, sizeof(ESL_SQ_BLOCK *) * tcache->nalloc);
+	}
+      tcache->blocks[tcache->nblocks++] = block;
+      block = NULL;
+    }
+  esl_sq_DestroyBlock(block);
+  block = NULL;
+
+  if (do_fcache)
+    {
+      ESL_ALLOC(tcache->delta, sizeof(int)     * abc->Kp);
+      ESL_ALLOC(tcache->msvsc, sizeof(float *) * ESL_MAX(1, tcache->nblocks));
+      ESL_ALLOC(tcache->slack, sizeof(int *)   * ESL_MAX(1, tcache->nblocks));
+      for (b = 0; b < tcache->nblocks; b++) { tcache->msvsc[b] = NULL; tcache->slack[b] = NULL; }
+      for (b = 0; b < tcache->nblocks; b++)
+	{
+	  ESL_ALLOC(tcache->msvsc[b], sizeof(float) * tcache->blocks[b]->count);
+	  ESL_ALLOC(tcache->slack[b], sizeof(int)   * tcache->blocks[b]->count);
+	}
+    }
+
+  *ret_tcache = tcache;
+  return eslOK;
+
+ ERROR:
+  if (block) esl_sq_DestroyBlock(block);
+  tcache_Destroy(tcache);
+  *ret_tcache = NULL;
+  return status;
+}
+
+/* tcache_NewModel()
+ * Prepare the score cache (if any) for a round of searching with the
+ * new model <om>. This must be called before worker threads are
+ * started, since they begin searching as soon as they're created.
+ *
+ * On the first round of a query, or if the model changed length,
+ * previous scores are no use and are forgotten; otherwise calculate
+ * the per-residue bound on the change in MSV scores since the
+ * previous round. Return eslOK on success, eslEMEM on allocation
+ * failure.
+ */
+static int
+tcache_NewModel(TARGET_CACHE *tcache, const P7_OPROFILE *om, int is_first_round)
+{
+  int b, i;
+
+  if (tcache->msvsc == NULL) return eslOK;
+
+  if (is_first_round || tcache->om == NULL || p7_MSVFilterDelta(tcache->om, om, tcache->delta) != eslOK)
+    {
+      for (b = 0; b < tcache->nblocks; b++)
+	for (i = 0; i < tcache->blocks[b]->count; i++)
+	  {
+	    tcache->msvsc[b][i] = eslINFINITY;
+	    tcache->slack[b][i] = 0;
+	  }
+    }
+
+  if (tcache->om) p7_oprofile_Destroy(tcache->om);
+  if ((tcache->om = p7_oprofile_Clone(om)) == NULL) return eslEMEM;
+  return eslOK;
+}
+
+/* tcache_Next()
+ * Hand the next unsearched block of the cache to a caller
+ * (a worker thread), and its index in <*ret_b>; return NULL when
+ * all blocks have been handed out.
+ */
+static ESL_SQ_BLOCK *
+tcache_Next(TARGET_CACHE *tcache, int *ret_b)
+{
+  ESL_SQ_BLOCK *block = NULL;
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_lock(&tcache->mutex) != 0) p7_Fail("mutex lock failed");
+#endif
+  if (tcache->next < tcache->nblocks) { *ret_b = tcache->next; block = tcache->blocks[tcache->next++]; }
+#ifdef HMMER_THREADS
+  if (pthread_mutex_unlock(&tcache->mutex) != 0) p7_Fail("mutex unlock failed");
+#endif
+  return block;
+}
+
+/* tcache_Search()
+ * Search cached target <i> of block <b> with the worker's pipeline.
+ * The target isn't Reuse()'d; it's searched again next round.
+ *
+ * With the score cache, a target that was scored in an earlier round
+ * first has this round's model change added to its bound. If its MSV
+ * score can't have risen enough to pass the F1 threshold, we skip it:
+ * p7_Pipeline() would have rejected it at the MSV filter, with no
+ * effect on the hit list or pipeline statistics other than the
+ * target count that p7_pli_NewSeq() has already made.
+ */
+static void
+tcache_Search(WORKER_INFO *info, TARGET_CACHE *tcache, int b, int i)
+{
+  ESL_SQ *dbsq = tcache->blocks[b]->list + i;
+  float   maxsc;
+  float   nullsc;
+  double  P;
+  int     j;
+
+  p7_pli_NewSeq(info->pli, dbsq);
+  p7_bg_SetLength(info->bg, dbsq->n);
+  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+
+  if (tcache->msvsc != NULL && tcache->msvsc[b][i] != eslINFINITY)
+    {
+      for (j = 1; j <= dbsq->n; j++) tcache->slack[b][i] += tcache->delta[dbsq->dsq[j]];
+
+      if (p7_MSVFilterBound(info->om, tcache->msvsc[b][i], tcache->slack[b][i], &maxsc) == eslOK)
+	{
+	  p7_bg_NullOne(info->bg, dbsq->dsq, dbsq->n, &nullsc);
+	  P = esl_gumbel_surv((maxsc - nullsc) / eslCONST_LOG2, info->om->evparam[p7_MMU], info->om->evparam[p7_MLAMBDA]);
+	  if (P > info->pli->F1) { info->nskipped++; return; }
+	}
+    }
+
+  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+
+  if (tcache->msvsc != NULL)
+    {
+      tcache->msvsc[b][i] = info->pli->msvsc;
+      tcache->slack[b][i] = 0;
+    }
+  p7_pipeline_Reuse(info->pli);
+}
+
+static void
+tcache_Destroy(TARGET_CACHE *tcache)
+{
+  int b;
+
+  if (tcache)
+    {
+      if (tcache->msvsc)
+	{
+	  for (b = 0; b < tcache->nblocks; b++) { free(tcache->msvsc[b]); free(tcache->slack[b]); }
+	  free(tcache->msvsc);
+	  free(tcache->slack);
+	}
+      if (tcache->delta) free(tcache->delta);
+      if (tcache->om)    p7_oprofile_Destroy(tcache->om);
+      for (b = 0; b < tcache->nblocks; b++) esl_sq_DestroyBlock(tcache->blocks[b]);
+      if (tcache->blocks) free(tcache->blocks);
+#ifdef HMMER_THREADS
+      pthread_mutex_destroy(&tcache->mutex);
+#endif
+      free(tcache);
+    }
+}
@@ -0,0 +1,509 @@
+/* Multithreaded single-linkage clustering of alignment sequences,
+ * for BLOSUM relative weights and --eclust effective sequence number.
+ *
+ * esl_msacluster_SingleLinkage() compares every pair of sequences, so
+ * building from an alignment of hundreds of thousands of sequences
+ * with --wblosum or --eclust takes hours. The clusters are the
+ * connected components of the graph linking pairs with fractional
+ * identity >= maxid, so we don't need every pair: we keep the
+ * components in a union-find forest and skip any pair that is
+ * already in the same component, and we spread the remaining
+ * comparisons over worker threads. The result is the same partition
+ * (up to cluster numbering) as esl_msacluster_SingleLinkage(), so
+ * weights and effective sequence numbers are unchanged.
+ *
+ * Contents:
+ *    1. Single-linkage clustering.
+ *    2. BLOSUM weights.
+ *    3. Internal routines.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_distance.h"
+#include "esl_msa.h"
+#include "esl_msacluster.h"
+#include "esl_msaweight.h"
+#include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
+
+#include "hmmer.h"
+
+#define p7_LINKAGE_CHUNK 256	/* # of pairs whose components are looked up in one critical section */
+
+/* LINKAGE: shared by the worker threads of one clustering. Rows i
+ * (comparisons of i to all j > i) are handed out in order from <next>.
+ * <parent>, <size> and <next> are only touched with <mutex> held.
+ */
+typedef struct {
+  const ESL_MSA   *msa;
+  double           maxid;	/* link pairs with fractional identity >= maxid       */
+  int             *parent;	/* union-find forest: parent[i], or i if i is a root  */
+  int             *size;	/* size[r] = # of seqs in tree of root r              */
+  int              next;	/* next row to hand out                               */
+  int              nworkers;	/* 0 = serial, in the caller                          */
+  int             *wstatus;	/* RESULT: [0..nworkers-1] status of each worker      */
+#ifdef HMMER_THREADS
+  pthread_mutex_t  mutex;
+#endif
+} LINKAGE;
+
+static int  link_rows(LINKAGE *lk);
+#ifdef HMMER_THREADS
+static void linkage_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ * 1. Single-linkage clustering.
+ *****************************************************************/
+
+/* Function:  p7_SingleLinkage()
+ * Synopsis:  Single-linkage clustering of an MSA, multithreaded.
+ *
+ * Purpose:   Cluster the sequences of digital alignment <msa> by single
+ *            linkage at fractional pairwise identity <maxid>, as
+ *            <esl_msacluster_SingleLinkage()> does, using <ncpu>
+ *            worker threads (0 = serial, in the caller).
+ *
+ *            Pairs already known to be in the same cluster aren't
+ *            compared. Fractional identity is that of
+ *            <esl_dst_XPairId()>, and pairs with identity >= <maxid>
+ *            are linked, so the partition is the same as
+ *            <esl_msacluster_SingleLinkage()>'s. Clusters are numbered
+ *            <0..nc-1> in order of their first sequence.
+ *
+ *            If <msa> is in text mode, this just calls
+ *            <esl_msacluster_SingleLinkage()>.
+ *
+ * Args:      msa    - alignment to cluster
+ *            maxid  - pairwise identity threshold for linking, 0..1
+ *            ncpu   - number of worker threads; 0 = serial
+ *            opt_c  - optRETURN: cluster assignments <[0..nseq-1]>; caller frees
+ *            ret_nc - RETURN: number of clusters
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEINVAL> on a
+ *            pairwise comparison failure. <*opt_c> is <NULL> and
+ *            <*ret_nc> is 0.
+ */
+int
+p7_SingleLinkage(const ESL_MSA *msa, double maxid, int ncpu, int **opt_c, int *ret_nc)
+{
+  LINKAGE      lk;
+  int         *c      = NULL;
+  int          nc     = 0;
+  int          i, r;
+  int          status;
+#ifdef HMMER_THREADS
+  ESL_THREADS *obj    = NULL;
+  int          w;
+  int          have_mutex = FALSE;
+#endif
+
+  if (! (msa->flags & eslMSA_DIGITAL))
+    return esl_msacluster_SingleLinkage(msa, maxid, opt_c, NULL, ret_nc);
+
+  lk.msa      = msa;
+  lk.maxid    = maxid;
+  lk.parent   = NULL;
+  lk.size     = NULL;
+  lk.next     = 0;
+  lk.nworkers = 0;
+  lk.wstatus  = NULL;
+
+  ESL_ALLOC(lk.parent, sizeof(int) * msa->nseq);
+  ESL_ALLOC(lk.size,   sizeof(int) * msa->nseq);
+  ESL_ALLOC(c,         sizeof(int) * msa->nseq);
+  for (i = 0; i < msa->nseq; i++) { lk.parent[i] = i; lk.size[i] = 1; }
+
+#ifdef HMMER_THREADS
+  if (ncpu > 0 && msa->nseq > 2)
+    {
+      lk.nworkers = ESL_MIN(ncpu, msa->nseq-1);
+      ESL_ALLOC(lk.wstatus, sizeof(int) * lk.nworkers);
+      if (pthread_mutex_init(&lk.mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      have_mutex = TRUE;
+
+      if ((obj = esl_threads_Create(&linkage_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (w = 0; w < lk.nworkers; w++) esl_threads_AddThread(obj, &lk);
+      esl_threads_WaitForStart(obj);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+      obj = NULL;
+
+      for (w = 0; w < lk.nworkers; w++)
+	if ((status = lk.wstatus[w]) != eslOK) goto ERROR;
+      pthread_mutex_destroy(&lk.mutex);
+      have_mutex = FALSE;
+    }
+  else
+#endif
+  if ((status = link_rows(&lk)) != eslOK) goto ERROR;
+
+  /* Number clusters in order of their first member. <size> is free now; reuse it as root -> cluster map. */
+  for (i = 0; i < msa->nseq; i++) lk.size[i] = -1;
+  for (i = 0; i < msa->nseq; i++)
+    {
+      for (r = i; lk.parent[r] != r; r = lk.parent[r]) ;
+      if (lk.size[r] == -1) lk.size[r] = nc++;
+      c[i] = lk.size[r];
+    }
+
+  free(lk.parent);
+  free(lk.size);
+  if (lk.wstatus) free(lk.wstatus);
+  if (opt_c != NULL) *opt_c = c; else free(c);
+  *ret_nc = nc;
+  return eslOK;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (obj)        esl_threads_Destroy(obj);
+  if (have_mutex) pthread_mutex_destroy(&lk.mutex);
+#endif
+  if (lk.parent)  free(lk.parent);
+  if (lk.size)    free(lk.size);
+  if (lk.wstatus) free(lk.wstatus);
+  if (c)          free(c);
+  if (opt_c != NULL) *opt_c = NULL;
+  *ret_nc = 0;
+  return status;
+}
+/*----------------- end, single-linkage clustering --------------*/
+
+
+
+/*****************************************************************
+ * 2. BLOSUM weights.
+ *****************************************************************/
+
+/* Function:  p7_BLOSUMWeights()
+ * Synopsis:  BLOSUM relative sequence weights, multithreaded.
+ *
+ * Purpose:   Set the relative weights <msa->wgt> as
+ *            <esl_msaweight_BLOSUM()> does: cluster the sequences by
+ *            single linkage at identity <maxid>, give each sequence
+ *            weight 1/(size of its cluster), and normalize the
+ *            weights to sum to <nseq>. The clustering is done by
+ *            <p7_SingleLinkage()> with <ncpu> threads.
+ *
+ * Returns:   <eslOK> on success, and <msa->wgt> is set.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_BLOSUMWeights(ESL_MSA *msa, double maxid, int ncpu)
+{
+  int *c    = NULL;
+  int *nmem = NULL;
+  int  nc;
+  int  i;
+  int  status;
+
+  if (msa->nseq == 1) { msa->wgt[0] = 1.0; return eslOK; }
+
+  if ((status = p7_SingleLinkage(msa, maxid, ncpu, &c, &nc)) != eslOK) goto ERROR;
+  ESL_ALLOC(nmem, sizeof(int) * nc);
+  esl_vec_ISet(nmem, nc, 0);
+  for (i = 0; i < msa->nseq; i++) nmem[c[i]]++;
+  for (i = 0; i < msa->nseq; i++) msa->wgt[i] = 1. / (double) nmem[c[i]];
+
+  /* same normalization as esl_msaweight_BLOSUM(), so weights are identical */
+  esl_vec_DNorm(msa->wgt, msa->nseq);
+  esl_vec_DScale(msa->wgt, msa->nseq, (double) msa->nseq);
+  msa->flags |= eslMSA_HASWGTS;
+
+  free(nmem);
+  free(c);
+  return eslOK;
+
+ ERROR:
+  if (c)    free(c);
+  if (nmem) free(nmem);
+  return status;
+}
+/*---------------------- end, BLOSUM weights --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Internal routines.
+ *****************************************************************/
+
+static void
+lk_lock(LINKAGE *lk)
+{
+#ifdef HMMER_THREADS
+  if (lk->nworkers > 0) pthread_mutex_lock(&lk->mutex);
+#endif
+}
+
+static void
+lk_unlock(LINKAGE *lk)
+{
+#ifdef HMMER_THREADS
+  if (lk->nworkers > 0) pthread_mutex_unlock(&lk->mutex);
+#endif
+}
+
+/* uf_find()
+ * Root of <i>'s tree, halving the path on the way up.
+ * Caller holds the lock.
+ */
+static int
+uf_find(int *parent, int i)
+{
+  while (parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i         = parent[i];
+    }
+  return i;
+}
+
+/* uf_union()
+ * Merge the trees of <i> and <j>, smaller under larger, and return
+ * the new root. Caller holds the lock.
+ */
+static int
+uf_union(LINKAGE *lk, int i, int j)
+{
+  int ri = uf_find(lk->parent, i);
+  int rj = uf_find(lk->parent, j);
+  int tmp;
+
+  if (ri == rj) return ri;
+  if (lk->size[ri] < lk->size[rj]) { tmp = ri; ri = rj; rj = tmp; }
+  lk->parent[rj]  = ri;
+  lk->size[ri]   += lk->size[rj];
+  return ri;
+}
+
+/* link_rows()
+ * Take rows from <lk->next> until they run out, comparing row i to each
+ * j > i whose component differs from i's, and linking them if their
+ * identity is >= maxid. Components are looked up a chunk of j's at a
+ * time; a lookup that is stale by the time we compare only costs an
+ * unneeded comparison, never a missed link.
+ */
+static int
+link_rows(LINKAGE *lk)
+{
+  const ESL_MSA *msa = lk->msa;
+  int            root[p7_LINKAGE_CHUNK];
+  double         pid;
+  int            i, j, j0, j1, ri;
+  int            status;
+
+  while (1)
+    {
+      lk_lock(lk);
+      i = lk->next++;
+      lk_unlock(lk);
+      if (i >= msa->nseq-1) break;
+
+      for (j0 = i+1; j0 < msa->nseq; j0 = j1)
+	{
+	  j1 = ESL_MIN(j0 + p7_LINKAGE_CHUNK, msa->nseq);
+
+	  lk_lock(lk);
+	  ri = uf_find(lk->parent, i);
+	  for (j = j0; j < j1; j++) root[j-j0] = uf_find(lk->parent, j);
+	  lk_unlock(lk);
+
+	  for (j = j0; j < j1; j++)
+	    {
+	      if (root[j-j0] == ri) continue;
+	      if ((status = esl_dst_XPairId(msa->abc, msa->ax[i], msa->ax[j], &pid, NULL, NULL)) != eslOK) return status;
+	      if (pid >= lk->maxid)
+		{
+		  lk_lock(lk);
+		  ri = uf_union(lk, i, j);
+		  lk_unlock(lk);
+		}
+	    }
+	}
+    }
+  return eslOK;
+}
+
+#ifdef HMMER_THREADS
+static void
+linkage_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  LINKAGE     *lk;
+  int          w;
+
+  esl_threads_Started(obj, &w);
+  lk = (LINKAGE *) esl_threads_GetData(obj, w);
+  lk->wstatus[w] = link_rows(lk);
+  esl_threads_Finished(obj, w);
+  return;
+}
+#endif /*HMMER_THREADS*/
+/*--------------------- end, internal routines ------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef p7LINKAGE_TESTDRIVE
+#include "esl_random.h"
+
+/* sample_msa()
+ * A digital MSA of <nseq> sequences, each a mutated copy of one of
+ * <nanc> random ancestors: each column is changed to a random residue
+ * or a gap with a per-sequence probability up to 0.6, so pairwise
+ * identities straddle the usual thresholds and clusters form both
+ * within and across ancestors.
+ */
+static ESL_MSA *
+sample_msa(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nseq, int alen, int nanc)
+{
+  ESL_MSA  *msa = esl_msa_CreateDigital(abc, nseq, alen);
+  ESL_DSQ **anc = malloc(sizeof(ESL_DSQ *) * nanc);
+  char      name[32];
+  double    pmut;
+  int       a, i, pos;
+
+  for (a = 0; a < nanc; a++)
+    {
+      anc[a] = malloc(sizeof(ESL_DSQ) * (alen+2));
+      for (pos = 1; pos <= alen; pos++) anc[a][pos] = esl_rnd_Roll(rng, abc->K);
+    }
+  for (i = 0; i < nseq; i++)
+    {
+      a    = esl_rnd_Roll(rng, nanc);
+      pmut = 0.6 * esl_random(rng);
+      msa->ax[i][0] = msa->ax[i][alen+1] = eslDSQ_SENTINEL;
+      for (pos = 1; pos <= alen; pos++)
+	{
+	  if (esl_random(rng) >= pmut)       msa->ax[i][pos] = anc[a][pos];
+	  else if (esl_random(rng) < 0.2)    msa->ax[i][pos] = abc->K; /* gap */
+	  else                               msa->ax[i][pos] = esl_rnd_Roll(rng, abc->K);
+	}
+      snprintf(name, 32, "seq%d", i);
+      esl_msa_SetSeqName(msa, i, name, -1);
+    }
+  msa->nseq = nseq;
+
+  for (a = 0; a < nanc; a++) free(anc[a]);
+  free(anc);
+  return msa;
+}
+
+/* utest_partition()
+ * p7_SingleLinkage(), serial and threaded, must give the same
+ * partition as esl_msacluster_SingleLinkage(); and p7_BLOSUMWeights()
+ * the same weights as esl_msaweight_BLOSUM().
+ */
+static void
+utest_partition(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nseq, int alen, double maxid, int ncpu)
+{
+  char     msg[] = "linkage partition unit test failed";
+  ESL_MSA *msa   = sample_msa(rng, abc, nseq, alen, 5);
+  double  *wgt   = malloc(sizeof(double) * nseq);
+  int     *c0    = NULL;
+  int     *c1    = NULL;
+  int     *map   = malloc(sizeof(int) * nseq);
+  int     *rmap  = malloc(sizeof(int) * nseq);
+  int      nc0, nc1;
+  int      n, i;
+
+  if (esl_msacluster_SingleLinkage(msa, maxid, &c0, NULL, &nc0) != eslOK) esl_fatal(msg);
+
+  for (n = 0; n <= ncpu; n += ESL_MAX(1, ncpu))
+    {
+      if (p7_SingleLinkage(msa, maxid, n, &c1, &nc1) != eslOK) esl_fatal(msg);
+      if (nc1 != nc0) esl_fatal(msg);
+
+      esl_vec_ISet(map,  nseq, -1);
+      esl_vec_ISet(rmap, nseq, -1);
+      for (i = 0; i < nseq; i++)
+	{
+	  if (map[c0[i]]  == -1) map[c0[i]]  = c1[i];
+	  if (rmap[c1[i]] == -1) rmap[c1[i]] = c0[i];
+	  if (map[c0[i]] != c1[i] || rmap[c1[i]] != c0[i]) esl_fatal(msg);
+	}
+      free(c1);
+      c1 = NULL;
+    }
+
+  if (esl_msaweight_BLOSUM(msa, maxid)     != eslOK) esl_fatal(msg);
+  esl_vec_DCopy(msa->wgt, nseq, wgt);
+  if (p7_BLOSUMWeights(msa, maxid, ncpu)   != eslOK) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    if (msa->wgt[i] != wgt[i]) esl_fatal(msg);
+
+  free(c0);
+  free(map);
+  free(rmap);
+  free(wgt);
+  esl_msa_Destroy(msa);
+}
+#endif /*p7LINKAGE_TESTDRIVE*/
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7LINKAGE_TESTDRIVE
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
+  {"-h",    eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",    eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
+  {"-v",    eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show verbose commentary/output",                 0},
+  {"-N",    eslARG_INT,     "200", NULL, NULL, NULL, NULL, NULL, "number of sequences in test MSAs",               0},
+  {"-L",    eslARG_INT,      "60", NULL, NULL, NULL, NULL, NULL, "length of test MSAs",                            0},
+  {"--cpu", eslARG_INT,       "4", NULL,"n>0", NULL, NULL, NULL, "number of threads to test",                      0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for linkage.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go          = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng         = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *aa          = esl_alphabet_Create(eslAMINO);
+  ESL_ALPHABET   *nt          = esl_alphabet_Create(eslDNA);
+  int             N           = esl_opt_GetInteger(go, "-N");
+  int             L           = esl_opt_GetInteger(go, "-L");
+  int             ncpu        = esl_opt_GetInteger(go, "--cpu");
+  int             be_verbose  = esl_opt_GetBoolean(go, "-v");
+
+  if (be_verbose) printf("linkage unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_partition(rng, aa, N, L, 0.62, ncpu);
+  utest_partition(rng, aa, N, L, 0.80, ncpu);
+  utest_partition(rng, nt, N, L, 0.62, ncpu);
+  utest_partition(rng, aa, 2,  L, 0.62, ncpu);
+
+  esl_alphabet_Destroy(aa);
+  esl_alphabet_Destroy(nt);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /* p7LINKAGE_TESTDRIVE */
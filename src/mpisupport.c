@@ -12,6 +12,7 @@
 #include "p7_config.h"		
 
 #ifdef HMMER_MPI
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -24,17 +25,13 @@
 
 #include "hmmer.h"
 
-static int p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 static int p7_hit_MPIPackSize(P7_HIT *hit, MPI_Comm comm, int *ret_n);
 static int p7_hit_MPIPack(P7_HIT *hit, char *buf, int n, int *pos, MPI_Comm comm);
 static int p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit);
-static int p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit);
 
-static int p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 static int p7_dcl_MPIPackSize(P7_DOMAIN *dcl, MPI_Comm comm, int *ret_n);
 static int p7_dcl_MPIPack(P7_DOMAIN *dcl, char *buf, int n, int *pos, MPI_Comm comm);
 static int p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl);
-static int p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl);
 
 /*****************************************************************
  * 1. Communicating P7_HMM, a core model.
@@ -696,6 +693,8 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
+  if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
+  if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   if (MPI_Pack_size(1, MPI_DOUBLE,        comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  n += sz;
   
   /* Make sure the buffer is allocated appropriately */
@@ -718,6 +717,8 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
       bogus.n_past_bias = 0;
       bogus.n_past_vit  = 0;
       bogus.n_past_fwd  = 0;
+      bogus.n_clustered = 0;
+      bogus.n_sampled   = 0;
       bogus.Z           = 0.0;
       pli = &bogus;
    } 
@@ -734,6 +735,8 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack(&pli->n_past_bias, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->n_past_vit,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->n_past_fwd,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->n_clustered, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->n_sampled,   1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->Z,           1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
 
   /* Send the packed pipeline to destination  */
@@ -804,6 +807,8 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_bias), 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_vit),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_fwd),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->n_clustered), 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->n_sampled),   1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->Z),           1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
 
   *ret_pli = pli;
@@ -830,98 +835,148 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
  *            with MPI tag <tag>, for MPI communicator <comm>, as 
  *            the sole workunit or result. 
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            The whole list -- hits, their domains, and their
+ *            alignment displays -- is packed into <*buf>. A list
+ *            that packs into less than <p7_TOPHITS_MPICHUNK> bytes
+ *            goes as one message. A bigger one is cut into a stream
+ *            of messages of about that size, each holding a whole
+ *            number of hits, all posted at once with nonblocking
+ *            sends; the receiver unpacks each one while the next is
+ *            still in transit. The first message starts with the
+ *            list's size and the number of messages in the stream.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
  * 
  * Throws:    <eslESYS> if an MPI call fails; <eslEMEM> if a malloc/realloc
- *            fails. In either case, <*buf> and <*nalloc> remain valid and useful
+ *            fails; <eslERANGE> if the packed list would exceed 2GB.
+ *            In either case, <*buf> and <*nalloc> remain valid and useful
  *            memory (though the contents of <*buf> are undefined). 
  */
 int
 p7_tophits_MPISend(P7_TOPHITS *th, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
 {
-  int   status;
-  int   sz, n, pos;
-  int   i, j, inx;
-
-  P7_DOMAIN *dcl = NULL;
-  P7_HIT    *hit = NULL;
-
-  n  = 0;
-  sz = 0;
+  int         *hitsz   = NULL;	/* hitsz[i]: packed size of hit <i>, with its domains      */
+  int         *msgsz   = NULL;	/* msgsz[c]: packed size of message <c>                    */
+  int         *msghits = NULL;	/* msghits[c]: number of hits in message <c>               */
+  MPI_Request *req     = NULL;
+  P7_HIT      *hit     = NULL;
+  int64_t      total;
+  int          hdrsz, contsz, sz;
+  int          nmsg;
+  int          pos, off;
+  int          c, j, k;
+  uint64_t     i;
+  int          status;
 
-  /* calculate the buffer size needed to hold the largest hit */
-  hit = th->unsrt;
-  for (i = 0; i < th->N; ++i) {
-    for (j = 0; j < th->unsrt[i].ndom; ++j) {
-      if (sz <= hit->dcl[j].ad->memsize) {
-	sz = hit->dcl[j].ad->memsize;
-	dcl = &hit->dcl[j];
+  /* Header of the first message: N, nreported, nincluded, # of messages, # of hits in it.
+   * Every later message only starts with its # of hits.
+   */
+  if (MPI_Pack_size(3, MPI_UINT64_T, comm, &hdrsz)  != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
+  if (MPI_Pack_size(2, MPI_INT,      comm, &sz)     != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");  hdrsz += sz;
+  if (MPI_Pack_size(1, MPI_INT,      comm, &contsz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
+
+  ESL_ALLOC(hitsz,   sizeof(int) * (th->N+1));
+  ESL_ALLOC(msgsz,   sizeof(int) * (th->N+1));
+  ESL_ALLOC(msghits, sizeof(int) * (th->N+1));
+
+  /* Size each hit, and cut the list into messages */
+  nmsg       = 0;
+  msgsz[0]   = hdrsz;
+  msghits[0] = 0;
+  for (i = 0; i < th->N; i++)
+    {
+      hit = th->unsrt + i;
+      if ((status = p7_hit_MPIPackSize(hit, comm, &(hitsz[i]))) != eslOK) goto ERROR;
+      for (j = 0; j < hit->ndom; j++) {
+	if ((status = p7_dcl_MPIPackSize(hit->dcl + j, comm, &sz)) != eslOK) goto ERROR;
+	hitsz[i] += sz;
       }
-    }
-    ++hit;
-  }
 
-  if (th->N > 0) {
-    if ((status = p7_hit_MPIPackSize(th->unsrt, comm, &n)) != eslOK) goto ERROR;
-    if (dcl != NULL) {
-      if ((status = p7_dcl_MPIPackSize(dcl, comm, &sz))    != eslOK) goto ERROR;
-      n = (n > sz) ? n : sz;
+      if (msghits[nmsg] > 0 && msgsz[nmsg] + hitsz[i] > p7_TOPHITS_MPICHUNK)
+	{
+	  nmsg++;
+	  msgsz[nmsg]   = contsz;
+	  msghits[nmsg] = 0;
+	}
+      msgsz[nmsg] += hitsz[i];
+      msghits[nmsg]++;
     }
-  }
+  nmsg++;
 
-  if (MPI_Pack_size(3, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
-  n = (n > sz) ? n : sz;
+  for (total = 0, c = 0; c < nmsg; c++) total += msgsz[c];
+  if (total > INT_MAX) ESL_XEXCEPTION(eslERANGE, "hit list too large to send");
 
   /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
+  if (*buf == NULL || total > *nalloc) {
     void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n);
-    *nalloc = n; 
+    ESL_RALLOC(*buf, tmp, sizeof(char) * total);
+    *nalloc = total; 
   }
+  ESL_ALLOC(req, sizeof(MPI_Request) * nmsg);
 
-  pos = 0;
-  if (MPI_Pack(&th->N,         1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nreported, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nincluded, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-
-  /* Send the packed tophits information */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
-  if (th->N == 0) return eslOK;
-
-  /* loop through the hit list sending to dest */
-  hit = th->unsrt;
-  for (inx = 0; inx < th->N; ++inx) {
-    if ((status = p7_hit_MPISend(hit, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-    ++hit;
-  }
+  /* Pack each message in its own stretch of <*buf>, and post it as soon as it's packed. */
+  for (i = 0, off = 0, c = 0; c < nmsg; off += msgsz[c], c++)
+    {
+      pos = 0;
+      if (c == 0) {
+	if (MPI_Pack(&th->N,         1, MPI_UINT64_T, *buf + off, msgsz[c], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+	if (MPI_Pack(&th->nreported, 1, MPI_UINT64_T, *buf + off, msgsz[c], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+	if (MPI_Pack(&th->nincluded, 1, MPI_UINT64_T, *buf + off, msgsz[c], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+	if (MPI_Pack(&nmsg,          1, MPI_INT,      *buf + off, msgsz[c], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+      }
+      if (MPI_Pack(&(msghits[c]),    1, MPI_INT,      *buf + off, msgsz[c], &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
 
+      for (k = 0; k < msghits[c]; k++, i++)
+	{
+	  hit = th->unsrt + i;
+	  if ((status = p7_hit_MPIPack(hit, *buf + off, msgsz[c], &pos, comm)) != eslOK) goto ERROR;
+	  for (j = 0; j < hit->ndom; j++)
+	    if ((status = p7_dcl_MPIPack(hit->dcl + j, *buf + off, msgsz[c], &pos, comm)) != eslOK) goto ERROR;
+	}
+
+      if (MPI_Isend(*buf + off, pos, MPI_PACKED, dest, tag, comm, &(req[c])) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
+    }
+
+  /* <*buf> belongs to the caller again once everything's out. */
+  if (MPI_Waitall(nmsg, req, MPI_STATUSES_IGNORE) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
+
+  free(req);
+  free(msghits);
+  free(msgsz);
+  free(hitsz);
   return eslOK;
 
  ERROR:
+  if (req) free(req);
+  if (msghits) free(msghits);
+  if (msgsz)   free(msgsz);
+  if (hitsz)   free(hitsz);
   return status;
 }
 
 /* Function:  p7_tophits_MPIRecv()
  * Synopsis:  Receives an TOPHITS as a work unit from an MPI sender.
  *
- * Purpose:   Sends the TOPHITS <th> as a work unit to MPI process
- *            <dest> (where <dest> ranges from 0..<nproc-1>), tagged
- *            with MPI tag <tag>, for MPI communicator <comm>, as 
- *            the sole workunit or result. 
+ * Purpose:   Receive a TOPHITS work unit that was sent by
+ *            <p7_tophits_MPISend()> from MPI process <source>
+ *            (0..<nproc-1>) with tag <tag> on communicator <comm>,
+ *            and return it in <*ret_th>. <source> may be
+ *            <MPI_ANY_SOURCE>; once the first message of a list has
+ *            arrived, the rest of its stream is received from the
+ *            same sender. 
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            Caller provides a working buffer <*buf> of size
+ *            <*nalloc> characters, as in <p7_tophits_MPISend()>; it
+ *            only has to hold one message of the stream at a time.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
  * 
  * Throws:    <eslESYS> if an MPI call fails; <eslEMEM> if a malloc/realloc
- *            fails. In either case, <*buf> and <*nalloc> remain valid and useful
- *            memory (though the contents of <*buf> are undefined). 
+ *            fails; <eslFAIL> if the stream is inconsistent. In any case
+ *            <*ret_th> is <NULL>, and <*buf> and <*nalloc> remain valid and
+ *            useful memory (though the contents of <*buf> are undefined). 
  */
 int
 p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_TOPHITS **ret_th)
@@ -932,51 +987,63 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   P7_TOPHITS *th    = NULL;
   P7_HIT     *hit   = NULL;
   MPI_Status  mpistatus;
-
   uint64_t    nhits;
-  uint64_t    inx;
+  int         nmsg, msghits;
+  int         c, k, j;
 
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
+  if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
 
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
+  for (c = 0, nmsg = 1; c < nmsg; c++)
+    {
+      /* Probe first, because we need to know if our buffer is big enough.
+       */
+      MPI_Probe(source, tag, comm, &mpistatus);
+      MPI_Get_count(&mpistatus, MPI_PACKED, &n);
+
+      /* make sure we are getting the tag we expect and from whom we expect if from */
+      if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
+	status = eslFAIL;
+	goto ERROR;
+      }
+      if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
+	status = eslFAIL;
+	goto ERROR;
+      }
 
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
+      /* set the source and tag: the rest of the stream comes from the same place */
+      tag    = mpistatus.MPI_TAG;
+      source = mpistatus.MPI_SOURCE;
 
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
+      /* Make sure the buffer is allocated appropriately */
+      if (*buf == NULL || n > *nalloc) {
+	void *tmp;
+	ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
+	*nalloc = n; 
+      }
 
-  /* Receive the packed top hits */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
+      /* Receive the packed top hits */
+      MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
 
-  /* Unpack it - watching out for the EOD signal of M = -1. */
-  pos = 0;
-  if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
-  if (MPI_Unpack(*buf, n, &pos, &nhits,         1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-  if (MPI_Unpack(*buf, n, &pos, &th->nreported, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-  if (MPI_Unpack(*buf, n, &pos, &th->nincluded, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < nhits; ++inx) {
-      if ((status = p7_tophits_CreateNextHit(th, &hit))                  != eslOK) goto ERROR;
-      if ((status = p7_hit_MPIRecv(source, tag, comm, buf, nalloc, hit)) != eslOK) goto ERROR;
+      pos = 0;
+      if (c == 0) {
+	if (MPI_Unpack(*buf, n, &pos, &nhits,         1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
+	if (MPI_Unpack(*buf, n, &pos, &th->nreported, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
+	if (MPI_Unpack(*buf, n, &pos, &th->nincluded, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
+	if (MPI_Unpack(*buf, n, &pos, &nmsg,          1, MPI_INT,      comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
+      }
+      if (MPI_Unpack(*buf, n, &pos, &msghits,         1, MPI_INT,      comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
+
+      for (k = 0; k < msghits; k++)
+	{
+	  if ((status = p7_tophits_CreateNextHit(th, &hit))             != eslOK) goto ERROR;
+	  if ((status = p7_hit_MPIUnpack(*buf, n, &pos, comm, hit))     != eslOK) goto ERROR;
+	  ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * ESL_MAX(1, hit->ndom));
+	  for (j = 0; j < hit->ndom; j++) 
+	    if ((status = p7_dcl_MPIUnpack(*buf, n, &pos, comm, hit->dcl + j)) != eslOK) { hit->ndom = j; goto ERROR; }
+	}
     }
+  if (th->N != nhits) { status = eslFAIL; goto ERROR; }
+
   *ret_th = th;
   return eslOK;
 
@@ -987,89 +1054,6 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
 }
 
 
-/* Function:  p7_hit_MPISend()
- */
-int
-p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   inx;
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the HIT into the buffer */
-  pos  = 0;
-  if ((status = p7_hit_MPIPack(hit, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  /* loop through all of the domains */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-    if ((status = p7_dcl_MPISend(hit->dcl + inx, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-  }
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-/* Function:  p7_hit_MPIRecv()
- */
-int
-p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit)
-{
-  int         n;
-  int         status;
-  int         pos;
-  int         inx;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed top hits */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it - watching out for the EOD signal of M = -1. */
-  pos = 0;
-  if ((status = p7_hit_MPIUnpack(*buf, n, &pos, comm, hit)) != eslOK) goto ERROR;
-  ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * hit->ndom);
-
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-     if ((status = p7_dcl_MPIRecv(source, tag, comm, buf, nalloc, hit->dcl + inx)) != eslOK) goto ERROR;
-  }
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
 /* Function:  p7_hit_MPIPackSize()
  * Synopsis:  Calculates size needed to pack a HIT.
  *
@@ -1226,29 +1210,6 @@ p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit)
   return status;
 }
 
-/* Function:  p7_dcl_MPISend()
- */
-int
-p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the DOMAIN into the buffer */
-  pos  = 0;
-  if ((status = p7_dcl_MPIPack(dcl, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-
 /* Function:  p7_dcl_MPIPackSize()
  */
 int
@@ -1441,53 +1402,6 @@ p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl)
   return status;
 }
 
-/* Function:  p7_dcl_MPIRecv()
- */
-int
-p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl)
-{
-  int         status;
-  int         n;
-  int         pos;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed dcl */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it, looking at the status code prefix for EOD/EOK  */
-  pos = 0;
-  return p7_dcl_MPIUnpack(*buf, *nalloc, &pos, comm, dcl);
-
- ERROR:
-  return status;
-}
-
 /*----------------- end, P7_TOPHITS communication -------------------*/
 
 
@@ -1701,6 +1615,79 @@ utest_ProfileSendRecv(int my_rank, int nproc)
   return;
 }
 
+/* utest_TophitsSendRecv()
+ * Make the hit list big enough that p7_tophits_MPISend() has to
+ * stream it as several messages.
+ */
+static void
+utest_TophitsSendRecv(int my_rank, int nproc)
+{
+  ESL_RANDOMNESS *r     = esl_randomness_CreateFast(42);
+  P7_TOPHITS     *th    = p7_tophits_Create();
+  P7_TOPHITS     *th2   = NULL;
+  P7_HIT         *hit   = NULL;
+  int             nhits = 4000;
+  int             L     = 200;
+  char           *wbuf  = NULL;
+  int             wn    = 0;
+  char            name[32];
+  int             i, h, d;
+
+  /* master and worker's sampled lists are identical */
+  for (h = 0; h < nhits; h++)
+    {
+      p7_tophits_CreateNextHit(th, &hit);
+      snprintf(name, 32, "seq%d", h);
+      if (esl_strdup(name, -1, &(hit->name)) != eslOK) esl_fatal("name strdup failed");
+      hit->sortkey = esl_random(r);
+      hit->score   = (float) (100. * esl_random(r));
+      hit->ndom    = 1 + esl_rnd_Roll(r, 2);
+      hit->dcl     = malloc(sizeof(P7_DOMAIN) * hit->ndom);
+      for (d = 0; d < hit->ndom; d++)
+	{
+	  memset(&(hit->dcl[d]), 0, sizeof(P7_DOMAIN));
+	  hit->dcl[d].bitscore = hit->score / (float) hit->ndom;
+	  if (p7_alidisplay_Sample(r, L, &(hit->dcl[d].ad)) != eslOK) esl_fatal("alidisplay sample failed");
+	  if (p7_alidisplay_Serialize_old(hit->dcl[d].ad)   != eslOK) esl_fatal("alidisplay serialize failed");
+	}
+    }
+  th->nreported = nhits / 2;
+  th->nincluded = nhits / 4;
+
+  if (my_rank == 0)
+    {
+      for (i = 1; i < nproc; i++)
+	{
+	  ESL_DPRINTF1(("Master: receiving test hit list\n"));
+	  if (p7_tophits_MPIRecv(MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &wbuf, &wn, &th2) != eslOK) esl_fatal("tophits receive failed");
+	  ESL_DPRINTF1(("Master: test hit list received\n"));
+
+	  if (th2->N != th->N || th2->nreported != th->nreported || th2->nincluded != th->nincluded)
+	    esl_fatal("Received hit list has wrong size");
+	  for (h = 0; h < nhits; h++)
+	    {
+	      if (strcmp(th2->unsrt[h].name, th->unsrt[h].name) != 0) esl_fatal("hit %d: bad name", h);
+	      if (th2->unsrt[h].sortkey != th->unsrt[h].sortkey)      esl_fatal("hit %d: bad sortkey", h);
+	      if (th2->unsrt[h].ndom    != th->unsrt[h].ndom)         esl_fatal("hit %d: bad ndom", h);
+	      for (d = 0; d < th->unsrt[h].ndom; d++)
+		if (p7_alidisplay_Compare(th2->unsrt[h].dcl[d].ad, th->unsrt[h].dcl[d].ad) != eslOK)
+		  esl_fatal("hit %d domain %d: bad alidisplay", h, d);
+	    }
+	  p7_tophits_Destroy(th2);
+	}
+    }
+  else
+    {
+      ESL_DPRINTF1(("Worker %d: sending test hit list\n", my_rank));
+      if (p7_tophits_MPISend(th, 0, 0, MPI_COMM_WORLD, &wbuf, &wn) != eslOK) esl_fatal("tophits send failed");
+      ESL_DPRINTF1(("Worker %d: test hit list sent\n", my_rank));
+    }
+
+  free(wbuf);
+  p7_tophits_Destroy(th);
+  esl_randomness_Destroy(r);
+  return;
+}
 
 
 #endif /*p7MPISUPPORT_TESTDRIVE*/
@@ -1745,6 +1732,7 @@ main(int argc, char **argv)
 
   utest_HMMSendRecv(my_rank, nproc);
   utest_ProfileSendRecv(my_rank, nproc);
+  utest_TophitsSendRecv(my_rank, nproc);
 
   MPI_Finalize();
   return 0;
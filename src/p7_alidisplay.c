@@ -90,6 +90,29 @@
  */
 P7_ALIDISPLAY *
 p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
+{
+  return p7_alidisplay_CreateInArena(NULL, tr, which, om, sq, ntsq);
+}
+
+/* Function:  p7_alidisplay_CreateInArena()
+ * Synopsis:  Create an alignment display in a hit list's arena.
+ *
+ * Purpose:   Same as <p7_alidisplay_Create()>, but the display is
+ *            allocated in hit arena <arena> (of a <P7_TOPHITS>), and
+ *            is released with it (or by <p7_hitarena_Rewind()>);
+ *            it must not be freed with <p7_alidisplay_Destroy()>.
+ *            The domain definition code uses this to build displays
+ *            directly in the hit list, so a reported domain's
+ *            display needn't be copied there. If <arena> is <NULL>,
+ *            this is <p7_alidisplay_Create()>.
+ *
+ * Returns:   ptr to the new display.
+ *
+ * Throws:    <NULL> on allocation failure, or if something's internally corrupt
+ *            in the data.
+ */
+P7_ALIDISPLAY *
+p7_alidisplay_CreateInArena(P7_HITARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
 {
   P7_ALIDISPLAY *ad       = NULL;
   char          *Alphabet = om->abc->sym;
@@ -144,12 +167,20 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   sq_acclen   = strlen(sq->acc);                            n += sq_acclen   + 1; /* sq->acc is "\0" when unset */
   sq_desclen  = strlen(sq->desc);                           n += sq_desclen  + 1; /* same for desc              */
  
-  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
-  ad->mem = NULL;
-
+  if (arena)
+    {
+      if ((ad = p7_hitarena_Alloc(arena, sizeof(P7_ALIDISPLAY))) == NULL) ESL_XEXCEPTION(eslEMEM, "hit arena allocation failed");
+      ad->memsize = sizeof(char) * n;
+      if ((ad->mem = p7_hitarena_Alloc(arena, ad->memsize)) == NULL) ESL_XEXCEPTION(eslEMEM, "hit arena allocation failed");
+    }
+  else
+    {
+      ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
+      ad->mem = NULL;
+      ad->memsize = sizeof(char) * n;
+      ESL_ALLOC(ad->mem, ad->memsize);
+    }
   pos = 0; 
-  ad->memsize = sizeof(char) * n;
-  ESL_ALLOC(ad->mem, ad->memsize);
   if (om->rf[0]  != 0) { ad->rfline = ad->mem + pos; pos += z2-z1+2; } else { ad->rfline = NULL; }
   //if (om->mm[0]  != 0) { ad->mmline = ad->mem + pos; pos += z2-z1+2; } else { ad->mmline = NULL; }
   ad->mmline = NULL;
@@ -253,7 +284,7 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   return ad;
 
  ERROR:
-  p7_alidisplay_Destroy(ad);
+  if (! arena) p7_alidisplay_Destroy(ad);
   return NULL;
 }
 
@@ -466,18 +466,52 @@ p7_bg_SetFilter(P7_BG *bg, int M, const float *compo)
  *            The filter null model has no length distribution of its
  *            own; the same geometric length distribution (controlled
  *            by <bg->p1>) that the null1 model uses is imposed.
+ *
+ *            This is a specialized version of <esl_hmm_Forward()> for
+ *            the two-state filter HMM: it keeps only the current two
+ *            cells, uses the emission odds ratios <bg->fhmm->eo>
+ *            precomputed by <esl_hmm_Configure()>, and allocates
+ *            nothing. Instead of taking a log of the row maximum at
+ *            every residue, it rescales only when the cells drift
+ *            out of range, by an exact power of two, and counts the
+ *            rescalings. Scores agree with <esl_hmm_Forward()> to
+ *            within float roundoff.
  */
 int
 p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 {
-  ESL_HMX *hmx = esl_hmx_Create(L, bg->fhmm->M); /* optimization target: this can be a 2-row matrix, and it can be stored in <bg>. */
-  float nullsc;		                  	 /* (or it could be passed in as an arg, but for sure it shouldn't be alloc'ed here */
-  
-  esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &nullsc);
+  const ESL_HMM *fhmm  = bg->fhmm;
+  float          t00   = fhmm->t[0][0];
+  float          t01   = fhmm->t[0][1];
+  float          t10   = fhmm->t[1][0];
+  float          t11   = fhmm->t[1][1];
+  float          f0, f1, g0, max;
+  int            nscale = 0;	/* net number of 2^64 rescalings: cells are scaled by 2^(-64*nscale) */
+  int            i;
+  double         nullsc;
+
+  if (L == 0) 
+    nullsc = log(fhmm->pi[2]);
+  else
+    {
+      f0 = fhmm->pi[0] * fhmm->eo[dsq[1]][0];
+      f1 = fhmm->pi[1] * fhmm->eo[dsq[1]][1];
+
+      for (i = 2; i <= L; i++)
+	{
+	  g0 = (f0 * t00 + f1 * t10) * fhmm->eo[dsq[i]][0];
+	  f1 = (f0 * t01 + f1 * t11) * fhmm->eo[dsq[i]][1];
+	  f0 = g0;
+
+	  max = ESL_MAX(f0, f1);
+	  if      (max > 1.8446744e19f) { f0 *= 5.4210109e-20f; f1 *= 5.4210109e-20f; nscale++; } /* 2^64, 2^-64 */
+	  else if (max < 5.4210109e-20f) { f0 *= 1.8446744e19f; f1 *= 1.8446744e19f; nscale--; }
+	}
+      nullsc = log(f0 * fhmm->t[0][2] + f1 * fhmm->t[1][2]) + (double) nscale * 64. * eslCONST_LOG2;
+    }
 
   /* impose the length distribution */
-  *ret_sc = nullsc + (float) L * logf(bg->p1) + logf(1.-bg->p1);
-  esl_hmx_Destroy(hmx);
+  *ret_sc = (float) nullsc + (float) L * logf(bg->p1) + logf(1.-bg->p1);
   return eslOK;
 }
 
@@ -497,6 +531,8 @@ p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
 #include "esl_sq.h"
 #include "esl_stopwatch.h"
 
@@ -505,6 +541,7 @@ p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",      0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,      NULL,      NULL,    NULL, "set random number seed to <n>",             0 },
   { "-L",        eslARG_INT,    "400", NULL, "n>0",     NULL,      NULL,    NULL, "length of random target seqs",              0 },
   { "-N",        eslARG_INT,    "100", NULL, "n>0",     NULL,      NULL,    NULL, "number of random target seqs",              0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -517,6 +554,7 @@ main(int argc, char **argv)
 {
   ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
   ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
   char           *hmmfile = esl_opt_GetArg(go, 1);
   ESL_ALPHABET   *abc     = NULL;
   P7_HMMFILE     *hfp     = NULL;
@@ -524,7 +562,9 @@ main(int argc, char **argv)
   P7_BG          *bg      = NULL;
   int             L       = esl_opt_GetInteger(go, "-L");
   int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = NULL;
   int             i;
+  float           sc;
  
   /* Read one HMM from <hmmfile> */
   if (p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
@@ -537,11 +577,23 @@ main(int argc, char **argv)
   for (i = 0; i < N; i++)
     p7_bg_SetFilterByHMM(bg, hmm);
   esl_stopwatch_Stop(w);
-  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  esl_stopwatch_Display(stdout, w, "# SetFilter CPU time:   ");
 
+  dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  p7_bg_SetLength(bg, L);
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    p7_bg_FilterScore(bg, dsq, L, &sc);
+  esl_stopwatch_Stop(w);
+  esl_stopwatch_Display(stdout, w, "# FilterScore CPU time: ");
+
+  free(dsq);
   p7_bg_Destroy(bg);
   p7_hmm_Destroy(hmm);
   esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
   esl_stopwatch_Destroy(w);
   esl_getopts_Destroy(go);
   return 0;
@@ -555,6 +607,7 @@ main(int argc, char **argv)
 #ifdef p7BG_TESTDRIVE
 #include "esl_dirichlet.h"
 #include "esl_random.h"
+#include "esl_randomseq.h"
 
 static void
 utest_ReadWrite(ESL_RANDOMNESS *rng)
@@ -587,6 +640,58 @@ utest_ReadWrite(ESL_RANDOMNESS *rng)
   free(fq);
   remove(tmpfile);
 }
+
+/* utest_FilterScore()
+ * 
+ * The specialized two-state Forward in p7_bg_FilterScore() must give
+ * the same scores as the general esl_hmm_Forward() it replaces, on
+ * sequences sampled either from the background or from the biased
+ * composition, including long ones that need rescaling.
+ */
+static void
+utest_FilterScore(ESL_RANDOMNESS *rng)
+{
+  char          msg[]  = "bg FilterScore unit test failed";
+  ESL_ALPHABET *abc    = NULL;
+  P7_BG        *bg     = NULL;
+  ESL_HMX      *hmx    = NULL;
+  ESL_DSQ      *dsq    = NULL;
+  float        *compo  = NULL;
+  int           maxL   = 4000;
+  int           ntrial = 20;
+  float         abstol = 0.01;	/* near-zero scores...                                               */
+  float         reltol = 1e-4;	/* ...and large ones, where esl_hmm_Forward()'s float sum of logs drifts */
+  int           t, L;
+  float         sc1, sc2;
+
+  if ((abc   = esl_alphabet_Create(esl_rnd_Roll(rng, 2) ? eslAMINO : eslDNA)) == NULL)  esl_fatal(msg);
+  if ((bg    = p7_bg_Create(abc))                                             == NULL)  esl_fatal(msg);
+  if ((hmx   = esl_hmx_Create(maxL, 2))                                       == NULL)  esl_fatal(msg);
+  if ((dsq   = malloc(sizeof(ESL_DSQ) * (maxL+2)))                            == NULL)  esl_fatal(msg);
+  if ((compo = malloc(sizeof(float)   * abc->K))                              == NULL)  esl_fatal(msg);
+
+  for (t = 0; t < ntrial; t++)
+    {
+      if (esl_dirichlet_FSampleUniform(rng, abc->K, compo)                 != eslOK) esl_fatal(msg);
+      if (p7_bg_SetFilter(bg, 1 + esl_rnd_Roll(rng, 500), compo)           != eslOK) esl_fatal(msg);
+
+      L = 1 + esl_rnd_Roll(rng, maxL);
+      if (p7_bg_SetLength(bg, L)                                           != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, (t % 2 ? compo : bg->f), abc->K, L, dsq)      != eslOK) esl_fatal(msg);
+
+      if (p7_bg_FilterScore(bg, dsq, L, &sc1)                              != eslOK) esl_fatal(msg);
+      if (esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &sc2)                     != eslOK) esl_fatal(msg);
+      sc2 += (float) L * logf(bg->p1) + logf(1.-bg->p1);
+
+      if (fabs(sc1 - sc2) > abstol && esl_FCompare(sc1, sc2, reltol) != eslOK) esl_fatal(msg);
+    }
+
+  free(compo);
+  free(dsq);
+  esl_hmx_Destroy(hmx);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*p7BG_TESTDRIVE*/
 
 
@@ -625,6 +730,7 @@ main(int argc, char **argv)
   if (be_verbose) printf("p7_bg unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_ReadWrite(rng);
+  utest_FilterScore(rng);
 
   esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
@@ -9,9 +9,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_buffer.h"
 #include "esl_dmatrix.h"
 #include "esl_getopts.h"
 #include "esl_msa.h"
@@ -22,6 +25,8 @@
 
 #include "hmmer.h"
 
+#define p7_BUILDER_THREADED_LINKAGE 1000 /* cluster alignments of >= this many seqs with p7_SingleLinkage() when bld->ncpu > 0 */
+
 /*****************************************************************
  * 1. P7_BUILDER: allocation, initialization, destruction
  *****************************************************************/
@@ -117,6 +122,8 @@ p7_builder_Create(const ESL_GETOPTS *go, const ESL_ALPHABET *abc)
   bld->EfL        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfL")        : 100;
   bld->EfN        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfN")        : 200;
   bld->Eft        = (go != NULL) ?  esl_opt_GetReal   (go, "--Eft")        : 0.04;
+  bld->ncpu       = 0;		/* apps that own worker threads set this themselves */
+  bld->evtable    = NULL;	/* apps that offer fast calibration set this themselves */
 
   /* Normally we reinitialize the RNG to original seed before calibrating each model.
    * This eliminates run-to-run variation.
@@ -373,6 +380,10 @@ static int    parameterize         (P7_BUILDER *bld, P7_HMM *hmm);
 static int    annotate             (P7_BUILDER *bld, const ESL_MSA *msa, P7_HMM *hmm);
 static int    calibrate            (P7_BUILDER *bld, P7_HMM *hmm, P7_BG *bg, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om);
 static int    make_post_msa        (P7_BUILDER *bld, const ESL_MSA *premsa, const P7_HMM *hmm, P7_TRACE **tr, ESL_MSA **opt_postmsa);
+static int    stream_read          (P7_BUILDER *bld, ESL_BUFFER *bf, int idx, ESL_DSQ **ax, int64_t *axalloc, int64_t *ret_n);
+static int    stream_validate      (P7_BUILDER *bld, ESL_DSQ *ax, int64_t n, int64_t alen, int idx);
+static double stream_weight        (P7_BUILDER *bld, ESL_DSQ *ax, int64_t alen, int *nct, int *ndiff);
+static void   stream_fragment      (P7_BUILDER *bld, ESL_DSQ *ax, int64_t alen);
 
 /* Function:  p7_Builder()
  * Synopsis:  Build a new HMM from an MSA.
@@ -541,6 +552,219 @@ p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq, P7_BG *bg, P7_HMM **opt_hmm,
 }
 
 
+/* Function:  p7_StreamBuilder()
+ * Synopsis:  Build a new HMM from an alignment too big to hold in memory.
+ *
+ * Purpose:   Build a new HMM from the aligned FASTA file open in
+ *            <bf>, reading it one aligned sequence at a time instead
+ *            of as an <ESL_MSA>. Memory use is O(alen), not
+ *            O(nseq * alen).
+ *
+ *            The file is read three times, so <bf> has to be
+ *            rewindable with <esl_buffer_SetOffset()> (a file, not
+ *            stdin or a gzip'ed file). The first pass collects
+ *            per-column residue counts; the second computes each
+ *            sequence's relative weight from those counts, and
+ *            collects weighted column occupancies to assign consensus
+ *            columns; the third counts each sequence's faux trace into
+ *            the new model. The rest of construction (effective
+ *            sequence number, priors, calibration) is the same as
+ *            <p7_Builder()>.
+ *
+ *            Only what can be computed column by column is
+ *            available: <--fast> architecture, Henikoff position-based
+ *            weights (over all columns) or no weights, and any
+ *            effective sequence number strategy but <--eclust>.
+ *            PB weights are the classic Henikoff ones, not the
+ *            consensus-column-only weights of <p7_Builder()>, so a
+ *            streamed model is close to, but not identical to, one
+ *            built from the same alignment in memory.
+ *
+ * Args:      bld      - build configuration
+ *            bf       - open aligned FASTA file, positioned at its start
+ *            name     - name of the new HMM
+ *            bg       - null model
+ *            opt_hmm  - optRETURN: new HMM
+ *            opt_alen - optRETURN: alignment length
+ *            opt_gm   - optRETURN: profile corresponding to <hmm>
+ *            opt_om   - optRETURN: optimized profile corresponding to <gm>
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            Returns <eslENORESULT> if no sequence has a canonical
+ *            residue to be weighted by, or no consensus columns were
+ *            assigned; <eslEFORMAT> if the file can't be parsed, its
+ *            sequences aren't all the same length, have missing data
+ *            other than at their ends, or it has no sequences; <eslEINVAL> if <bf> can't be rewound or
+ *            <bld> asks for a strategy that needs the whole
+ *            alignment. <bld->errbuf> contains an informative
+ *            error message.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+p7_StreamBuilder(P7_BUILDER *bld, ESL_BUFFER *bf, char *name, P7_BG *bg,
+		 P7_HMM **opt_hmm, int64_t *opt_alen, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om)
+{
+  ESL_DSQ   *ax        = NULL;	/* current aligned sequence, 1..n, as read                   */
+  int64_t    axalloc   = 0;
+  ESL_MSA   *row       = NULL;	/* current aligned sequence as a 1-seq MSA, for p7_trace_FauxFromMSA() */
+  P7_HMM    *hmm       = NULL;
+  P7_TRACE  *tr        = NULL;
+  int       *nct       = NULL;	/* [apos*K + x] count of canonical residue x in column apos  */
+  int       *ndiff     = NULL;	/* [1..alen] number of different residues in column          */
+  int       *matassign = NULL;	/* [1..alen] TRUE if column is consensus                     */
+  double    *occ       = NULL;	/* [1..alen] weighted residue count in column                */
+  double    *tot       = NULL;	/* [1..alen] weighted residue+gap count in column            */
+  int64_t    alen      = -1;
+  int64_t    n;
+  int        K         = bld->abc->K;
+  int        nseq      = 0;
+  int        idx;
+  double     wtot      = 0.;
+  double     wgt;
+  int64_t    apos;
+  int        M, k, x, i;
+  int        status;
+
+  bld->errbuf[0] = '\0';
+  if (bld->arch_strategy != p7_ARCH_FAST)                                 ESL_XFAIL(eslEINVAL, bld->errbuf, "streaming build can only use --fast architecture");
+  if (bld->wgt_strategy != p7_WGT_PB && bld->wgt_strategy != p7_WGT_NONE) ESL_XFAIL(eslEINVAL, bld->errbuf, "streaming build can only use PB weights or no weights");
+  if (bld->effn_strategy == p7_EFFN_CLUST)                                ESL_XFAIL(eslEINVAL, bld->errbuf, "streaming build can't use --eclust");
+
+  axalloc = 256;
+  ESL_ALLOC(ax, sizeof(ESL_DSQ) * axalloc);
+
+  /* Pass 1: alignment length; residue counts per column. */
+  while ((status = stream_read(bld, bf, nseq+1, &ax, &axalloc, &n)) == eslOK)
+    {
+      if (alen == -1)
+	{
+	  alen = n;
+	  if (alen == 0) ESL_XFAIL(eslEFORMAT, bld->errbuf, "first aligned sequence is empty");
+	  if ((row = esl_msa_CreateDigital(bld->abc, 1, alen)) == NULL) { status = eslEMEM; goto ERROR; }
+	  row->nseq = 1;
+	  ESL_ALLOC(nct,       sizeof(int)    * (alen+1) * K);
+	  ESL_ALLOC(ndiff,     sizeof(int)    * (alen+1));
+	  ESL_ALLOC(matassign, sizeof(int)    * (alen+1));
+	  ESL_ALLOC(occ,       sizeof(double) * (alen+1));
+	  ESL_ALLOC(tot,       sizeof(double) * (alen+1));
+	  esl_vec_ISet(nct, (alen+1) * K, 0);
+	}
+      if ((status = stream_validate(bld, ax, n, alen, nseq+1)) != eslOK) goto ERROR;
+      for (apos = 1; apos <= alen; apos++)
+	if (esl_abc_XIsCanonical(bld->abc, ax[apos])) nct[apos*K + ax[apos]]++;
+      nseq++;
+    }
+  if (status != eslEOF) goto ERROR;
+  if (nseq == 0)        ESL_XFAIL(eslEFORMAT, bld->errbuf, "No aligned sequences found");
+
+  for (apos = 1; apos <= alen; apos++)
+    for (ndiff[apos] = 0, x = 0; x < K; x++)
+      if (nct[apos*K + x] > 0) ndiff[apos]++;
+
+  /* Pass 2: relative weights; weighted occupancy of each column, for --symfrac. */
+  if (esl_buffer_SetOffset(bf, 0) != eslOK) ESL_XFAIL(eslEINVAL, bld->errbuf, "streaming build needs to rewind the alignment file; it can't be stdin or gzip'ed");
+  esl_vec_DSet(occ, alen+1, 0.);
+  esl_vec_DSet(tot, alen+1, 0.);
+  for (idx = 1; idx <= nseq; idx++)
+    {
+      if ((status = stream_read(bld, bf, idx, &ax, &axalloc, &n)) != eslOK) ESL_XFAIL(eslEFORMAT, bld->errbuf, "alignment file changed while it was being read");
+      wgt   = stream_weight(bld, ax, alen, nct, ndiff);
+      wtot += wgt;
+      stream_fragment(bld, ax, alen);
+      for (apos = 1; apos <= alen; apos++)
+	{
+	  if      (esl_abc_XIsResidue(bld->abc, ax[apos])) { occ[apos] += wgt; tot[apos] += wgt; }
+	  else if (esl_abc_XIsGap    (bld->abc, ax[apos])) {                   tot[apos] += wgt; }
+	}
+    }
+
+  if (wtot == 0.) ESL_XFAIL(eslENORESULT, bld->errbuf, "Alignment %s has no sequence with a canonical residue - can't weight it or build a model.\n", name);
+
+  for (M = 0, apos = 1; apos <= alen; apos++)
+    {
+      matassign[apos] = (occ[apos] > 0. && occ[apos] / tot[apos] >= bld->symfrac) ? TRUE : FALSE;
+      if (matassign[apos]) M++;
+    }
+  if (M == 0) ESL_XFAIL(eslENORESULT, bld->errbuf, "Alignment %s has no consensus columns w/ > %d%% residues - can't build a model.\n", name, (int) (100 * bld->symfrac));
+
+  /* Pass 3: count faux traces into the new model, with weights normalized to sum to nseq, as in p7_Builder(). */
+  if (esl_buffer_SetOffset(bf, 0) != eslOK) ESL_XFAIL(eslEINVAL, bld->errbuf, "streaming build needs to rewind the alignment file; it can't be stdin or gzip'ed");
+  if ((hmm    = p7_hmm_Create(M, bld->abc)) == NULL)  { status = eslEMEM; goto ERROR; }
+  if ((status = p7_hmm_Zero(hmm))           != eslOK) goto ERROR;
+  for (idx = 1; idx <= nseq; idx++)
+    {
+      if ((status = stream_read(bld, bf, idx, &ax, &axalloc, &n)) != eslOK) ESL_XFAIL(eslEFORMAT, bld->errbuf, "alignment file changed while it was being read");
+      wgt = stream_weight(bld, ax, alen, nct, ndiff) * (double) nseq / wtot;
+      stream_fragment(bld, ax, alen);
+      memcpy(row->ax[0], ax, sizeof(ESL_DSQ) * (alen+2));
+
+      if ((status = p7_trace_FauxFromMSA(row, matassign, p7_MSA_COORDS, &tr))     != eslOK) goto ERROR;
+      if (tr == NULL) continue;	/* skip rare examples of empty sequences */
+      if ((status = p7_trace_Doctor(tr, NULL, NULL))                              != eslOK) goto ERROR;
+      if ((status = p7_trace_Validate(tr, bld->abc, row->ax[0], bld->errbuf))     != eslOK) ESL_XEXCEPTION(eslFAIL, "validation failed: %s", bld->errbuf);
+      if ((status = p7_trace_Count(hmm, row->ax[0], wgt, tr))                     != eslOK) goto ERROR;
+      p7_trace_Destroy(tr);
+      tr = NULL;
+    }
+
+  hmm->nseq     = nseq;
+  hmm->eff_nseq = nseq;
+
+  ESL_ALLOC(hmm->map, sizeof(int) * (hmm->M+1));
+  hmm->map[0] = 0;
+  for (apos = k = 1; apos <= alen; apos++)
+    if (matassign[apos]) hmm->map[k++] = apos;
+  hmm->flags |= p7H_MAP;
+
+  if (bld->max_insert_len>0)
+    for (i=1; i<hmm->M; i++ )
+      hmm->t[i][p7H_II] = ESL_MIN(hmm->t[i][p7H_II], bld->max_insert_len*hmm->t[i][p7H_MI]);
+
+  if ((status =  effective_seqnumber  (bld, NULL, hmm, bg))             != eslOK) goto ERROR;
+  if ((status =  parameterize         (bld, hmm))                       != eslOK) goto ERROR;
+  if ((status =  p7_hmm_SetName       (hmm, name))                      != eslOK) ESL_XFAIL(status, bld->errbuf, "Unable to name the HMM.");
+  if ((status =  p7_hmm_SetCtime      (hmm))                            != eslOK) ESL_XFAIL(status, bld->errbuf, "Failed to record timestamp");
+  if ((status =  p7_hmm_SetComposition(hmm))                            != eslOK) ESL_XFAIL(status, bld->errbuf, "Failed to determine model composition");
+  if ((status =  p7_hmm_SetConsensus  (hmm, NULL))                      != eslOK) ESL_XFAIL(status, bld->errbuf, "Failed to set consensus line");
+  if ((status =  calibrate            (bld, hmm, bg, opt_gm, opt_om))   != eslOK) goto ERROR;
+
+  if ( bld->abc->type == eslDNA ||  bld->abc->type == eslRNA ) {
+    if (bld->w_len > 0)           hmm->max_length = bld->w_len;
+    else if (bld->w_beta == 0.0)  hmm->max_length = hmm->M *4;
+    else if ( (status =  p7_Builder_MaxLength(hmm, bld->w_beta)) != eslOK) goto ERROR;
+  }
+
+  free(ax);
+  esl_msa_Destroy(row);
+  free(nct);
+  free(ndiff);
+  free(matassign);
+  free(occ);
+  free(tot);
+  if (opt_alen != NULL) *opt_alen = alen;
+  if (opt_hmm  != NULL) *opt_hmm  = hmm; else p7_hmm_Destroy(hmm);
+  return eslOK;
+
+ ERROR:
+  if (ax)        free(ax);
+  if (row)       esl_msa_Destroy(row);
+  if (tr)        p7_trace_Destroy(tr);
+  if (nct)       free(nct);
+  if (ndiff)     free(ndiff);
+  if (matassign) free(matassign);
+  if (occ)       free(occ);
+  if (tot)       free(tot);
+  p7_hmm_Destroy(hmm);
+  if (opt_gm    != NULL) p7_profile_Destroy(*opt_gm);
+  if (opt_om    != NULL) p7_oprofile_Destroy(*opt_om);
+  if (opt_alen  != NULL) *opt_alen = 0;
+  if (opt_hmm   != NULL) *opt_hmm  = NULL;
+  return status;
+}
+
+
 /* Function:  p7_Builder_MaxLength()
  *
  * Purpose:  Compute the maximum likely length of an emitted sequence
@@ -816,6 +1040,8 @@ relative_weights(P7_BUILDER *bld, ESL_MSA *msa)
   else if (bld->wgt_strategy == p7_WGT_GIVEN)                   ;
   else if (bld->wgt_strategy == p7_WGT_PB)                      status = esl_msaweight_PB_adv(cfg, msa, /*ESL_MSAWEIGHT_DAT=*/ NULL); 
   else if (bld->wgt_strategy == p7_WGT_GSC)                     status = esl_msaweight_GSC(msa); 
+  else if (bld->wgt_strategy == p7_WGT_BLOSUM && bld->ncpu > 0 && msa->nseq >= p7_BUILDER_THREADED_LINKAGE)
+                                                                status = p7_BLOSUMWeights(msa, bld->wid, bld->ncpu);
   else if (bld->wgt_strategy == p7_WGT_BLOSUM)                  status = esl_msaweight_BLOSUM(msa, bld->wid); 
   else ESL_EXCEPTION(eslEINCONCEIVABLE, "no such weighting strategy");
 
@@ -867,7 +1093,8 @@ build_model(P7_BUILDER *bld, ESL_MSA *msa, P7_HMM **ret_hmm, P7_TRACE ***opt_tr)
  * number". 
  *
  * <msa> is needed because we may need to see the sequences in order 
- * to determine effective seq #. (for --eclust)
+ * to determine effective seq #. (for --eclust) It may be <NULL>
+ * in a streaming build, where --eclust isn't available.
  *
  * <prior> is needed because we may need to parameterize test models
  * looking for the right relative entropy. (for --eent, the default)
@@ -900,13 +1127,17 @@ effective_seqnumber(P7_BUILDER *bld, const ESL_MSA *msa, P7_HMM *hmm, const P7_B
 
   } else {
 
-    if      (bld->effn_strategy == p7_EFFN_NONE)    hmm->eff_nseq = msa->nseq;
+    if      (bld->effn_strategy == p7_EFFN_NONE)    hmm->eff_nseq = hmm->nseq;
     else if (bld->effn_strategy == p7_EFFN_SET)     hmm->eff_nseq = bld->eset;
     else if (bld->effn_strategy == p7_EFFN_CLUST)
     {
         int nclust;
 
-        status = esl_msacluster_SingleLinkage(msa, bld->eid, NULL, NULL, &nclust);
+        if (msa == NULL) ESL_XFAIL(eslEINVAL, bld->errbuf, "--eclust needs the whole alignment; it can't be used in a streaming build");
+        if (bld->ncpu > 0 && msa->nseq >= p7_BUILDER_THREADED_LINKAGE)
+          status = p7_SingleLinkage(msa, bld->eid, bld->ncpu, NULL, &nclust);
+        else
+          status = esl_msacluster_SingleLinkage(msa, bld->eid, NULL, NULL, &nclust);
         if      (status == eslEMEM) ESL_XFAIL(status, bld->errbuf, "memory allocation failed");
         else if (status != eslOK)   ESL_XFAIL(status, bld->errbuf, "single linkage clustering algorithm (at %d%% id) failed", (int)(100 * bld->eid));
 
@@ -1046,5 +1277,134 @@ make_post_msa(P7_BUILDER *bld, const ESL_MSA *premsa, const P7_HMM *hmm, P7_TRAC
   if (postmsa != NULL) esl_msa_Destroy(postmsa);
   return status;
 }
+
+
+/* stream_read()
+ * Read the next aligned sequence (number <idx>, for error messages)
+ * from aligned FASTA file <bf> into <*ax>, as digital
+ * <(*ax)[1..n]> with sentinels at 0 and n+1, reallocating <*ax> as
+ * needed. Return <eslEOF> if there are no more sequences, or
+ * <eslEFORMAT> with <bld->errbuf> set on a parse error.
+ */
+static int
+stream_read(P7_BUILDER *bld, ESL_BUFFER *bf, int idx, ESL_DSQ **ax, int64_t *axalloc, int64_t *ret_n)
+{
+  char      *p;
+  esl_pos_t  n, i;
+  esl_pos_t  anchor;
+  int64_t    pos = 0;
+  ESL_DSQ    x;
+  int        status;
+
+  do {
+    if ((status = esl_buffer_GetLine(bf, &p, &n)) != eslOK) return status; /* eslEOF: no more sequences */
+  } while (esl_memspn(p, n, " \t\r") == n);
+  if (p[0] != '>') ESL_FAIL(eslEFORMAT, bld->errbuf, "aligned sequence %d: expected a >name line; is the file aligned FASTA?", idx);
+
+  while (1)
+    {
+      anchor = esl_buffer_GetOffset(bf);
+      if ((status = esl_buffer_SetAnchor(bf, anchor)) != eslOK) return status;
+      if ((status = esl_buffer_GetLine(bf, &p, &n))   == eslEOF) { esl_buffer_RaiseAnchor(bf, anchor); break; }
+      else if (status != eslOK) return status;
+      if (n > 0 && p[0] == '>') 	/* next sequence's name line: push it back */
+	{
+	  if ((status = esl_buffer_SetOffset(bf, anchor)) != eslOK) return status;
+	  esl_buffer_RaiseAnchor(bf, anchor);
+	  break;
+	}
+      esl_buffer_RaiseAnchor(bf, anchor);
+
+      for (i = 0; i < n; i++)
+	{
+	  if (! isascii((int) p[i])) ESL_FAIL(eslEFORMAT, bld->errbuf, "aligned sequence %d: illegal character", idx);
+	  if (isspace((int) p[i]))   continue;
+	  x = bld->abc->inmap[(int) p[i]];
+	  if (! esl_abc_XIsValid(bld->abc, x)) ESL_FAIL(eslEFORMAT, bld->errbuf, "aligned sequence %d: illegal character %c", idx, p[i]);
+	  if (pos+2 >= *axalloc) { *axalloc *= 2; ESL_REALLOC(*ax, sizeof(ESL_DSQ) * *axalloc); }
+	  (*ax)[++pos] = x;
+	}
+    }
+
+  (*ax)[0]     = eslDSQ_SENTINEL;
+  (*ax)[pos+1] = eslDSQ_SENTINEL;
+  *ret_n = pos;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* stream_validate()
+ * p7_StreamBuilder()'s version of validate_msa(), for aligned
+ * sequence <ax> of length <n>: check that it has the alignment length
+ * <alen>, and uses missing data characters only at its ends. Returns
+ * <eslEFORMAT> with <bld->errbuf> set if not.
+ */
+static int
+stream_validate(P7_BUILDER *bld, ESL_DSQ *ax, int64_t n, int64_t alen, int idx)
+{
+  int64_t apos;
+
+  if (n != alen) ESL_FAIL(eslEFORMAT, bld->errbuf, "aligned sequence %d has length %" PRId64 ", not %" PRId64 " like the first; is the file aligned FASTA?", idx, n, alen);
+
+  apos = 1;
+  while (  esl_abc_XIsMissing(bld->abc, ax[apos]) && apos <= alen) apos++;
+  while (! esl_abc_XIsMissing(bld->abc, ax[apos]) && apos <= alen) apos++;
+  while (  esl_abc_XIsMissing(bld->abc, ax[apos]) && apos <= alen) apos++;
+  if (apos != alen+1) ESL_FAIL(eslEFORMAT, bld->errbuf, "aligned sequence %d\nhas missing data chars (~) other than at fragment edges", idx);
+
+  return eslOK;
+}
+
+
+/* stream_weight()
+ * Relative weight of aligned sequence <ax>, before normalization:
+ * 1.0 for --wnone, or its Henikoff position-based weight from the
+ * canonical residue counts <nct> and the number of different residues
+ * <ndiff> per column, averaged over its residues.
+ */
+static double
+stream_weight(P7_BUILDER *bld, ESL_DSQ *ax, int64_t alen, int *nct, int *ndiff)
+{
+  int     K    = bld->abc->K;
+  double  wgt  = 0.;
+  int64_t rlen = 0;
+  int64_t apos;
+
+  if (bld->wgt_strategy == p7_WGT_NONE) return 1.0;
+
+  for (apos = 1; apos <= alen; apos++)
+    if (esl_abc_XIsCanonical(bld->abc, ax[apos]))
+      {
+	wgt += 1. / (double) (ndiff[apos] * nct[apos*K + ax[apos]]);
+	rlen++;
+      }
+  return (rlen > 0 ? wgt / (double) rlen : 0.);
+}
+
+
+/* stream_fragment()
+ * p7_StreamBuilder()'s version of esl_msa_MarkFragments_old(), for one
+ * aligned sequence <ax>: if its span from first to last residue is
+ * < fragthresh * alen, convert its leading and trailing gaps to missing
+ * data.
+ */
+static void
+stream_fragment(P7_BUILDER *bld, ESL_DSQ *ax, int64_t alen)
+{
+  int64_t lpos, rpos, apos;
+
+  for (lpos = 1;    lpos <= alen; lpos++) if (esl_abc_XIsResidue(bld->abc, ax[lpos])) break;
+  for (rpos = alen; rpos >= 1;    rpos--) if (esl_abc_XIsResidue(bld->abc, ax[rpos])) break;
+  if (lpos > rpos) return;	/* no residues at all */
+
+  if ((double) (rpos - lpos + 1) < bld->fragthresh * (double) alen)
+    {
+      for (apos = 1;    apos < lpos; apos++) ax[apos] = esl_abc_XGetMissing(bld->abc);
+      for (apos = alen; apos > rpos; apos--) ax[apos] = esl_abc_XGetMissing(bld->abc);
+    }
+}
 /*---------------- end, internal functions ----------------------*/
 
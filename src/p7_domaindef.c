@@ -41,10 +41,18 @@
 #include "esl_random.h"
 #include "esl_sq.h"
 #include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 
 static int is_multidomain_region  (P7_DOMAINDEF *ddef, int i, int j);
+static int define_region          (P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *fwd, P7_OMX *bck,
+				   int i, int j, int is_multi, int saveL, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+#ifdef HMMER_THREADS
+static int define_regions_parallel(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, int saveL);
+#endif
 static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc);
 static int rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *ox1, P7_OMX *ox2,
 				   int i, int j, int null2_is_done, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
@@ -79,8 +87,18 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->mocc = ddef->btot = ddef->etot = NULL;
   ddef->n2sc = NULL;
   ddef->sp   = NULL;
+  ddef->prvc = NULL;
   ddef->tr   = NULL;
+  ddef->trb  = NULL;
+  ddef->ntrb = 0;
   ddef->dcl  = NULL;
+  ddef->reg    = NULL;
+  ddef->sub    = NULL;
+  ddef->subfwd = NULL;
+  ddef->subbck = NULL;
+  ddef->nreg      = 0;
+  ddef->reg_alloc = 0;
+  ddef->nsub      = 0;
 
   /* level 2 alloc: posterior prob arrays */
   ESL_ALLOC(ddef->mocc, sizeof(float) * (Lalloc+1));
@@ -96,24 +114,38 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ESL_ALLOC(ddef->dcl, sizeof(P7_DOMAIN) * nalloc);
   ddef->nalloc = nalloc;
   ddef->ndom   = 0;
+  ddef->arena       = NULL;
+  ddef->ad_in_arena = FALSE;
+
+  /* level 2 alloc: previous round's clusters, for adaptive ensemble sampling */
+  ESL_ALLOC(ddef->prvc, sizeof(struct p7_spcoord_s) * nalloc);
+  ddef->prvc_alloc = nalloc;
+  ddef->nprvc      = -1;
 
   ddef->nexpected  = 0.0;
   ddef->nregions   = 0;
   ddef->nclustered = 0;
   ddef->noverlaps  = 0;
   ddef->nenvelopes = 0;
+  ddef->nsampled   = 0;
 
   /* default thresholds */
   ddef->rt1           = 0.25;
   ddef->rt2           = 0.10;
   ddef->rt3           = 0.20;
   ddef->nsamples      = 200;
+  ddef->nround        = 0;	/* 0 = no adaptive sampling; always collect <nsamples> traces */
+  ddef->nbatch        = 50;
   ddef->min_overlap   = 0.8;
   ddef->of_smaller    = TRUE;
   ddef->max_diagdiff  = 4;
   ddef->min_posterior = 0.25;
   ddef->min_endpointp = 0.02;
 
+  /* parallel domain definition is off by default */
+  ddef->ncpu          = 0;
+  ddef->par_minL      = 10000;
+
   /* allocate reusable, growable objects that domain def reuses for each seq */
   ddef->sp  = p7_spensemble_Create(1024, 64, 32); /* init allocs = # sampled pairs; max endpoint range; # of domains */
   ddef->tr  = p7_trace_CreateWithPP();
@@ -196,7 +228,8 @@ p7_domaindef_Reuse(P7_DOMAINDEF *ddef)
   else
     {
       for (d = 0; d < ddef->ndom; d++) {
-	p7_alidisplay_Destroy(ddef->dcl[d].ad); ddef->dcl[d].ad             = NULL;
+	if (! ddef->ad_in_arena) p7_alidisplay_Destroy(ddef->dcl[d].ad); /* else it's the hit list's */
+	ddef->dcl[d].ad = NULL;
 	free(ddef->dcl[d].scores_per_pos);      ddef->dcl[d].scores_per_pos = NULL;
       }
       
@@ -209,6 +242,7 @@ p7_domaindef_Reuse(P7_DOMAINDEF *ddef)
   ddef->nclustered = 0;
   ddef->noverlaps  = 0;
   ddef->nenvelopes = 0;
+  ddef->nsampled   = 0;
 
   p7_spensemble_Reuse(ddef->sp);
   p7_trace_Reuse(ddef->tr);	/* probable overkill; should already have been called */
@@ -289,11 +323,12 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   if (ddef->btot != NULL) free(ddef->btot);
   if (ddef->etot != NULL) free(ddef->etot);
   if (ddef->n2sc != NULL) free(ddef->n2sc);
+  if (ddef->prvc != NULL) free(ddef->prvc);
 
   if (ddef->dcl  != NULL) {
     for (d = 0; d < ddef->ndom; d++) {
       if (ddef->dcl[d].scores_per_pos) free(ddef->dcl[d].scores_per_pos);
-      p7_alidisplay_Destroy(ddef->dcl[d].ad);
+      if (! ddef->ad_in_arena) p7_alidisplay_Destroy(ddef->dcl[d].ad);
     }
     free(ddef->dcl);
   }
@@ -301,6 +336,21 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   p7_spensemble_Destroy(ddef->sp);
   p7_trace_Destroy(ddef->tr);
   p7_trace_Destroy(ddef->gtr);
+  if (ddef->trb) {
+    for (d = 0; d < ddef->ntrb; d++) p7_trace_Destroy(ddef->trb[d]);
+    free(ddef->trb);
+  }
+
+  if (ddef->reg) free(ddef->reg);
+  for (d = 0; d < ddef->nsub; d++) {
+    esl_randomness_Destroy(ddef->sub[d]->r); /* each thread's workspace owns its RNG */
+    p7_domaindef_Destroy(ddef->sub[d]);
+    p7_omx_Destroy(ddef->subfwd[d]);
+    p7_omx_Destroy(ddef->subbck[d]);
+  }
+  if (ddef->sub)    free(ddef->sub);
+  if (ddef->subfwd) free(ddef->subfwd);
+  if (ddef->subbck) free(ddef->subbck);
   free(ddef);
   return;
 }
@@ -374,11 +424,24 @@ p7_domaindef_ByViterbi(P7_PROFILE *gm, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_
  *            domains: their bounds, their null-corrected Forward
  *            scores, and their optimal posterior accuracy alignments.
  *            
+ *            If <ddef->ncpu> is $>0$ (and HMMER is compiled with
+ *            threads), the regions of a target of length $\geq$
+ *            <ddef->par_minL> are found first, then defined on
+ *            <ddef->ncpu> threads, each with its own copy of <om>,
+ *            DP matrices, and RNG. This is only done when
+ *            <ddef->do_reseeding> is TRUE, so the stochastic traces
+ *            of each region come from the RNG's original seed,
+ *            whichever thread does the sampling; the results are the
+ *            same as the serial calculation's. It isn't done for
+ *            <long_target> searches, which modify <bg> in place.
+ *            
  * Returns:   <eslOK> on success.           
  *            
  *            <eslERANGE> on numeric overflow in posterior
  *            decoding. This should not be possible for multihit
  *            models.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
  */
 int
 p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om,
@@ -388,20 +451,25 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
 {
   int i, j;
   int triggered;
-  int d;
-  int i2,j2;
-  int last_j2;
-  int nc;
+  int is_multi;
+  int do_parallel = FALSE;
   int saveL     = om->L;	/* Save the length config of <om>; will restore upon return */
   int save_mode = om->mode;	/* Likewise for the mode. */
+  void *p;
   int status;
 
   if ((status = p7_domaindef_GrowTo(ddef, sq->n))      != eslOK) return status;  /* ddef's btot,etot,mocc now ready for seq of length n */
   if ((status = p7_DomainDecoding(om, oxf, oxb, ddef)) != eslOK) return status;  /* ddef->{btot,etot,mocc} now made.                    */
 
   esl_vec_FSet(ddef->n2sc, sq->n+1, 0.0);          /* ddef->n2sc null2 scores are initialized                        */
+  ddef->ad_in_arena = (ddef->arena != NULL);       /* alidisplays go in caller's arena, if any (not the threads')    */
   ddef->nexpected = ddef->btot[sq->n];             /* posterior expectation for # of domains (same as etot[sq->n])   */
 
+#ifdef HMMER_THREADS
+  if (ddef->ncpu > 0 && sq->n >= ddef->par_minL && ddef->do_reseeding && ! long_target) do_parallel = TRUE;
+#endif
+  ddef->nreg = 0;
+
   p7_oprofile_ReconfigUnihit(om, saveL);	   /* process each domain in unihit mode, regardless of om->mode     */
   i     = -1;
   triggered = FALSE;
@@ -418,78 +486,46 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
     else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
     {
         /* We have a region i..j to evaluate. */
-        p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
-        p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
         ddef->nregions++;
-        if (is_multidomain_region(ddef, i, j))
+        is_multi = is_multidomain_region(ddef, i, j);
+
+        if (do_parallel)
         {
-            /* This region appears to contain more than one domain, so we have to
-             * resolve it by cluster analysis of posterior trace samples, to define
-             * one or more domain envelopes.
-             */
-            ddef->nclustered++;
-
-            /* Resolve the region into domains by stochastic trace
-             * clustering; assign position-specific null2 model by
-             * stochastic trace clustering; there is redundancy
-             * here; we will consolidate later if null2 strategy
-             * works
-             */
-            p7_oprofile_ReconfigMultihit(om, saveL);
-            p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
-
-            region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
-            p7_oprofile_ReconfigUnihit(om, saveL);
-            /* ddef->n2sc is now set on i..j by the traceback-dependent method */
-
-            last_j2 = 0;
-            for (d = 0; d < nc; d++) {
-                  p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
-                  if (i2 <= last_j2) ddef->noverlaps++;
-
-                  /* Note that k..m coords on model are available, but
-                     * we're currently ignoring them.  This leads to a
-                     * rare clustering bug that we eventually need to fix
-                     * properly [xref J3/32]: two different regions in one
-                     * profile HMM might have hit same seq domain, and
-                     * when we now go to calculate an OA trace, nothing
-                     * constrains us to find the two different alignments
-                     * to the HMM; in fact, because OA is optimal, we'll
-                     * find one and the *same* alignment, leading to an
-                     * apparent duplicate alignment in the output.
-                     *
-                     * Registered as #h74, Dec 2009, after EBI finds and
-                     * reports it.  #h74 is worked around in p7_tophits.c
-                     * by hiding all but one envelope with an identical
-                     * alignment, in the rare event that this
-                     * happens. [xref J5/130].
-                  */
-                  ddef->nenvelopes++;
-
-                  /*the !long_target argument will cause the function to recompute null2
-                   * scores if this is part of a long_target (nhmmer) pipeline */
-                  if (rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
-                       last_j2 = j2;
+            /* Save it for the threads, once we've found them all. */
+            if (ddef->nreg == ddef->reg_alloc) {
+              ESL_RALLOC(ddef->reg, p, sizeof(struct p7_dregion_s) * (ddef->reg_alloc == 0 ? 32 : ddef->reg_alloc * 2));
+              ddef->reg_alloc = (ddef->reg_alloc == 0 ? 32 : ddef->reg_alloc * 2);
             }
-            p7_spensemble_Reuse(ddef->sp);
-            p7_trace_Reuse(ddef->tr);
-        }
-        else
-        {
-            /* The region looks simple, single domain; convert the region to an envelope. */
-            ddef->nenvelopes++;
-            rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+            ddef->reg[ddef->nreg].i        = i;
+            ddef->reg[ddef->nreg].j        = j;
+            ddef->reg[ddef->nreg].is_multi = is_multi;
+            ddef->nreg++;
         }
+        else if ((status = define_region(ddef, om, sq, ntsq, fwd, bck, i, j, is_multi, saveL, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr)) != eslOK) return status;
+
         i     = -1;
         triggered = FALSE;
     }
   }
 
+#ifdef HMMER_THREADS
+  if (do_parallel && ddef->nreg == 1)	/* one region isn't worth starting threads for */
+    {
+      if ((status = define_region(ddef, om, sq, ntsq, fwd, bck, ddef->reg[0].i, ddef->reg[0].j, ddef->reg[0].is_multi, saveL, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr)) != eslOK) return status;
+    }
+  else if (do_parallel && ddef->nreg > 1)
+    {
+      if ((status = define_regions_parallel(ddef, om, sq, ntsq, saveL)) != eslOK) return status;
+    }
+#endif
 
   /* Restore model to uni/multihit mode, and to its original length model */
   if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
   else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
   return eslOK;
+
+ ERROR:
+  return status;
 }
 
 
@@ -499,6 +535,277 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
  *****************************************************************/
 
 
+/* define_region()
+ *
+ * Define the domains in region <i>..<j> of <sq>, appending them to
+ * <ddef->dcl>. If <is_multi> is TRUE, the region is first resolved
+ * into envelopes by clustering an ensemble of stochastic traces;
+ * else the whole region is one envelope. <om> is in unihit mode on
+ * entry and on return; <saveL> is its length configuration. <fwd>
+ * and <bck> are reallocated as needed for the region.
+ *
+ * Called by <p7_domaindef_ByPosteriorHeuristics()> as it finds each
+ * region, or by each thread in <define_regions_parallel()> with its
+ * own <ddef>, <om>, <fwd>, <bck>.
+ *
+ * Returns <eslOK> on success.
+ *
+ * Throws  <eslEMEM> on allocation failure.
+ */
+static int
+define_region(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *fwd, P7_OMX *bck,
+	      int i, int j, int is_multi, int saveL, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
+{
+  int d;
+  int i2,j2;
+  int last_j2;
+  int nc;
+  int status;
+
+  p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
+  p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
+  if (is_multi)
+    {
+      /* This region appears to contain more than one domain, so we have to
+       * resolve it by cluster analysis of posterior trace samples, to define
+       * one or more domain envelopes.
+       */
+      ddef->nclustered++;
+
+      /* Resolve the region into domains by stochastic trace
+       * clustering; assign position-specific null2 model by
+       * stochastic trace clustering; there is redundancy
+       * here; we will consolidate later if null2 strategy
+       * works
+       */
+      p7_oprofile_ReconfigMultihit(om, saveL);
+      p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
+
+      if ((status = region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc)) != eslOK) return status;
+      p7_oprofile_ReconfigUnihit(om, saveL);
+      /* ddef->n2sc is now set on i..j by the traceback-dependent method */
+
+      last_j2 = 0;
+      for (d = 0; d < nc; d++) {
+	p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
+	if (i2 <= last_j2) ddef->noverlaps++;
+
+	/* Note that k..m coords on model are available, but
+	 * we're currently ignoring them.  This leads to a
+	 * rare clustering bug that we eventually need to fix
+	 * properly [xref J3/32]: two different regions in one
+	 * profile HMM might have hit same seq domain, and
+	 * when we now go to calculate an OA trace, nothing
+	 * constrains us to find the two different alignments
+	 * to the HMM; in fact, because OA is optimal, we'll
+	 * find one and the *same* alignment, leading to an
+	 * apparent duplicate alignment in the output.
+	 *
+	 * Registered as #h74, Dec 2009, after EBI finds and
+	 * reports it.  #h74 is worked around in p7_tophits.c
+	 * by hiding all but one envelope with an identical
+	 * alignment, in the rare event that this
+	 * happens. [xref J5/130].
+	 */
+	ddef->nenvelopes++;
+
+	/*the !long_target argument will cause the function to recompute null2
+	 * scores if this is part of a long_target (nhmmer) pipeline */
+	if (rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
+	  last_j2 = j2;
+      }
+      p7_spensemble_Reuse(ddef->sp);
+      p7_trace_Reuse(ddef->tr);
+    }
+  else
+    {
+      /* The region looks simple, single domain; convert the region to an envelope. */
+      ddef->nenvelopes++;
+      rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+    }
+  return eslOK;
+}
+
+
+#ifdef HMMER_THREADS
+/* REGIONJOB: shared by the worker threads of one parallel domain
+ * definition. Worker <w> defines regions w, w+nworkers, w+2*nworkers...
+ * in its own workspace <ddef->sub[w]>, records where their domains
+ * went in <ddef->reg>, and records any error in its own <wstatus[w]>;
+ * nothing is written by more than one thread.
+ */
+typedef struct {
+  P7_DOMAINDEF      *ddef;	/* parent: regions in <reg>, workspaces in <sub>      */
+  const P7_OPROFILE *om;	/* profile in unihit mode; each worker clones it      */
+  const ESL_SQ      *sq;	/* target sequence                                    */
+  const ESL_SQ      *ntsq;	/* nucleotide source of a translated <sq>, or NULL    */
+  int                saveL;	/* length configuration of <om>                       */
+  int                nworkers;	/* number of worker threads                           */
+  int               *wstatus;	/* RESULT: [0..nworkers-1] status of each worker      */
+} REGIONJOB;
+
+static void
+define_regions_thread(void *arg)
+{
+  ESL_THREADS         *obj = (ESL_THREADS *) arg;
+  REGIONJOB           *job;
+  P7_DOMAINDEF        *sub;
+  P7_OPROFILE         *om  = NULL;
+  struct p7_dregion_s *reg;
+  int                  w, r;
+  int                  status = eslOK;
+
+  impl_Init();			/* same FP modes as the master, so scores are identical */
+  esl_threads_Started(obj, &w);
+  job = (REGIONJOB *) esl_threads_GetData(obj, w);
+  sub = job->ddef->sub[w];
+
+  /* <om> gets flipped between uni- and multihit mode, so each worker needs its own */
+  if ((om = p7_oprofile_Clone(job->om)) == NULL) status = eslEMEM;
+  for (r = w; status == eslOK && r < job->ddef->nreg; r += job->nworkers)
+    {
+      reg     = job->ddef->reg + r;
+      reg->d0 = sub->ndom;
+      status  = define_region(sub, om, job->sq, job->ntsq, job->ddef->subfwd[w], job->ddef->subbck[w],
+			      reg->i, reg->j, reg->is_multi, job->saveL, NULL, FALSE, NULL, NULL, NULL);
+      reg->nd = sub->ndom - reg->d0;
+    }
+
+  job->wstatus[w] = status;
+  p7_oprofile_Destroy(om);
+  esl_threads_Finished(obj, w);
+  return;
+}
+
+
+/* define_regions_parallel()
+ *
+ * Define the domains in the <ddef->nreg> regions <ddef->reg> found
+ * by the posterior scan of <sq>, on up to <ddef->ncpu> threads; then
+ * collect their domains into <ddef->dcl> and their null2 scores into
+ * <ddef->n2sc>, in region order, as the serial calculation would
+ * have.
+ *
+ * Each thread has a workspace <ddef->sub[w]> (with its own RNG,
+ * seeded like <ddef->r>) and DP matrices <ddef->subfwd[w]>,
+ * <ddef->subbck[w]>. These are created the first time they're
+ * needed, and kept for reuse.
+ *
+ * Returns <eslOK> on success.
+ *
+ * Throws  <eslEMEM> on allocation failure.
+ */
+static int
+define_regions_parallel(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, int saveL)
+{
+  ESL_THREADS         *obj      = NULL;
+  ESL_RANDOMNESS      *r        = NULL;
+  REGIONJOB            job;
+  P7_DOMAINDEF        *sub;
+  struct p7_dregion_s *reg;
+  int                  nworkers = ESL_MIN(ddef->ncpu, ddef->nreg);
+  uint32_t             seed     = esl_randomness_GetSeed(ddef->r);
+  int                  w, rr, d;
+  void                *p;
+  int                  status;
+
+  job.wstatus = NULL;
+
+  /* Make sure each thread has a workspace */
+  if (nworkers > ddef->nsub)
+    {
+      ESL_RALLOC(ddef->sub,    p, sizeof(P7_DOMAINDEF *) * nworkers);
+      ESL_RALLOC(ddef->subfwd, p, sizeof(P7_OMX *)       * nworkers);
+      ESL_RALLOC(ddef->subbck, p, sizeof(P7_OMX *)       * nworkers);
+      while (ddef->nsub < nworkers)
+	{
+	  w = ddef->nsub;
+	  r = (ddef->r->type == eslRND_FAST ? esl_randomness_CreateFast(seed) : esl_randomness_Create(seed));
+	  if (r == NULL) { status = eslEMEM; goto ERROR; }
+	  if ((ddef->sub[w] = p7_domaindef_Create(r)) == NULL) { status = eslEMEM; goto ERROR; }
+	  r = NULL;		/* the workspace owns it now; p7_domaindef_Destroy() on the parent frees it */
+	  ddef->subfwd[w] = p7_omx_Create(om->M, 0, 0);
+	  ddef->subbck[w] = p7_omx_Create(om->M, 0, 0);
+	  ddef->nsub++;
+	  if (ddef->subfwd[w] == NULL || ddef->subbck[w] == NULL) { status = eslEMEM; goto ERROR; }
+	}
+    }
+
+  /* Each thread's workspace gets the parent's settings, and an RNG with the parent's seed */
+  for (w = 0; w < nworkers; w++)
+    {
+      sub = ddef->sub[w];
+      if ((status = p7_domaindef_Reuse(sub))         != eslOK) goto ERROR;
+      if ((status = p7_domaindef_GrowTo(sub, sq->n)) != eslOK) goto ERROR;
+      if (esl_randomness_GetSeed(sub->r) != seed) esl_randomness_Init(sub->r, seed);
+      sub->do_reseeding  = ddef->do_reseeding;
+      sub->nsamples      = ddef->nsamples;
+      sub->nround        = ddef->nround;
+      sub->nbatch        = ddef->nbatch;
+      sub->min_overlap   = ddef->min_overlap;
+      sub->of_smaller    = ddef->of_smaller;
+      sub->max_diagdiff  = ddef->max_diagdiff;
+      sub->min_posterior = ddef->min_posterior;
+      sub->min_endpointp = ddef->min_endpointp;
+    }
+
+  ESL_ALLOC(job.wstatus, sizeof(int) * nworkers);
+  job.ddef     = ddef;
+  job.om       = om;
+  job.sq       = sq;
+  job.ntsq     = ntsq;
+  job.saveL    = saveL;
+  job.nworkers = nworkers;
+
+  if ((obj = esl_threads_Create(&define_regions_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+  for (w = 0; w < nworkers; w++) esl_threads_AddThread(obj, &job);
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+  esl_threads_Destroy(obj);
+  obj = NULL;
+
+  for (w = 0; w < nworkers; w++)
+    if ((status = job.wstatus[w]) != eslOK) goto ERROR;
+
+  /* Collect the results in region order. The domains' alidisplays are
+   * handed over to <ddef>, so the workspaces mustn't free them.
+   */
+  for (rr = 0; rr < ddef->nreg; rr++)
+    {
+      reg = ddef->reg + rr;
+      sub = ddef->sub[rr % nworkers];
+      if (ddef->ndom + reg->nd > ddef->nalloc) {
+	ESL_RALLOC(ddef->dcl, p, sizeof(P7_DOMAIN) * (ddef->ndom + reg->nd) * 2);
+	ddef->nalloc = (ddef->ndom + reg->nd) * 2;
+      }
+      for (d = 0; d < reg->nd; d++)
+	ddef->dcl[ddef->ndom++] = sub->dcl[reg->d0 + d];
+      memcpy(ddef->n2sc + reg->i, sub->n2sc + reg->i, sizeof(float) * (reg->j - reg->i + 1));
+    }
+  ddef->ad_in_arena = FALSE;	/* the workspaces malloc() theirs; one arena can't be shared by threads */
+
+  for (w = 0; w < nworkers; w++)
+    {
+      sub = ddef->sub[w];
+      ddef->nclustered += sub->nclustered;
+      ddef->noverlaps  += sub->noverlaps;
+      ddef->nenvelopes += sub->nenvelopes;
+      ddef->nsampled   += sub->nsampled;
+      sub->ndom = 0;
+    }
+
+  free(job.wstatus);
+  return eslOK;
+
+ ERROR:
+  if (r)           esl_randomness_Destroy(r);
+  if (obj)         esl_threads_Destroy(obj);
+  if (job.wstatus) free(job.wstatus);
+  return status;
+}
+#endif /*HMMER_THREADS*/
+
+
 /* is_multidomain_region()
  * SRE, Fri Feb  8 11:35:04 2008 [Janelia]
  *
@@ -572,6 +879,15 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  * Reuse() the whole <ddef>, when it's in the process of analyzing
  * regions.
  * 
+ * If <ddef->nround> is nonzero, the ensemble is sampled in rounds of
+ * <nround> traces, clustering it after each round; sampling stops
+ * early when two successive rounds define the same significant
+ * clusters with the same consensus endpoints, or at <ddef->nsamples>
+ * traces, whichever comes first. Because the RNG stream is the same,
+ * an early stop defines the envelopes that a fixed-size ensemble of
+ * that many traces would have. The number of traces sampled is added
+ * to <ddef->nsampled>.
+ * 
  * Upon return, <*ret_nc> contains the number of clusters that were
  * defined.
  * 
@@ -589,7 +905,9 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  *    answers, it needs to <esl_spensemble_Reuse()> it before calling
  *    <region_trace_ensemble()> again.
  *    
- * <ddef->tr> is used as working memory for sampled traces.
+ * <ddef->trb> is used as working memory for sampled traces, which are
+ *    sampled in batches of up to <ddef->nbatch> from the one Forward 
+ *    matrix by <p7_StochasticTraceBatch()>.
  *    
  * <wrk> has had its zero row clobbered as working space for a null2 calculation.
  */
@@ -597,14 +915,20 @@ static int
 region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, 
 		      const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc)
 {
+  struct p7_spcoord_s *sigc;
+  P7_TRACE *tr;
   int    Lr  = jreg-ireg+1;
-  int    t, d, d2;
+  int    t, b, nb, d, d2;
   int    nov, n;
   int    nc;
   int    pos;
+  int    is_clustered = FALSE;
   float  null2[p7_MAXCODE];
+  void  *p;
+  int    status;
 
   esl_vec_FSet(ddef->n2sc+ireg, Lr, 0.0); /* zero the null2 scores in region */
+  ddef->nprvc = -1;
 
   /* By default, we make results reproducible by forcing a reset of
    * the RNG to its originally seeded state.
@@ -612,37 +936,87 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   if (ddef->do_reseeding) 
     esl_randomness_Init(ddef->r, esl_randomness_GetSeed(ddef->r));
 
-  /* Collect an ensemble of sampled traces; calculate null2 odds ratios from these */
-  for (t = 0; t < ddef->nsamples; t++)
+  /* Make sure we have a batch of traces to sample into */
+  nb = ESL_MIN(ddef->nbatch, ddef->nsamples);
+  if (nb > ddef->ntrb)
+    {
+      ESL_RALLOC(ddef->trb, p, sizeof(P7_TRACE *) * nb);
+      for (; ddef->ntrb < nb; ddef->ntrb++)
+	if ((ddef->trb[ddef->ntrb] = p7_trace_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+    }
+
+  /* Collect an ensemble of sampled traces, a batch at a time; calculate null2 odds ratios from these */
+  for (t = 0; t < ddef->nsamples; )
     {
-      p7_StochasticTrace(ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->tr);
-      p7_trace_Index(ddef->tr);
+      nb = ESL_MIN(ddef->nbatch, ddef->nsamples - t);
+      if (ddef->nround > 0) nb = ESL_MIN(nb, ddef->nround - t % ddef->nround); /* a batch doesn't cross the end of a round */
+      if ((status = p7_StochasticTraceBatch(ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->trb, nb)) != eslOK) goto ERROR;
 
-      pos = 1;
-      for (d = 0; d < ddef->tr->ndom; d++)
+      for (b = 0; b < nb; b++, t++)
 	{
-	  p7_spensemble_Add(ddef->sp, t, ddef->tr->sqfrom[d]+ireg-1, ddef->tr->sqto[d]+ireg-1, ddef->tr->hmmfrom[d], ddef->tr->hmmto[d]);
+	  tr = ddef->trb[b];
+	  p7_trace_Index(tr);
 
-	  p7_Null2_ByTrace(om, ddef->tr, ddef->tr->tfrom[d], ddef->tr->tto[d], wrk, null2);
+	  pos = 1;
+	  for (d = 0; d < tr->ndom; d++)
+	    {
+	      p7_spensemble_Add(ddef->sp, t, tr->sqfrom[d]+ireg-1, tr->sqto[d]+ireg-1, tr->hmmfrom[d], tr->hmmto[d]);
+
+	      p7_Null2_ByTrace(om, tr, tr->tfrom[d], tr->tto[d], wrk, null2);
 	  
-	  /* residues outside domains get bumped +1: because f'(x) = f(x), so f'(x)/f(x) = 1 in these segments */
-	  for (; pos <= ddef->tr->sqfrom[d]; pos++) ddef->n2sc[ireg+pos-1] += 1.0;
+	      /* residues outside domains get bumped +1: because f'(x) = f(x), so f'(x)/f(x) = 1 in these segments */
+	      for (; pos <= tr->sqfrom[d]; pos++) ddef->n2sc[ireg+pos-1] += 1.0;
+
+	      /* Residues inside domains get bumped by their null2 ratio */
+	      for (; pos <= tr->sqto[d];   pos++) ddef->n2sc[ireg+pos-1] += null2[dsq[ireg+pos-1]];
+	    }
+	  /* the remaining residues in the region outside any domains get +1 */
+	  for (; pos <= Lr; pos++)  ddef->n2sc[ireg+pos-1] += 1.0;
 
-	  /* Residues inside domains get bumped by their null2 ratio */
-	  for (; pos <= ddef->tr->sqto[d];   pos++) ddef->n2sc[ireg+pos-1] += null2[dsq[ireg+pos-1]];
+	  p7_trace_Reuse(tr);        
 	}
-      /* the remaining residues in the region outside any domains get +1 */
-      for (; pos <= Lr; pos++)  ddef->n2sc[ireg+pos-1] += 1.0;
 
-      p7_trace_Reuse(ddef->tr);        
+      /* In adaptive mode, cluster the ensemble at the end of each
+       * round. If the significant clusters and their consensus
+       * endpoints are the same as they were at the end of the
+       * previous round, the ensemble has converged: stop sampling.
+       */
+      if (ddef->nround > 0 && t % ddef->nround == 0 && t < ddef->nsamples)
+	{
+	  ddef->sp->nsigc = 0;
+	  if ((status = p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc)) != eslOK) goto ERROR;
+
+	  sigc = ddef->sp->sigc;
+	  if (nc == ddef->nprvc) 
+	    {
+	      for (d = 0; d < nc; d++)
+		if (sigc[d].i != ddef->prvc[d].i || sigc[d].j != ddef->prvc[d].j ||
+		    sigc[d].k != ddef->prvc[d].k || sigc[d].m != ddef->prvc[d].m) break;
+	      if (d == nc) { is_clustered = TRUE; break; }
+	    }
+
+	  if (nc > ddef->prvc_alloc) {
+	    ESL_RALLOC(ddef->prvc, p, sizeof(struct p7_spcoord_s) * nc);
+	    ddef->prvc_alloc = nc;
+	  }
+	  if (nc > 0) memcpy(ddef->prvc, sigc, sizeof(struct p7_spcoord_s) * nc);
+	  ddef->nprvc = nc;
+	}
     }
+  ddef->nsampled += t;		/* <t> is now the number of traces in the ensemble */
 
   /* Convert the accumulated n2sc[] ratios in this region to log odds null2 scores on each residue. */
   for (pos = ireg; pos <= jreg; pos++)
-    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) ddef->nsamples);
+    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) t);
 
-  /* Cluster the ensemble of traces to break region into envelopes. */
-  p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc);
+  /* Cluster the ensemble of traces to break region into envelopes
+   * (unless adaptive sampling already did, when it converged).
+   */
+  if (! is_clustered)
+    {
+      ddef->sp->nsigc = 0;
+      if ((status = p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc)) != eslOK) goto ERROR;
+    }
 
   /* A little hacky now. Remove "dominated" domains relative to seq coords. */
   for (d = 0; d < nc; d++) 
@@ -675,6 +1049,10 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   ddef->sp->nc = d;
   *ret_nc = d;
   return eslOK;
+
+ ERROR:
+  *ret_nc = 0;
+  return status;
 }
 
 
@@ -865,7 +1243,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     ddef->nalloc *= 2;
   }
   dom = &(ddef->dcl[ddef->ndom]);
-  dom->ad             = p7_alidisplay_Create(ddef->tr, 0, om, sq, ntsq);
+  dom->ad             = p7_alidisplay_CreateInArena(ddef->arena, ddef->tr, 0, om, sq, ntsq);
   dom->scores_per_pos = NULL;
 
 
@@ -914,9 +1292,9 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
        for (z = 0; z < ddef->tr->N; z++)
          if (ddef->tr->i[z] > 0) ddef->tr->i[z] += i-1;
 
-       /* store the results in it, first destroying the old alidisplay object */
-       p7_alidisplay_Destroy(dom->ad);
-       dom->ad            = p7_alidisplay_Create(ddef->tr, 0, om, sq, NULL);
+       /* store the results in it, first destroying the old alidisplay object (an arena's is just dropped) */
+       if (! ddef->arena) p7_alidisplay_Destroy(dom->ad);
+       dom->ad            = p7_alidisplay_CreateInArena(ddef->arena, ddef->tr, 0, om, sq, NULL);
     }
 
     /* Estimate bias correction, by computing what the score would've been without
@@ -981,6 +1359,181 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   return status;
 }
   
+
+
+/*****************************************************************
+ * Benchmark driver.
+ *****************************************************************/
+
+#ifdef p7DOMAINDEF_BENCHMARK
+/* gcc -o domaindef_benchmark -O2 -Wall -I../easel -L../easel -I. -L. -Dp7DOMAINDEF_BENCHMARK p7_domaindef.c -lhmmer -leasel -lm
+ * ./domaindef_benchmark <hmmfile>
+ *
+ * Samples multidomain target sequences from the model, and defines
+ * their domains twice: with fixed-size stochastic trace ensembles
+ * (the default), and with adaptive ensembles (ddef->nround > 0).
+ * Reports the number of traces each sampled, the time each took in
+ * domain definition, and the number of targets on which the two
+ * disagree on the number or the envelope coords of the domains.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_sq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length config for the profile",                    0 },
+  { "-N",        eslARG_INT,    "200", NULL, "n>0", NULL,  NULL, NULL, "number of sampled target seqs",                    0 },
+  { "-R",        eslARG_INT,     "50", NULL, "n>0", NULL,  NULL, NULL, "adaptive ensembles sample in rounds of <n> traces", 0 },
+  { "-v",        eslARG_NONE,    NULL, NULL, NULL,  NULL,  NULL, NULL, "be verbose: show targets with different calls",    0 },
+  { "--mindom",  eslARG_INT,      "2", NULL, "n>0", NULL,  NULL, NULL, "sampled targets have at least <n> domains",        0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for adaptive stochastic trace ensembles in domain definition";
+
+static int
+define_domains(P7_OPROFILE *om, P7_BG *bg, ESL_SQ *sq, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *fwd, P7_OMX *bck, 
+	       P7_DOMAINDEF *ddef, ESL_STOPWATCH *w, double *tot_time)
+{
+  int status;
+
+  p7_omx_GrowTo(oxf, om->M, 0, sq->n);
+  p7_omx_GrowTo(oxb, om->M, 0, sq->n);
+  p7_ForwardParser (sq->dsq, sq->n, om, oxf,      NULL);
+  p7_BackwardParser(sq->dsq, sq->n, om, oxf, oxb, NULL);
+
+  esl_stopwatch_Start(w);
+  status = p7_domaindef_ByPosteriorHeuristics(sq, NULL, om, oxf, oxb, fwd, bck, ddef, bg, FALSE, NULL, NULL, NULL);
+  esl_stopwatch_Stop(w);
+  *tot_time += w->user;
+  return status;
+}
+
+int 
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_RANDOMNESS *r1      = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_RANDOMNESS *r2      = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_TRACE       *tr      = p7_trace_Create();
+  ESL_SQ         *sq      = NULL;
+  P7_DOMAINDEF   *ddef1   = p7_domaindef_Create(r1);  /* fixed-size ensembles */
+  P7_DOMAINDEF   *ddef2   = p7_domaindef_Create(r2);  /* adaptive ensembles   */
+  P7_OMX         *oxf     = NULL;
+  P7_OMX         *oxb     = NULL;
+  P7_OMX         *fwd     = NULL;
+  P7_OMX         *bck     = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  int             mindom  = esl_opt_GetInteger(go, "--mindom");
+  int             nclustered = 0;
+  int64_t         nsampled1  = 0;
+  int64_t         nsampled2  = 0;
+  int             ndiff      = 0;
+  double          t1         = 0.;
+  double          t2         = 0.;
+  int             idx, d;
+
+  if (p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)            != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);                 p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);    p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);    p7_oprofile_Convert(gm, om);
+  sq = esl_sq_CreateDigital(abc);
+
+  oxf = p7_omx_Create(gm->M, 0, L);
+  oxb = p7_omx_Create(gm->M, 0, L);
+  fwd = p7_omx_Create(gm->M, L, L);
+  bck = p7_omx_Create(gm->M, L, L);
+
+  ddef2->nround = esl_opt_GetInteger(go, "-R");
+
+  for (idx = 0; idx < N; idx++)
+    {
+      do { p7_ProfileEmit(r, hmm, gm, bg, sq, tr); p7_trace_Index(tr); } while (tr->ndom < mindom);
+      esl_sq_FormatName(sq, "seq%d", idx);
+
+      p7_oprofile_ReconfigLength(om, sq->n);
+      p7_bg_SetLength(bg, sq->n);
+
+      if (define_domains(om, bg, sq, oxf, oxb, fwd, bck, ddef1, w, &t1) != eslOK) p7_Fail("domain definition failed");
+      if (define_domains(om, bg, sq, oxf, oxb, fwd, bck, ddef2, w, &t2) != eslOK) p7_Fail("domain definition failed");
+
+      nclustered += ddef1->nclustered;
+      nsampled1  += ddef1->nsampled;
+      nsampled2  += ddef2->nsampled;
+
+      if (ddef1->ndom == ddef2->ndom)
+	for (d = 0; d < ddef1->ndom; d++)
+	  if (ddef1->dcl[d].ienv != ddef2->dcl[d].ienv || ddef1->dcl[d].jenv != ddef2->dcl[d].jenv) break;
+      if (ddef1->ndom != ddef2->ndom || d < ddef1->ndom)
+	{
+	  ndiff++;
+	  if (esl_opt_GetBoolean(go, "-v"))
+	    printf("%-10s L=%-6" PRId64 " fixed: %d domains, %d traces   adaptive: %d domains, %d traces\n",
+		   sq->name, sq->n, ddef1->ndom, ddef1->nsampled, ddef2->ndom, ddef2->nsampled);
+	}
+
+      p7_domaindef_Reuse(ddef1);
+      p7_domaindef_Reuse(ddef2);
+      p7_oprofile_ReconfigLength(om, L);
+      p7_bg_SetLength(bg, L);
+    }
+
+  printf("# targets:                %d\n",   N);
+  printf("# regions clustered:      %d\n",   nclustered);
+  printf("# traces, fixed:          %" PRId64 "  (%.1f per region)\n", nsampled1, nclustered ? (double) nsampled1 / (double) nclustered : 0.);
+  printf("# traces, adaptive:       %" PRId64 "  (%.1f per region)\n", nsampled2, nclustered ? (double) nsampled2 / (double) nclustered : 0.);
+  printf("# domain def time, fixed:    %.2fu\n", t1);
+  printf("# domain def time, adaptive: %.2fu\n", t2);
+  printf("# targets w/ different domain calls: %d  (%.2f%%)\n", ndiff, 100. * (double) ndiff / (double) N);
+
+  p7_omx_Destroy(oxf);
+  p7_omx_Destroy(oxb);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(bck);
+  p7_domaindef_Destroy(ddef1);
+  p7_domaindef_Destroy(ddef2);
+  esl_sq_Destroy(sq);
+  p7_trace_Destroy(tr);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r2);
+  esl_randomness_Destroy(r1);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7DOMAINDEF_BENCHMARK*/
+
     
 /*****************************************************************
  * Example driver.
@@ -0,0 +1,1008 @@
+/* P7_EVTABLE: regression table for fast E-value calibration.
+ *
+ * Most of the time spent building a single-sequence query model
+ * (phmmer, jackhmmer round 1, hmmpgmd sequence searches) goes to the
+ * p7_Calibrate() simulations that fit the MSV and Viterbi Gumbel mu's
+ * and the Forward exponential tail tau. Lambda is calculated, not
+ * simulated, and is cheap.
+ *
+ * For a given background, score system and simulation lengths, the
+ * location parameters are well predicted by a linear function of
+ * log(M) and the model's mean match relative entropy H (bits), fit
+ * separately in a handful of model length bins. A P7_EVTABLE holds
+ * those fits. It is made by the <p7_evtable_stats> driver from full
+ * calibrations of a representative set of query sequences, saved in a
+ * small text file, and handed to a builder as <bld->evtable>.
+ * p7_Calibrate() then uses the table instead of simulating, whenever
+ * the model is within the range the table was fit on, and falls back
+ * to simulation otherwise.
+ *
+ * Contents:
+ *    1. P7_EVTABLE object: allocation, destruction.
+ *    2. Fitting a table; estimating parameters from it.
+ *    3. Reading/writing tables from files.
+ *    4. Stats driver: making a table; accuracy report.
+ *    5. Unit tests.
+ *    6. Test driver.
+ */
+#include "p7_config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_fileparser.h"
+#include "esl_scorematrix.h"
+#include "esl_vectorops.h"
+
+#include "hmmer.h"
+
+/* Model length bins. Bin b covers M = evtable_bounds[b]+1..evtable_bounds[b+1].
+ * Models longer than the last bound are always simulated.
+ */
+static const int evtable_bounds[] = { 0, 30, 60, 120, 250, 500, 1000, 2000, 5000 };
+static const int evtable_nbounds  = sizeof(evtable_bounds) / sizeof(int);
+
+#define p7_EVTABLE_MINFIT 20	/* a bin needs at least this many calibrated models to be fit */
+
+static int      fit_bin(int n, const double *x1, const double *x2, const double *y, double *c);
+static uint32_t scorematrix_checksum(const ESL_SCOREMATRIX *S);
+
+
+/*****************************************************************
+ * 1. P7_EVTABLE object: allocation, destruction.
+ *****************************************************************/
+
+/* Function:  p7_evtable_Create()
+ * Synopsis:  Create a new, empty <P7_EVTABLE>.
+ *
+ * Purpose:   Create an empty regression table for models in alphabet
+ *            type <abctype> (<eslAMINO>, for example), calibrated with
+ *            simulation lengths <EmL>, <EvL>, <EfL> and Forward tail
+ *            mass <Eft>. Bins are added by <p7_evtable_Fit()> or
+ *            <p7_evtable_Read()>.
+ *
+ *            The single-sequence score system and background the
+ *            table is fit for are unset; the caller records them
+ *            with <p7_evtable_SetScoreSystem()>. A table without
+ *            them is never <p7_evtable_Compatible()> with anything.
+ *
+ * Returns:   ptr to the new table.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_EVTABLE *
+p7_evtable_Create(int abctype, int EmL, int EvL, int EfL, double Eft)
+{
+  P7_EVTABLE *tbl = NULL;
+  int         status;
+
+  ESL_ALLOC(tbl, sizeof(P7_EVTABLE));
+  tbl->bin     = NULL;
+  tbl->nbins   = 0;
+  tbl->nalloc  = 8;
+  tbl->abctype = abctype;
+  tbl->EmL     = EmL;
+  tbl->EvL     = EvL;
+  tbl->EfL     = EfL;
+  tbl->Eft     = Eft;
+  tbl->mxsum   = 0;
+  tbl->popen   = -1.;
+  tbl->pextend = -1.;
+  tbl->f       = NULL;
+  tbl->K       = 0;
+
+  ESL_ALLOC(tbl->bin, sizeof(P7_EVBIN) * tbl->nalloc);
+  return tbl;
+
+ ERROR:
+  p7_evtable_Destroy(tbl);
+  return NULL;
+}
+
+/* Function:  p7_evtable_Destroy()
+ * Synopsis:  Free a <P7_EVTABLE>.
+ */
+void
+p7_evtable_Destroy(P7_EVTABLE *tbl)
+{
+  if (tbl == NULL) return;
+  if (tbl->bin != NULL) free(tbl->bin);
+  if (tbl->f   != NULL) free(tbl->f);
+  free(tbl);
+}
+
+/* add_bin()
+ * Append a new bin to <tbl>, reallocating if needed, and
+ * return a ptr to it in <ret_bin>.
+ */
+static int
+add_bin(P7_EVTABLE *tbl, P7_EVBIN **ret_bin)
+{
+  int status;
+
+  if (tbl->nbins == tbl->nalloc) {
+    ESL_REALLOC(tbl->bin, sizeof(P7_EVBIN) * tbl->nalloc * 2);
+    tbl->nalloc *= 2;
+  }
+  *ret_bin = &(tbl->bin[tbl->nbins++]);
+  return eslOK;
+
+ ERROR:
+  *ret_bin = NULL;
+  return status;
+}
+/*----------------- end, P7_EVTABLE object ----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Fitting a table; estimating parameters from it.
+ *****************************************************************/
+
+/* Function:  p7_evtable_Fit()
+ * Synopsis:  Fit a regression table to a set of full calibrations.
+ *
+ * Purpose:   Given <n> models that were calibrated by simulation, with
+ *            lengths <M[i]>, mean match relative entropies <H[i]>
+ *            (bits; see <p7_MeanMatchRelativeEntropy()>), and fitted
+ *            parameters <mmu[i]>, <vmu[i]>, <tau[i]>, fit each
+ *            parameter to $c_0 + c_1 \log M + c_2 H$ by least squares,
+ *            separately in each model length bin, and append the bins
+ *            to <tbl>.
+ *
+ *            Bins with fewer than 20 models, or in which H doesn't
+ *            vary enough to fit a slope, are left out; models in
+ *            them will be calibrated by simulation.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_evtable_Fit(P7_EVTABLE *tbl, int n, const int *M, const double *H, const double *mmu, const double *vmu, const double *tau)
+{
+  const double *ev[3] = { mmu, vmu, tau };
+  double       *x1    = NULL;
+  double       *x2    = NULL;
+  double       *y     = NULL;
+  P7_EVBIN     *bin   = NULL;
+  P7_EVBIN      tmp;
+  int           b, i, p, nb;
+  int           status;
+
+  ESL_ALLOC(x1, sizeof(double) * ESL_MAX(1, n));
+  ESL_ALLOC(x2, sizeof(double) * ESL_MAX(1, n));
+  ESL_ALLOC(y,  sizeof(double) * ESL_MAX(1, n));
+
+  for (b = 0; b < evtable_nbounds-1; b++)
+    {
+      tmp.Mmin = evtable_bounds[b] + 1;
+      tmp.Mmax = evtable_bounds[b+1];
+      tmp.Hmin = eslINFINITY;
+      tmp.Hmax = -eslINFINITY;
+
+      for (nb = 0, i = 0; i < n; i++)
+	if (M[i] >= tmp.Mmin && M[i] <= tmp.Mmax)
+	  {
+	    x1[nb] = log((double) M[i]);
+	    x2[nb] = H[i];
+	    tmp.Hmin = ESL_MIN(tmp.Hmin, H[i]);
+	    tmp.Hmax = ESL_MAX(tmp.Hmax, H[i]);
+	    nb++;
+	  }
+      if (nb < p7_EVTABLE_MINFIT) continue;
+      tmp.n = nb;
+
+      for (p = 0; p < 3; p++)
+	{
+	  for (nb = 0, i = 0; i < n; i++)
+	    if (M[i] >= tmp.Mmin && M[i] <= tmp.Mmax) y[nb++] = ev[p][i];
+	  if ((status = fit_bin(nb, x1, x2, y, tmp.c[p])) != eslOK) break;
+	}
+      if (status == eslENORESULT) continue;
+
+      if ((status = add_bin(tbl, &bin)) != eslOK) goto ERROR;
+      *bin = tmp;
+    }
+
+  free(x1);
+  free(x2);
+  free(y);
+  return eslOK;
+
+ ERROR:
+  if (x1) free(x1);
+  if (x2) free(x2);
+  if (y)  free(y);
+  return status;
+}
+
+
+/* Function:  p7_evtable_SetScoreSystem()
+ * Synopsis:  Record the score system a table is fit for.
+ *
+ * Purpose:   Record in table <tbl> the single-sequence score system of
+ *            builder <bld> (its substitution matrix, as a checksum of
+ *            its scores, and its gap open and extend probabilities)
+ *            and the background frequencies of <bg>. These determine
+ *            the query models, so a table fit under one score system
+ *            or background predicts the wrong parameters for another.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <bld> has no single-sequence score system.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+p7_evtable_SetScoreSystem(P7_EVTABLE *tbl, const P7_BUILDER *bld, const P7_BG *bg)
+{
+  int status;
+
+  if (bld->S == NULL) ESL_EXCEPTION(eslEINVAL, "builder has no single-sequence score system");
+
+  tbl->mxsum   = scorematrix_checksum(bld->S);
+  tbl->popen   = bld->popen;
+  tbl->pextend = bld->pextend;
+
+  ESL_REALLOC(tbl->f, sizeof(float) * bg->abc->K);
+  esl_vec_FCopy(bg->f, bg->abc->K, tbl->f);
+  tbl->K = bg->abc->K;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_evtable_Compatible()
+ * Synopsis:  Check that a table applies to a calibration's settings.
+ *
+ * Purpose:   Return <eslOK> if table <tbl> was fit with the same
+ *            calibration settings as builder <bld> will use with
+ *            null model <bg>: the same alphabet type; the same
+ *            simulation lengths <EmL>, <EvL>, <EfL> and tail mass
+ *            <Eft>; the same single-sequence score system (matrix,
+ *            gap open and extend probabilities); and the same
+ *            background frequencies. The number of simulated
+ *            sequences doesn't matter: it affects only the precision
+ *            of a simulated fit, not its expected value.
+ *
+ *            Otherwise return <eslFAIL>, and if <errbuf> is
+ *            non-<NULL>, put a user-directed message in it saying
+ *            what differs.
+ */
+int
+p7_evtable_Compatible(const P7_EVTABLE *tbl, const P7_BUILDER *bld, const P7_BG *bg, char *errbuf)
+{
+  if (errbuf) errbuf[0] = '\0';
+  if (tbl->abctype != bld->abc->type)                      ESL_FAIL(eslFAIL, errbuf, "table is for %s sequences", esl_abc_DecodeType(tbl->abctype));
+  if (tbl->EmL     != bld->EmL)                            ESL_FAIL(eslFAIL, errbuf, "table was fit with EmL %d, not %d", tbl->EmL, bld->EmL);
+  if (tbl->EvL     != bld->EvL)                            ESL_FAIL(eslFAIL, errbuf, "table was fit with EvL %d, not %d", tbl->EvL, bld->EvL);
+  if (tbl->EfL     != bld->EfL)                            ESL_FAIL(eslFAIL, errbuf, "table was fit with EfL %d, not %d", tbl->EfL, bld->EfL);
+  if (esl_DCompare(tbl->Eft, bld->Eft, 1e-6) != eslOK)     ESL_FAIL(eslFAIL, errbuf, "table was fit with Eft %g, not %g", tbl->Eft, bld->Eft);
+  if (tbl->f == NULL)                                      ESL_FAIL(eslFAIL, errbuf, "table doesn't record its score system and background");
+  if (bld->S == NULL)                                      ESL_FAIL(eslFAIL, errbuf, "table only applies to single-sequence query models");
+  if (tbl->mxsum != scorematrix_checksum(bld->S))          ESL_FAIL(eslFAIL, errbuf, "table was fit with a different substitution score matrix");
+  if (esl_DCompare(tbl->popen,   bld->popen,   1e-5) != eslOK) ESL_FAIL(eslFAIL, errbuf, "table was fit with gap open probability %g, not %g",   tbl->popen,   bld->popen);
+  if (esl_DCompare(tbl->pextend, bld->pextend, 1e-5) != eslOK) ESL_FAIL(eslFAIL, errbuf, "table was fit with gap extend probability %g, not %g", tbl->pextend, bld->pextend);
+  if (tbl->K != bg->abc->K || esl_vec_FCompare(tbl->f, bg->f, tbl->K, 1e-4) != eslOK)
+    ESL_FAIL(eslFAIL, errbuf, "table was fit with different background residue frequencies");
+  return eslOK;
+}
+
+
+/* Function:  p7_evtable_Estimate()
+ * Synopsis:  Predict E-value parameters from a regression table.
+ *
+ * Purpose:   Predict MSV Gumbel mu, Viterbi Gumbel mu, and Forward
+ *            tau for a model of length <M> and mean match relative
+ *            entropy <H> (bits), using table <tbl>, and return them
+ *            in <*ret_mmu>, <*ret_vmu>, <*ret_tau>.
+ *
+ *            The caller is responsible for checking with
+ *            <p7_evtable_Compatible()> that the table was fit with
+ *            the same calibration settings.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENORESULT> if <M> isn't in any of the table's bins,
+ *            or <H> is outside the range seen when fitting that bin;
+ *            caller should calibrate by simulation instead.
+ *            <*ret_mmu>, <*ret_vmu>, <*ret_tau> are 0.
+ */
+int
+p7_evtable_Estimate(const P7_EVTABLE *tbl, int M, double H, double *ret_mmu, double *ret_vmu, double *ret_tau)
+{
+  const P7_EVBIN *bin = NULL;
+  double          lM  = log((double) M);
+  int             b;
+
+  for (b = 0; b < tbl->nbins; b++)
+    if (M >= tbl->bin[b].Mmin && M <= tbl->bin[b].Mmax) { bin = &(tbl->bin[b]); break; }
+  if (bin == NULL || H < bin->Hmin || H > bin->Hmax)
+    { *ret_mmu = *ret_vmu = *ret_tau = 0.; return eslENORESULT; }
+
+  *ret_mmu = bin->c[0][0] + bin->c[0][1] * lM + bin->c[0][2] * H;
+  *ret_vmu = bin->c[1][0] + bin->c[1][1] * lM + bin->c[1][2] * H;
+  *ret_tau = bin->c[2][0] + bin->c[2][1] * lM + bin->c[2][2] * H;
+  return eslOK;
+}
+
+
+/* fit_bin()
+ * Least squares fit of y = c0 + c1 x1 + c2 x2 to <n> points,
+ * centered on the means for numerical stability. Sets
+ * c[0..2], and c[3] to the rms residual.
+ * Returns <eslENORESULT> if the 2x2 normal equations are singular
+ * (x1 or x2 constant, or the two collinear).
+ */
+static int
+fit_bin(int n, const double *x1, const double *x2, const double *y, double *c)
+{
+  double m1 = 0., m2 = 0., my = 0.;
+  double s11 = 0., s12 = 0., s22 = 0., s1y = 0., s2y = 0.;
+  double det, r, sse = 0.;
+  int    i;
+
+  for (i = 0; i < n; i++) { m1 += x1[i]; m2 += x2[i]; my += y[i]; }
+  m1 /= (double) n;  m2 /= (double) n;  my /= (double) n;
+
+  for (i = 0; i < n; i++)
+    {
+      s11 += (x1[i]-m1) * (x1[i]-m1);
+      s12 += (x1[i]-m1) * (x2[i]-m2);
+      s22 += (x2[i]-m2) * (x2[i]-m2);
+      s1y += (x1[i]-m1) * (y[i]-my);
+      s2y += (x2[i]-m2) * (y[i]-my);
+    }
+  det = s11*s22 - s12*s12;
+  if (det <= 1e-9 * s11 * s22 || s11 == 0. || s22 == 0.) return eslENORESULT;
+
+  c[1] = (s1y*s22 - s2y*s12) / det;
+  c[2] = (s2y*s11 - s1y*s12) / det;
+  c[0] = my - c[1]*m1 - c[2]*m2;
+
+  for (i = 0; i < n; i++)
+    {
+      r    = y[i] - (c[0] + c[1]*x1[i] + c[2]*x2[i]);
+      sse += r*r;
+    }
+  c[3] = (n > 3) ? sqrt(sse / (double) (n-3)) : 0.;
+  return eslOK;
+}
+
+/* scorematrix_checksum()
+ * Jenkins one-at-a-time hash of the canonical residue scores of
+ * <S>, so a table can tell whether it's being used with the matrix
+ * it was fit with, whatever name (or file) that matrix came from.
+ */
+static uint32_t
+scorematrix_checksum(const ESL_SCOREMATRIX *S)
+{
+  uint32_t val = 0;
+  int      a, b;
+
+  for (a = 0; a < S->K; a++)
+    for (b = 0; b < S->K; b++)
+      {
+	val += (uint32_t) S->s[a][b];
+	val += (val << 10);
+	val ^= (val >>  6);
+      }
+  val += (val <<  3);
+  val ^= (val >> 11);
+  val += (val << 15);
+  return val;
+}
+/*------------------ end, fitting and estimation ----------------*/
+
+
+
+/*****************************************************************
+ * 3. Reading/writing tables from files.
+ *****************************************************************/
+
+/* Function:  p7_evtable_Write()
+ * Synopsis:  Write a <P7_EVTABLE> to a stream in its save file format.
+ *
+ * Purpose:   Write table <tbl> to stream <fp>. The format is a
+ *            keyword per line: <alph>, <EmL>, <EvL>, <EfL>, <Eft>;
+ *            if the score system is set, <mxsum> (score matrix
+ *            checksum), <popen>, <pextend>, and <bgf> followed by the
+ *            K background frequencies;
+ *            then one <bin> line per model length bin giving Mmin,
+ *            Mmax, Hmin, Hmax, the number of models fit, and for
+ *            each of MSV mu, Viterbi mu, Forward tau in turn: the
+ *            intercept, log(M) slope, H slope, and rms residual.
+ *            Lines beginning with # are comments.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on any write error.
+ */
+int
+p7_evtable_Write(FILE *fp, const P7_EVTABLE *tbl)
+{
+  const P7_EVBIN *bin;
+  int             b, p;
+
+  if (fprintf(fp, "# HMMER %s E-value calibration regression table\n", HMMER_VERSION)         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+  if (fprintf(fp, "alph  %s\n",    esl_abc_DecodeType(tbl->abctype))                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+  if (fprintf(fp, "EmL   %d\nEvL   %d\nEfL   %d\nEft   %g\n", tbl->EmL, tbl->EvL, tbl->EfL, tbl->Eft) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+  if (tbl->f != NULL)
+    {
+      if (fprintf(fp, "mxsum %" PRIu32 "\npopen %g\npextend %g\nbgf  ", tbl->mxsum, tbl->popen, tbl->pextend)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+      for (b = 0; b < tbl->K; b++)
+	if (fprintf(fp, " %.6f", tbl->f[b])                                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+      if (fprintf(fp, "\n")                                                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+    }
+  if (fprintf(fp, "#    Mmin  Mmax     Hmin     Hmax      n | msv mu: c0 c1 c2 rms | vit mu: c0 c1 c2 rms | fwd tau: c0 c1 c2 rms\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+
+  for (b = 0; b < tbl->nbins; b++)
+    {
+      bin = &(tbl->bin[b]);
+      if (fprintf(fp, "bin  %5d %5d %8.6f %8.6f %6d", bin->Mmin, bin->Mmax, bin->Hmin, bin->Hmax, bin->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+      for (p = 0; p < 3; p++)
+	if (fprintf(fp, "  %9.6f %9.6f %9.6f %8.6f", bin->c[p][0], bin->c[p][1], bin->c[p][2], bin->c[p][3]) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+      if (fprintf(fp, "\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+    }
+  if (fprintf(fp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "evtable write failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_evtable_Read()
+ * Synopsis:  Read a <P7_EVTABLE> from a file.
+ *
+ * Purpose:   Read a regression table from file <tblfile>, in the
+ *            format written by <p7_evtable_Write()>, and return it
+ *            in <*ret_tbl>.
+ *
+ * Args:      tblfile - file to read
+ *            ret_tbl - RETURN: new table
+ *            errbuf  - OPTIONAL: space for an error message, upon parse errors; or NULL.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if <tblfile> can't be opened for reading.
+ *            <eslEFORMAT> if parsing fails. In both cases <errbuf>
+ *            contains a user-directed error message, and
+ *            <*ret_tbl> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_evtable_Read(const char *tblfile, P7_EVTABLE **ret_tbl, char *errbuf)
+{
+  ESL_FILEPARSER *efp     = NULL;
+  P7_EVTABLE     *tbl     = NULL;
+  P7_EVBIN       *bin     = NULL;
+  char           *tok;
+  char           *key;
+  int             toklen;
+  int             abctype = eslUNKNOWN;
+  int             EmL     = -1;
+  int             EvL     = -1;
+  int             EfL     = -1;
+  double          Eft     = -1.;
+  uint32_t        mxsum   = 0;
+  int             have_mxsum = FALSE;
+  double          popen   = -1.;
+  double          pextend = -1.;
+  float          *f       = NULL;
+  int             K       = 0;
+  double          v[17];
+  int             i;
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  status = esl_fileparser_Open(tblfile, NULL, &efp);
+  if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, errbuf, "couldn't open evtable file %s for reading", tblfile);
+  else if (status != eslOK)        goto ERROR;
+  esl_fileparser_SetCommentChar(efp, '#');
+
+  while ((status = esl_fileparser_NextLine(efp)) == eslOK)
+    {
+      if ((status = esl_fileparser_GetTokenOnLine(efp, &tok, &toklen)) != eslOK) goto ERROR;
+
+      if (strcmp(tok, "//") == 0) break;
+
+      if (strcmp(tok, "bin") == 0)
+	{
+	  if (tbl == NULL) {
+	    if (abctype == eslUNKNOWN || EmL < 0 || EvL < 0 || EfL < 0 || Eft < 0.)
+	      ESL_XFAIL(eslEFORMAT, errbuf, "alph, EmL, EvL, EfL, Eft must precede bin lines [line %d of evtable %s]", efp->linenumber, tblfile);
+	    if ((tbl = p7_evtable_Create(abctype, EmL, EvL, EfL, Eft)) == NULL) { status = eslEMEM; goto ERROR; }
+	    if (f != NULL) {
+	      if (! have_mxsum || popen < 0. || pextend < 0.)
+		ESL_XFAIL(eslEFORMAT, errbuf, "mxsum, popen, pextend, bgf must all be given, or none [line %d of evtable %s]", efp->linenumber, tblfile);
+	      tbl->mxsum   = mxsum;
+	      tbl->popen   = popen;
+	      tbl->pextend = pextend;
+	      tbl->f       = f;
+	      tbl->K       = K;
+	      f            = NULL;
+	    }
+	    else if (have_mxsum || popen >= 0. || pextend >= 0.)
+	      ESL_XFAIL(eslEFORMAT, errbuf, "mxsum, popen, pextend, bgf must all be given, or none [line %d of evtable %s]", efp->linenumber, tblfile);
+	  }
+	  for (i = 0; i < 17; i++)
+	    {
+	      status = esl_fileparser_GetTokenOnLine(efp, &tok, &toklen);
+	      if      (status == eslEOL)   ESL_XFAIL(eslEFORMAT, errbuf, "expected 17 fields on bin line [line %d of evtable %s]", efp->linenumber, tblfile);
+	      else if (status != eslOK)    goto ERROR;
+	      if (! esl_str_IsReal(tok))   ESL_XFAIL(eslEFORMAT, errbuf, "expected a number, saw %s [line %d of evtable %s]", tok, efp->linenumber, tblfile);
+	      v[i] = atof(tok);
+	    }
+	  if ((status = add_bin(tbl, &bin)) != eslOK) goto ERROR;
+	  bin->Mmin = (int) v[0];
+	  bin->Mmax = (int) v[1];
+	  bin->Hmin = v[2];
+	  bin->Hmax = v[3];
+	  bin->n    = (int) v[4];
+	  for (i = 0; i < 12; i++) bin->c[i/4][i%4] = v[5+i];
+	  if (bin->Mmin < 1 || bin->Mmax < bin->Mmin) ESL_XFAIL(eslEFORMAT, errbuf, "bad M range on bin line [line %d of evtable %s]", efp->linenumber, tblfile);
+	}
+      else if (strcmp(tok, "bgf") == 0)
+	{
+	  if (tbl != NULL) ESL_XFAIL(eslEFORMAT, errbuf, "bgf must precede bin lines [line %d of evtable %s]", efp->linenumber, tblfile);
+	  if (f   != NULL) ESL_XFAIL(eslEFORMAT, errbuf, "more than one bgf line [line %d of evtable %s]", efp->linenumber, tblfile);
+	  while ((status = esl_fileparser_GetTokenOnLine(efp, &tok, &toklen)) == eslOK)
+	    {
+	      if (! esl_str_IsReal(tok)) ESL_XFAIL(eslEFORMAT, errbuf, "expected a frequency on bgf line, saw %s [line %d of evtable %s]", tok, efp->linenumber, tblfile);
+	      ESL_REALLOC(f, sizeof(float) * (K+1));
+	      f[K++] = atof(tok);
+	    }
+	  if (status != eslEOL) goto ERROR;
+	  if (K == 0)           ESL_XFAIL(eslEFORMAT, errbuf, "no frequencies on bgf line [line %d of evtable %s]", efp->linenumber, tblfile);
+	}
+      else if (strcmp(tok, "alph") == 0 || strcmp(tok, "EmL") == 0 || strcmp(tok, "EvL") == 0 || strcmp(tok, "EfL") == 0 || strcmp(tok, "Eft") == 0 ||
+	       strcmp(tok, "mxsum") == 0 || strcmp(tok, "popen") == 0 || strcmp(tok, "pextend") == 0)
+	{
+	  key = tok;
+	  if (tbl != NULL) ESL_XFAIL(eslEFORMAT, errbuf, "%s must precede bin lines [line %d of evtable %s]", key, efp->linenumber, tblfile);
+	  status = esl_fileparser_GetTokenOnLine(efp, &tok, &toklen);
+	  if      (status == eslEOL) ESL_XFAIL(eslEFORMAT, errbuf, "expected a value for %s [line %d of evtable %s]", key, efp->linenumber, tblfile);
+	  else if (status != eslOK)  goto ERROR;
+
+	  if (strcmp(key, "alph") == 0) {
+	    if ((abctype = esl_abc_EncodeType(tok)) == eslUNKNOWN) ESL_XFAIL(eslEFORMAT, errbuf, "expected alphabet type but saw \"%s\" [line %d of evtable %s]", tok, efp->linenumber, tblfile);
+	  } else {
+	    if (! esl_str_IsReal(tok)) ESL_XFAIL(eslEFORMAT, errbuf, "expected a number for %s, saw %s [line %d of evtable %s]", key, tok, efp->linenumber, tblfile);
+	    if      (strcmp(key, "EmL")   == 0) EmL     = atoi(tok);
+	    else if (strcmp(key, "EvL")   == 0) EvL     = atoi(tok);
+	    else if (strcmp(key, "EfL")   == 0) EfL     = atoi(tok);
+	    else if (strcmp(key, "Eft")   == 0) Eft     = atof(tok);
+	    else if (strcmp(key, "mxsum") == 0) { mxsum = (uint32_t) strtoul(tok, NULL, 10); have_mxsum = TRUE; }
+	    else if (strcmp(key, "popen") == 0) popen   = atof(tok);
+	    else                                pextend = atof(tok);
+	  }
+	}
+      else ESL_XFAIL(eslEFORMAT, errbuf, "unrecognized keyword %s [line %d of evtable %s]", tok, efp->linenumber, tblfile);
+    }
+  if (status != eslOK && status != eslEOF) goto ERROR;
+  if (tbl == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "no bins found in evtable %s", tblfile);
+
+  esl_fileparser_Close(efp);
+  if (f) free(f);
+  *ret_tbl = tbl;
+  return eslOK;
+
+ ERROR:
+  if (efp) esl_fileparser_Close(efp);
+  if (f)   free(f);
+  p7_evtable_Destroy(tbl);
+  *ret_tbl = NULL;
+  return status;
+}
+/*------------------- end, reading/writing ----------------------*/
+
+
+
+/*****************************************************************
+ * 4. Stats driver: making a table; accuracy report.
+ *****************************************************************/
+#ifdef p7EVTABLE_STATS
+/* gcc -o p7_evtable_stats -g -O2 -msse2 -I. -L. -I../easel -L../easel -Dp7EVTABLE_STATS p7_evtable.c -lhmmer -leasel -lm
+ *
+ * To make a table, fully calibrate single-sequence models built
+ * from a representative set of queries (Pfam-A seed consensus
+ * sequences, say) and fit:
+ *    ./p7_evtable_stats --cpu 8 Pfam-A.seed.cons.fa > evtable
+ *
+ * To report how well a table does against full calibration, on
+ * a different set of queries:
+ *    ./p7_evtable_stats --report evtable Pfam-A.seed.cons.fa
+ *
+ * The report gives a line per query, then a summary. The E-value
+ * error is given as a fold change, exp(lambda * |delta|): in the
+ * tail, E-values computed with the estimated location parameter
+ * differ from those computed with the simulated one by that factor.
+ * Simulated fits themselves vary by about 1.1-1.3 fold run to run
+ * (J1/135), which is the most a table can be asked to do.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type        default  env  range   toggles reqs incomp  help                                              docgroup*/
+  { "-h",        eslARG_NONE,     FALSE, NULL, NULL,   NULL,  NULL, NULL, "show brief help on version and usage",                  0 },
+  { "--report",  eslARG_INFILE,    NULL, NULL, NULL,   NULL,  NULL, NULL, "compare table <f> to full calibration, don't fit one",  0 },
+  { "--mx",      eslARG_STRING,"BLOSUM62",NULL,NULL,   NULL,  NULL, "--mxfile", "substitution score matrix choice (of some built-in matrices)", 0 },
+  { "--mxfile",  eslARG_INFILE,    NULL, NULL, NULL,   NULL,  NULL, "--mx",     "read substitution score matrix from file <f>",          0 },
+  { "--popen",   eslARG_REAL,    "0.02", NULL,"0<=x<0.5",NULL,NULL, NULL, "gap open probability",                                  0 },
+  { "--pextend", eslARG_REAL,     "0.4", NULL, "0<=x<1",NULL, NULL, NULL, "gap extend probability",                                0 },
+  { "--EmL",     eslARG_INT,      "200", NULL,"n>0",   NULL,  NULL, NULL, "length of sequences for MSV Gumbel mu fit",             0 },
+  { "--EmN",     eslARG_INT,      "200", NULL,"n>0",   NULL,  NULL, NULL, "number of sequences for MSV Gumbel mu fit",             0 },
+  { "--EvL",     eslARG_INT,      "200", NULL,"n>0",   NULL,  NULL, NULL, "length of sequences for Viterbi Gumbel mu fit",         0 },
+  { "--EvN",     eslARG_INT,      "200", NULL,"n>0",   NULL,  NULL, NULL, "number of sequences for Viterbi Gumbel mu fit",         0 },
+  { "--EfL",     eslARG_INT,      "100", NULL,"n>0",   NULL,  NULL, NULL, "length of sequences for Forward exp tail tau fit",      0 },
+  { "--EfN",     eslARG_INT,      "200", NULL,"n>0",   NULL,  NULL, NULL, "number of sequences for Forward exp tail tau fit",      0 },
+  { "--Eft",     eslARG_REAL,    "0.04", NULL,"0<x<1", NULL,  NULL, NULL, "tail mass for Forward exponential tail tau fit",        0 },
+  { "--cpu",     eslARG_INT,        "0", NULL,"n>=0",  NULL,  NULL, NULL, "number of threads for each calibration",                0 },
+  { "--seed",    eslARG_INT,       "42", NULL,"n>=0",  NULL,  NULL, NULL, "set RNG seed to <n>",                                   0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqfile>";
+static char banner[] = "fit, or report accuracy of, an E-value calibration regression table";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *seqfile = esl_opt_GetArg(go, 1);
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  ESL_SQFILE     *sqfp    = NULL;
+  ESL_SQ         *sq      = esl_sq_CreateDigital(abc);
+  P7_BG          *bg      = p7_bg_Create(abc);
+  P7_BUILDER     *bld     = p7_builder_Create(NULL, abc);
+  P7_EVTABLE     *tbl     = NULL;
+  P7_HMM         *hmm     = NULL;
+  int            *M       = NULL;
+  double         *H       = NULL;
+  double         *ev[3]   = { NULL, NULL, NULL };
+  int             n       = 0;
+  int             nalloc  = 0;
+  double          est[3];
+  double          fold, lambda;
+  double          sumfold[3] = { 0., 0., 0. };
+  double          maxfold[3] = { 0., 0., 0. };
+  int             n2fold[3]  = { 0, 0, 0 };
+  int             nest    = 0;
+  int             p;
+  char            errbuf[eslERRBUFSIZE];
+  int             status;
+
+  esl_randomness_Init(bld->r, esl_opt_GetInteger(go, "--seed"));
+  bld->do_reseeding = TRUE;
+  bld->EmL  = esl_opt_GetInteger(go, "--EmL");
+  bld->EmN  = esl_opt_GetInteger(go, "--EmN");
+  bld->EvL  = esl_opt_GetInteger(go, "--EvL");
+  bld->EvN  = esl_opt_GetInteger(go, "--EvN");
+  bld->EfL  = esl_opt_GetInteger(go, "--EfL");
+  bld->EfN  = esl_opt_GetInteger(go, "--EfN");
+  bld->Eft  = esl_opt_GetReal   (go, "--Eft");
+  bld->ncpu = esl_opt_GetInteger(go, "--cpu");
+  if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
+  else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
+  if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+
+  if (esl_opt_IsOn(go, "--report"))
+    {
+      if (p7_evtable_Read(esl_opt_GetString(go, "--report"), &tbl, errbuf) != eslOK) p7_Fail("%s", errbuf);
+      if (p7_evtable_Compatible(tbl, bld, bg, errbuf) != eslOK)
+	p7_Fail("Table %s doesn't apply to these settings:\n%s\n", esl_opt_GetString(go, "--report"), errbuf);
+      printf("# %-28s %6s %6s %9s %9s %9s\n", "query", "M", "H", "msv fold", "vit fold", "fwd fold");
+    }
+
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) p7_Fail("Failed to open sequence file %s", seqfile);
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+    {
+      if (sq->n == 0) { esl_sq_Reuse(sq); continue; }
+      /* p7_SingleBuilder() calibrates by simulation: bld->evtable is NULL */
+      if (p7_SingleBuilder(bld, sq, bg, &hmm, NULL, NULL, NULL) != eslOK) p7_Fail("build failed: %s", bld->errbuf);
+
+      if (n == nalloc) {
+	nalloc = (nalloc == 0) ? 1024 : nalloc * 2;
+	ESL_REALLOC(M, sizeof(int) * nalloc);
+	ESL_REALLOC(H, sizeof(double) * nalloc);
+	for (p = 0; p < 3; p++) ESL_REALLOC(ev[p], sizeof(double) * nalloc);
+      }
+      M[n]     = hmm->M;
+      H[n]     = p7_MeanMatchRelativeEntropy(hmm, bg);
+      ev[0][n] = hmm->evparam[p7_MMU];
+      ev[1][n] = hmm->evparam[p7_VMU];
+      ev[2][n] = hmm->evparam[p7_FTAU];
+      lambda   = hmm->evparam[p7_MLAMBDA];
+
+      if (tbl != NULL)
+	{
+	  if (p7_evtable_Estimate(tbl, M[n], H[n], &est[0], &est[1], &est[2]) == eslOK)
+	    {
+	      printf("%-30s %6d %6.3f", sq->name, M[n], H[n]);
+	      for (p = 0; p < 3; p++)
+		{
+		  fold        = exp(lambda * fabs(est[p] - ev[p][n]));
+		  sumfold[p] += fold;
+		  maxfold[p]  = ESL_MAX(maxfold[p], fold);
+		  if (fold <= 2.0) n2fold[p]++;
+		  printf(" %9.3f", fold);
+		}
+	      printf("\n");
+	      nest++;
+	    }
+	  else printf("%-30s %6d %6.3f %9s %9s %9s\n", sq->name, M[n], H[n], "-", "-", "-");
+	}
+
+      n++;
+      p7_hmm_Destroy(hmm);
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     p7_Fail("Unexpected error %d reading sequence file %s", status, sqfp->filename);
+
+  if (tbl == NULL)
+    {
+      if ((tbl = p7_evtable_Create(abc->type, bld->EmL, bld->EvL, bld->EfL, bld->Eft)) == NULL) p7_Fail("allocation failed");
+      if (p7_evtable_SetScoreSystem(tbl, bld, bg)            != eslOK) p7_Fail("failed to record score system");
+      if (p7_evtable_Fit(tbl, n, M, H, ev[0], ev[1], ev[2]) != eslOK) p7_Fail("fit failed");
+      p7_evtable_Write(stdout, tbl);
+    }
+  else
+    {
+      printf("#\n# %d of %d queries estimated from table; %d fall back to simulation\n", nest, n, n-nest);
+      if (nest > 0)
+	{
+	  printf("# %-12s %10s %10s %10s\n", "",             "msv mu",               "vit mu",               "fwd tau");
+	  printf("# %-12s %10.3f %10.3f %10.3f\n", "mean fold", sumfold[0]/nest,     sumfold[1]/nest,     sumfold[2]/nest);
+	  printf("# %-12s %10.3f %10.3f %10.3f\n", "max fold",  maxfold[0],          maxfold[1],          maxfold[2]);
+	  printf("# %-12s %10.4f %10.4f %10.4f\n", "<= 2 fold", (double) n2fold[0]/nest, (double) n2fold[1]/nest, (double) n2fold[2]/nest);
+	}
+    }
+
+  for (p = 0; p < 3; p++) free(ev[p]);
+  free(M);
+  free(H);
+  p7_evtable_Destroy(tbl);
+  esl_sqfile_Close(sqfp);
+  esl_sq_Destroy(sq);
+  p7_builder_Destroy(bld);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ ERROR:
+  p7_Fail("allocation failed");
+  return status;
+}
+#endif /*p7EVTABLE_STATS*/
+/*------------------- end, stats driver -------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Unit tests.
+ *****************************************************************/
+#ifdef p7EVTABLE_TESTDRIVE
+#include "esl_random.h"
+
+/* Synthetic calibrations that lie exactly on known planes, with
+ * M spread over the first few bins; the fit must recover the
+ * coefficients, estimates must hit the planes, and models outside
+ * the fitted ranges must get eslENORESULT.
+ */
+static void
+utest_FitEstimate(ESL_RANDOMNESS *rng, int n)
+{
+  char        msg[]   = "evtable fit/estimate unit test failed";
+  double      c[3][3] = { { -2.0, 1.1, -0.5 }, { -3.0, 1.3, -0.7 }, { -5.0, 0.9, -0.2 } };
+  P7_EVTABLE *tbl     = NULL;
+  int        *M       = malloc(sizeof(int)    * n);
+  double     *H       = malloc(sizeof(double) * n);
+  double     *ev[3];
+  double      est[3];
+  int         i, p;
+
+  for (p = 0; p < 3; p++) ev[p] = malloc(sizeof(double) * n);
+  for (i = 0; i < n; i++)
+    {
+      M[i] = 1 + esl_rnd_Roll(rng, 250);
+      H[i] = 0.5 + esl_random(rng);
+      for (p = 0; p < 3; p++) ev[p][i] = c[p][0] + c[p][1] * log((double) M[i]) + c[p][2] * H[i];
+    }
+
+  if ((tbl = p7_evtable_Create(eslAMINO, 200, 200, 100, 0.04))  == NULL)  esl_fatal(msg);
+  if (p7_evtable_Fit(tbl, n, M, H, ev[0], ev[1], ev[2])          != eslOK) esl_fatal(msg);
+  if (tbl->nbins == 0)                                                     esl_fatal(msg);
+
+  for (i = 0; i < tbl->nbins; i++)
+    for (p = 0; p < 3; p++)
+      {
+	if (esl_DCompare(tbl->bin[i].c[p][0], c[p][0], 1e-4) != eslOK) esl_fatal(msg);
+	if (esl_DCompare(tbl->bin[i].c[p][1], c[p][1], 1e-4) != eslOK) esl_fatal(msg);
+	if (esl_DCompare(tbl->bin[i].c[p][2], c[p][2], 1e-4) != eslOK) esl_fatal(msg);
+      }
+
+  if (p7_evtable_Estimate(tbl, 100, 1.0, &est[0], &est[1], &est[2]) != eslOK) esl_fatal(msg);
+  for (p = 0; p < 3; p++)
+    if (esl_DCompare(est[p], c[p][0] + c[p][1] * log(100.) + c[p][2], 1e-4) != eslOK) esl_fatal(msg);
+
+  if (p7_evtable_Estimate(tbl, 100,  3.0, &est[0], &est[1], &est[2]) != eslENORESULT) esl_fatal(msg);
+  if (p7_evtable_Estimate(tbl, 4000, 1.0, &est[0], &est[1], &est[2]) != eslENORESULT) esl_fatal(msg);
+
+  for (p = 0; p < 3; p++) free(ev[p]);
+  free(M);
+  free(H);
+  p7_evtable_Destroy(tbl);
+}
+
+/* Write a table, read it back, and check that estimates agree. */
+static void
+utest_ReadWrite(ESL_RANDOMNESS *rng, int n)
+{
+  char        msg[]       = "evtable Read/Write unit test failed";
+  char        tmpfile[32] = "esltmpXXXXXX";
+  FILE       *fp          = NULL;
+  P7_EVTABLE *tbl1        = NULL;
+  P7_EVTABLE *tbl2        = NULL;
+  ESL_ALPHABET *abc       = NULL;
+  P7_BG      *bg          = NULL;
+  P7_BUILDER *bld         = NULL;
+  int        *M           = malloc(sizeof(int)    * n);
+  double     *H           = malloc(sizeof(double) * n);
+  double     *ev[3];
+  double      est1[3], est2[3];
+  int         i, p;
+
+  for (p = 0; p < 3; p++) ev[p] = malloc(sizeof(double) * n);
+  for (i = 0; i < n; i++)
+    {
+      M[i] = 1 + esl_rnd_Roll(rng, 1000);
+      H[i] = 0.5 + esl_random(rng);
+      for (p = 0; p < 3; p++) ev[p][i] = -2.0 + log((double) M[i]) - H[i] + 0.1 * esl_random(rng);
+    }
+  if ((tbl1 = p7_evtable_Create(eslAMINO, 200, 200, 100, 0.04)) == NULL)  esl_fatal(msg);
+  if (p7_evtable_Fit(tbl1, n, M, H, ev[0], ev[1], ev[2])         != eslOK) esl_fatal(msg);
+  if ((abc  = esl_alphabet_Create(eslAMINO))                     == NULL)  esl_fatal(msg);
+  if ((bg   = p7_bg_Create(abc))                                 == NULL)  esl_fatal(msg);
+  if ((bld  = p7_builder_Create(NULL, abc))                      == NULL)  esl_fatal(msg);
+  if (p7_builder_LoadScoreSystem(bld, "BLOSUM62", 0.02, 0.4, bg) != eslOK) esl_fatal(msg);
+  if (p7_evtable_SetScoreSystem(tbl1, bld, bg)                   != eslOK) esl_fatal(msg);
+
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+  if (p7_evtable_Write(fp, tbl1)      != eslOK) esl_fatal(msg);
+  fclose(fp);
+
+  if (p7_evtable_Read(tmpfile, &tbl2, NULL) != eslOK)           esl_fatal(msg);
+  if (tbl2->nbins != tbl1->nbins || tbl2->abctype != eslAMINO)  esl_fatal(msg);
+  if (tbl2->mxsum != tbl1->mxsum)                                esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl2, bld, bg, NULL)      != eslOK)  esl_fatal(msg);
+
+  for (i = 0; i < n; i++)
+    {
+      if (p7_evtable_Estimate(tbl1, M[i], H[i], &est1[0], &est1[1], &est1[2]) != eslOK) continue;
+      if (p7_evtable_Estimate(tbl2, M[i], H[i], &est2[0], &est2[1], &est2[2]) != eslOK) esl_fatal(msg);
+      for (p = 0; p < 3; p++)
+	if (esl_DCompare(est1[p], est2[p], 1e-3) != eslOK) esl_fatal(msg);
+    }
+
+  for (p = 0; p < 3; p++) free(ev[p]);
+  free(M);
+  free(H);
+  p7_evtable_Destroy(tbl1);
+  p7_evtable_Destroy(tbl2);
+  p7_builder_Destroy(bld);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  remove(tmpfile);
+}
+
+/* A table must refuse to apply to anything but the calibration
+ * settings, score system and background it was fit with.
+ */
+static void
+utest_Compatible(void)
+{
+  char          msg[]  = "evtable Compatible unit test failed";
+  ESL_ALPHABET *abc    = esl_alphabet_Create(eslAMINO);
+  ESL_ALPHABET *nabc   = esl_alphabet_Create(eslDNA);
+  P7_BG        *bg     = p7_bg_Create(abc);
+  P7_BG        *nbg    = p7_bg_Create(nabc);
+  P7_BUILDER   *bld    = p7_builder_Create(NULL, abc);
+  P7_BUILDER   *nbld   = p7_builder_Create(NULL, nabc);
+  P7_EVTABLE   *tbl    = NULL;
+  char          errbuf[eslERRBUFSIZE];
+
+  if (p7_builder_LoadScoreSystem(bld,  "BLOSUM62", 0.02, 0.4,  bg)  != eslOK) esl_fatal(msg);
+  if (p7_builder_LoadScoreSystem(nbld, "DNA1",     0.03, 0.75, nbg) != eslOK) esl_fatal(msg);
+  if ((tbl = p7_evtable_Create(eslAMINO, bld->EmL, bld->EvL, bld->EfL, bld->Eft)) == NULL) esl_fatal(msg);
+
+  /* no score system recorded: never compatible */
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)  != eslFAIL) esl_fatal(msg);
+  if (p7_evtable_SetScoreSystem(tbl, bld, bg)      != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)  != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, nbld, nbg, NULL)  != eslFAIL) esl_fatal(msg);
+
+  bld->EmL = 400;
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)  != eslFAIL) esl_fatal(msg);
+  bld->EmL = tbl->EmL;
+
+  if (p7_builder_LoadScoreSystem(bld, "BLOSUM62", 0.03, 0.4, bg) != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)                != eslFAIL) esl_fatal(msg);
+  if (p7_builder_LoadScoreSystem(bld, "BLOSUM62", 0.02, 0.5, bg) != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)                != eslFAIL) esl_fatal(msg);
+  if (p7_builder_LoadScoreSystem(bld, "BLOSUM45", 0.02, 0.4, bg) != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)                != eslFAIL) esl_fatal(msg);
+  if (p7_builder_LoadScoreSystem(bld, "BLOSUM62", 0.02, 0.4, bg) != eslOK)   esl_fatal(msg);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)                != eslOK)   esl_fatal(msg);
+
+  esl_vec_FSet(bg->f, abc->K, 1.0 / (float) abc->K);
+  if (p7_evtable_Compatible(tbl, bld, bg, errbuf)                != eslFAIL) esl_fatal(msg);
+
+  p7_evtable_Destroy(tbl);
+  p7_builder_Destroy(bld);
+  p7_builder_Destroy(nbld);
+  p7_bg_Destroy(bg);
+  p7_bg_Destroy(nbg);
+  esl_alphabet_Destroy(abc);
+  esl_alphabet_Destroy(nabc);
+}
+#endif /*p7EVTABLE_TESTDRIVE*/
+
+
+/*****************************************************************
+ * 6. Test driver.
+ *****************************************************************/
+#ifdef p7EVTABLE_TESTDRIVE
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
+  {"-v",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show verbose commentary/output",                 0},
+  {"-N",  eslARG_INT,    "1000", NULL, NULL, NULL, NULL, NULL, "number of synthetic calibrations to fit",        0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for p7_evtable";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go          = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng         = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N           = esl_opt_GetInteger(go, "-N");
+  int             be_verbose  = esl_opt_GetBoolean(go, "-v");
+
+  if (be_verbose) printf("p7_evtable unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_FitEstimate(rng, N);
+  utest_ReadWrite  (rng, N);
+  utest_Compatible ();
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /* p7EVTABLE_TESTDRIVE */
@@ -65,6 +65,7 @@ extern P7_HIT *p7_hit_Create_empty(){
   the_hit->subseq_start = 0;
   the_hit->dcl = NULL;
   the_hit->offset = 0;
+  the_hit->in_arena = FALSE;
 
   return the_hit;
 ERROR:
@@ -390,6 +391,7 @@ extern int p7_hit_Deserialize(const uint8_t *buf, uint32_t *n, P7_HIT *ret_obj){
   }   
 
   ptr = (uint8_t *) buf + *n;
+  ret_obj->in_arena = FALSE; // deserialized strings and domains are malloc()'ed, never in a P7_TOPHITS arena
   
   //First field: Size of the serialized object.  Copy out of buffer into scalar variable to deal with memory alignment, convert to 
   // host machine order
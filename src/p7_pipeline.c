@@ -84,6 +84,8 @@ typedef struct {
  *            | --F3         |  Stage 2 (Fwd) thresh: promote hits P <= F3 |    1e-5   |
  *            | --nobias     |  turn OFF composition bias filter HMM       |   FALSE   |
  *            | --nonull2    |  turn OFF biased comp score correction      |   FALSE   |
+ *            | --adaptens   |  adaptive stochastic trace ensemble size    |   FALSE   |
+ *            | --domcpu     |  threads for domain def'n of long targets   |       0   |
  *            | --seed       |  RNG seed (0=use arbitrary seed)            |      42   |
  *            | --acc        |  prefer accessions over names in output     |   FALSE   |
  *
@@ -229,7 +231,14 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
     }
   if (go && esl_opt_GetBoolean(go, "--nonull2")) pli->do_null2      = FALSE;
   if (go && esl_opt_GetBoolean(go, "--nobias"))  pli->do_biasfilter = FALSE;
+
+  /* Adaptive stochastic traceback ensembles, in rounds of 50 traces (up to ddef->nsamples) */
+  if (go && esl_opt_GetBoolean(go, "--adaptens")) pli->ddef->nround = 50;
+
+  /* Parallel domain definition of long targets; not for nhmmer's long_targets mode (and needs threads) */
+  if (go && ! long_targets) pli->ddef->ncpu = esl_opt_GetInteger(go, "--domcpu");
   
+  pli->msvsc         = eslINFINITY;
 
   /* Accounting as we collect results */
   pli->nmodels         = 0;
@@ -240,6 +249,8 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->n_past_bias     = 0;
   pli->n_past_vit      = 0;
   pli->n_past_fwd      = 0;
+  pli->n_clustered     = 0;
+  pli->n_sampled       = 0;
   pli->pos_past_msv    = 0;
   pli->pos_past_bias   = 0;
   pli->pos_past_vit    = 0;
@@ -619,6 +630,8 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   p1->n_past_vit  += p2->n_past_vit;
   p1->n_past_fwd  += p2->n_past_fwd;
   p1->n_output    += p2->n_output;
+  p1->n_clustered += p2->n_clustered;
+  p1->n_sampled   += p2->n_sampled;
 
   p1->pos_past_msv  += p2->pos_past_msv;
   p1->pos_past_bias += p2->pos_past_bias;
@@ -693,6 +706,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   int              d;
   int              status;
   
+  pli->msvsc = eslINFINITY;
   if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
   if (sq->n > 100000) ESL_EXCEPTION(eslETYPE, "Target sequence length > 100K, over comparison pipeline limit.\n(Did you mean to use nhmmer/nhmmscan?)");
 
@@ -701,8 +715,11 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   /* Base null model score (we could calculate this in NewSeq(), for a scan pipeline) */
   p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
 
-  /* First level filter: the MSV filter, multihit with <om> */
+  /* First level filter: the MSV filter, multihit with <om>.
+   * The score is kept in <pli>, for callers that cache it between searches.
+   */
   p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+  pli->msvsc = usc;
   seq_score = (usc - nullsc) / eslCONST_LOG2;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
   if (P > pli->F1) return eslOK;
@@ -749,8 +766,15 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
   p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
 
+  /* Domains' alignment displays are built in the hit list's arena; if the target isn't reported, they're rewound away */
+  pli->ddef->arena = hitlist->arena;
+  p7_hitarena_Mark(hitlist->arena);
+
   status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
+  pli->n_clustered += pli->ddef->nclustered;
+  pli->n_sampled   += pli->ddef->nsampled;
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
+  if (pli->ddef->ndom       == 0) p7_hitarena_Rewind(hitlist->arena); /* nothing to report; drop any half-built alidisplays */
   if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
   if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
   if (pli->ddef->ndom       == 0) return eslOK; /* even rarer: envelope found, no domain identified {iss131}         */
@@ -822,13 +846,9 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
     {
       p7_tophits_CreateNextHit(hitlist, &hit);
       if (pli->mode == p7_SEARCH_SEQS) {
-        if (                       (status  = esl_strdup(sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->acc[0]  != '\0' && (status  = esl_strdup(sq->acc,  -1, &(hit->acc)))   != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->desc[0] != '\0' && (status  = esl_strdup(sq->desc, -1, &(hit->desc)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if ((status = p7_tophits_CopyHitNames(hitlist, hit, sq->name, (sq->acc[0] != '\0' ? sq->acc : NULL), (sq->desc[0] != '\0' ? sq->desc : NULL))) != eslOK) return status;
       } else {
-        if ((status  = esl_strdup(om->name, -1, &(hit->name)))  != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
+        if ((status = p7_tophits_CopyHitNames(hitlist, hit, om->name, om->acc, om->desc)) != eslOK) esl_fatal("allocation failure");
       } 
       hit->ndom       = pli->ddef->ndom;
       hit->nexpected  = pli->ddef->nexpected;
@@ -847,16 +867,17 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
       hit->sum_score  = sum_score; /* BITS */
       hit->sum_lnP    = esl_exp_logsurv (hit->sum_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
 
-      /* Transfer all domain coordinates (unthresholded for
-       * now) with their alignment displays to the hit list,
-       * associated with the sequence. Domain reporting will
+      /* Copy all domain coordinates (unthresholded for
+       * now) to the hit list's arena, associated with the
+       * sequence; the hit takes over their alignment displays,
+       * which are already there. Domain reporting will
        * be thresholded after complete hit list is collected,
        * because we probably need to know # of significant
        * hits found to set domZ, and thence threshold and
-       * count reported domains.
+       * count reported domains. <ddef> keeps its own list,
+       * and reuses it for the next target.
        */
-      hit->dcl         = pli->ddef->dcl;
-      pli->ddef->dcl   = NULL;
+      if ((status = p7_tophits_CopyHitDomains(hitlist, hit, pli->ddef->dcl, pli->ddef->ndom)) != eslOK) return status;
       hit->best_domain = 0;
       for (d = 0; d < hit->ndom; d++)
       {
@@ -914,6 +935,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
       }
 	  
     }
+  else p7_hitarena_Rewind(hitlist->arena); /* not reported: drop its domains' alidisplays */
 
   return eslOK;
 }
@@ -1063,6 +1085,9 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   int              status;
 //  int              nres;
   ESL_DSQ          *dsq_holder;
+  int              nclustered0 = pli->ddef->nclustered; /* <ddef> isn't reused between windows; */
+  int              nsampled0   = pli->ddef->nsampled;   /* count only this window's sampling    */
+  int              nhits0;                                /* hits in <hitlist> before this window */
 
   int env_len;
   int ali_len;
@@ -1111,11 +1136,18 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   p7_omx_GrowTo(pli->oxb, om->M, 0, window_len);
   p7_BackwardParser(subseq, window_len, om, pli->oxf, pli->oxb, NULL);
 
+  /* As in p7_Pipeline(), alignment displays are built in the hit list's arena */
+  pli->ddef->arena = hitlist->arena;
+  p7_hitarena_Mark(hitlist->arena);
+  nhits0 = hitlist->N;
+
   //if we're asked to not do null correction, pass a NULL instead of a temp scores variable - domaindef knows what to do
   status = p7_domaindef_ByPosteriorHeuristics(pli_tmp->tmpseq, NULL, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, TRUE,
                                               pli_tmp->bg, (pli->do_null2?pli_tmp->scores:NULL), pli_tmp->fwd_emissions_arr);
 
   pli_tmp->tmpseq->dsq = dsq_holder;
+  pli->n_clustered += pli->ddef->nclustered - nclustered0;
+  pli->n_sampled   += pli->ddef->nsampled   - nsampled0;
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen */
   if (pli->ddef->nregions   == 0)  return eslOK; /* score passed threshold but there's no discrete domains here       */
   if (pli->ddef->nenvelopes == 0)  return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
@@ -1145,7 +1177,8 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
 
 
       if (ali_len < 8) {
-        p7_alidisplay_Destroy(dom->ad);
+        if (! pli->ddef->ad_in_arena) p7_alidisplay_Destroy(dom->ad);
+        dom->ad = NULL;
         continue; // anything less than this is a funny byproduct of the Forward score passing a very low threshold, but no reliable alignment existing that supports it
       }
 
@@ -1187,8 +1220,10 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
       hit->seqidx = seqidx;
       hit->subseq_start = seq_start;
 
-      ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) );
-      hit->dcl[0] = pli->ddef->dcl[d];
+      if ((status = p7_tophits_CopyHitDomains(hitlist, hit, dom, 1)) != eslOK) goto ERROR;
+      if (! pli->ddef->ad_in_arena) p7_alidisplay_Destroy(dom->ad);
+      dom->ad             = NULL;  /* the hit has it (or its own copy) now */
+      free(dom->scores_per_pos);       dom->scores_per_pos = NULL;
 
       hit->dcl[0].ad->L = seq_len;
 
@@ -1219,13 +1254,9 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
 
       if (pli->mode == p7_SEARCH_SEQS)
       {
-        if (                       (status  = esl_strdup(seq_name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (seq_acc[0]  != '\0' && (status  = esl_strdup(seq_acc,  -1, &(hit->acc)))   != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (seq_desc[0] != '\0' && (status  = esl_strdup(seq_desc, -1, &(hit->desc)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if ((status = p7_tophits_CopyHitNames(hitlist, hit, seq_name, (seq_acc[0] != '\0' ? seq_acc : NULL), (seq_desc[0] != '\0' ? seq_desc : NULL))) != eslOK) goto ERROR;
       } else {
-        if ((status  = esl_strdup(om->name, -1, &(hit->name)))  != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
+        if ((status = p7_tophits_CopyHitNames(hitlist, hit, om->name, om->acc, om->desc)) != eslOK) esl_fatal("allocation failure");
       }
 
 
@@ -1252,6 +1283,7 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
       }
 
   }
+  if (hitlist->N == nhits0) p7_hitarena_Rewind(hitlist->arena); /* no hits: drop the domains' alidisplays */
 
   return eslOK;
 
@@ -1774,6 +1806,12 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
       fprintf(ofp, "Domain search space  (domZ): %15.0f  %s\n", pli->domZ, pli->domZ_setby == p7_ZSETBY_OPTION ? "[as set by --domZ on cmdline]" : "[number of targets reported over threshold]");
   }
 
+  if (pli->ddef->nround > 0 && pli->n_clustered > 0)
+    fprintf(ofp, "Stochastic traces sampled:   %15" PRId64 "  (%.1f per clustered region, of %d max)\n",
+	    pli->n_sampled,
+	    (double) pli->n_sampled / (double) pli->n_clustered,
+	    pli->ddef->nsamples);
+
   if (w != NULL) {
     esl_stopwatch_Display(ofp, w, "# CPU time: ");
     fprintf(ofp, "# Mc/sec: %.2f\n", 
@@ -1820,6 +1858,8 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--adaptens",   eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "sample trace ensembles adaptively, stopping on convergence",   0 },
+  { "--domcpu",     eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL,  NULL,                          "threads for domain definition of long targets",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -1959,6 +1999,8 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--adaptens",   eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "sample trace ensembles adaptively, stopping on convergence",   0 },
+  { "--domcpu",     eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL,  NULL,                          "threads for domain definition of long targets",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
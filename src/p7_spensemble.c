@@ -5,7 +5,6 @@
  */
 #include "p7_config.h"
 #include "easel.h"
-#include "esl_cluster.h"
 #include "esl_vectorops.h"
 #include "hmmer.h"
 
@@ -170,7 +169,7 @@ p7_spensemble_Add(P7_SPENSEMBLE *sp, int sampleidx, int i, int j, int k, int m)
 
 /* struct p7_linkparam_s:
  * used just within this .c, as part of setting up the clustering problem in
- * the form that Easel's general SLC algorithm will take it. 
+ * the form that Easel's general SLC algorithm would take it. 
  */
 struct p7_linkparam_s {
   float min_overlap;	/* 0.8 means >= 80% overlap of (smaller/larger) segment is required, both in seq and hmm               */
@@ -185,7 +184,7 @@ struct p7_linkparam_s {
  * 
  * Defines the rule used for single linkage clustering of sampled
  * domain coordinates. (API is dictated by Easel's general single
- * linkage clustering routine.)
+ * linkage clustering routine, which the unit tests use as a reference.)
  */
 static int
 link_spsamples(const void *v1, const void *v2, const void *prm, int *ret_link)
@@ -219,7 +218,9 @@ link_spsamples(const void *v1, const void *v2, const void *prm, int *ret_link)
 /* cluster_orderer()
  * is the routine that gets passed to qsort() to sort
  * the significant clusters by order of occurrence on
- * the target sequence
+ * the target sequence. Ties on <i> are broken by the other
+ * coords, so the order doesn't depend on how clusters
+ * happened to be numbered.
  */
 static int
 cluster_orderer(const void *v1, const void *v2)
@@ -229,9 +230,125 @@ cluster_orderer(const void *v1, const void *v2)
 
   if      (h1->i < h2->i) return -1;
   else if (h1->i > h2->i) return 1;
+  else if (h1->j < h2->j) return -1;
+  else if (h1->j > h2->j) return 1;
+  else if (h1->k < h2->k) return -1;
+  else if (h1->k > h2->k) return 1;
+  else if (h1->m < h2->m) return -1;
+  else if (h1->m > h2->m) return 1;
   else                    return 0;
 }
 
+/* seqstart_orderer()
+ * is the qsort() routine that sorts seg pairs by start
+ * position <i> on the target sequence, for the sweep in
+ * cluster_spsamples().
+ */
+static int
+seqstart_orderer(const void *v1, const void *v2)
+{
+  struct p7_spcoord_s   *h1    = (struct p7_spcoord_s *)   v1;
+  struct p7_spcoord_s   *h2    = (struct p7_spcoord_s *)   v2;
+
+  if      (h1->i < h2->i) return -1;
+  else if (h1->i > h2->i) return 1;
+  else                    return 0;
+}
+
+/* find_root()
+ * returns the root of seg pair <h>'s tree in the union-find
+ * forest <parent>, halving the path as it goes.
+ */
+static int
+find_root(int *parent, int h)
+{
+  while (parent[h] != h) {
+    parent[h] = parent[parent[h]];
+    h         = parent[h];
+  }
+  return h;
+}
+
+/* cluster_spsamples()
+ * 
+ * Single linkage clustering of the seg pairs in <sp>, under the
+ * linkage rule of link_spsamples(). Gives the same partition as
+ * Easel's general <esl_cluster_SingleLinkage()>, but without
+ * testing all n^2 pairs. 
+ * 
+ * When <min_overlap> is > 0, two linked seg pairs have to overlap on
+ * the target sequence. So we sort a copy of the seg pairs by start
+ * position <i>, and sweep: each seg pair only needs to be tested
+ * against the ones that start after it does but before it ends. In
+ * a sampled ensemble, that's the other samples of the same domain,
+ * rather than every segment in the target. Linked pairs are merged
+ * in a union-find forest in <sp->workspace> (first n), and clusters
+ * are then numbered 0..nc-1 in order of their first seg pair in <sp>,
+ * using the second half of the workspace.
+ * 
+ * If <min_overlap> is <= 0, nonoverlapping pairs can link too, and
+ * we fall back to testing all pairs.
+ * 
+ * Results in <sp->assignment> and <sp->nc>.
+ * 
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+static int
+cluster_spsamples(P7_SPENSEMBLE *sp, struct p7_linkparam_s *param)
+{
+  struct p7_spcoord_s *srt    = NULL;
+  int                 *parent = sp->workspace;
+  int                 *cidx   = sp->workspace + sp->n;
+  int                  a, b;
+  int                  ra, rb;
+  int                  h;
+  int                  do_link;
+  int                  status;
+
+  if (sp->n == 0) { sp->nc = 0; return eslOK; }
+
+  ESL_ALLOC(srt, sizeof(struct p7_spcoord_s) * sp->n);
+  for (h = 0; h < sp->n; h++) {
+    srt[h]     = sp->sp[h];
+    srt[h].idx = h;		/* in the copy, <idx> is the seg pair's index in <sp->sp> */
+    parent[h]  = h;
+  }
+  if (param->min_overlap > 0.) qsort((void *) srt, sp->n, sizeof(struct p7_spcoord_s), seqstart_orderer);
+
+  for (a = 0; a < sp->n; a++)
+    for (b = a+1; b < sp->n; b++)
+      {
+	if (param->min_overlap > 0. && srt[b].i > srt[a].j) break; /* b, and all after it, start after a ends */
+
+	ra = find_root(parent, srt[a].idx);
+	rb = find_root(parent, srt[b].idx);
+	if (ra == rb) continue;	/* already in the same cluster; no need to test the link */
+
+	link_spsamples(&(srt[a]), &(srt[b]), param, &do_link);
+	if (do_link) {
+	  if (ra < rb) parent[rb] = ra; 
+	  else         parent[ra] = rb;
+	}
+      }
+
+  /* Number the clusters in order of their first seg pair. */
+  for (h = 0; h < sp->n; h++) cidx[h] = -1;
+  for (sp->nc = 0, h = 0; h < sp->n; h++)
+    {
+      ra = find_root(parent, h);
+      if (cidx[ra] == -1) cidx[ra] = sp->nc++;
+      sp->assignment[h] = cidx[ra];
+    }
+
+  free(srt);
+  return eslOK;
+
+ ERROR:
+  if (srt != NULL) free(srt);
+  sp->nc = 0;
+  return status;
+}
+
 /* Function:  p7_spensemble_Cluster()
  * Synopsis:  Cluster a seg pair ensemble and define domains.
  * Incept:    SRE, Wed Jan  9 11:04:07 2008 [Janelia]
@@ -286,40 +403,42 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   int status;
   int c;
   int h;
-  int idx_of_last;
   int *ninc = NULL;
+  int *last = NULL;
   int cwindow_width;
   int epc_threshold;
   int imin, jmin, kmin, mmin;
   int imax, jmax, kmax, mmax;
   int best_i, best_j, best_k, best_m;
 
-  /* set up a single linkage clustering problem for Easel's general routine */
+  /* set up the single linkage clustering problem */
   param.min_overlap   = min_overlap;
   param.of_smaller    = of_smaller;
   param.max_diagdiff  = max_diagdiff;
   param.min_posterior = min_posterior;
   param.min_endpointp = min_endpointp;
-  if ((status = esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
-					  sp->workspace, sp->assignment, &(sp->nc))) != eslOK) goto ERROR;
+  if ((status = cluster_spsamples(sp, &param)) != eslOK) goto ERROR;
 
-  ESL_ALLOC(ninc, sizeof(int) * sp->nc);
+  ESL_ALLOC(ninc, sizeof(int) * ESL_MAX(1, sp->nc));
+  ESL_ALLOC(last, sizeof(int) * ESL_MAX(1, sp->nc));
+
+  /* Calculate posterior probability of each cluster, in one pass over the seg pairs. 
+   * The extra wrinkle here is that this probability is w.r.t the number of sampled traces;
+   * but the clusters might contain more than one seg pair from a given trace.
+   * That's what the last[] logic is doing, avoiding double-counting: it's the
+   * idx of the last seg pair we counted in each cluster.
+   */
+  esl_vec_ISet(ninc, sp->nc, 0);
+  esl_vec_ISet(last, sp->nc, -1);
+  for (h = 0; h < sp->n; h++) {
+    c = sp->assignment[h];
+    if (sp->sp[h].idx != last[c]) ninc[c]++;
+    last[c] = sp->sp[h].idx;
+  }
 
   /* Look at each cluster in turn; most will be too small to worry about. */
   for (c = 0; c < sp->nc; c++)
     {
-      /* Calculate posterior probability of each cluster. 
-       * The extra wrinkle here is that this probability is w.r.t the number of sampled traces;
-       * but the clusters might contain more than one seg pair from a given trace.
-       * That's what the idx_of_last logic is doing, avoiding double-counting.
-       */
-      idx_of_last = -1;
-      for (ninc[c] = 0, h = 0; h < sp->n; h++) {
-	if (sp->assignment[h] == c) {
-	  if (sp->sp[h].idx != idx_of_last) ninc[c]++;
-	  idx_of_last = sp->sp[h].idx;
-	}
-      }
       /* Reject low probability clusters: */
       if ((float) ninc[c] / (float) sp->nsamples < min_posterior) continue;
 
@@ -401,11 +520,13 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   qsort((void *) sp->sigc, sp->nsigc, sizeof(struct p7_spcoord_s), cluster_orderer);
 
   free(ninc);
+  free(last);
   *ret_nclusters = sp->nsigc;
   return eslOK;
 
  ERROR:
   if (ninc != NULL) free(ninc);
+  if (last != NULL) free(last);
   *ret_nclusters = 0;
   return status;
 }
@@ -456,6 +577,148 @@ p7_spensemble_Destroy(P7_SPENSEMBLE *sp)
 
 
 
+/*****************************************************************
+ * Unit tests.
+ *****************************************************************/
+#ifdef p7SPENSEMBLE_TESTDRIVE
+#include "esl_cluster.h"
+#include "esl_random.h"
+
+/* utest_cluster()
+ * Fill an ensemble with <nsamples> fake samples of <ndom> jittered
+ * domains, plus some random noise segments, and check that
+ * p7_spensemble_Cluster() partitions the seg pairs the same way
+ * Easel's all-pairs single linkage clustering does.
+ */
+static void
+utest_cluster(ESL_RANDOMNESS *r, int ndom, int nsamples, float min_overlap, int of_smaller)
+{
+  char                 *msg   = "p7_spensemble cluster unit test failed";
+  P7_SPENSEMBLE        *sp    = p7_spensemble_Create(64, 64, 8);
+  struct p7_linkparam_s param;
+  int                  *ref   = NULL;
+  int                  *work  = NULL;
+  int                  *map1  = NULL;
+  int                  *map2  = NULL;
+  int                   L     = 100 * ndom;
+  int                   nref;
+  int                   nsig;
+  int                   t, d, h;
+  int                   i, j, k, m;
+  int                   status;
+
+  for (t = 0; t < nsamples; t++)
+    {
+      for (d = 0; d < ndom; d++)
+	{
+	  if (esl_random(r) < 0.3) continue;
+	  i = 100*d + 10 + esl_rnd_Roll(r, 9);	/* domain d is at ~ 100d+14..100d+84 on seq, ~ 6..76 on model */
+	  j = 100*d + 80 + esl_rnd_Roll(r, 9);
+	  k = 2 + esl_rnd_Roll(r, 9);
+	  m = 72 + esl_rnd_Roll(r, 9);
+	  if (p7_spensemble_Add(sp, t, i, j, k, m) != eslOK) esl_fatal(msg);
+	}
+      if (esl_random(r) < 0.5 || sp->nsamples == t) /* a noise segment anywhere; and each sample needs at least one seg pair */
+	{
+	  i = 1 + esl_rnd_Roll(r, L);
+	  j = ESL_MIN(L, i + esl_rnd_Roll(r, 50));
+	  k = 1 + esl_rnd_Roll(r, 80);
+	  m = ESL_MIN(80, k + esl_rnd_Roll(r, 50));
+	  if (p7_spensemble_Add(sp, t, i, j, k, m) != eslOK) esl_fatal(msg);
+	}
+    }
+
+  param.min_overlap   = min_overlap;
+  param.of_smaller    = of_smaller;
+  param.max_diagdiff  = 4;
+  param.min_posterior = 0.25;
+  param.min_endpointp = 0.02;
+  ESL_ALLOC(ref,  sizeof(int) * ESL_MAX(1, sp->n));
+  ESL_ALLOC(work, sizeof(int) * ESL_MAX(1, sp->n) * 2);
+  if (esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
+				work, ref, &nref) != eslOK) esl_fatal(msg);
+
+  if (p7_spensemble_Cluster(sp, min_overlap, of_smaller, 4, 0.25, 0.02, &nsig) != eslOK) esl_fatal(msg);
+  if (sp->nc != nref) esl_fatal(msg);
+  if (ndom > 0 && nsamples >= 10 && nsig == 0) esl_fatal(msg);
+
+  /* same partition: cluster numbers map one to one */
+  ESL_ALLOC(map1, sizeof(int) * ESL_MAX(1, nref));
+  ESL_ALLOC(map2, sizeof(int) * ESL_MAX(1, nref));
+  esl_vec_ISet(map1, nref, -1);
+  esl_vec_ISet(map2, nref, -1);
+  for (h = 0; h < sp->n; h++)
+    {
+      if (map1[ref[h]]            == -1) map1[ref[h]]            = sp->assignment[h];
+      if (map2[sp->assignment[h]] == -1) map2[sp->assignment[h]] = ref[h];
+      if (map1[ref[h]]            != sp->assignment[h]) esl_fatal(msg);
+      if (map2[sp->assignment[h]] != ref[h])            esl_fatal(msg);
+    }
+
+  /* significant clusters come out ordered by start position */
+  for (d = 1; d < nsig; d++)
+    if (sp->sigc[d].i < sp->sigc[d-1].i) esl_fatal(msg);
+
+  free(map1);
+  free(map2);
+  free(ref);
+  free(work);
+  p7_spensemble_Destroy(sp);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7SPENSEMBLE_TESTDRIVE*/
+
+
+/*****************************************************************
+ * Test driver.
+ *****************************************************************/
+#ifdef p7SPENSEMBLE_TESTDRIVE
+/*
+  gcc -o p7_spensemble_utest -msse2 -std=gnu99 -g -O2 -I. -L. -I../easel -L../easel -Dp7SPENSEMBLE_TESTDRIVE p7_spensemble.c -lhmmer -leasel -lm 
+  ./p7_spensemble_utest
+*/
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_SPENSEMBLE";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r  = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+
+  utest_cluster(r,  0,   0, 0.8, TRUE);   /* empty ensemble */
+  utest_cluster(r,  1,   1, 0.8, TRUE);
+  utest_cluster(r,  5, 100, 0.8, TRUE);
+  utest_cluster(r,  5, 100, 0.5, FALSE);
+  utest_cluster(r, 20, 200, 0.8, TRUE);
+  utest_cluster(r,  3,  50, 0.0, TRUE);   /* no overlap required: all-pairs path */
+
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SPENSEMBLE_TESTDRIVE*/
+
+
+
 /*****************************************************************
  * Benchmark and example.
  *****************************************************************/
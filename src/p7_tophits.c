@@ -4,8 +4,9 @@
  *    1. The P7_TOPHITS object.
  *    2. Standard (human-readable) output of pipeline results.
  *    3. Tabular (parsable) output of pipeline results.
- *    4. Benchmark driver.
- *    5. Test driver.
+ *    4. Binary output of pipeline results (--hitsout).
+ *    5. Benchmark driver.
+ *    6. Test driver.
  */
 #include "p7_config.h"
 
@@ -20,6 +21,313 @@
  *= 1. The P7_TOPHITS object
  *****************************************************************/
 
+/* The hit arena.
+ * 
+ * Names, domain lists, alignment displays, and per-position scores of
+ * hits created by the pipeline are copied into a bump allocator owned
+ * by the P7_TOPHITS, so a hit list's memory is released together:
+ * Reuse() and Destroy() free a handful of chunks instead of walking
+ * every hit and domain, and MergeList() takes over the other lists'
+ * chunks without touching their contents.
+ * 
+ * The pipeline also has P7_DOMAINDEF build each target's alignment
+ * displays directly in the hit list's arena (ddef->arena), after
+ * p7_hitarena_Mark(). If the target is reported,
+ * p7_tophits_CopyHitDomains() takes the displays over as they are;
+ * if not, p7_hitarena_Rewind() gives the space back. Displays built
+ * elsewhere (by the threads of a parallel domain definition, or by
+ * callers without an arena) are malloc()'ed, and are deep-copied.
+ * 
+ * Hits that were filled in some other way (deserialized, MPI
+ * unpacked, p7_tophits_Add()) are still malloc()'ed, and are marked
+ * with hit->in_arena = FALSE.
+ */
+static P7_HITARENA *
+arena_create(void)
+{
+  P7_HITARENA *a = NULL;
+  int          status;
+
+  ESL_ALLOC(a, sizeof(P7_HITARENA));
+  a->chunk     = NULL;
+  a->chunksize = NULL;
+  a->nchunk    = 0;
+  a->nalloc    = 4;
+  a->used      = 0;
+  a->mark_nchunk = 0;
+  a->mark_used   = 0;
+
+  ESL_ALLOC(a->chunk,     sizeof(char *) * a->nalloc);
+  ESL_ALLOC(a->chunksize, sizeof(size_t) * a->nalloc);
+  return a;
+
+ ERROR:
+  if (a) { free(a->chunk); free(a->chunksize); free(a); }
+  return NULL;
+}
+
+/* arena_grow_index()
+ * Make room in <a> for at least <n> more chunk pointers.
+ */
+static int
+arena_grow_index(P7_HITARENA *a, int n)
+{
+  void *p;
+  int   nalloc = a->nalloc;
+  int   status;
+
+  if (a->nchunk + n <= a->nalloc) return eslOK;
+  while (a->nchunk + n > nalloc) nalloc *= 2;
+  ESL_RALLOC(a->chunk,     p, sizeof(char *) * nalloc);
+  ESL_RALLOC(a->chunksize, p, sizeof(size_t) * nalloc);
+  a->nalloc = nalloc;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* arena_alloc()
+ * Return a pointer to <n> bytes of (8-byte aligned) memory in <a>,
+ * starting a new chunk if the current one is full; or NULL on
+ * allocation failure.
+ */
+static void *
+arena_alloc(P7_HITARENA *a, size_t n)
+{
+  void   *p;
+  size_t  size;
+  int     status;
+
+  n = (n + 7) & ~((size_t) 7);
+  if (a->nchunk == 0 || a->used + n > a->chunksize[a->nchunk-1])
+    {
+      size = (a->nchunk ? a->chunksize[a->nchunk-1] * 2 : p7_HITARENA_CHUNKSIZE);
+      while (size < n) size *= 2;
+
+      if (arena_grow_index(a, 1) != eslOK) goto ERROR;
+      ESL_ALLOC(a->chunk[a->nchunk], sizeof(char) * size);
+      a->chunksize[a->nchunk] = size;
+      a->nchunk++;
+      a->used = 0;
+    }
+  p        = a->chunk[a->nchunk-1] + a->used;
+  a->used += n;
+  return p;
+
+ ERROR:
+  return NULL;
+}
+
+/* arena_contains()
+ * Return TRUE if <p> points into one of <a>'s chunks.
+ */
+static int
+arena_contains(const P7_HITARENA *a, const void *p)
+{
+  const char *cp = (const char *) p;
+  int         c;
+
+  for (c = 0; c < a->nchunk; c++)
+    if (cp >= a->chunk[c] && cp < a->chunk[c] + a->chunksize[c]) return TRUE;
+  return FALSE;
+}
+
+static int
+arena_strdup(P7_HITARENA *a, const char *s, char **ret_s)
+{
+  size_t n;
+
+  if (s == NULL) { *ret_s = NULL; return eslOK; }
+  n = strlen(s) + 1;
+  if ((*ret_s = arena_alloc(a, n)) == NULL) return eslEMEM;
+  memcpy(*ret_s, s, n);
+  return eslOK;
+}
+
+/* arena_alidisplay()
+ * Copy alignment display <ad> into arena <a>. A serialized
+ * display is one block copy, with its pointers rebased as in
+ * p7_alidisplay_Clone(); a deserialized one is copied field by field.
+ */
+static P7_ALIDISPLAY *
+arena_alidisplay(P7_HITARENA *a, const P7_ALIDISPLAY *ad)
+{
+  P7_ALIDISPLAY *ad2;
+  char          *mem;
+
+  if ((ad2 = arena_alloc(a, sizeof(P7_ALIDISPLAY))) == NULL) return NULL;
+  *ad2 = *ad;
+
+  if (ad->memsize)		/* serialized */
+    {
+      if ((mem = arena_alloc(a, ad->memsize)) == NULL) return NULL;
+      memcpy(mem, ad->mem, ad->memsize);
+      ad2->mem = mem;
+
+      ad2->rfline  = (ad->rfline ? mem + (ad->rfline - ad->mem) : NULL );
+      ad2->mmline  = (ad->mmline ? mem + (ad->mmline - ad->mem) : NULL );
+      ad2->csline  = (ad->csline ? mem + (ad->csline - ad->mem) : NULL );
+      ad2->model   = mem + (ad->model  - ad->mem);
+      ad2->mline   = mem + (ad->mline  - ad->mem);
+      ad2->aseq    = mem + (ad->aseq   - ad->mem);
+      ad2->ntseq   = (ad->ntseq  ? mem + (ad->ntseq  - ad->mem) : NULL );
+      ad2->ppline  = (ad->ppline ? mem + (ad->ppline - ad->mem) : NULL );
+      ad2->hmmname = mem + (ad->hmmname - ad->mem);
+      ad2->hmmacc  = mem + (ad->hmmacc  - ad->mem);
+      ad2->hmmdesc = mem + (ad->hmmdesc - ad->mem);
+      ad2->sqname  = mem + (ad->sqname  - ad->mem);
+      ad2->sqacc   = mem + (ad->sqacc   - ad->mem);
+      ad2->sqdesc  = mem + (ad->sqdesc  - ad->mem);
+    }
+  else				/* deserialized */
+    {
+      if (arena_strdup(a, ad->rfline,  &(ad2->rfline))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->mmline,  &(ad2->mmline))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->csline,  &(ad2->csline))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->model,   &(ad2->model))   != eslOK) return NULL;
+      if (arena_strdup(a, ad->mline,   &(ad2->mline))   != eslOK) return NULL;
+      if (arena_strdup(a, ad->aseq,    &(ad2->aseq))    != eslOK) return NULL;
+      if (arena_strdup(a, ad->ntseq,   &(ad2->ntseq))   != eslOK) return NULL;
+      if (arena_strdup(a, ad->ppline,  &(ad2->ppline))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->hmmname, &(ad2->hmmname)) != eslOK) return NULL;
+      if (arena_strdup(a, ad->hmmacc,  &(ad2->hmmacc))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->hmmdesc, &(ad2->hmmdesc)) != eslOK) return NULL;
+      if (arena_strdup(a, ad->sqname,  &(ad2->sqname))  != eslOK) return NULL;
+      if (arena_strdup(a, ad->sqacc,   &(ad2->sqacc))   != eslOK) return NULL;
+      if (arena_strdup(a, ad->sqdesc,  &(ad2->sqdesc))  != eslOK) return NULL;
+    }
+  return ad2;
+}
+
+/* arena_reset()
+ * Empty arena <a>, keeping only its largest chunk for reuse. 
+ */
+static void
+arena_reset(P7_HITARENA *a)
+{
+  int c, cmax;
+
+  if (a == NULL || a->nchunk == 0) return;
+  for (cmax = 0, c = 1; c < a->nchunk; c++)
+    if (a->chunksize[c] > a->chunksize[cmax]) cmax = c;
+  for (c = 0; c < a->nchunk; c++)
+    if (c != cmax) free(a->chunk[c]);
+
+  a->chunk[0]     = a->chunk[cmax];
+  a->chunksize[0] = a->chunksize[cmax];
+  a->nchunk       = 1;
+  a->used         = 0;
+  a->mark_nchunk  = 0;
+  a->mark_used    = 0;
+}
+
+/* arena_adopt()
+ * Arena <a> takes over all of <b>'s chunks, leaving <b> empty.
+ * The adopted chunks go in front of <a>'s current chunk, so <a>
+ * keeps allocating where it was. No hit data move.
+ */
+static int
+arena_adopt(P7_HITARENA *a, P7_HITARENA *b)
+{
+  int status;
+
+  if (b->nchunk == 0) return eslOK;
+  if ((status = arena_grow_index(a, b->nchunk)) != eslOK) return status;
+
+  if (a->nchunk == 0)
+    {
+      memcpy(a->chunk,     b->chunk,     sizeof(char *) * b->nchunk);
+      memcpy(a->chunksize, b->chunksize, sizeof(size_t) * b->nchunk);
+      a->used = b->used;
+    }
+  else
+    {
+      a->chunk    [a->nchunk-1+b->nchunk] = a->chunk    [a->nchunk-1];
+      a->chunksize[a->nchunk-1+b->nchunk] = a->chunksize[a->nchunk-1];
+      memcpy(a->chunk     + a->nchunk-1, b->chunk,     sizeof(char *) * b->nchunk);
+      memcpy(a->chunksize + a->nchunk-1, b->chunksize, sizeof(size_t) * b->nchunk);
+    }
+  a->nchunk += b->nchunk;
+  b->nchunk  = 0;
+  b->used    = 0;
+  return eslOK;
+}
+
+static void
+arena_destroy(P7_HITARENA *a)
+{
+  int c;
+
+  if (a == NULL) return;
+  for (c = 0; c < a->nchunk; c++) free(a->chunk[c]);
+  free(a->chunk);
+  free(a->chunksize);
+  free(a);
+}
+
+
+/* Function:  p7_hitarena_Alloc()
+ * Synopsis:  Allocate memory in a hit list's arena.
+ *
+ * Purpose:   Return a pointer to <n> bytes of 8-byte aligned memory
+ *            in arena <a>. The memory is released with the rest of
+ *            the arena, or by <p7_hitarena_Rewind()>; never free()
+ *            it.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+void *
+p7_hitarena_Alloc(P7_HITARENA *a, size_t n)
+{
+  return arena_alloc(a, n);
+}
+
+/* Function:  p7_hitarena_Mark()
+ * Synopsis:  Remember an arena's current allocation point.
+ *
+ * Purpose:   Save the current allocation point of arena <a>, so a
+ *            later <p7_hitarena_Rewind()> can release everything
+ *            allocated after it. There is one mark per arena; the
+ *            next call replaces it.
+ */
+void
+p7_hitarena_Mark(P7_HITARENA *a)
+{
+  a->mark_nchunk = a->nchunk;
+  a->mark_used   = a->used;
+}
+
+/* Function:  p7_hitarena_Rewind()
+ * Synopsis:  Release an arena's allocations since its mark.
+ *
+ * Purpose:   Release everything allocated in arena <a> since the
+ *            last <p7_hitarena_Mark()>. Chunks started since then
+ *            are freed, except the newest (largest), which becomes
+ *            the current chunk, so a rewound target's space gets
+ *            reused by the next one instead of reallocated; the rest
+ *            of the marked chunk is left unused.
+ *
+ *            Nothing may have been taken over from <a> (by
+ *            <p7_tophits_MergeList()>) or reset in it since the mark.
+ */
+void
+p7_hitarena_Rewind(P7_HITARENA *a)
+{
+  int c;
+
+  if (a->nchunk == a->mark_nchunk) { a->used = a->mark_used; return; }
+
+  for (c = a->mark_nchunk; c < a->nchunk-1; c++) free(a->chunk[c]);
+  a->chunk[a->mark_nchunk]     = a->chunk[a->nchunk-1];
+  a->chunksize[a->mark_nchunk] = a->chunksize[a->nchunk-1];
+  a->nchunk                    = a->mark_nchunk + 1;
+  a->used                      = 0;
+  a->mark_nchunk               = a->nchunk;
+  a->mark_used                 = 0;
+}
+
+
 /* Function:  p7_tophits_Create()
  * Synopsis:  Allocate a hit list.
  *
@@ -38,9 +346,12 @@ p7_tophits_Create(void)
   ESL_ALLOC(h, sizeof(P7_TOPHITS));
   h->hit    = NULL;
   h->unsrt  = NULL;
+  h->arena  = NULL;
+  h->N      = 0;
 
   ESL_ALLOC(h->hit,   sizeof(P7_HIT *) * default_nalloc);
   ESL_ALLOC(h->unsrt, sizeof(P7_HIT)   * default_nalloc);
+  if ((h->arena = arena_create()) == NULL) { status = eslEMEM; goto ERROR; }
   h->Nalloc    = default_nalloc;
   h->N         = 0;
   h->nreported = 0;
@@ -153,6 +464,7 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
   hit->best_domain  = -1;
   hit->dcl          = NULL;
   hit->offset       = 0;
+  hit->in_arena     = FALSE;
 
   *ret_hit = hit;
   return eslOK;
@@ -164,6 +476,94 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
 
 
 
+/* Function:  p7_tophits_CopyHitNames()
+ * Synopsis:  Copy a hit's name, accession, description into the list's arena.
+ *
+ * Purpose:   Copy <name>, <acc>, and <desc> into the memory arena of
+ *            hit list <h>, and set <hit>'s pointers to the copies.
+ *            <acc> and <desc> may be <NULL>, in which case <hit->acc>,
+ *            <hit->desc> are <NULL>. Caller may free its originals.
+ *
+ *            <hit> must be a new hit in <h>, from
+ *            <p7_tophits_CreateNextHit()>. It is marked as
+ *            arena-owned, and its name, accession, description, and
+ *            domain list will be released together with the arena by
+ *            <p7_tophits_Reuse()> or <p7_tophits_Destroy()>, not
+ *            individually; so its domain list must also be set with
+ *            <p7_tophits_CopyHitDomains()>, not malloc()'ed.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_CopyHitNames(P7_TOPHITS *h, P7_HIT *hit, const char *name, const char *acc, const char *desc)
+{
+  hit->in_arena = TRUE;
+  if (arena_strdup(h->arena, name, &(hit->name)) != eslOK) goto ERROR;
+  if (arena_strdup(h->arena, acc,  &(hit->acc))  != eslOK) goto ERROR;
+  if (arena_strdup(h->arena, desc, &(hit->desc)) != eslOK) goto ERROR;
+  return eslOK;
+
+ ERROR:
+  ESL_EXCEPTION(eslEMEM, "hit arena allocation failed");
+}
+
+
+/* Function:  p7_tophits_CopyHitDomains()
+ * Synopsis:  Copy a hit's domain list into the list's arena.
+ *
+ * Purpose:   Copy the <ndom> domains <dcl[0..ndom-1]>, including their
+ *            alignment displays and per-position scores, into the
+ *            memory arena of hit list <h>, and set <hit->dcl> to the
+ *            copy. Caller keeps ownership of <dcl>; the domain
+ *            definition code reuses its own list for the next target.
+ *
+ *            An alignment display that was already built in <h>'s
+ *            arena (see <p7_alidisplay_CreateInArena()>) isn't
+ *            copied; the hit takes it over, and caller must not
+ *            use or free it after this.
+ *
+ *            As with <p7_tophits_CopyHitNames()>, <hit> must be a
+ *            new hit in <h>, and becomes arena-owned. Caller may
+ *            modify the copied domains (coordinates, scores) freely.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_CopyHitDomains(P7_TOPHITS *h, P7_HIT *hit, const P7_DOMAIN *dcl, int ndom)
+{
+  P7_DOMAIN *dom;
+  int        d;
+
+  hit->in_arena = TRUE;
+  if ((hit->dcl = arena_alloc(h->arena, sizeof(P7_DOMAIN) * ndom)) == NULL) goto ERROR;
+  for (d = 0; d < ndom; d++)
+    {
+      dom  = hit->dcl + d;
+      *dom = dcl[d];
+      dom->ad             = NULL;
+      dom->scores_per_pos = NULL;
+      if (dcl[d].ad == NULL) continue;
+
+      if      (arena_contains(h->arena, dcl[d].ad))                        dom->ad = dcl[d].ad;
+      else if ((dom->ad = arena_alidisplay(h->arena, dcl[d].ad)) == NULL) goto ERROR;
+      if (dcl[d].scores_per_pos != NULL)
+	{
+	  if ((dom->scores_per_pos = arena_alloc(h->arena, sizeof(float) * dcl[d].ad->N)) == NULL) goto ERROR;
+	  memcpy(dom->scores_per_pos, dcl[d].scores_per_pos, sizeof(float) * dcl[d].ad->N);
+	}
+    }
+  return eslOK;
+
+ ERROR:
+  hit->dcl = NULL;
+  ESL_EXCEPTION(eslEMEM, "hit arena allocation failed");
+}
+
+
 /* Function:  p7_tophits_Add()
  * Synopsis:  Add a hit to the top hits list.
  *
@@ -242,6 +642,7 @@ p7_tophits_Add(P7_TOPHITS *h,
   h->unsrt[h->N].nincluded  = 0;
   h->unsrt[h->N].best_domain= 0;
   h->unsrt[h->N].dcl        = NULL;
+  h->unsrt[h->N].in_arena   = FALSE;
   h->N++;
 
   if (h->N >= 2) {
@@ -326,6 +727,86 @@ hit_sorter_by_modelname_aliposition(const void *vh1, const void *vh2)
 }
 
 
+/* radix_sort_by_sortkey()
+ * 
+ * The fast way of sorting <h->hit> by sortkey, for big lists: an LSD
+ * radix sort on the sortkeys, 8 bits at a time, then
+ * hit_sorter_by_sortkey() only on runs of tied sortkeys, to break the
+ * ties the same way qsort() would. Doubles are mapped to unsigned
+ * ints that sort in the same order (flip the sign bit of positive
+ * numbers, all the bits of negative ones); then complemented, because
+ * big sortkeys go first.
+ * 
+ * Needs 32 bytes/hit of temporary space. Returns <eslEMEM> if it can't
+ * get it, and the caller falls back to qsort().
+ */
+typedef struct {
+  uint64_t  key;
+  P7_HIT   *hit;
+} RADIX_ITEM;
+
+static int
+radix_sort_by_sortkey(P7_TOPHITS *h)
+{
+  RADIX_ITEM *a   = NULL;
+  RADIX_ITEM *b   = NULL;
+  RADIX_ITEM *tmp;
+  uint64_t  (*cnt)[256] = NULL;   /* cnt[pass][byte]: histogram of each byte of the keys */
+  uint64_t    pos[256];
+  uint64_t    u;
+  uint64_t    i, j;
+  double      x;
+  int         pass, c;
+  int         status;
+
+  ESL_ALLOC(a,   sizeof(RADIX_ITEM) * h->N);
+  ESL_ALLOC(b,   sizeof(RADIX_ITEM) * h->N);
+  ESL_ALLOC(cnt, sizeof(uint64_t) * 8 * 256);
+  memset(cnt, 0, sizeof(uint64_t) * 8 * 256);
+
+  for (i = 0; i < h->N; i++)
+    {
+      x = h->unsrt[i].sortkey;
+      if (x == 0.0) x = 0.0;	/* -0.0 == 0.0 to the comparator; make them the same key too */
+      memcpy(&u, &x, sizeof(uint64_t));
+      u = ( (u >> 63) ? ~u : u | (1ULL << 63));
+      a[i].key = ~u;
+      a[i].hit = h->unsrt + i;
+      for (pass = 0; pass < 8; pass++) cnt[pass][(a[i].key >> (8*pass)) & 0xff]++;
+    }
+
+  for (pass = 0; pass < 8; pass++)
+    {
+      c = (a[0].key >> (8*pass)) & 0xff;
+      if (cnt[pass][c] == h->N) continue; /* all keys share this byte: nothing to do on this pass */
+
+      for (pos[0] = 0, c = 1; c < 256; c++) pos[c] = pos[c-1] + cnt[pass][c-1];
+      for (i = 0; i < h->N; i++) b[ pos[(a[i].key >> (8*pass)) & 0xff]++ ] = a[i];
+      tmp = a; a = b; b = tmp;
+    }
+
+  for (i = 0; i < h->N; i++) h->hit[i] = a[i].hit;
+
+  /* break ties */
+  for (i = 0; i < h->N; i = j)
+    {
+      for (j = i+1; j < h->N && a[j].key == a[i].key; j++) ;
+      if (j - i > 1) qsort(h->hit + i, j - i, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+    }
+
+  free(a);
+  free(b);
+  free(cnt);
+  return eslOK;
+
+ ERROR:
+  if (a)   free(a);
+  if (b)   free(b);
+  if (cnt) free(cnt);
+  return status;
+}
+
+
 /* Function:  p7_tophits_SortBySortkey()
  * Synopsis:  Sorts a hit list.
  *
@@ -333,6 +814,11 @@ hit_sorter_by_modelname_aliposition(const void *vh1, const void *vh2)
  *            <h->hit[i]> points to the i'th ranked 
  *            <P7_HIT> for all <h->N> hits.
  *
+ *            Lists of <p7_TOPHITS_RADIXSORT> or more hits are radix
+ *            sorted on the sortkey, which is linear in the number of
+ *            hits; smaller ones with qsort(). Either way the result
+ *            is the same.
+ *
  * Returns:   <eslOK> on success.
  */
 int
@@ -342,7 +828,8 @@ p7_tophits_SortBySortkey(P7_TOPHITS *h)
 
   if (h->is_sorted_by_sortkey)  return eslOK;
   for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
-  if (h->N > 1)  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+  if (h->N >= p7_TOPHITS_RADIXSORT && radix_sort_by_sortkey(h) == eslOK) ;
+  else if (h->N > 1) qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
   h->is_sorted_by_seqidx  = FALSE;
   h->is_sorted_by_sortkey = TRUE;
   return eslOK;
@@ -420,58 +907,158 @@ p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h)
 int
 p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
 {
-  void    *p;
-  P7_HIT **new_hit = NULL;
-  P7_HIT  *ori1    = h1->unsrt;    /* original base of h1's data */
-  P7_HIT  *new2;
-  int      i,j,k;
-  uint64_t Nalloc = h1->N + h2->N;
-  int      status;
-
-  if(h2->N <= 0) return eslOK;
-  
-  /* Make sure the two lists are sorted */
-  if ((status = p7_tophits_SortBySortkey(h1)) != eslOK) goto ERROR;
-  if ((status = p7_tophits_SortBySortkey(h2)) != eslOK) goto ERROR;
+  return p7_tophits_MergeList(h1, &h2, 1);
+}
+
+
+/* merge_heap_sift()
+ * The k-way merge in p7_tophits_MergeList() keeps a binary heap of
+ * list indices <heap[0..n-1]>, ordered by their current head hits
+ * <head[]>; ties go to the lower-numbered list, so the merge is
+ * stable. Sift <heap[i]> down to where it belongs.
+ */
+static void
+merge_heap_sift(int *heap, int n, int i, P7_HIT **head)
+{
+  int c, x;
+
+  while ((c = 2*i+1) < n)
+    {
+      if (c+1 < n) {
+	x = hit_sorter_by_sortkey(&head[heap[c+1]], &head[heap[c]]);
+	if (x < 0 || (x == 0 && heap[c+1] < heap[c])) c++;
+      }
+      x = hit_sorter_by_sortkey(&head[heap[c]], &head[heap[i]]);
+      if (x > 0 || (x == 0 && heap[c] > heap[i])) break;
+      ESL_SWAP(heap[c], heap[i], int);
+      i = c;
+    }
+}
+
+/* Function:  p7_tophits_MergeList()
+ * Synopsis:  Merge many top hits lists into one.
+ *
+ * Purpose:   Merge the <nlist> lists <hl[0..nlist-1]> into <h>, in a
+ *            single k-way merge. Upon return, <h> contains the
+ *            sorted, merged list. The lists in <hl> are effectively
+ *            destroyed, as in <p7_tophits_Merge()>; caller should
+ *            not access them further, and may as well free them.
+ *
+ *            Each list is sorted by sortkey first, if it isn't
+ *            already. Threaded callers sort each worker's list in its
+ *            own thread, so only the merge itself is serial.
+ *
+ *            The result is the same as merging the lists into <h>
+ *            one at a time with <p7_tophits_Merge()>, but takes time
+ *            $O(N \log k)$, not $O(Nk)$, for $N$ hits total in $k$
+ *            lists.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and
+ *            <h> and the <hl> lists remain valid.
+ */
+int
+p7_tophits_MergeList(P7_TOPHITS *h, P7_TOPHITS **hl, int nlist)
+{
+  void     *p;
+  P7_HIT  **new_hit = NULL;
+  P7_HIT  **head    = NULL;	/* head[0..nlist]: current hit of <h> and each <hl> list, 0=h */
+  uint64_t *next    = NULL;	/* next[0..nlist]: index of the hit after the current head    */
+  uint64_t *base    = NULL;	/* base[1..nlist]: where each <hl> list's hits go in h->unsrt */
+  int      *heap    = NULL;
+  P7_HIT   *ori     = h->unsrt;	/* original base of h's data */
+  uint64_t  Ntot    = h->N;
+  uint64_t  Nalloc;
+  uint64_t  i, k;
+  int       n, L;
+  int       status;
+
+  for (L = 0; L < nlist; L++) Ntot += hl[L]->N;
+  if (Ntot == h->N) return eslOK;
+  Nalloc = ESL_MAX(Ntot, h->Nalloc);
+
+  /* Make sure the lists are sorted */
+  if ((status = p7_tophits_SortBySortkey(h)) != eslOK) goto ERROR;
+  for (L = 0; L < nlist; L++)
+    if ((status = p7_tophits_SortBySortkey(hl[L])) != eslOK) goto ERROR;
 
   /* Attempt our allocations, so we fail early if we fail. 
-   * Reallocating h1->unsrt screws up h1->hit, so fix it.
+   * Reallocating h->unsrt screws up h->hit, so fix it.
    */
-  ESL_RALLOC(h1->unsrt, p, sizeof(P7_HIT) * Nalloc);
-  ESL_ALLOC (new_hit, sizeof(P7_HIT *)    * Nalloc);
-  for (i = 0; i < h1->N; i++)
-    h1->hit[i] = h1->unsrt + (h1->hit[i] - ori1);
-
-  /* Append h2's unsorted data array to h1. h2's data begin at <new2> */
-  new2 = h1->unsrt + h1->N;
-  memcpy(new2, h2->unsrt, sizeof(P7_HIT) * h2->N);
-
-  /* Merge the sorted hit lists */
-  for (i=0,j=0,k=0; i < h1->N && j < h2->N ; k++)
-    new_hit[k] = (hit_sorter_by_sortkey(&h1->hit[i], &h2->hit[j]) > 0) ? new2 + (h2->hit[j++] - h2->unsrt) : h1->hit[i++];
-  while (i < h1->N) new_hit[k++] = h1->hit[i++];
-  while (j < h2->N) new_hit[k++] = new2 + (h2->hit[j++] - h2->unsrt);
-
-  /* h2 now turns over management of name, acc, desc memory to h1;
-   * nullify its pointers, to prevent double free.  */
-  for (i = 0; i < h2->N; i++)
-  {
-      h2->unsrt[i].name = NULL;
-      h2->unsrt[i].acc  = NULL;
-      h2->unsrt[i].desc = NULL;
-      h2->unsrt[i].dcl  = NULL;
-  }
+  ESL_ALLOC(new_hit, sizeof(P7_HIT *) * Nalloc);
+  ESL_ALLOC(head,    sizeof(P7_HIT *) * (nlist+1));
+  ESL_ALLOC(next,    sizeof(uint64_t) * (nlist+1));
+  ESL_ALLOC(base,    sizeof(uint64_t) * (nlist+1));
+  ESL_ALLOC(heap,    sizeof(int)      * (nlist+1));
+  ESL_RALLOC(h->unsrt, p, sizeof(P7_HIT) * Nalloc);
+  for (i = 0; i < h->N; i++)
+    h->hit[i] = h->unsrt + (h->hit[i] - ori);
+
+  /* Take over the other lists' arenas: their hits' data stay where they are. */
+  for (L = 0; L < nlist; L++)
+    if ((status = arena_adopt(h->arena, hl[L]->arena)) != eslOK) goto ERROR;
+
+  /* Append each list's unsorted data array to h's. */
+  for (L = 1, k = h->N; L <= nlist; k += hl[L-1]->N, L++)
+    {
+      base[L] = k;
+      memcpy(h->unsrt + k, hl[L-1]->unsrt, sizeof(P7_HIT) * hl[L-1]->N);
+    }
+
+  /* Start the heap with the top hit of each nonempty list */
+  for (n = 0, L = 0; L <= nlist; L++)
+    {
+      if      (L == 0 && h->N > 0)      head[L] = h->hit[0];
+      else if (L >  0 && hl[L-1]->N > 0) head[L] = h->unsrt + base[L] + (hl[L-1]->hit[0] - hl[L-1]->unsrt);
+      else continue;
+      next[L]   = 1;
+      heap[n++] = L;
+    }
+  for (i = n/2; i > 0; i--) merge_heap_sift(heap, n, i-1, head);
 
-  /* Construct the new grown h1 */
-  free(h1->hit);
-  h1->hit    = new_hit;
-  h1->Nalloc = Nalloc;
-  h1->N     += h2->N;
-  /* and is_sorted is TRUE, as a side effect of p7_tophits_Sort() above. */
+  /* Merge */
+  for (k = 0; n > 0; k++)
+    {
+      L = heap[0];
+      new_hit[k] = head[L];
+
+      if      (L == 0 && next[L] < h->N)       head[L] = h->hit[next[L]++];
+      else if (L >  0 && next[L] < hl[L-1]->N) { head[L] = h->unsrt + base[L] + (hl[L-1]->hit[next[L]] - hl[L-1]->unsrt); next[L]++; }
+      else    heap[0] = heap[--n];
+      merge_heap_sift(heap, n, 0, head);
+    }
+
+  /* The <hl> lists now turn over management of name, acc, desc memory to h
+   * (their arenas already have been); nullify their pointers, to prevent double free.  */
+  for (L = 0; L < nlist; L++)
+    for (i = 0; i < hl[L]->N; i++)
+      {
+	hl[L]->unsrt[i].name = NULL;
+	hl[L]->unsrt[i].acc  = NULL;
+	hl[L]->unsrt[i].desc = NULL;
+	hl[L]->unsrt[i].dcl  = NULL;
+      }
+
+  /* Construct the new grown h */
+  free(h->hit);
+  h->hit    = new_hit;
+  h->Nalloc = Nalloc;
+  h->N      = Ntot;
+  /* and is_sorted is TRUE, as a side effect of p7_tophits_SortBySortkey() above. */
+
+  free(head);
+  free(next);
+  free(base);
+  free(heap);
   return eslOK;
   
  ERROR:
-  if (new_hit != NULL) free(new_hit);
+  if (new_hit) free(new_hit);
+  if (head)    free(head);
+  if (next)    free(next);
+  if (base)    free(base);
+  if (heap)    free(heap);
   return status;
 }
 
@@ -596,7 +1183,10 @@ p7_tophits_GetMaxShownLength(P7_TOPHITS *h)
  * Purpose:   Reuse the tophits list <h>; save as 
  *            many malloc/free cycles as possible,
  *            as opposed to <Destroy()>'ing it and
- *            <Create>'ing a new one.
+ *            <Create>'ing a new one. Arena-owned hit
+ *            data are released by emptying the arena,
+ *            which keeps its largest chunk for the next
+ *            round.
  */
 int
 p7_tophits_Reuse(P7_TOPHITS *h)
@@ -608,16 +1198,20 @@ p7_tophits_Reuse(P7_TOPHITS *h)
   {
     for (i = 0; i < h->N; i++)
     {
+      if (h->unsrt[i].in_arena) continue; /* released all at once, below */
       if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
       if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
       if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
       if (h->unsrt[i].dcl  != NULL) {
-        for (j = 0; j < h->unsrt[i].ndom; j++)
-          if (h->unsrt[i].dcl[j].ad != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
+        for (j = 0; j < h->unsrt[i].ndom; j++) {
+          if (h->unsrt[i].dcl[j].ad             != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
+	  if (h->unsrt[i].dcl[j].scores_per_pos != NULL) free(h->unsrt[i].dcl[j].scores_per_pos);
+	}
         free(h->unsrt[i].dcl);
       }
     }
   }
+  arena_reset(h->arena);
   h->N         = 0;
   h->is_sorted_by_seqidx = FALSE;
   h->is_sorted_by_sortkey = TRUE;  /* because there are 0 hits */
@@ -638,19 +1232,21 @@ p7_tophits_Destroy(P7_TOPHITS *h)
   {
     for (i = 0; i < h->N; i++)
     {
+      if (h->unsrt[i].in_arena) continue;
       if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
       if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
       if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
       if (h->unsrt[i].dcl  != NULL) {
         for (j = 0; j < h->unsrt[i].ndom; j++) {
           if (h->unsrt[i].dcl[j].ad             != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
-	  if (h->unsrt[i].dcl[j].scores_per_pos != NULL) free (h->unsrt[i].dcl->scores_per_pos);
+	  if (h->unsrt[i].dcl[j].scores_per_pos != NULL) free (h->unsrt[i].dcl[j].scores_per_pos);
 	}
         free(h->unsrt[i].dcl);
       }
     }
     free(h->unsrt);
   }
+  arena_destroy(h->arena);
   free(h);
   return;
 }
@@ -1892,6 +2488,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
       }
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      arena_destroy(domHitlist->arena);
       free (domHitlist);
   }
   return eslOK;
@@ -1901,6 +2498,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
   {
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      arena_destroy(domHitlist->arena);
       free (domHitlist);
   }
   return status;
@@ -2021,7 +2619,330 @@ p7_tophits_TabularTail(FILE *ofp, const char *progname, enum p7_pipemodes_e pipe
 
 
 /*****************************************************************
- * 4. Benchmark driver
+ * 4. Binary output of pipeline results (--hitsout)
+ *****************************************************************/
+
+/* A hitsout file is a series of records, one per query, each
+ * holding one query's complete hit list and the pipeline accounting
+ * needed to recalculate its E-values. hmmmerge combines the records
+ * of searches that were split by target database chunk.
+ * 
+ * A record is:
+ *     char[4]   p7_HITSOUT_MAGIC
+ *     uint32    p7_HITSOUT_VERSION
+ *     uint64    size of the rest of the record, in bytes
+ *     uint32    mode, long_targets, Z_setby, domZ_setby
+ *     int64     query length (M for a model, L for a sequence)
+ *     double    Z, domZ
+ *     uint64    nmodels, nseqs, nres, nnodes,
+ *               n_past_{msv,bias,vit,fwd}, n_output,
+ *               pos_past_{msv,bias,vit,fwd}, pos_output
+ *     uint64    number of hits
+ *     uint8     presence flags: query accession, description
+ *     char[]    query name, accession, description; \0-terminated
+ *     ...       hits, as by p7_hit_Serialize()
+ * All numbers are in network byte order.
+ */
+#define HITSOUT_HDRSIZE    (4 + sizeof(uint32_t) + sizeof(uint64_t))
+#define HITSOUT_FIXEDSIZE  (4 * sizeof(uint32_t) + sizeof(int64_t) + 2 * sizeof(double) + 15 * sizeof(uint64_t) + 1)
+#define HITSOUT_ACC        (1 << 0)
+#define HITSOUT_DESC       (1 << 1)
+
+static uint8_t *
+hitsout_put32(uint8_t *ptr, uint32_t v)
+{
+  v = esl_hton32(v);
+  memcpy(ptr, &v, sizeof(uint32_t));
+  return ptr + sizeof(uint32_t);
+}
+
+static uint8_t *
+hitsout_put64(uint8_t *ptr, uint64_t v)
+{
+  v = esl_hton64(v);
+  memcpy(ptr, &v, sizeof(uint64_t));
+  return ptr + sizeof(uint64_t);
+}
+
+static uint8_t *
+hitsout_putdouble(uint8_t *ptr, double x)
+{
+  uint64_t v;
+  memcpy(&v, &x, sizeof(double));
+  return hitsout_put64(ptr, v);
+}
+
+static const uint8_t *
+hitsout_get32(const uint8_t *ptr, uint32_t *ret_v)
+{
+  uint32_t v;
+  memcpy(&v, ptr, sizeof(uint32_t));
+  *ret_v = esl_ntoh32(v);
+  return ptr + sizeof(uint32_t);
+}
+
+static const uint8_t *
+hitsout_get64(const uint8_t *ptr, uint64_t *ret_v)
+{
+  uint64_t v;
+  memcpy(&v, ptr, sizeof(uint64_t));
+  *ret_v = esl_ntoh64(v);
+  return ptr + sizeof(uint64_t);
+}
+
+static const uint8_t *
+hitsout_getdouble(const uint8_t *ptr, double *ret_x)
+{
+  uint64_t v;
+  ptr = hitsout_get64(ptr, &v);
+  memcpy(ret_x, &v, sizeof(double));
+  return ptr;
+}
+
+
+/* Function:  p7_tophits_WriteBinary()
+ * Synopsis:  Save a query's hit list and pipeline accounting.
+ *
+ * Purpose:   Append one binary record to open stream <ofp>, saving
+ *            the hit list <th> for query <qname> (with optional
+ *            accession <qacc> and description <qdesc>, either of
+ *            which may be <NULL> or empty), and the search space
+ *            accounting from pipeline <pli>. <qlen> is the length
+ *            of the query, <M> for a profile or <L> for a sequence;
+ *            it's only used for output.
+ *
+ *            Hits are saved in sorted order if <th> is sorted, else
+ *            in the order they were found. Their reporting and
+ *            inclusion flags are saved too, but a reader that has
+ *            merged lists will usually recalculate them with
+ *            <p7_tophits_Threshold()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslEWRITE> on write failure.
+ *            <eslERANGE> if the record would be 4GB or more, which
+ *            the hit serialization can't address.
+ */
+int
+p7_tophits_WriteBinary(FILE *ofp, const char *qname, const char *qacc, const char *qdesc, int64_t qlen, const P7_TOPHITS *th, const P7_PIPELINE *pli)
+{
+  uint8_t  *buf    = NULL;
+  uint8_t  *ptr;
+  uint32_t  n;
+  uint32_t  nalloc;
+  uint8_t   flags  = 0;
+  size_t    nname  = strlen(qname) + 1;
+  size_t    nacc   = (qacc  && *qacc)  ? strlen(qacc)  + 1 : 0;
+  size_t    ndesc  = (qdesc && *qdesc) ? strlen(qdesc) + 1 : 0;
+  int       sorted = (th->is_sorted_by_sortkey || th->is_sorted_by_seqidx);
+  uint64_t  h;
+  int       status;
+
+  if (nacc)  flags |= HITSOUT_ACC;
+  if (ndesc) flags |= HITSOUT_DESC;
+
+  nalloc = HITSOUT_HDRSIZE + HITSOUT_FIXEDSIZE + nname + nacc + ndesc;
+  ESL_ALLOC(buf, nalloc);
+
+  ptr = buf;
+  memcpy(ptr, p7_HITSOUT_MAGIC, 4);                     ptr += 4;
+  ptr = hitsout_put32(ptr, p7_HITSOUT_VERSION);
+  ptr = hitsout_put64(ptr, 0);                           /* size; filled in below */
+
+  ptr = hitsout_put32(ptr, (uint32_t) pli->mode);
+  ptr = hitsout_put32(ptr, (uint32_t) pli->long_targets);
+  ptr = hitsout_put32(ptr, (uint32_t) pli->Z_setby);
+  ptr = hitsout_put32(ptr, (uint32_t) pli->domZ_setby);
+  ptr = hitsout_put64(ptr, (uint64_t) qlen);
+  ptr = hitsout_putdouble(ptr, pli->Z);
+  ptr = hitsout_putdouble(ptr, pli->domZ);
+  ptr = hitsout_put64(ptr, pli->nmodels);
+  ptr = hitsout_put64(ptr, pli->nseqs);
+  ptr = hitsout_put64(ptr, pli->nres);
+  ptr = hitsout_put64(ptr, pli->nnodes);
+  ptr = hitsout_put64(ptr, pli->n_past_msv);
+  ptr = hitsout_put64(ptr, pli->n_past_bias);
+  ptr = hitsout_put64(ptr, pli->n_past_vit);
+  ptr = hitsout_put64(ptr, pli->n_past_fwd);
+  ptr = hitsout_put64(ptr, pli->n_output);
+  ptr = hitsout_put64(ptr, pli->pos_past_msv);
+  ptr = hitsout_put64(ptr, pli->pos_past_bias);
+  ptr = hitsout_put64(ptr, pli->pos_past_vit);
+  ptr = hitsout_put64(ptr, pli->pos_past_fwd);
+  ptr = hitsout_put64(ptr, pli->pos_output);
+  ptr = hitsout_put64(ptr, th->N);
+  *ptr++ = flags;
+  memcpy(ptr, qname, nname);                   ptr += nname;
+  if (nacc)  { memcpy(ptr, qacc,  nacc);       ptr += nacc;  }
+  if (ndesc) { memcpy(ptr, qdesc, ndesc);      ptr += ndesc; }
+
+  n = ptr - buf;
+  for (h = 0; h < th->N; h++)
+    {
+      if ((status = p7_hit_Serialize( (sorted ? th->hit[h] : th->unsrt + h), &buf, &n, &nalloc)) != eslOK) goto ERROR;
+      if (n > UINT32_MAX - (1 << 20)) ESL_XEXCEPTION(eslERANGE, "hit list for %s too big for a hitsout record", qname);
+    }
+  hitsout_put64(buf + 4 + sizeof(uint32_t), (uint64_t) n - HITSOUT_HDRSIZE);
+
+  if (fwrite(buf, 1, n, ofp) != n) ESL_XEXCEPTION_SYS(eslEWRITE, "hitsout write failed");
+  free(buf);
+  return eslOK;
+
+ ERROR:
+  if (buf) free(buf);
+  return status;
+}
+
+
+/* Function:  p7_tophits_ReadBinary()
+ * Synopsis:  Read a query's hit list and pipeline accounting.
+ *
+ * Purpose:   Read the next record from open stream <ifp>, written by
+ *            <p7_tophits_WriteBinary()>. Append its hits to hit list
+ *            <th>, unsorted. Overwrite the accounting fields of
+ *            pipeline <pli> (the target and model counts, filter
+ *            pass counts, <Z>, <domZ> and how they were set, and
+ *            <mode> and <long_targets>) with the record's; leave its
+ *            thresholds alone.
+ *
+ *            Return the query's name, accession, and description in
+ *            <*ret_qname>, <*ret_qacc>, <*ret_qdesc> (the latter two
+ *            <NULL> if the query had none), and its length in
+ *            <*ret_qlen>. Caller frees the strings. Any of these may
+ *            be passed as <NULL> if caller doesn't want it.
+ *
+ *            Deserialized hits are <malloc()>'ed, not in <th>'s
+ *            arena; <p7_tophits_Destroy()> frees them all the same.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if there are no more records.
+ *
+ *            <eslEFORMAT> if the record is bad or truncated; <errbuf>,
+ *            if provided, contains an informative message.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_ReadBinary(FILE *ifp, P7_TOPHITS *th, P7_PIPELINE *pli, char **ret_qname, char **ret_qacc, char **ret_qdesc, int64_t *ret_qlen, char *errbuf)
+{
+  uint8_t        hdr[HITSOUT_HDRSIZE];
+  uint8_t       *buf    = NULL;
+  const uint8_t *ptr;
+  uint8_t        flags;
+  char          *qname  = NULL;
+  char          *qacc   = NULL;
+  char          *qdesc  = NULL;
+  uint32_t       version, v32, pos;
+  uint64_t       size, nhits, qlen, h;
+  size_t         nr;
+  P7_HIT        *hit;
+  int            status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  if ((nr = fread(hdr, 1, HITSOUT_HDRSIZE, ifp)) == 0) return eslEOF;
+  if (nr != HITSOUT_HDRSIZE)                      ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record header is truncated");
+  if (memcmp(hdr, p7_HITSOUT_MAGIC, 4) != 0)      ESL_XFAIL(eslEFORMAT, errbuf, "not a hitsout file (bad magic number)");
+  ptr = hitsout_get32(hdr + 4, &version);
+  if (version != p7_HITSOUT_VERSION)              ESL_XFAIL(eslEFORMAT, errbuf, "hitsout format version %u; expected %d", version, p7_HITSOUT_VERSION);
+  hitsout_get64(ptr, &size);
+  if (size < HITSOUT_FIXEDSIZE + 1 || size > UINT32_MAX - HITSOUT_HDRSIZE)
+    ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has bad size %" PRIu64, size);
+
+  ESL_ALLOC(buf, size);
+  if (fread(buf, 1, size, ifp) != size)           ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record is truncated");
+
+  ptr = buf;
+  ptr = hitsout_get32(ptr, &v32);   pli->mode         = (enum p7_pipemodes_e) v32;
+  ptr = hitsout_get32(ptr, &v32);   pli->long_targets = (int) v32;
+  ptr = hitsout_get32(ptr, &v32);   pli->Z_setby      = (enum p7_zsetby_e) v32;
+  ptr = hitsout_get32(ptr, &v32);   pli->domZ_setby   = (enum p7_zsetby_e) v32;
+  ptr = hitsout_get64(ptr, &qlen);
+  ptr = hitsout_getdouble(ptr, &(pli->Z));
+  ptr = hitsout_getdouble(ptr, &(pli->domZ));
+  ptr = hitsout_get64(ptr, &(pli->nmodels));
+  ptr = hitsout_get64(ptr, &(pli->nseqs));
+  ptr = hitsout_get64(ptr, &(pli->nres));
+  ptr = hitsout_get64(ptr, &(pli->nnodes));
+  ptr = hitsout_get64(ptr, &(pli->n_past_msv));
+  ptr = hitsout_get64(ptr, &(pli->n_past_bias));
+  ptr = hitsout_get64(ptr, &(pli->n_past_vit));
+  ptr = hitsout_get64(ptr, &(pli->n_past_fwd));
+  ptr = hitsout_get64(ptr, &(pli->n_output));
+  ptr = hitsout_get64(ptr, &(pli->pos_past_msv));
+  ptr = hitsout_get64(ptr, &(pli->pos_past_bias));
+  ptr = hitsout_get64(ptr, &(pli->pos_past_vit));
+  ptr = hitsout_get64(ptr, &(pli->pos_past_fwd));
+  ptr = hitsout_get64(ptr, &(pli->pos_output));
+  ptr = hitsout_get64(ptr, &nhits);
+  flags = *ptr++;
+
+  if (pli->mode != p7_SEARCH_SEQS && pli->mode != p7_SCAN_MODELS)                   ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has bad pipeline mode %d", (int) pli->mode);
+  if (pli->Z_setby    != p7_ZSETBY_NTARGETS && pli->Z_setby    != p7_ZSETBY_OPTION && pli->Z_setby    != p7_ZSETBY_FILEINFO) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has bad Z_setby");
+  if (pli->domZ_setby != p7_ZSETBY_NTARGETS && pli->domZ_setby != p7_ZSETBY_OPTION && pli->domZ_setby != p7_ZSETBY_FILEINFO) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has bad domZ_setby");
+
+  /* Query name, accession, description: each must be terminated inside the record */
+  if (memchr(ptr, '\0', size - (ptr - buf)) == NULL)                       ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has unterminated query name");
+  if ((status = esl_strdup((const char *) ptr, -1, &qname)) != eslOK) goto ERROR;
+  ptr += strlen(qname) + 1;
+  if (flags & HITSOUT_ACC) {
+    if (ptr >= buf + size || memchr(ptr, '\0', size - (ptr - buf)) == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has unterminated query accession");
+    if ((status = esl_strdup((const char *) ptr, -1, &qacc)) != eslOK) goto ERROR;
+    ptr += strlen(qacc) + 1;
+  }
+  if (flags & HITSOUT_DESC) {
+    if (ptr >= buf + size || memchr(ptr, '\0', size - (ptr - buf)) == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record has unterminated query description");
+    if ((status = esl_strdup((const char *) ptr, -1, &qdesc)) != eslOK) goto ERROR;
+    ptr += strlen(qdesc) + 1;
+  }
+
+  /* Hits. p7_hit_Deserialize() trusts its input, so at least make
+   * sure each one starts inside the record and the last one ends
+   * exactly at its end.
+   */
+  pos = ptr - buf;
+  for (h = 0; h < nhits; h++)
+    {
+      if (pos >= size) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record for %s is truncated at hit %" PRIu64, qname, h);
+      if ((status = p7_tophits_CreateNextHit(th, &hit)) != eslOK) goto ERROR;
+      if ((status = p7_hit_Deserialize(buf, &pos, hit))  != eslOK) {
+	/* a half-deserialized hit can't be freed safely; drop (leak) it */
+	hit->name = hit->acc = hit->desc = NULL;
+	hit->dcl  = NULL;
+	hit->ndom = 0;
+	if (status == eslEMEM) goto ERROR;
+	ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record for %s has a bad hit", qname);
+      }
+    }
+  if (pos != size) ESL_XFAIL(eslEFORMAT, errbuf, "hitsout record for %s: hits end at byte %u of %" PRIu64, qname, pos, size);
+
+  free(buf);
+  if (ret_qname) *ret_qname = qname; else free(qname);
+  if (ret_qacc)  *ret_qacc  = qacc;  else if (qacc)  free(qacc);
+  if (ret_qdesc) *ret_qdesc = qdesc; else if (qdesc) free(qdesc);
+  if (ret_qlen)  *ret_qlen  = (int64_t) qlen;
+  return eslOK;
+
+ ERROR:
+  if (buf)   free(buf);
+  if (qname) free(qname);
+  if (qacc)  free(qacc);
+  if (qdesc) free(qdesc);
+  if (ret_qname) *ret_qname = NULL;
+  if (ret_qacc)  *ret_qacc  = NULL;
+  if (ret_qdesc) *ret_qdesc = NULL;
+  if (ret_qlen)  *ret_qlen  = 0;
+  return status;
+}
+/*------------------- end, binary output ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 5. Benchmark driver
  *****************************************************************/
 #ifdef p7TOPHITS_BENCHMARK
 /* 
@@ -2090,11 +3011,8 @@ main(int argc, char **argv)
       p7_tophits_SortBySortkey(h[j]);
   }
   /* then merge them into one big list in h[0] */
-  for (j = 1; j < M; j++)
-  {
-      p7_tophits_Merge(h[0], h[j]);
-      p7_tophits_Destroy(h[j]);
-  }
+  p7_tophits_MergeList(h[0], h+1, M-1);
+  for (j = 1; j < M; j++) p7_tophits_Destroy(h[j]);
 
   esl_stopwatch_Stop(w);
 
@@ -2112,7 +3030,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 5. Test driver
+ * 6. Test driver
  *****************************************************************/
 
 #ifdef p7TOPHITS_TESTDRIVE
@@ -2140,11 +3058,341 @@ static ESL_OPTIONS options[] = {
 static char usage[]  = "[-options]";
 static char banner[] = "test driver for P7_TOPHITS";
 
+/* The radix sort and the k-way merge have to give exactly the order
+ * that qsort() with hit_sorter_by_sortkey() gives. Use small integer
+ * sortkeys, so there are lots of ties for the tiebreakers, and unique
+ * names so the order is fully determined.
+ */
+static void
+utest_sort_merge(ESL_RANDOMNESS *r, int N, int nlist)
+{
+  char        msg[]  = "tophits sort/merge unit test failed";
+  P7_TOPHITS *h      = p7_tophits_Create();
+  P7_TOPHITS *hl[8];
+  P7_HIT    **ref    = NULL;
+  char        name[32];
+  double      key;
+  uint64_t    ntot   = 0;
+  uint64_t    i;
+  int         L, n;
+  int         status;
+
+  if (nlist > 8) esl_fatal(msg);
+  for (L = 0; L <= nlist; L++)
+    {
+      if (L > 0) hl[L-1] = p7_tophits_Create();
+      n = (L % 2 ? N : esl_rnd_Roll(r, N+1));
+      for (i = 0; i < n; i++)
+	{
+	  key = (double) esl_rnd_Roll(r, 50) - 25.0;
+	  if (esl_rnd_Roll(r, 10) == 0) key = -0.0;
+	  sprintf(name, "seq%d.%d", L, (int) i);
+	  p7_tophits_Add( (L ? hl[L-1] : h), name, NULL, NULL, key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL);
+	}
+      ntot += n;
+    }
+
+  /* Sorting one list: radix vs. qsort */
+  if (p7_tophits_SortBySortkey(hl[0]) != eslOK) esl_fatal(msg);
+  ESL_ALLOC(ref, sizeof(P7_HIT *) * ESL_MAX(1, ntot));
+  for (i = 0; i < hl[0]->N; i++) ref[i] = hl[0]->unsrt + i;
+  qsort(ref, hl[0]->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+  for (i = 0; i < hl[0]->N; i++)
+    if (hl[0]->hit[i] != ref[i]) esl_fatal(msg);
+
+  /* Merging: k-way merge vs. qsort of everything */
+  if (p7_tophits_MergeList(h, hl, nlist) != eslOK) esl_fatal(msg);
+  if (h->N != ntot || ! h->is_sorted_by_sortkey)  esl_fatal(msg);
+  for (i = 0; i < ntot; i++) ref[i] = h->hit[i];
+  qsort(ref, ntot, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+  for (i = 0; i < ntot; i++)
+    if (h->hit[i] != ref[i]) esl_fatal(msg);
+
+  for (L = 0; L < nlist; L++) p7_tophits_Destroy(hl[L]);
+  p7_tophits_Destroy(h);
+  free(ref);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* Hits copied into the arena must be faithful copies of what the
+ * pipeline handed over, must survive a merge that adopts the other
+ * lists' arenas, and must mix with ordinary malloc()'ed hits; and
+ * Reuse() and Destroy() must release both kinds (run under valgrind
+ * to check that). 
+ */
+static void
+utest_arena(ESL_RANDOMNESS *r, int N, int nlist)
+{
+  char            msg[]  = "tophits arena unit test failed";
+  P7_TOPHITS     *h      = p7_tophits_Create();
+  P7_TOPHITS     *hl[8];
+  P7_TOPHITS     *th;
+  P7_HIT         *hit;
+  P7_DOMAIN       dcl[3];
+  P7_ALIDISPLAY **ad     = NULL;	/* reference alidisplays: ad[3k+d] for hit <k>, domain <d> */
+  char            name[32];
+  double          key;
+  int             nhits  = (nlist+1) * N;
+  int             round, L, i, k, d, z;
+  int             status;
+
+  if (nlist > 8) esl_fatal(msg);
+  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY *) * nhits * 3);
+  for (k = 0; k < nhits * 3; k++)
+    {
+      if (p7_alidisplay_Sample(r, 20 + esl_rnd_Roll(r, 100), &(ad[k])) != eslOK) esl_fatal(msg);
+      if (k % 2 && p7_alidisplay_Serialize_old(ad[k])                  != eslOK) esl_fatal(msg);
+    }
+  for (L = 0; L < nlist; L++) hl[L] = p7_tophits_Create();
+
+  for (round = 0; round < 2; round++)
+    {
+      /* Fill the lists; every other hit goes in the arena */
+      for (k = 0, L = 0; L <= nlist; L++)
+	for (th = (L ? hl[L-1] : h), i = 0; i < N; i++, k++)
+	  {
+	    key = (double) esl_rnd_Roll(r, 50);
+	    sprintf(name, "hit%d", k);
+	    if (k % 2) {
+	      p7_tophits_Add(th, name, NULL, "malloc()'ed", key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL);
+	      continue;
+	    }
+
+	    p7_tophits_CreateNextHit(th, &hit);
+	    hit->sortkey = key;
+	    hit->ndom    = 1 + k % 3;
+	    for (d = 0; d < hit->ndom; d++)
+	      {
+		memset(&(dcl[d]), 0, sizeof(P7_DOMAIN));
+		dcl[d].iali = dcl[d].ienv = k;
+		dcl[d].jali = dcl[d].jenv = k + ad[3*k+d]->N;
+		dcl[d].ad   = ad[3*k+d];
+		dcl[d].scores_per_pos = NULL;
+		if (d == 0) {
+		  ESL_ALLOC(dcl[d].scores_per_pos, sizeof(float) * ad[3*k+d]->N);
+		  for (z = 0; z < ad[3*k+d]->N; z++) dcl[d].scores_per_pos[z] = (float) (k + z);
+		}
+	      }
+	    if (p7_tophits_CopyHitNames  (th, hit, name, (k % 4 ? NULL : "acc"), NULL) != eslOK) esl_fatal(msg);
+	    if (p7_tophits_CopyHitDomains(th, hit, dcl, hit->ndom)                    != eslOK) esl_fatal(msg);
+	    free(dcl[0].scores_per_pos);	/* caller keeps ownership of its originals */
+	  }
+
+      if (p7_tophits_MergeList(h, hl, nlist) != eslOK) esl_fatal(msg);
+      if (h->N != nhits)                              esl_fatal(msg);
+
+      for (i = 0; i < h->N; i++)
+	{
+	  hit = h->hit[i];
+	  if (sscanf(hit->name, "hit%d", &k) != 1) esl_fatal(msg);
+	  if (hit->in_arena != (k % 2 == 0))       esl_fatal(msg);
+	  if (! hit->in_arena) continue;
+
+	  if ((k % 4 == 0) != (hit->acc != NULL)) esl_fatal(msg);
+	  if (hit->desc != NULL)                  esl_fatal(msg);
+	  if (hit->ndom != 1 + k % 3)             esl_fatal(msg);
+	  for (d = 0; d < hit->ndom; d++)
+	    {
+	      if (hit->dcl[d].iali != k)                                     esl_fatal(msg);
+	      if (hit->dcl[d].ad == ad[3*k+d])                               esl_fatal(msg);
+	      if (p7_alidisplay_Compare(hit->dcl[d].ad, ad[3*k+d]) != eslOK) esl_fatal(msg);
+	      if ((d == 0) != (hit->dcl[d].scores_per_pos != NULL))          esl_fatal(msg);
+	    }
+	  for (z = 0; z < hit->dcl[0].ad->N; z++)
+	    if (hit->dcl[0].scores_per_pos[z] != (float) (k + z)) esl_fatal(msg);
+	}
+
+      /* Second round reuses everything, including the kept arena chunk */
+      p7_tophits_Reuse(h);
+      for (L = 0; L < nlist; L++) p7_tophits_Reuse(hl[L]);
+    }
+
+  for (k = 0; k < nhits * 3; k++) p7_alidisplay_Destroy(ad[k]);
+  for (L = 0; L < nlist; L++)     p7_tophits_Destroy(hl[L]);
+  p7_tophits_Destroy(h);
+  free(ad);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* The pipeline's use of the arena: an alidisplay already built in the
+ * list's arena is taken over by p7_tophits_CopyHitDomains(), not
+ * copied; and p7_hitarena_Rewind() releases what was allocated since
+ * p7_hitarena_Mark(), spilled chunks included, leaving earlier hits
+ * intact.
+ */
+static void
+utest_arena_rewind(ESL_RANDOMNESS *r, int ntarget)
+{
+  char           msg[] = "tophits arena rewind unit test failed";
+  P7_TOPHITS    *h     = p7_tophits_Create();
+  P7_HIT        *hit;
+  P7_DOMAIN      dom;
+  P7_ALIDISPLAY *ad    = NULL;
+  P7_ALIDISPLAY *ad2;
+  int            t, nchunk;
+  size_t         used;
+
+  if (p7_alidisplay_Sample(r, 200, &ad)      != eslOK) esl_fatal(msg);
+  if (p7_alidisplay_Serialize_old(ad)        != eslOK) esl_fatal(msg);
+
+  for (t = 0; t < ntarget; t++)
+    {
+      nchunk = h->arena->nchunk;
+      used   = h->arena->used;
+      p7_hitarena_Mark(h->arena);
+      if ((ad2 = arena_alidisplay(h->arena, ad)) == NULL) esl_fatal(msg);  /* as p7_alidisplay_CreateInArena() would */
+      if (! arena_contains(h->arena, ad2))                 esl_fatal(msg);
+
+      if (t % 3)		/* not reported: give it back, sometimes along with a spilled chunk */
+	{
+	  if (t % 3 == 2 && t < 10 && p7_hitarena_Alloc(h->arena, h->arena->chunksize[h->arena->nchunk-1]) == NULL) esl_fatal(msg);
+	  p7_hitarena_Rewind(h->arena);
+	  if (h->arena->nchunk == nchunk) { if (h->arena->used != used) esl_fatal(msg); }
+	  else if (h->arena->nchunk != nchunk+1 || h->arena->used != 0)  esl_fatal(msg);
+	  continue;
+	}
+
+      p7_tophits_CreateNextHit(h, &hit);
+      memset(&dom, 0, sizeof(P7_DOMAIN));
+      dom.ad       = ad2;
+      hit->ndom    = 1;
+      hit->sortkey = (double) t;
+      if (p7_tophits_CopyHitNames  (h, hit, "hit", NULL, NULL) != eslOK) esl_fatal(msg);
+      if (p7_tophits_CopyHitDomains(h, hit, &dom, 1)           != eslOK) esl_fatal(msg);
+      if (hit->dcl[0].ad != ad2)                                        esl_fatal(msg);
+    }
+
+  if (h->N != (ntarget+2) / 3) esl_fatal(msg);
+  for (t = 0; t < h->N; t++)
+    if (p7_alidisplay_Compare(h->unsrt[t].dcl[0].ad, ad) != eslOK) esl_fatal(msg);
+
+  p7_alidisplay_Destroy(ad);
+  p7_tophits_Destroy(h);
+}
+
+/* utest_binary_read(): read one record from the <n> bytes in <rec> */
+static int
+utest_binary_read(const char *rec, long n, P7_PIPELINE *pli)
+{
+  FILE       *fp = tmpfile();
+  P7_TOPHITS *th = p7_tophits_Create();
+  char        errbuf[eslERRBUFSIZE];
+  int         status;
+
+  if (fp == NULL || fwrite(rec, 1, n, fp) != n) esl_fatal("utest_binary_read: tmpfile failed");
+  rewind(fp);
+  status = p7_tophits_ReadBinary(fp, th, pli, NULL, NULL, NULL, NULL, errbuf);
+  p7_tophits_Destroy(th);
+  fclose(fp);
+  return status;
+}
+
+/* Hit lists saved with p7_tophits_WriteBinary() must read back
+ * exactly, with their pipeline accounting and query info, several
+ * records to a file; and a truncated or damaged record has to be
+ * rejected with <eslEFORMAT>, not read as garbage.
+ */
+static void
+utest_binary(ESL_RAND64 *rng, int N, int nrec)
+{
+  char         msg[]  = "tophits binary output unit test failed";
+  P7_TOPHITS  *th[4];
+  P7_TOPHITS  *th2    = NULL;
+  P7_PIPELINE *pli    = p7_pipeline_Create(NULL, 100, 100, FALSE, p7_SEARCH_SEQS);
+  P7_PIPELINE *pli2   = p7_pipeline_Create(NULL, 100, 100, FALSE, p7_SCAN_MODELS);
+  P7_HIT      *sample = NULL;
+  P7_HIT      *hit    = NULL;
+  FILE        *fp     = NULL;
+  char        *qname  = NULL;
+  char        *qacc   = NULL;
+  char        *qdesc  = NULL;
+  char        *rec    = NULL;
+  char         name[32];
+  char         errbuf[eslERRBUFSIZE];
+  int64_t      qlen;
+  long         nrec0;
+  long         cut;
+  uint64_t     i;
+  int          r;
+  int          status;
+
+  if (nrec > 4 || nrec < 2)      esl_fatal(msg);
+  if ((fp = tmpfile()) == NULL)  esl_fatal(msg);
+
+  for (r = 0; r < nrec; r++)
+    {
+      th[r] = p7_tophits_Create();
+      for (i = 0; i < (r == 1 ? 0 : N + r); i++)   /* record 1 has no hits */
+	{
+	  if (p7_hit_TestSample(rng, &sample)       != eslOK) esl_fatal(msg);
+	  if (p7_tophits_CreateNextHit(th[r], &hit) != eslOK) esl_fatal(msg);
+	  *hit = *sample;	/* list takes over the sample's strings and domains */
+	  free(sample);
+	}
+      pli->nseqs      = 1000 * (r+1);
+      pli->nres       = 300000 * (r+1);
+      pli->n_past_msv = 20 * r;
+      pli->Z          = (double) pli->nseqs;
+      sprintf(name, "query%d", r);
+      if (p7_tophits_WriteBinary(fp, name, (r % 2 ? "PF00001.1" : NULL), (r % 2 ? NULL : "a description"), 100 + r, th[r], pli) != eslOK) esl_fatal(msg);
+      if (r == 0) nrec0 = ftell(fp);
+    }
+
+  rewind(fp);
+  for (r = 0; r < nrec; r++)
+    {
+      th2 = p7_tophits_Create();
+      if (p7_tophits_ReadBinary(fp, th2, pli2, &qname, &qacc, &qdesc, &qlen, errbuf) != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+      sprintf(name, "query%d", r);
+      if (strcmp(qname, name) != 0)                                esl_fatal(msg);
+      if ((qacc  != NULL) != (r % 2 == 1))                          esl_fatal(msg);
+      if ((qdesc != NULL) != (r % 2 == 0))                          esl_fatal(msg);
+      if (qlen != 100 + r)                                          esl_fatal(msg);
+      if (pli2->mode != p7_SEARCH_SEQS)                             esl_fatal(msg);
+      if (pli2->nseqs != 1000 * (r+1) || pli2->nres != 300000 * (r+1)) esl_fatal(msg);
+      if (pli2->n_past_msv != 20 * r || pli2->Z != 1000.0 * (r+1))  esl_fatal(msg);
+      if (th2->N != th[r]->N)                                       esl_fatal(msg);
+      for (i = 0; i < th2->N; i++)
+	if (p7_hit_Compare(th2->unsrt + i, th[r]->unsrt + i, 0.0, 0.0) != eslOK) esl_fatal(msg);
+      p7_tophits_Destroy(th2);
+      free(qname); if (qacc) free(qacc); if (qdesc) free(qdesc);
+    }
+  if (p7_tophits_ReadBinary(fp, th[0], pli2, NULL, NULL, NULL, NULL, errbuf) != eslEOF) esl_fatal(msg);
+
+  /* Every truncation of the first record fails, as does a bad magic number */
+  ESL_ALLOC(rec, nrec0);
+  rewind(fp);
+  if (fread(rec, 1, nrec0, fp) != nrec0) esl_fatal(msg);
+  for (cut = 1; cut < nrec0; cut += (cut < 64 ? 1 : 1 + nrec0 / 200))
+    if (utest_binary_read(rec, cut, pli2)  != eslEFORMAT) esl_fatal(msg);
+  if (utest_binary_read(rec, nrec0-1, pli2) != eslEFORMAT) esl_fatal(msg);
+  if (utest_binary_read(rec, nrec0,   pli2) != eslOK)      esl_fatal(msg);
+  rec[0] = 'X';
+  if (utest_binary_read(rec, nrec0,   pli2) != eslEFORMAT) esl_fatal(msg);
+
+  for (r = 0; r < nrec; r++) p7_tophits_Destroy(th[r]);
+  p7_pipeline_Destroy(pli);
+  p7_pipeline_Destroy(pli2);
+  free(rec);
+  fclose(fp);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
 int
 main(int argc, char **argv)
 {
   ESL_GETOPTS    *go       = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
   ESL_RANDOMNESS *r        = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_RAND64     *rng      = esl_rand64_Create(esl_opt_GetInteger(go, "-s"));
   int             N        = esl_opt_GetInteger(go, "-N");
   P7_TOPHITS     *h1       = NULL;
   P7_TOPHITS     *h2       = NULL;
@@ -2185,10 +3433,19 @@ main(int argc, char **argv)
   
   if (p7_tophits_GetMaxNameLength(h3) != strlen(name)) esl_fatal("GetMaxNameLength() failed");
 
+  utest_sort_merge(r, N,                        3);
+  utest_sort_merge(r, 4*p7_TOPHITS_RADIXSORT,   1);
+  utest_sort_merge(r, 2*p7_TOPHITS_RADIXSORT,   5);
+  utest_arena     (r, N,                        3);
+  utest_arena     (r, 2000,                     2); /* spills past the first arena chunk */
+  utest_arena_rewind(r, 100);
+  utest_binary    (rng, N,                      3);
+
   p7_tophits_Destroy(h1);
   p7_tophits_Destroy(h2);
   p7_tophits_Destroy(h3);
   esl_randomness_Destroy(r);
+  esl_rand64_Destroy(rng);
   esl_getopts_Destroy(go);
   return eslOK;
 }
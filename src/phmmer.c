@@ -100,8 +100,11 @@ static ESL_OPTIONS options[] = {
   { "--EfL",        eslARG_INT,         "100", NULL,"n>0",      NULL,  NULL,  NULL,              "length of sequences for Forward exp tail tau fit",            11 },   
   { "--EfN",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "number of sequences for Forward exp tail tau fit",            11 },   
   { "--Eft",        eslARG_REAL,       "0.04", NULL,"0<x<1",    NULL,  NULL,  NULL,              "tail mass for Forward exponential tail tau fit",              11 },   
+  { "--Etable",     eslARG_INFILE,      NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "fast calibration: estimate mu, tau from regression table <f>", 11 },
 /* other options */
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "turn off biased composition score corrections",               12 },
+  { "--adaptens",   eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "adaptively size stochastic trace ensembles",                  12 },
+  { "--domcpu",     eslARG_INT,         "0",   NULL, "n>=0",    NULL,  NULL,  NULL,              "threads for domain definition of long targets",               12 },
   { "-Z",           eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",    NULL,  NULL,  NULL,              "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
@@ -272,6 +275,8 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adaptens")  && fprintf(ofp, "# adaptive trace ensembles:        on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--domcpu")    && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--domcpu"))               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmL")       && fprintf(ofp, "# seq length, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmN")       && fprintf(ofp, "# seq number, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EvL")       && fprintf(ofp, "# seq length, Vit Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EvL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -279,6 +284,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--EfL")       && fprintf(ofp, "# seq length, Fwd exp tau fit:     %d\n",             esl_opt_GetInteger(go, "--EfL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EfN")       && fprintf(ofp, "# seq number, Fwd exp tau fit:     %d\n",             esl_opt_GetInteger(go, "--EfN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--Eft")       && fprintf(ofp, "# tail mass for Fwd exp tau fit:   %f\n",             esl_opt_GetReal   (go, "--Eft"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--Etable")    && fprintf(ofp, "# fast calibration table:          %s\n",             esl_opt_GetString (go, "--Etable"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -392,6 +398,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BG           *bg       = NULL;		  /* null model (copies made of this into threads)    */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
+  P7_EVTABLE      *evtable  = NULL;               /* fast E-value calibration table (--Etable)        */
+  char             errbuf[eslERRBUFSIZE];
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                       */
   int              nquery   = 0;
   int              seed;
@@ -403,6 +411,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              ncpus    = 0;
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;   /* worker hit lists to merge into info[0].th */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -441,11 +450,17 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   bld->EfL = esl_opt_GetInteger(go, "--EfL");
   bld->EfN = esl_opt_GetInteger(go, "--EfN");
   bld->Eft = esl_opt_GetReal   (go, "--Eft");
+  if (esl_opt_IsOn(go, "--Etable")) {
+    if (p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &evtable, errbuf) != eslOK) p7_Fail("Failed to read E-value calibration table:\n%s\n", errbuf);
+    bld->evtable = evtable;
+  }
 
   /* Default is stored in the --mx option, so it's always IsOn(). Check --mxfile first; then go to the --mx option and the default. */
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (evtable && p7_evtable_Compatible(evtable, bld, bg, errbuf) != eslOK)
+    p7_Fail("E-value calibration table %s doesn't apply to this search:\n%s\n", esl_opt_GetString(go, "--Etable"), errbuf);
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  p7_Fail("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); } 
@@ -486,10 +501,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
     }
+  bld->ncpu = ncpus;		/* workers are idle while the master calibrates each query */
 #endif
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* Show header output */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -590,10 +607,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
 
-      /* merge the results of the search results */
+      /* merge the results of the search results: each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeList(info[0].th, thl, infocnt-1);
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
@@ -673,12 +691,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thl);
   esl_sqfile_Close(dbfp);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
   esl_sq_Destroy(qsq);
   p7_bg_Destroy(bg);
   p7_builder_Destroy(bld);
+  p7_evtable_Destroy(evtable);
   esl_alphabet_Destroy(abc);
 
   if (ofp      != stdout) fclose(ofp);
@@ -879,6 +899,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   ESL_SQ          *dbsq     = NULL;               /* target sequence                                  */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
+  P7_EVTABLE      *evtable  = NULL;               /* fast E-value calibration table (--Etable)        */
+  char             errbuf[eslERRBUFSIZE];
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                       */
   int              nquery   = 0;
   int              seed;
@@ -890,6 +912,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   char            *mpi_buf  = NULL;               /* buffer used to pack/unpack structures            */
   int              mpi_size = 0;                  /* size of the allocated buffer                     */
+  P7_TOPHITS     **mpi_thl  = NULL;              /* each worker's hit list for the current query */
   BLOCK_LIST      *list     = NULL;
   SEQ_BLOCK        block;
 
@@ -934,10 +957,16 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   bld->EfL = esl_opt_GetInteger(go, "--EfL");
   bld->EfN = esl_opt_GetInteger(go, "--EfN");
   bld->Eft = esl_opt_GetReal   (go, "--Eft");
+  if (esl_opt_IsOn(go, "--Etable")) {
+    if (p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &evtable, errbuf) != eslOK) mpi_failure("Failed to read E-value calibration table:\n%s\n", errbuf);
+    bld->evtable = evtable;
+  }
 
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (evtable && p7_evtable_Compatible(evtable, bld, bg, errbuf) != eslOK)
+    mpi_failure("E-value calibration table %s doesn't apply to this search:\n%s\n", esl_opt_GetString(go, "--Etable"), errbuf);
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o")          && (ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  
@@ -976,6 +1005,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure ("Unexpected error %d opening sequence file %s\n", status, cfg->qfile);
   qsq  = esl_sq_CreateDigital(abc);
 
+  ESL_ALLOC(mpi_thl, sizeof(P7_TOPHITS *) * cfg->nproc);
   ESL_ALLOC(list, sizeof(SEQ_BLOCK));
   list->complete = 0;
   list->size     = 0;
@@ -1091,29 +1121,35 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
 	}
 
-      /* merge the results of the search results */
+      /* send an empty block to every worker to signal they are done */
       for (dest = 1; dest < cfg->nproc; ++dest)
+	MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+
+      /* collect the results in whatever order the workers finish */
+      for (i = 1; i < cfg->nproc; ++i)
 	{
 	  P7_PIPELINE     *mpi_pli   = NULL;
 	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
-	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
+	  if (MPI_Probe(MPI_ANY_SOURCE, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
+	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
+	  dest = mpistatus.MPI_SOURCE;
 
-	  /* wait for the results */
 	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
 
 	  if ((status = p7_pipeline_MPIRecv(dest, HMMER_PIPELINE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, go, &mpi_pli)) != eslOK)
 	    mpi_failure("Unexpected error %d receiving pipeline from %d", status, dest);
 
-	  p7_tophits_Merge(th, mpi_th);
 	  p7_pipeline_Merge(pli, mpi_pli);
-
 	  p7_pipeline_Destroy(mpi_pli);
-	  p7_tophits_Destroy(mpi_th);
+	  mpi_thl[dest-1] = mpi_th;
 	}
 
+      /* merge the search results in rank order, so output doesn't depend on who finished first */
+      p7_tophits_MergeList(th, mpi_thl, cfg->nproc-1);
+      for (dest = 1; dest < cfg->nproc; ++dest) p7_tophits_Destroy(mpi_thl[dest-1]);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(th);
       p7_tophits_Threshold(th, pli);
@@ -1192,6 +1228,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Cleanup - prepare for successful exit
    */
   free(list);
+  free(mpi_thl);
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_bg_Destroy(bg);
@@ -1202,6 +1239,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sq_Destroy(dbsq);
   esl_sq_Destroy(qsq);
   p7_builder_Destroy(bld);
+  p7_evtable_Destroy(evtable);
   esl_alphabet_Destroy(abc);
 
   if (ofp      != stdout) fclose(ofp);
@@ -1228,6 +1266,8 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   ESL_SQ          *dbsq     = NULL;               /* target sequence                                  */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
+  P7_EVTABLE      *evtable  = NULL;               /* fast E-value calibration table (--Etable)        */
+  char             errbuf[eslERRBUFSIZE];
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                       */
   int              seed;
   int              status   = eslOK;
@@ -1270,10 +1310,16 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   bld->EfL = esl_opt_GetInteger(go, "--EfL");
   bld->EfN = esl_opt_GetInteger(go, "--EfN");
   bld->Eft = esl_opt_GetReal   (go, "--Eft");
+  if (esl_opt_IsOn(go, "--Etable")) {
+    if (p7_evtable_Read(esl_opt_GetString(go, "--Etable"), &evtable, errbuf) != eslOK) mpi_failure("Failed to read E-value calibration table:\n%s\n", errbuf);
+    bld->evtable = evtable;
+  }
 
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (evtable && p7_evtable_Compatible(evtable, bld, bg, errbuf) != eslOK)
+    mpi_failure("E-value calibration table %s doesn't apply to this search:\n%s\n", esl_opt_GetString(go, "--Etable"), errbuf);
 
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -1384,6 +1430,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sq_Destroy(dbsq);
   esl_sq_Destroy(qsq);
   p7_builder_Destroy(bld);
+  p7_evtable_Destroy(evtable);
   esl_alphabet_Destroy(abc);
   return eslOK;
 }
@@ -1526,6 +1573,7 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  p7_tophits_SortBySortkey(info->th); /* so the master only has to merge */
   esl_threads_Finished(obj, workeridx);
   return;
 }
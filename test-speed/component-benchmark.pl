@@ -9,6 +9,9 @@
 # each component of H3's pipeline. Output an ASCII summary table to
 # stdout.
 #
+# For JSON output with confidence intervals, and comparison to a
+# previous run, see src/hmmer-bench instead.
+#
 # SRE, Thu Mar 10 09:07:38 2011
 
 $top_builddir = shift;
@@ -16,16 +19,16 @@ $top_srcdir   = shift;
 
 #@benchmarks = ( "./generic_fwdback_benchmark -F", "./msvfilter_benchmark" );
   	
-@benchmarks = ( "src/impl/msvfilter_benchmark", 
- 		"src/impl/vitfilter_benchmark",
- 		"src/impl/fwdback_benchmark -PF",
-  		"src/impl/fwdback_benchmark -PB",
- 		"src/impl/fwdback_benchmark -F",
-  		"src/impl/fwdback_benchmark -B",
-  		"src/impl/decoding_benchmark",
-  		"src/impl/null2_benchmark",
-  		"src/impl/null2_benchmark -t",
-  		"src/impl/optacc_benchmark",
+@benchmarks = ( "src/impl_sse/msvfilter_benchmark", 
+ 		"src/impl_sse/vitfilter_benchmark",
+ 		"src/impl_sse/fwdback_benchmark -PF",
+  		"src/impl_sse/fwdback_benchmark -PB",
+ 		"src/impl_sse/fwdback_benchmark -F",
+  		"src/impl_sse/fwdback_benchmark -B",
+  		"src/impl_sse/decoding_benchmark",
+  		"src/impl_sse/null2_benchmark",
+  		"src/impl_sse/null2_benchmark -t",
+  		"src/impl_sse/optacc_benchmark",
 		"src/generic_msv_benchmark",
 		"src/generic_viterbi_benchmark",
 		"src/generic_fwdback_benchmark -F",
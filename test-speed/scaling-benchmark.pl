@@ -0,0 +1,507 @@
+#! /usr/bin/perl
+
+# Thread scaling and throughput benchmarks for the search programs.
+#
+# Usage:     ./scaling-benchmark.pl [options] <top_builddir> <top_srcdir> <resultdir>
+# Example:   ./scaling-benchmark.pl --cpu 1,2,4,8 ../build-icc .. sc-new > sc-new.json
+#
+# Runs hmmsearch, hmmscan, phmmer, nhmmer and hmmpgmd over a matrix of
+# thread counts (--cpu), target database sizes, and queries of
+# different lengths, and outputs one JSON result per run: wall clock
+# time, residues/sec, speedup and parallel efficiency relative to the
+# smallest thread count, peak RSS, and the fraction of targets
+# passing each stage of the acceleration pipeline. The output of two
+# builds on the same machine can be compared with diff, or with
+# --baseline.
+#
+# Databases and queries are synthetic, generated in <resultdir>:
+# targets are iid random sequences (esl-shuffle -G) with a few
+# homologs of each query (hmmemit) mixed in; queries are HMMs from
+# <top_srcdir>/testsuite, and their consensus sequences for phmmer.
+# To benchmark on a profmark set instead, give its prefix with
+# --profmark <pfx>: targets are then <pfx>.fa and queries are built
+# from the first alignments in <pfx>.msa (see create-profmark).
+#
+# Peak RSS is the VmHWM of the process, polled from /proc; it's -1 on
+# systems without /proc. For hmmpgmd it's the worker's.
+#
+# Options:
+#   --cpu <list>       thread counts to run           [0,1,2,4]
+#                      (hmmpgmd skips 0; its worker needs a thread)
+#   --programs <list>  programs to run                [hmmsearch,hmmscan,phmmer,nhmmer,hmmpgmd]
+#   --dbsizes <list>   number of target seqs          [10000,100000]
+#   --queries <list>   protein query models           [RRM_1,Caudal_act,LuxC,SMC_N]
+#   --ntqueries <list> DNA query models (nhmmer)      [2OG-FeII_Oxy_3-nt]
+#   --L <n>            mean target length             [350]
+#   --nscan <n>        number of query seqs (hmmscan) [1000]
+#   --reps <n>         time each run <n> times, keep the fastest [1]
+#   --seed <n>         random number seed             [42]
+#   --profmark <pfx>   use profmark set <pfx> instead of synthetic data
+#   --baseline <f>     compare to a previous run's output in <f>
+#   --tol <x>          flag slowdowns of more than fraction <x> [0.10]
+#   --pgmd_timeout <s> give up on an hmmc2 query after <s> sec [600]
+#
+# For timing HMMER against other programs, see speed-master.pl; for
+# timing individual DP kernels, src/hmmer-bench.
+
+use Getopt::Long;
+use Time::HiRes qw(time sleep);
+use IO::Socket;
+use POSIX ":sys_wait_h";
+
+$SIG{INT} = \&catch_sigint;
+
+$opt_cpu       = "0,1,2,4";
+$opt_programs  = "hmmsearch,hmmscan,phmmer,nhmmer,hmmpgmd";
+$opt_dbsizes   = "10000,100000";
+$opt_queries   = "RRM_1,Caudal_act,LuxC,SMC_N";
+$opt_ntqueries = "2OG-FeII_Oxy_3-nt";
+$opt_L         = 350;
+$opt_nscan     = 1000;
+$opt_reps      = 1;
+$opt_seed      = 42;
+$opt_profmark  = "";
+$opt_baseline  = "";
+$opt_tol       = 0.10;
+$opt_pgmd_timeout = 600;
+&GetOptions("cpu=s"       => \$opt_cpu,
+	    "programs=s"  => \$opt_programs,
+	    "dbsizes=s"   => \$opt_dbsizes,
+	    "queries=s"   => \$opt_queries,
+	    "ntqueries=s" => \$opt_ntqueries,
+	    "L=i"         => \$opt_L,
+	    "nscan=i"     => \$opt_nscan,
+	    "reps=i"      => \$opt_reps,
+	    "seed=i"      => \$opt_seed,
+	    "profmark=s"  => \$opt_profmark,
+	    "baseline=s"  => \$opt_baseline,
+	    "tol=f"       => \$opt_tol,
+	    "pgmd_timeout=i" => \$opt_pgmd_timeout) || die("bad options");
+
+if ($#ARGV != 2) { die("Usage: ./scaling-benchmark.pl [options] <top_builddir> <top_srcdir> <resultdir>"); }
+$top_builddir = shift;
+$top_srcdir   = shift;
+$resultdir    = shift;
+
+@cpus      = split(/,/, $opt_cpu);
+@programs  = split(/,/, $opt_programs);
+@dbsizes   = split(/,/, $opt_dbsizes);
+@queries   = split(/,/, $opt_queries);
+@ntqueries = split(/,/, $opt_ntqueries);
+@cpus      = sort { $a <=> $b } @cpus;
+
+$hmmbuild    = "$top_builddir/src/hmmbuild";
+$hmmemit     = "$top_builddir/src/hmmemit";
+$hmmpress    = "$top_builddir/src/hmmpress";
+$hmmc2       = "$top_builddir/src/hmmc2";
+$esl_shuffle = "$top_builddir/easel/miniapps/esl-shuffle";
+$esl_reformat= "$top_builddir/easel/miniapps/esl-reformat";
+$esl_afetch  = "$top_builddir/easel/miniapps/esl-afetch";
+
+foreach $prog (@programs, "hmmbuild", "hmmemit", "hmmpress") {
+    if (! -x "$top_builddir/src/$prog") { die("didn't find $prog executable in $top_builddir/src"); }
+}
+if (grep(/^hmmpgmd$/, @programs) && ! -x $hmmc2) { die("hmmpgmd benchmark needs $hmmc2"); }
+
+# hmmpgmd uses nondefault ports, like the testsuite
+$host    = "127.0.0.1";
+$cport   = 51383;
+$wport   = 51384;
+$pgmd_active = 0;
+
+if (-e $resultdir) { die("$resultdir exists"); }
+system("mkdir $resultdir");
+
+&read_baseline($opt_baseline) if ($opt_baseline ne "");
+
+# The queries: HMMs, and consensus seqs for phmmer.
+if ($opt_profmark ne "")
+{
+    @queries = ();
+    $output = `$esl_afetch --index $opt_profmark.msa 2>&1`;
+    if ($?) { die("esl-afetch --index failed on $opt_profmark.msa"); }
+    open(PMTBL, "$opt_profmark.tbl") || die("failed to open $opt_profmark.tbl");
+    while (<PMTBL>) { if (/^(\S+)/ && $#queries < 3) { push(@queries, $1); } }
+    close PMTBL;
+    foreach $query (@queries) {
+	`$esl_afetch -o $resultdir/$query.sto $opt_profmark.msa $query > /dev/null`;  if ($?) { die("esl-afetch failed on $query"); }
+	`$hmmbuild $resultdir/$query.hmm $resultdir/$query.sto > /dev/null`;          if ($?) { die("hmmbuild failed on $query");   }
+    }
+    @ntqueries = ();
+    @dbsizes   = ( &count_seqs("$opt_profmark.fa") );
+}
+else
+{
+    foreach $query (@queries, @ntqueries) {
+	if (! -e "$top_srcdir/testsuite/$query.hmm") { die("no query model $query.hmm in $top_srcdir/testsuite"); }
+	system("cp $top_srcdir/testsuite/$query.hmm $resultdir/$query.hmm");
+    }
+}
+foreach $query (@queries) {
+    `$hmmemit -c -o $resultdir/$query.cons.fa $resultdir/$query.hmm`;  if ($?) { die("hmmemit -c failed on $query"); }
+    $M{$query} = &model_length("$resultdir/$query.hmm");
+    $M{scan}  += $M{$query};
+}
+foreach $query (@ntqueries) {
+    $M{$query} = &model_length("$resultdir/$query.hmm");
+}
+
+# hmmscan's target database: all the protein queries, pressed.
+if (grep(/^hmmscan$/, @programs))
+{
+    system("cat " . join(" ", map { "$resultdir/$_.hmm" } @queries) . " > $resultdir/scan.hmm");
+    `$hmmpress $resultdir/scan.hmm`;                                                          if ($?) { die("hmmpress failed"); }
+    `$esl_shuffle -G --amino -N $opt_nscan -L $opt_L --seed $opt_seed -o $resultdir/scan.fa`; if ($?) { die("esl-shuffle failed"); }
+}
+
+print "{\n";
+print "  \"program\": \"scaling-benchmark\",\n";
+printf "  \"builddir\": \"%s\",\n", $top_builddir;
+printf "  \"date\": \"%s\",\n", scalar localtime;
+printf "  \"ncores\": %d,\n", &count_cores();
+print "  \"results\": [";
+$nresults     = 0;
+$nregressions = 0;
+
+foreach $dbsize (@dbsizes)
+{
+    # The target databases: protein, and DNA with about the same number of residues.
+    if ($opt_profmark ne "") { $db = "$opt_profmark.fa"; }
+    else                     { $db = &make_db("$resultdir/db$dbsize", "--amino", $dbsize, $opt_L, @queries); }
+    if (grep(/^nhmmer$/, @programs) && $#ntqueries >= 0) {
+	$ntdb = &make_db("$resultdir/ntdb$dbsize", "--dna", int($dbsize/100)+1, $opt_L*100, @ntqueries);
+    }
+
+    foreach $program (@programs)
+    {
+	if ($program eq "hmmscan")
+	{   # one run, all the models; its size is set by --nscan, not dbsize
+	    next if ($dbsize != $dbsizes[0]);
+	    &scaling_series($program, "scan", $opt_nscan, sub { "$top_builddir/src/hmmscan --cpu $_[0] $resultdir/scan.hmm $resultdir/scan.fa" });
+	}
+	elsif ($program eq "hmmpgmd")
+	{
+	    &pgmd_series($db, $dbsize);
+	}
+	else
+	{
+	    foreach $query ($program eq "nhmmer" ? @ntqueries : @queries)
+	    {
+		$target = ($program eq "nhmmer" ? $ntdb : $db);
+		$qfile  = ($program eq "phmmer" ? "$resultdir/$query.cons.fa" : "$resultdir/$query.hmm");
+		&scaling_series($program, $query, $dbsize, sub { "$top_builddir/src/$program --cpu $_[0] $qfile $target" });
+	    }
+	}
+    }
+}
+
+print "\n  ]";
+if ($opt_baseline ne "") { printf(",\n  \"baseline\": \"%s\",\n  \"tolerance\": %g,\n  \"nregressions\": %d", $opt_baseline, $opt_tol, $nregressions); }
+print "\n}\n";
+exit ($nregressions > 0 ? 1 : 0);
+
+
+# scaling_series(program, query, dbsize, cmdfunc)
+# Time a program at each thread count; cmdfunc(ncpu) returns its command line.
+sub scaling_series
+{
+    my ($program, $query, $dbsize, $cmdfunc) = @_;
+    my ($ncpu, $rep, $wall, $rss, $best, $bestrss, $stats, $t1);
+
+    $t1 = 0;
+    foreach $ncpu (@cpus)
+    {
+	$best = -1;
+	$bestrss = -1;
+	for ($rep = 0; $rep < $opt_reps; $rep++)
+	{
+	    ($wall, $rss) = &run_timed(&$cmdfunc($ncpu), "$resultdir/out");
+	    if ($best < 0 || $wall < $best) { $best = $wall; }
+	    if ($rss > $bestrss)            { $bestrss = $rss; }
+	}
+	$stats = &parse_stats("$resultdir/out");
+	if ($t1 == 0) { $t1 = $best; }
+	&output_result($program, $query, $M{$query}, $dbsize, $ncpu, $cpus[0], $best, $t1, $bestrss, $stats);
+    }
+    unlink "$resultdir/out";
+}
+
+# pgmd_series(db, dbsize)
+# Start an hmmpgmd master and worker for each thread count, and time
+# searches of each query model through hmmc2. Each hmmc2 script ends
+# with a bare // line; without it, hmmc2 waits for one forever at EOF.
+# An hmmc2 run that takes longer than --pgmd_timeout is killed, and the
+# rest of the hmmpgmd series for this database is skipped.
+sub pgmd_series
+{
+    my ($db, $dbsize) = @_;
+    my ($ncpu, $query, $rep, $wall, $best, $rss, $stats, $status);
+    my (%t1, @pgmd_cpus);
+
+    @pgmd_cpus = grep { $_ > 0 } @cpus;    # a worker needs at least one thread
+
+    if (! -e "$db.hmmpgmd") {
+	`$esl_reformat --id_map $db.hmmpgmd.map hmmpgmd $db > $db.hmmpgmd`;  if ($?) { die("esl-reformat hmmpgmd failed"); }
+    }
+    foreach $query (@queries) {
+	open(SCRIPT, ">$resultdir/$query.pgmd") || die("failed to create hmmc2 script");
+	print SCRIPT "\@--seqdb 1\n";
+	open(HMM, "$resultdir/$query.hmm") || die("failed to open $query.hmm");
+	while (<HMM>) { print SCRIPT; }
+	close HMM;
+	print SCRIPT "//\n";
+	close SCRIPT;
+    }
+
+    foreach $ncpu (@pgmd_cpus)
+    {
+	if (IO::Socket::INET->new(PeerHost => $host, PeerPort => $wport, Proto => 'tcp') ||
+	    IO::Socket::INET->new(PeerHost => $host, PeerPort => $cport, Proto => 'tcp'))
+	{ die("hmmpgmd worker port $wport or client port $cport already in use"); }
+
+	system("$top_builddir/src/hmmpgmd --master --wport $wport --cport $cport --seqdb $db.hmmpgmd --pid $resultdir/master.pid > /dev/null 2>&1 &");
+	$pgmd_active = 1;
+	sleep 2;
+	system("$top_builddir/src/hmmpgmd --worker $host --wport $wport --cpu $ncpu --pid $resultdir/worker.pid > /dev/null 2>&1 &");
+	sleep 2;
+	if (! &wait_for_pgmd_worker("$resultdir/$queries[0].pgmd")) { &stop_pgmd(); return; }
+
+	foreach $query (@queries)
+	{
+	    $best = -1;
+	    for ($rep = 0; $rep < $opt_reps; $rep++)
+	    {
+		($status, $wall) = &run_limited("$hmmc2 -i $host -p $cport -S < $resultdir/$query.pgmd", "$resultdir/out", $opt_pgmd_timeout);
+		if ($status == -1) { warn("hmmc2 timed out on $query; skipping the rest of the hmmpgmd series\n"); &stop_pgmd(); return; }
+		if ($status)       { &stop_pgmd(); die("FAILED: hmmc2 on $query"); }
+		if ($best < 0 || $wall < $best) { $best = $wall; }
+	    }
+	    $rss   = &peak_rss(&read_pid("$resultdir/worker.pid"));
+	    $stats = &parse_stats("$resultdir/out");
+	    if (! defined($t1{$query})) { $t1{$query} = $best; }
+	    &output_result("hmmpgmd", $query, $M{$query}, $dbsize, $ncpu, $pgmd_cpus[0], $best, $t1{$query}, $rss, $stats);
+	}
+	&stop_pgmd();
+    }
+    unlink "$resultdir/out";
+}
+
+# run_timed(cmd, outfile)
+# Run <cmd> with stdout to <outfile>; return wall clock time, and peak
+# RSS in kB polled from /proc while it runs (or -1).
+sub run_timed
+{
+    my ($cmd, $outfile) = @_;
+    my ($status, $wall, $rss);
+
+    ($status, $wall, $rss) = &run_limited($cmd, $outfile, 0);
+    if ($status) { die("FAILED: $cmd"); }
+    return ($wall, $rss);
+}
+
+# run_limited(cmd, outfile, limit)
+# As run_timed(), but don't die: return the exit status too, first.
+# If <limit> > 0 and <cmd> runs longer than <limit> seconds, kill it
+# and return status -1.
+sub run_limited
+{
+    my ($cmd, $outfile, $limit) = @_;
+    my ($pid, $t0, $t1, $rss, $r);
+
+    $rss = -1;
+    $t0  = time();
+    $pid = fork();
+    if (! defined($pid)) { die("fork failed"); }
+    if ($pid == 0) { exec("exec $cmd > $outfile 2>/dev/null") || die("exec failed: $cmd"); }
+    while (waitpid($pid, WNOHANG) == 0)
+    {
+	if ($limit > 0 && time() - $t0 > $limit) {
+	    kill('TERM', $pid);
+	    waitpid($pid, 0);
+	    return (-1, time() - $t0, $rss);
+	}
+	$r = &peak_rss($pid);
+	if ($r > $rss) { $rss = $r; }
+	sleep(0.05);
+    }
+    $t1 = time();
+    return ($?, $t1 - $t0, $rss);
+}
+
+# parse_stats(outfile)
+# Pull the pipeline statistics out of a program's output: residues
+# searched, and fraction passing each filter stage.
+sub parse_stats
+{
+    my ($outfile) = @_;
+    my (%stats);
+
+    %stats = ( nres => 0, msv => -1, bias => -1, vit => -1, fwd => -1 );
+    open(OUT, $outfile) || die("failed to open $outfile");
+    while (<OUT>)
+    {
+	if    (/^Target sequences:\s+\d+\s+\((\d+) residues searched\)/)  { $stats{nres} += $1; }
+	elsif (/^Query sequence\(s\):\s+\d+\s+\((\d+) residues searched\)/){ $stats{nres} += $1; }
+	elsif (/^(?:Passed|Residues passing) (MSV|SSV|bias|Vit|Fwd) filter:\s*\d+\s+\((\S+)\)/)
+	{
+	    $stage = lc($1);
+	    if ($stage eq "ssv") { $stage = "msv"; }
+	    $stats{$stage} = $2;      # for a multiquery run, the last query's
+	}
+    }
+    close OUT;
+    return \%stats;
+}
+
+# output_result()
+# One JSON result line. Speedup is relative to time <t1> at the smallest
+# thread count <ncpu1>; efficiency divides that by the ratio of threads,
+# counting --cpu 0 as one thread.
+sub output_result
+{
+    my ($program, $query, $M, $dbsize, $ncpu, $ncpu1, $wall, $t1, $rss, $stats) = @_;
+    my ($rps, $speedup, $efficiency, $old, $change, $is_regression);
+
+    $rps        = ($wall > 0 ? $stats->{nres} / $wall : 0);
+    $speedup    = ($wall > 0 ? $t1 / $wall : 0);
+    $efficiency = $speedup / ( ($ncpu > 0 ? $ncpu : 1) / ($ncpu1 > 0 ? $ncpu1 : 1) );
+
+    printf("%s\n    { \"program\": \"%s\", \"query\": \"%s\", \"M\": %d, \"dbsize\": %d, \"cpu\": %d, \"wall\": %.3f, \"res_per_sec\": %.0f, \"speedup\": %.3f, \"efficiency\": %.3f, \"peak_rss_kb\": %d, \"pass_msv\": %g, \"pass_bias\": %g, \"pass_vit\": %g, \"pass_fwd\": %g",
+	   ($nresults > 0 ? "," : ""), $program, $query, $M, $dbsize, $ncpu, $wall, $rps, $speedup, $efficiency, $rss,
+	   $stats->{msv}, $stats->{bias}, $stats->{vit}, $stats->{fwd});
+
+    if (defined($old = $baseline{"$program $query $dbsize $ncpu"}) && $old > 0)
+    {
+	$change        = ($rps - $old) / $old;
+	$is_regression = ($change < -$opt_tol ? 1 : 0);
+	printf(", \"baseline\": %.0f, \"change\": %.4f, \"regression\": %s", $old, $change, $is_regression ? "true" : "false");
+	$nregressions += $is_regression;
+    }
+    print " }";
+    $nresults++;
+}
+
+# read_baseline(file)
+# Read res_per_sec of each run from a previous run's output.
+sub read_baseline
+{
+    my ($file) = @_;
+
+    open(BASE, $file) || die("failed to open baseline $file");
+    while (<BASE>)
+    {
+	if (/"program": "(\S+)", "query": "(\S+)",.*"dbsize": (\d+), "cpu": (\d+),.*"res_per_sec": (\S+?),/) {
+	    $baseline{"$1 $2 $3 $4"} = $5;
+	}
+    }
+    close BASE;
+}
+
+# make_db(prefix, alphabet, nseq, L, queries...)
+# Generate <nseq> iid random seqs of length <L>, plus 10 homologs of
+# each query model, shuffled together into <prefix>.fa.
+sub make_db
+{
+    my ($prefix, $alph, $nseq, $L, @dbqueries) = @_;
+    my ($query);
+
+    if (-e "$prefix.fa") { return "$prefix.fa"; }
+    `$esl_shuffle -G $alph -N $nseq -L $L --seed $opt_seed -o $prefix.neg`;   if ($?) { die("esl-shuffle failed"); }
+    system("cp $prefix.neg $prefix.fa");
+    foreach $query (@dbqueries) {
+	`$hmmemit -N 10 --seed $opt_seed $resultdir/$query.hmm >> $prefix.fa`;  if ($?) { die("hmmemit failed on $query"); }
+    }
+    unlink "$prefix.neg";
+    return "$prefix.fa";
+}
+
+sub model_length
+{
+    my ($hmmfile) = @_;
+    my ($M) = -1;
+    open(HMM, $hmmfile) || die("failed to open $hmmfile");
+    while (<HMM>) { if (/^LENG\s+(\d+)/) { $M = $1; last; } }
+    close HMM;
+    return $M;
+}
+
+sub count_seqs
+{
+    my ($seqfile) = @_;
+    my ($n) = 0;
+    open(SEQS, $seqfile) || die("failed to open $seqfile");
+    while (<SEQS>) { if (/^>/) { $n++; } }
+    close SEQS;
+    return $n;
+}
+
+sub count_cores
+{
+    my ($n) = 0;
+    if (open(CPUINFO, "/proc/cpuinfo")) {
+	while (<CPUINFO>) { if (/^processor\s*:/) { $n++; } }
+	close CPUINFO;
+    }
+    return $n;
+}
+
+# peak_rss(pid)
+# VmHWM of a running process in kB, or -1 if we can't tell.
+sub peak_rss
+{
+    my ($pid) = @_;
+    my ($rss) = -1;
+    if (defined($pid) && open(STATUS, "/proc/$pid/status")) {
+	while (<STATUS>) { if (/^VmHWM:\s+(\d+)\s+kB/) { $rss = $1; last; } }
+	close STATUS;
+    }
+    return $rss;
+}
+
+sub read_pid
+{
+    my ($pidfile) = @_;
+    my ($pid);
+    open(PID, $pidfile) || return undef;
+    $pid = <PID>;
+    close PID;
+    chomp $pid;
+    return $pid;
+}
+
+# wait_for_pgmd_worker(scriptfile)
+# The master answers queries only once a worker has loaded the database;
+# run an untimed query, retrying until that works. Return 1 when it
+# does; 0 (with a warning) if a query hangs past --pgmd_timeout.
+sub wait_for_pgmd_worker
+{
+    my ($scriptfile) = @_;
+    my ($ntry) = 30;
+    my ($status);
+    while ($ntry-- > 0) {
+	($status) = &run_limited("$hmmc2 -i $host -p $cport -S < $scriptfile", "/dev/null", $opt_pgmd_timeout);
+	if ($status == 0)  { return 1; }
+	if ($status == -1) { warn("hmmc2 timed out waiting for hmmpgmd; skipping the hmmpgmd series\n"); return 0; }
+	sleep 2;
+    }
+    &stop_pgmd();
+    die("hmmpgmd didn't answer");
+}
+
+sub stop_pgmd
+{
+    my ($pid);
+    if ($pgmd_active) {
+	if (defined($pid = &read_pid("$resultdir/master.pid"))) { `kill $pid`; }
+	if (defined($pid = &read_pid("$resultdir/worker.pid"))) { `kill $pid`; }
+	unlink "$resultdir/master.pid", "$resultdir/worker.pid";
+	$pgmd_active = 0;
+	sleep 1;
+    }
+}
+
+sub catch_sigint
+{
+    &stop_pgmd();
+    die "sigint signal captured; killed daemons\n";
+}
@@ -0,0 +1,127 @@
+#! /usr/bin/env perl
+
+# Test the hmmpgmd_load load generator against a small local hmmpgmd
+# master and worker: synthetic hmmscan queries, closed-loop with two
+# connections and then open-loop at a fixed rate, and a replayed query
+# log. Every query should complete, with no errors.
+#
+# Usage:   ./i24-hmmpgmd-load.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i24-hmmpgmd-load.pl ..         ..       tmpfoo
+
+use IO::Socket;
+use Fcntl ':flock';
+
+$SIG{INT} = \&catch_sigint;
+
+$builddir = shift;
+$srcdir   = shift;
+$tmppfx   = shift;
+
+$host    = "127.0.0.1";
+$cport   = 51375;               # nondefault ports, different from the other daemon tests
+$wport   = 51376;
+
+# Only one daemon test at a time; see i19-hmmpgmd-ga.pl.
+$ntry     = 10;
+$lockfile = "/tmp/esl-hmmpgmd-test.lock";
+umask 0011;
+open my $lock, '>>', $lockfile or die("FAIL: failed to open $lockfile for flocking: $1");
+chmod 0666, $lockfile;
+while (! flock $lock, LOCK_EX | LOCK_NB)
+{
+    if ($ntry == 0) { die("FAIL: $0 is already running"); }
+    $ntry--;
+    sleep(3);
+}
+
+@h3progs = ("hmmpgmd", "hmmpgmd_load", "hmmpress");
+foreach $h3prog  (@h3progs) { if (! -x "$builddir/src/$h3prog") { die "FAIL: didn't find $h3prog executable in $builddir/src\n"; } }
+
+# The daemon needs threads; without them, skip the test.
+$have_threads = `cat $builddir/src/p7_config.h | grep "^#define HMMER_THREADS"`;
+if ($have_threads eq "") {
+    printf("HMMER_THREADS not defined in p7_config.h\n");
+    exit 0;
+}
+
+if ( IO::Socket::INET->new(PeerHost => $host, PeerPort => $wport, Proto => 'tcp') ||
+     IO::Socket::INET->new(PeerHost => $host, PeerPort => $cport, Proto => 'tcp'))
+{
+    die "FAIL: worker port $wport or client port $cport already in use";
+}
+
+# A small HMM database, and a query log of two hmmscan queries.
+`cat $srcdir/testsuite/RRM_1.hmm $srcdir/testsuite/Caudal_act.hmm $srcdir/testsuite/LuxC.hmm > $tmppfx.hmm`;
+`$builddir/src/hmmpress -f $tmppfx.hmm`;  if ($?) { die "FAIL: hmmpress"; }
+open(LOG, ">$tmppfx.log") || die "FAIL: couldn't create the query log";
+print LOG <<"EOF";
+\@--hmmdb 1
+>q1
+MNKIYIGNLSPAVTADDLRQLFGDRKLPLAGQVLLKSGYAFVDYPDQNWAIRAIETLSGKVELHGKIMEVDYSVSKK
+//
+\@--hmmdb 1 -E 0.01
+>q2
+ACDEFGHIKLMNPQRSTVWYACDEFGHIKLMNPQRSTVWYACDEFGHIKLMNPQRSTVWY
+//
+EOF
+close LOG;
+
+$daemon_active = 0;
+system("$builddir/src/hmmpgmd --master --wport $wport --cport $cport --hmmdb $tmppfx.hmm --pid $tmppfx.pid  > /dev/null 2>&1 &");
+if ($?) { die "FAIL: hmmpgmd master failed to start";  }
+$daemon_active = 1;
+sleep 2;
+system("$builddir/src/hmmpgmd --worker 127.0.0.1 --wport $wport --cpu 1   > /dev/null 2>&1 &");
+if ($?) { &tear_down(); die "FAIL: hmmpgmd worker failed to start";  }
+sleep 2;
+
+# closed loop, two connections
+&run_load("--phmmer 0 --hmmscan 1 -L 100 --npool 4 -N 20 --conc 2", 20);
+
+# open loop, 20 queries/sec
+&run_load("--phmmer 0 --hmmscan 1 -L 100 --npool 4 -N 10 --conc 2 --qps 20", 10);
+
+# replay the log, twice around
+&run_load("-N 4 $tmppfx.log", 4);
+
+# the per-query table
+$output = `cat $tmppfx.tbl`;
+if ($output !~ /^\s+3 hmmscan\s+\S+\s+\d+ ok$/m) { &tear_down(); die "FAIL: per-query table is wrong"; }
+
+&tear_down();
+print "ok\n";
+exit 0;
+
+
+sub run_load
+{
+    my ($opts, $n) = @_;
+    my ($output);
+
+    $output = `$builddir/src/hmmpgmd_load -i $host -p $cport -o $tmppfx.tbl $opts 2>&1`;
+    if ($?) { &tear_down(); die "FAIL: hmmpgmd_load $opts returned nonzero exit status\n$output"; }
+    if ($output !~ /^# queries completed:\s+$n of $n$/m)     { &tear_down(); die "FAIL: hmmpgmd_load $opts didn't complete $n queries\n$output"; }
+    if ($output !~ /^all\s+$n\s+0\s+\S+\s+\S+\s+\S+\s+\S+/m) { &tear_down(); die "FAIL: hmmpgmd_load $opts latency summary is wrong\n$output"; }
+}
+
+sub tear_down
+{
+    if ($daemon_active) {
+        open PID, "<$tmppfx.pid";
+        my $pid = <PID>;
+        close PID;
+        `kill $pid`;
+	$daemon_active = 0;
+    }
+    close($lock);
+    unlink <$tmppfx.hmm*>;
+    unlink "$tmppfx.log";
+    unlink "$tmppfx.tbl";
+    unlink "$tmppfx.pid";
+}
+
+sub catch_sigint
+{
+    &tear_down();
+    die "sigint signal captured; killed daemons\n";
+}
@@ -0,0 +1,83 @@
+#! /usr/bin/perl
+
+# Test that jackhmmer --dbcache, and --dbcache --fcache, give the same
+# results as a plain jackhmmer search, over several rounds, both
+# serially and with worker threads; and that with --dbcache, the
+# target database can come through a stdin pipe.
+#
+# --fcache skips targets that it can prove would fail the MSV filter
+# again. A wrong bound would silently lose hits in rounds >= 2, so the
+# rounds after the first are where this test matters.
+#
+# The target database is big enough to make more than one block of
+# the in-memory cache, so threaded rounds >= 2 have to rewind the
+# cache properly to see every target exactly once.
+#
+# Usage:   ./i25-jackhmmer-dbcache.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i25-jackhmmer-dbcache.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.db              <seqdb>   20 globin-like seqs + globins45 + 2500 random seqs
+# $tmppfx.tbl{1,2,...}    --tblout output of each run, comments stripped
+
+@h3progs  = ("hmmemit", "jackhmmer");
+@eslprogs = ("esl-shuffle");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")             { die "FAIL: didn't find $h3prog executable in $builddir/src\n";             } }
+foreach $eslprog (@eslprogs) { if (! -x "$builddir/easel/miniapps/$eslprog") { die "FAIL: didn't find $eslprog executable in $builddir/easel/miniapps\n"; } }
+
+$have_threads = `cat $builddir/src/p7_config.h | grep "^#define HMMER_THREADS"`;
+
+`$builddir/src/hmmemit -p -N20 --seed 1 $srcdir/tutorial/globins4.hmm                > $tmppfx.db`;  if ($?) { die "FAIL: hmmemit\n"; }
+`cat $srcdir/tutorial/globins45.fa                                                  >> $tmppfx.db`;  if ($?) { die "FAIL: cat\n"; }
+`$builddir/easel/miniapps/esl-shuffle --seed 1 -G -N2500 -L 200 --amino             >> $tmppfx.db`;  if ($?) { die "FAIL: esl-shuffle\n"; }
+
+$prog  = "$builddir/src/jackhmmer";
+$opts  = "-N 3 --EmL 10 --EvL 10 --EfL 10";
+$query = "$srcdir/tutorial/HBB_HUMAN";
+
+@cpuopts = ("");
+if ($have_threads ne "") { @cpuopts = ("--cpu 0", "--cpu 2"); }
+
+foreach $cpu (@cpuopts)
+{
+    if ($verbose) { print "jackhmmer $cpu...\n"; }
+    &run_tbl("$cpu",                    "$tmppfx.tbl1");
+    &run_tbl("$cpu --dbcache",          "$tmppfx.tbl2");
+    &compare("$tmppfx.tbl1", "$tmppfx.tbl2", "--dbcache $cpu");
+    &run_tbl("$cpu --dbcache --fcache", "$tmppfx.tbl5");
+    &compare("$tmppfx.tbl1", "$tmppfx.tbl5", "--dbcache --fcache $cpu");
+}
+
+`cat $tmppfx.db | $prog $opts --dbcache --tblout $tmppfx.tbl3 $query - > /dev/null 2>&1`;  if ($?) { die "FAIL: jackhmmer --dbcache on <seqdb> from stdin\n"; }
+`grep -v "^#" $tmppfx.tbl3 > $tmppfx.tbl4`;
+&compare("$tmppfx.tbl1", "$tmppfx.tbl4", "--dbcache with <seqdb> from stdin");
+
+print "ok\n";
+unlink "$tmppfx.db";
+unlink <$tmppfx.tbl*>;
+exit 0;
+
+
+sub run_tbl
+{
+    my ($extra, $tblfile) = @_;
+
+    `$prog $opts $extra --tblout $tblfile.raw $query $tmppfx.db > /dev/null 2>&1`;   if ($?) { die "FAIL: jackhmmer $extra\n"; }
+    `grep -v "^#" $tblfile.raw > $tblfile`;
+}
+
+sub compare
+{
+    my ($f1, $f2, $what) = @_;
+
+    if (-z $f1) { die "FAIL: jackhmmer found no hits; test is uninformative\n"; }
+    `diff -b $f1 $f2 2>&1 > /dev/null`;  if ($?) { die "FAIL: jackhmmer results differ with $what\n"; }
+}
@@ -0,0 +1,52 @@
+#! /usr/bin/perl
+
+# Test that hmmbuild --stream, which reads an aligned FASTA file one
+# sequence at a time, builds the same model as an ordinary in-memory
+# hmmbuild of the same alignment.
+#
+# Streamed PB weights are computed over all columns, not just
+# consensus ones, so the models are only expected to be identical
+# with --wnone. --fast is the only architecture --stream can use. A
+# streamed model has no CKSUM line, since there is no MSA to checksum.
+#
+# Usage:   ./i26-hmmbuild-stream.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i26-hmmbuild-stream.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.afa             <msafile>   an alignment, reformatted to aligned FASTA
+# $tmppfx.hmm{1,2}        <hmmfile>   in-memory and streamed models
+# $tmppfx.cmp{1,2}        models with DATE, COM and CKSUM lines stripped
+
+@h3progs  = ("hmmbuild");
+@eslprogs = ("esl-reformat");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")             { die "FAIL: didn't find $h3prog executable in $builddir/src\n";             } }
+foreach $eslprog (@eslprogs) { if (! -x "$builddir/easel/miniapps/$eslprog") { die "FAIL: didn't find $eslprog executable in $builddir/easel/miniapps\n"; } }
+
+$opts = "--amino --fast --wnone --informat afa -n test";
+
+foreach $ali ("globins4.sto", "fn3.sto", "Pkinase.sto")
+{
+    if ($verbose) { print "$ali...\n"; }
+    `$builddir/easel/miniapps/esl-reformat afa $srcdir/tutorial/$ali > $tmppfx.afa`;  if ($?) { die "FAIL: esl-reformat $ali\n"; }
+
+    `$builddir/src/hmmbuild $opts          $tmppfx.hmm1 $tmppfx.afa > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmbuild on $ali\n"; }
+    `$builddir/src/hmmbuild $opts --stream $tmppfx.hmm2 $tmppfx.afa > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmbuild --stream on $ali\n"; }
+
+    `grep -v "^DATE" $tmppfx.hmm1 | grep -v "^COM" | grep -v "^CKSUM" > $tmppfx.cmp1`;
+    `grep -v "^DATE" $tmppfx.hmm2 | grep -v "^COM" | grep -v "^CKSUM" > $tmppfx.cmp2`;
+    `diff -b $tmppfx.cmp1 $tmppfx.cmp2 2>&1 > /dev/null`;  if ($?) { die "FAIL: hmmbuild --stream model differs from in-memory model of $ali\n"; }
+}
+
+print "ok\n";
+unlink "$tmppfx.afa";
+unlink <$tmppfx.hmm*>;
+unlink <$tmppfx.cmp*>;
+exit 0;
@@ -0,0 +1,57 @@
+#! /usr/bin/perl
+
+# Test that hmmsim gives the same results for any number of worker
+# threads. Each block of random sequences has its own RNG stream,
+# seeded from --seed, so --cpu 1 and --cpu 4 have to agree exactly,
+# and with a serial (--cpu 0) run.
+#
+# A two-model file exercises the overlap of the master configuring the
+# next model while workers are still scoring the last one.
+#
+# Usage:   ./i27-hmmsim-threads.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i27-hmmsim-threads.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.hmm             <hmmfile>   globins4 + fn3
+# $tmppfx.out{0,1,4}      -o output of each run
+# $tmppfx.ali{0,1,4}      --afile (Viterbi) or --pfile output of each run
+
+@h3progs  = ("hmmsim");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog") { die "FAIL: didn't find $h3prog executable in $builddir/src\n"; } }
+
+$have_threads = `cat $builddir/src/p7_config.h | grep "^#define HMMER_THREADS"`;
+if ($have_threads eq "") { print "ok\n"; exit 0; }   # nothing to compare without threads
+
+`cat $srcdir/tutorial/globins4.hmm $srcdir/tutorial/fn3.hmm > $tmppfx.hmm`;  if ($?) { die "FAIL: cat\n"; }
+
+foreach $mode ("", "--msv", "--fwd")
+{
+    if ($verbose) { print "hmmsim $mode...\n"; }
+    $aopts = ($mode eq "" ? "-a --afile $tmppfx.ali" : "--pfile $tmppfx.ali");   # -a is Viterbi-only
+    foreach $ncpu (0, 1, 4)
+    {
+	`$builddir/src/hmmsim $mode --seed 42 -N 1000 --cpu $ncpu -o $tmppfx.out$ncpu $aopts$ncpu $tmppfx.hmm > /dev/null 2>&1`;
+	if ($?) { die "FAIL: hmmsim $mode --cpu $ncpu\n"; }
+    }
+    if (-z "$tmppfx.out1") { die "FAIL: hmmsim $mode produced no output\n"; }
+
+    foreach $ncpu (0, 4)
+    {
+	`diff -b $tmppfx.out1 $tmppfx.out$ncpu 2>&1 > /dev/null`;  if ($?) { die "FAIL: hmmsim $mode results differ, --cpu 1 vs --cpu $ncpu\n"; }
+	`diff -b $tmppfx.ali1 $tmppfx.ali$ncpu 2>&1 > /dev/null`;  if ($?) { die "FAIL: hmmsim $mode --afile/--pfile differs, --cpu 1 vs --cpu $ncpu\n"; }
+    }
+}
+
+print "ok\n";
+unlink "$tmppfx.hmm";
+unlink <$tmppfx.out*>;
+unlink <$tmppfx.ali*>;
+exit 0;
@@ -0,0 +1,74 @@
+#! /usr/bin/perl
+
+# Test that a search split by target database and put back together
+# with hmmmerge gives the same result as a single search of the whole
+# database: same hits, same scores, same E-values (Z and domZ are
+# recomputed from the merged counts), in both --tblout and --domtblout.
+#
+# Usage:   ./i28-hmmmerge.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i28-hmmmerge.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.hmm               <hmmfile>   globins4 + fn3 queries
+# $tmppfx.db                <seqdb>     globins45 + 7LESS_DROME + 1000 random seqs
+# $tmppfx.db{1,2,3}         <seqdb>     the same database, split three ways
+# $tmppfx.hits{1,2,3}       --hitsout output of each piece's search
+# $tmppfx.tbl, .dom         tables of the single search
+# $tmppfx.mtbl, .mdom       tables of the merged search
+
+@h3progs  = ("hmmsearch", "hmmmerge");
+@eslprogs = ("esl-reformat", "esl-shuffle");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")             { die "FAIL: didn't find $h3prog executable in $builddir/src\n";             } }
+foreach $eslprog (@eslprogs) { if (! -x "$builddir/easel/miniapps/$eslprog") { die "FAIL: didn't find $eslprog executable in $builddir/easel/miniapps\n"; } }
+
+`cat $srcdir/tutorial/globins4.hmm $srcdir/tutorial/fn3.hmm > $tmppfx.hmm`;                       if ($?) { die "FAIL: cat\n"; }
+`cat $srcdir/tutorial/globins45.fa > $tmppfx.db`;                                                  if ($?) { die "FAIL: cat\n"; }
+`$builddir/easel/miniapps/esl-reformat fasta $srcdir/tutorial/7LESS_DROME >> $tmppfx.db`;          if ($?) { die "FAIL: esl-reformat\n"; }
+`$builddir/easel/miniapps/esl-shuffle --seed 1 -G -N1000 -L 300 --amino >> $tmppfx.db`;            if ($?) { die "FAIL: esl-shuffle\n"; }
+
+# Deal the sequences round robin into three pieces, so that
+# each piece gets some of the hits.
+open(DB, "$tmppfx.db") || die "FAIL: couldn't open $tmppfx.db\n";
+for ($p = 1; $p <= 3; $p++) { open($piece[$p], ">$tmppfx.db$p") || die "FAIL: couldn't open $tmppfx.db$p for writing\n"; }
+$nseq = 0;
+while (<DB>)
+{
+    if (/^>/) { $nseq++; }
+    print { $piece[($nseq-1) % 3 + 1] } $_;
+}
+close DB;
+for ($p = 1; $p <= 3; $p++) { close $piece[$p]; }
+
+`$builddir/src/hmmsearch --tblout $tmppfx.tbl.raw --domtblout $tmppfx.dom.raw $tmppfx.hmm $tmppfx.db > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmsearch on whole database\n"; }
+for ($p = 1; $p <= 3; $p++)
+{
+    `$builddir/src/hmmsearch --hitsout $tmppfx.hits$p $tmppfx.hmm $tmppfx.db$p > /dev/null 2>&1`;                       if ($?) { die "FAIL: hmmsearch --hitsout on piece $p\n"; }
+}
+`$builddir/src/hmmmerge --tblout $tmppfx.mtbl.raw --domtblout $tmppfx.mdom.raw $tmppfx.hits1 $tmppfx.hits2 $tmppfx.hits3 > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmmerge\n"; }
+
+`grep -v "^#" $tmppfx.tbl.raw  > $tmppfx.tbl`;
+`grep -v "^#" $tmppfx.dom.raw  > $tmppfx.dom`;
+`grep -v "^#" $tmppfx.mtbl.raw > $tmppfx.mtbl`;
+`grep -v "^#" $tmppfx.mdom.raw > $tmppfx.mdom`;
+
+if (-z "$tmppfx.tbl") { die "FAIL: hmmsearch found no hits; test is uninformative\n"; }
+`diff -b $tmppfx.tbl $tmppfx.mtbl 2>&1 > /dev/null`;  if ($?) { die "FAIL: merged --tblout differs from single search\n"; }
+`diff -b $tmppfx.dom $tmppfx.mdom 2>&1 > /dev/null`;  if ($?) { die "FAIL: merged --domtblout differs from single search\n"; }
+
+print "ok\n";
+unlink "$tmppfx.hmm";
+unlink <$tmppfx.db*>;
+unlink <$tmppfx.hits*>;
+unlink <$tmppfx.tbl*>;
+unlink <$tmppfx.dom*>;
+unlink <$tmppfx.mtbl*>;
+unlink <$tmppfx.mdom*>;
+exit 0;
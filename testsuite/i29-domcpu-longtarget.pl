@@ -0,0 +1,95 @@
+#! /usr/bin/perl
+
+# Test that threaded domain definition (--domcpu) of a long target gives
+# the same domains and alignments as the serial calculation.
+#
+# Only targets of at least 10000 residues (P7_DOMAINDEF's par_minL)
+# have their regions defined in parallel, so the target here is one
+# ~20kb sequence: 7LESS_DROME (many fn3 domains, close together, so
+# some regions need stochastic trace clustering), followed by globin
+# emissions separated by random spacers.
+#
+# Usage:   ./i29-domcpu-longtarget.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i29-domcpu-longtarget.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.hmm             <hmmfile>   globins4 + fn3 queries
+# $tmppfx.pieces          <seqfile>   7LESS_DROME, globin emissions, random spacers
+# $tmppfx.db              <seqdb>     the pieces joined into one long target
+# $tmppfx.{tbl,dom,sto}N  --tblout, --domtblout, -A output of each run, comments stripped
+
+@h3progs  = ("hmmemit", "hmmsearch");
+@eslprogs = ("esl-reformat", "esl-shuffle");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")             { die "FAIL: didn't find $h3prog executable in $builddir/src\n";             } }
+foreach $eslprog (@eslprogs) { if (! -x "$builddir/easel/miniapps/$eslprog") { die "FAIL: didn't find $eslprog executable in $builddir/easel/miniapps\n"; } }
+
+$have_threads = `cat $builddir/src/p7_config.h | grep "^#define HMMER_THREADS"`;
+if ($have_threads eq "") { print "ok\n"; exit 0; }   # --domcpu needs threads
+
+`cat $srcdir/tutorial/globins4.hmm $srcdir/tutorial/fn3.hmm > $tmppfx.hmm`;                            if ($?) { die "FAIL: cat\n"; }
+`$builddir/easel/miniapps/esl-reformat fasta $srcdir/tutorial/7LESS_DROME          > $tmppfx.pieces`;   if ($?) { die "FAIL: esl-reformat\n"; }
+`$builddir/src/hmmemit -p -N30 --seed 1 $srcdir/tutorial/globins4.hmm               >> $tmppfx.pieces`;  if ($?) { die "FAIL: hmmemit\n"; }
+`$builddir/easel/miniapps/esl-shuffle --seed 1 -G -N30 -L 400 --amino              >> $tmppfx.pieces`;  if ($?) { die "FAIL: esl-shuffle\n"; }
+
+# Join the pieces: 7LESS_DROME, then globin, spacer, globin, spacer...
+open(PIECES, "$tmppfx.pieces") || die "FAIL: couldn't open $tmppfx.pieces\n";
+$n = -1;
+while (<PIECES>)
+{
+    if (/^>/) { $n++; $seq[$n] = ""; next; }
+    chomp;
+    $seq[$n] .= $_;
+}
+close PIECES;
+$longseq = $seq[0];
+for ($i = 1; $i <= 30; $i++) { $longseq .= $seq[$i] . $seq[$i+30]; }
+if (length($longseq) < 10000) { die "FAIL: long target is too short to be defined in parallel\n"; }
+
+open(DB, ">$tmppfx.db") || die "FAIL: couldn't open $tmppfx.db for writing\n";
+print DB ">longseq\n";
+for ($i = 0; $i < length($longseq); $i += 60) { print DB substr($longseq, $i, 60), "\n"; }
+close DB;
+
+&run_search("--cpu 0",             1);
+&run_search("--cpu 0 --domcpu 2",  2);  &compare(1, 2, "--domcpu 2");
+&run_search("--cpu 0 --domcpu 4",  3);  &compare(1, 3, "--domcpu 4");
+&run_search("--cpu 2 --domcpu 2",  4);  &compare(1, 4, "--cpu 2 --domcpu 2");
+
+print "ok\n";
+unlink "$tmppfx.hmm";
+unlink "$tmppfx.pieces";
+unlink "$tmppfx.db";
+unlink <$tmppfx.tbl*>;
+unlink <$tmppfx.dom*>;
+unlink <$tmppfx.sto*>;
+exit 0;
+
+
+sub run_search
+{
+    my ($opts, $n) = @_;
+
+    `$builddir/src/hmmsearch $opts --tblout $tmppfx.tbl$n.raw --domtblout $tmppfx.dom$n.raw -A $tmppfx.sto$n.raw $tmppfx.hmm $tmppfx.db > /dev/null 2>&1`;
+    if ($?) { die "FAIL: hmmsearch $opts\n"; }
+    `grep -v "^#" $tmppfx.tbl$n.raw > $tmppfx.tbl$n`;
+    `grep -v "^#" $tmppfx.dom$n.raw > $tmppfx.dom$n`;
+    `grep -v "^#" $tmppfx.sto$n.raw > $tmppfx.sto$n`;
+}
+
+sub compare
+{
+    my ($n1, $n2, $what) = @_;
+
+    if (-z "$tmppfx.dom$n1") { die "FAIL: hmmsearch found no domains; test is uninformative\n"; }
+    `diff -b $tmppfx.tbl$n1 $tmppfx.tbl$n2 2>&1 > /dev/null`;  if ($?) { die "FAIL: --tblout differs with $what\n"; }
+    `diff -b $tmppfx.dom$n1 $tmppfx.dom$n2 2>&1 > /dev/null`;  if ($?) { die "FAIL: --domtblout differs with $what\n"; }
+    `diff -b $tmppfx.sto$n1 $tmppfx.sto$n2 2>&1 > /dev/null`;  if ($?) { die "FAIL: -A alignments differ with $what\n"; }
+}
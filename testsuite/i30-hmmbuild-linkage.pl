@@ -0,0 +1,47 @@
+#! /usr/bin/perl
+
+# Test that threaded hmmbuild gives the same model as a serial one for
+# a single alignment big enough (>= 1000 seqs) that --wblosum and
+# --eclust use threaded single-linkage clustering, and calibration is
+# threaded too.
+#
+# Usage:   ./i30-hmmbuild-linkage.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i30-hmmbuild-linkage.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+}
+
+$verbose = 0;
+
+# The test creates the following files:
+# $tmppfx.sto             <msafile>   1200 seqs emitted from globins4
+# $tmppfx.hmm{1,2}        <hmmfile>   serial and threaded models
+# $tmppfx.cmp{1,2}        models with DATE and COM lines stripped
+
+@h3progs  = ("hmmemit", "hmmbuild");
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog") { die "FAIL: didn't find $h3prog executable in $builddir/src\n"; } }
+
+$have_threads = `cat $builddir/src/p7_config.h | grep "^#define HMMER_THREADS"`;
+if ($have_threads eq "") { print "ok\n"; exit 0; }   # nothing to compare without threads
+
+`$builddir/src/hmmemit -a -N1200 --seed 1 $srcdir/tutorial/globins4.hmm > $tmppfx.sto`;  if ($?) { die "FAIL: hmmemit\n"; }
+
+foreach $opt ("--wblosum", "--eclust", "--wblosum --eclust")
+{
+    if ($verbose) { print "hmmbuild $opt...\n"; }
+    `$builddir/src/hmmbuild --cpu 0 $opt $tmppfx.hmm1 $tmppfx.sto > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmbuild --cpu 0 $opt\n"; }
+    `$builddir/src/hmmbuild --cpu 4 $opt $tmppfx.hmm2 $tmppfx.sto > /dev/null 2>&1`;  if ($?) { die "FAIL: hmmbuild --cpu 4 $opt\n"; }
+
+    `grep -v "^DATE" $tmppfx.hmm1 | grep -v "^COM" > $tmppfx.cmp1`;
+    `grep -v "^DATE" $tmppfx.hmm2 | grep -v "^COM" > $tmppfx.cmp2`;
+    `diff -b $tmppfx.cmp1 $tmppfx.cmp2 2>&1 > /dev/null`;  if ($?) { die "FAIL: hmmbuild $opt model differs, --cpu 0 vs --cpu 4\n"; }
+}
+
+print "ok\n";
+unlink "$tmppfx.sto";
+unlink <$tmppfx.hmm*>;
+unlink <$tmppfx.cmp*>;
+exit 0;